@@ -0,0 +1,544 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by Саша Миленковић                                 *
+ *   sasa.milenkovic.xyz@gmail.com                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *   ( http://www.gnu.org/licenses/gpl-3.0.en.html )                       *
+ *									   *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <QFile>
+#include <QFileInfo>
+#include <QThreadPool>
+#include <QtConcurrentRun>
+
+#include <algorithm>
+#include <cstring>
+#include <zlib.h>
+
+#include "accesslog.h"
+#include "uboxindex.h"
+#include "tracer.h"
+
+const int READSIZE = 1024*1024;         // compressed bytes read at once
+const int CHUNKSIZE = 4*1024*1024;      // log text parsed by one task
+
+//----------------------------------------------
+void TileHeat::add(int z, qint64 x, qint64 y, quint32 hits)
+{
+    if(z < 0 || x < 0 || y < 0)
+        return;
+
+    if(levels.size() <= z)
+        levels.resize(z + 1);
+
+    levels[z][(x << 32) | (y & 0xFFFFFFFF)] += hits;
+}
+
+//----------------------------------------------
+void TileHeat::merge(const TileHeat& other)
+{
+    if(levels.size() < other.levels.size())
+        levels.resize(other.levels.size());
+
+    for(int z=0; z<other.levels.size(); z++)
+    {
+        const QHash<qint64, quint32>& from = other.levels[z];
+        QHash<qint64, quint32>& to = levels[z];
+        if(to.isEmpty())
+        {
+            to = from;
+            continue;
+        }
+
+        for(QHash<qint64, quint32>::const_iterator it=from.constBegin(); it!=from.constEnd(); ++it)
+            to[it.key()] += it.value();
+    }
+}
+
+//----------------------------------------------
+bool TileHeat::isEmpty() const
+{
+    return tiles() == 0;
+}
+
+//----------------------------------------------
+qint64 TileHeat::tiles() const
+{
+    qint64 count = 0;
+    for(int z=0; z<levels.size(); z++)
+        count += levels[z].size();
+
+    return count;
+}
+
+//----------------------------------------------
+qint64 TileHeat::requests() const
+{
+    qint64 count = 0;
+    for(int z=0; z<levels.size(); z++)
+        for(QHash<qint64, quint32>::const_iterator it=levels[z].constBegin(); it!=levels[z].constEnd(); ++it)
+            count += it.value();
+
+    return count;
+}
+
+//----------------------------------------------
+static bool hotter(const TileHeat::Entry& a, const TileHeat::Entry& b)
+{
+    if(a.hits != b.hits)
+        return a.hits > b.hits;
+
+    // coarser first, a stable order otherwise
+    if(a.z != b.z)
+        return a.z < b.z;
+    return a.x != b.x ? a.x < b.x : a.y < b.y;
+}
+
+//----------------------------------------------
+QVector<TileHeat::Entry> TileHeat::hottest(double percent) const
+{
+    QVector<Entry> entries;
+    entries.reserve(int(tiles()));
+    for(int z=0; z<levels.size(); z++)
+    {
+        for(QHash<qint64, quint32>::const_iterator it=levels[z].constBegin(); it!=levels[z].constEnd(); ++it)
+        {
+            Entry e;
+            e.z = z;
+            e.x = it.key() >> 32;
+            e.y = it.key() & 0xFFFFFFFF;
+            e.hits = it.value();
+            entries.append(e);
+        }
+    }
+
+    int count = qBound(0, int(std::ceil(entries.size() * percent / 100.0)), entries.size());
+    std::partial_sort(entries.begin(), entries.begin() + count, entries.end(), hotter);
+    entries.resize(count);
+
+    return entries;
+}
+
+//----------------------------------------------
+QString TileHeat::describe() const
+{
+    if(isEmpty())
+        return "No tile requests";
+
+    int zmin = -1, zmax = 0;
+    for(int z=0; z<levels.size(); z++)
+    {
+        if(levels[z].isEmpty())
+            continue;
+        if(zmin < 0)
+            zmin = z;
+        zmax = z;
+    }
+
+    return QString::number(requests()) + " requests of " + QString::number(tiles()) +
+           " tiles, z " + QString::number(zmin) + "-" + QString::number(zmax);
+}
+
+//==============================================
+// parsing
+
+//----------------------------------------------
+static const char* digitsBefore(const char* begin, const char* p, qint64& value)
+{
+    const char* q = p;
+    while(q > begin && q[-1] >= '0' && q[-1] <= '9' && p - q < 10)
+        q--;
+
+    if(q == p)
+        return 0;
+
+    value = 0;
+    for(const char* d=q; d<p; d++)
+        value = value * 10 + (*d - '0');
+
+    return q;
+}
+
+//----------------------------------------------
+// from every '.' backwards: <y> '/' <x> '/' <z> '/'
+bool AccessLog::parseLine(const char* begin, const char* end, int& z, qint64& x, qint64& y)
+{
+    for(const char* p=begin; p<end; p++)
+    {
+        if(*p != '.')
+            continue;
+
+        const char* ext = p + 1;
+        qint64 len = end - ext;
+        if(!((len >= 3 && (memcmp(ext, "png", 3) == 0 || memcmp(ext, "jpg", 3) == 0 || memcmp(ext, "gif", 3) == 0)) ||
+             (len >= 4 && memcmp(ext, "jpeg", 4) == 0)))
+            continue;
+
+        qint64 vy, vx, vz;
+        const char* q = digitsBefore(begin, p, vy);
+        if(!q || q == begin || q[-1] != '/')
+            continue;
+        q = digitsBefore(begin, q - 1, vx);
+        if(!q || q == begin || q[-1] != '/')
+            continue;
+        q = digitsBefore(begin, q - 1, vz);
+        if(!q || q == begin || q[-1] != '/' || vz > 40)
+            continue;
+
+        z = int(vz);
+        x = vx;
+        y = vy;
+        return true;
+    }
+
+    return false;
+}
+
+//----------------------------------------------
+TileHeat AccessLog::parseChunk(const QByteArray& text)
+{
+    TraceSpan span("parse log", "heat", text.size());
+
+    TileHeat heat;
+    const char* p = text.constData();
+    const char* end = p + text.size();
+    while(p < end)
+    {
+        const char* eol = (const char*)memchr(p, '\n', end - p);
+        if(!eol)
+            eol = end;
+
+        int z;
+        qint64 x, y;
+        if(parseLine(p, eol, z, x, y))
+            heat.add(z, x, y);
+
+        p = eol + 1;
+    }
+
+    return heat;
+}
+
+//----------------------------------------------
+// a hot tile, or a run of them in a row; 'rank' - of the hottest one
+struct HotRun
+{
+    HotRun() : k(0), c0(0), c1(0), r(0), rank(0) {}
+    HotRun(int level, qint64 c, qint64 row, int i) : k(level), c0(c), c1(c), r(row), rank(i) {}
+
+    int k;
+    qint64 c0, c1, r;
+    int rank;
+};
+
+//----------------------------------------------
+static bool rowOrder(const HotRun& a, const HotRun& b)
+{
+    if(a.k != b.k)
+        return a.k < b.k;
+    if(a.r != b.r)
+        return a.r < b.r;
+    return a.c0 < b.c0;
+}
+
+//----------------------------------------------
+static bool hotterRun(const HotRun& a, const HotRun& b)
+{
+    return a.rank < b.rank;
+}
+
+//----------------------------------------------
+QList<UBox> AccessLog::priorityRegions(const TileHeat& heat, const TileGrid& grid, double percent,
+                                       const QList<UBox>& regions, bool bonly, int* hot)
+{
+    QVector<TileHeat::Entry> entries = heat.hottest(percent);
+
+    // the regions which may hold a tile
+    UBoxIndex index(grid.extent(), qMax(grid.extent().right - grid.extent().left,
+                                        grid.extent().top - grid.extent().bottom) / 64);
+    for(int i=0; i<regions.size(); i++)
+        index.insert(i, regions[i].box);
+
+    QVector<HotRun> tiles;
+    QVector<int> ids;
+    for(int i=0; i<entries.size(); i++)
+    {
+        int k = grid.level(entries[i].z);
+        if(k < 0 || k >= grid.levels())
+            continue;
+
+        TileRange all = grid.levelTiles(k);
+        qint64 c = entries[i].x, r = entries[i].y;
+        if(c < all.c0 || c > all.c1 || r < all.r0 || r > all.r1)
+            continue;
+
+        bool bin = regions.isEmpty();
+        if(!bin)
+        {
+            index.query(grid.tileBox(k, c, r), ids);
+            for(int j=0; j<ids.size() && !bin; j++)
+            {
+                int kmin, kmax;
+                grid.levelRange(regions[ids[j]], kmin, kmax);
+                TileRange range = grid.range(regions[ids[j]], k);
+                bin = k >= kmin && k <= kmax && c >= range.c0 && c <= range.c1 && r >= range.r0 && r <= range.r1;
+            }
+        }
+
+        if(bin)
+            tiles.append(HotRun(k, c, r, i));
+    }
+
+    if(hot)
+        *hot = tiles.size();
+
+    // the neighbours in a row into runs, one request region each
+    std::sort(tiles.begin(), tiles.end(), rowOrder);
+
+    QVector<HotRun> runs;
+    for(int i=0; i<tiles.size(); i++)
+    {
+        if(!runs.isEmpty() && runs.last().k == tiles[i].k && runs.last().r == tiles[i].r &&
+           runs.last().c1 + 1 == tiles[i].c0)
+        {
+            runs.last().c1 = tiles[i].c0;
+            runs.last().rank = qMin(runs.last().rank, tiles[i].rank);
+        }
+        else
+            runs.append(tiles[i]);
+    }
+
+    std::stable_sort(runs.begin(), runs.end(), hotterRun);
+
+    QList<UBox> uboxes;
+    for(int i=0; i<runs.size(); i++)
+    {
+        double inset = grid.span(runs[i].k) / 4.0; // the region touches only these tiles
+
+        UBox ubox;
+        ubox.box = grid.rangeBox(runs[i].k, TileRange(runs[i].c0, runs[i].c1, runs[i].r, runs[i].r));
+        ubox.box.left += inset;
+        ubox.box.right -= inset;
+        ubox.box.bottom += inset;
+        ubox.box.top -= inset;
+        ubox.hres = ubox.lres = grid.resolution(runs[i].k);
+        uboxes.append(ubox);
+    }
+
+    if(!bonly)
+    {
+        if(regions.isEmpty())
+        {
+            UBox whole;
+            whole.box = grid.extent();
+            uboxes.append(whole);
+        }
+        else
+            uboxes += regions;
+    }
+
+    return uboxes;
+}
+
+//==============================================
+// the importer
+
+//----------------------------------------------
+AccessLogImporter::AccessLogImporter(QObject *parent) :
+    QObject(parent),
+    lines(0),
+    matched(0),
+    bcancelled(false)
+{
+    connect(&watcher, SIGNAL(finished()), this, SIGNAL(finished()));
+}
+
+//----------------------------------------------
+AccessLogImporter::~AccessLogImporter()
+{
+    cancel();
+    watcher.waitForFinished();
+}
+
+//----------------------------------------------
+void AccessLogImporter::start(const QStringList& logs)
+{
+    files = logs;
+    result.clear();
+    error.clear();
+    lines = matched = 0;
+    bcancel.store(0);
+    bcancelled = false;
+    timer.start();
+
+    watcher.setFuture(QtConcurrent::run(this, &AccessLogImporter::import));
+}
+
+//----------------------------------------------
+void AccessLogImporter::cancel()
+{
+    bcancel.store(1);
+    bcancelled = true;
+}
+
+//----------------------------------------------
+bool AccessLogImporter::isRunning() const
+{
+    return watcher.isRunning();
+}
+
+//----------------------------------------------
+// in a pool thread
+void AccessLogImporter::import()
+{
+    TraceSpan span("import logs", "heat");
+
+    qint64 total = 0, done = 0;
+    for(int i=0; i<files.size(); i++)
+        total += QFileInfo(files[i]).size();
+
+    for(int i=0; i<files.size() && !bcancel.load(); i++)
+        if(!importFile(files[i], done, total))
+            break;
+
+    collect(true);
+    emit progress(int(total / 1024), int(total / 1024));
+}
+
+//----------------------------------------------
+// a gzip'd file (also several concatenated members) is inflated on the fly
+bool AccessLogImporter::importFile(const QString& path, qint64& done, qint64 total)
+{
+    QFile file(path);
+    if(!file.open(QIODevice::ReadOnly))
+    {
+        error = "Cannot open " + path;
+        return false;
+    }
+
+    QByteArray head = file.peek(2);
+    bool bgzip = head.size() == 2 && (uchar)head[0] == 0x1F && (uchar)head[1] == 0x8B;
+
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if(bgzip && inflateInit2(&zs, 15 + 32) != Z_OK)
+    {
+        error = "Cannot inflate " + path;
+        return false;
+    }
+
+    QByteArray pending;
+    QByteArray in;
+    QByteArray out(READSIZE * 4, Qt::Uninitialized);
+    bool bOK = true;
+
+    while(!bcancel.load())
+    {
+        in = file.read(READSIZE);
+        if(in.isEmpty())
+            break;
+
+        done += in.size();
+        emit progress(int(done / 1024), int(total / 1024));
+
+        if(!bgzip)
+        {
+            parse(pending, in, false);
+            continue;
+        }
+
+        // a full output buffer may hold back more output of the input
+        // already taken, also of the last read
+        zs.next_in = (Bytef*)in.data();
+        zs.avail_in = uInt(in.size());
+        bool bmore = true;
+        while(bmore && bOK)
+        {
+            zs.next_out = (Bytef*)out.data();
+            zs.avail_out = uInt(out.size());
+
+            // Z_BUF_ERROR - no progress without more input
+            int ret = inflate(&zs, Z_NO_FLUSH);
+            if(ret == Z_STREAM_END)
+                ret = inflateReset(&zs); // the next member, if any
+            if(ret != Z_OK && ret != Z_BUF_ERROR)
+            {
+                error = "Corrupt gzip data in " + path;
+                bOK = false;
+            }
+
+            parse(pending, QByteArray::fromRawData(out.constData(), out.size() - int(zs.avail_out)), false);
+            bmore = ret != Z_BUF_ERROR && (zs.avail_in > 0 || zs.avail_out == 0);
+        }
+
+        if(!bOK)
+            break;
+    }
+
+    if(bgzip)
+        inflateEnd(&zs);
+
+    parse(pending, QByteArray(), true);
+    return bOK;
+}
+
+//----------------------------------------------
+// whole lines are handed to the pool in CHUNKSIZE parts
+void AccessLogImporter::parse(QByteArray& pending, const QByteArray& data, bool blast)
+{
+    pending.append(data.constData(), data.size());
+    if(pending.size() < CHUNKSIZE && !blast)
+        return;
+
+    int cut = blast ? pending.size() : pending.lastIndexOf('\n') + 1;
+    if(cut <= 0)
+        return;
+
+    for(int i=0; i<cut; i++)
+        if(pending[i] == '\n')
+            lines++;
+
+    parsing.append(QtConcurrent::run(AccessLog::parseChunk, pending.left(cut)));
+    pending.remove(0, cut);
+
+    // no more text in flight than the pool can parse
+    collect(false);
+}
+
+//----------------------------------------------
+void AccessLogImporter::collect(bool ball)
+{
+    const int inflight = 2 * QThreadPool::globalInstance()->maxThreadCount();
+    while(!parsing.isEmpty() && (ball || parsing.size() > inflight || parsing.first().isFinished()))
+    {
+        TileHeat heat = parsing.takeFirst().result();
+        matched += heat.requests();
+        result.merge(heat);
+    }
+}
+
+//----------------------------------------------
+QString AccessLogImporter::report() const
+{
+    QString sretval = "Access logs: " + QString::number(files.size()) + " files, " + QString::number(lines) +
+                      " lines, " + QString::number(matched) + " tile requests in " +
+                      QString::number(timer.elapsed() / 1000.0, 'f', 1) + " s" + (bcancelled ? " (cancelled)" : "");
+
+    sretval += "\n" + result.describe();
+    if(!error.isEmpty())
+        sretval += "\n" + error;
+
+    return sretval;
+}
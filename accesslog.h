@@ -0,0 +1,121 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by Саша Миленковић                                 *
+ *   sasa.milenkovic.xyz@gmail.com                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *   ( http://www.gnu.org/licenses/gpl-3.0.en.html )                       *
+ *									   *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef ACCESSLOG_H
+#define ACCESSLOG_H
+
+#include <QObject>
+#include <QVector>
+#include <QHash>
+#include <QStringList>
+#include <QFutureWatcher>
+#include <QElapsedTimer>
+#include <QAtomicInt>
+
+#include "tilegrid.h"
+
+//----------------------------------------------
+// The requests per tile (TMS z/x/y) counted from the access logs of a
+// tile server; one hash of x/y per level, only the requested tiles.
+class TileHeat
+{
+public:
+    struct Entry
+    {
+        int z;
+        qint64 x, y;
+        quint32 hits;
+    };
+
+    void add(int z, qint64 x, qint64 y, quint32 hits = 1);
+    void merge(const TileHeat& other);
+    void clear() { levels.clear(); }
+
+    bool isEmpty() const;
+    qint64 tiles() const;
+    qint64 requests() const;
+
+    // the 'percent' most requested of the requested tiles, the hottest first
+    QVector<Entry> hottest(double percent) const;
+
+    QString describe() const;
+
+private:
+    QVector<QHash<qint64, quint32> > levels;   // by z, the key is x << 32 | y
+};
+
+namespace AccessLog
+{
+    // the first "/<z>/<x>/<y>.<png|jpg|jpeg|gif>" of a log line
+    bool parseLine(const char* begin, const char* end, int& z, qint64& x, qint64& y);
+
+    // the tiles of whole lines
+    TileHeat parseChunk(const QByteArray& lines);
+
+    // The hottest 'percent' of the requested tiles as regions, in the order
+    // of their popularity; the neighbouring hot tiles of a row are merged
+    // into one region, ranked by its hottest tile. Only the tiles in
+    // 'regions' (none - in the BBOX). Unless 'bonly', the regions follow
+    // them, so the rest is seeded after (the hot tiles are rendered twice).
+    QList<UBox> priorityRegions(const TileHeat& heat, const TileGrid& grid, double percent,
+                                const QList<UBox>& regions, bool bonly, int* hot = 0);
+}
+
+//----------------------------------------------
+// Streams the logs (plain or gzip'd) in a pool thread and parses their
+// lines in chunks on the other pool threads into one heat map.
+class AccessLogImporter : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit AccessLogImporter(QObject *parent = 0);
+    ~AccessLogImporter();
+
+    void start(const QStringList& files);
+    void cancel();
+    bool isRunning() const;
+
+    const TileHeat& heat() const { return result; }
+    QString report() const;
+
+signals:
+    void progress(int done, int total);     // kB of the files
+    void finished();
+
+private:
+    QStringList files;
+    TileHeat result;
+    qint64 lines, matched;
+    QString error;
+    QAtomicInt bcancel;
+    bool bcancelled;
+    QElapsedTimer timer;
+    QFutureWatcher<void> watcher;
+
+    void import();
+    bool importFile(const QString& path, qint64& done, qint64 total);
+    void parse(QByteArray& pending, const QByteArray& data, bool blast);
+    void collect(bool ball);
+
+    QList<QFuture<TileHeat> > parsing;
+};
+
+#endif // ACCESSLOG_H
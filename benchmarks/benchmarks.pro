@@ -0,0 +1,11 @@
+#-------------------------------------------------
+#
+# Benchmarks (QtTest QBENCHMARK), built apart from the GUI:
+#   qmake benchmarks.pro && make && make check
+#
+#-------------------------------------------------
+
+TEMPLATE = subdirs
+
+SUBDIRS += jobio \
+        uboxindex
@@ -0,0 +1,21 @@
+#-------------------------------------------------
+#
+# JobIO parsing and validation of the update regions
+#
+#-------------------------------------------------
+
+QT       += core testlib
+QT       -= gui
+
+TARGET = tst_jobio
+TEMPLATE = app
+
+CONFIG += c++11 console testcase
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../..
+
+SOURCES += tst_jobio.cpp \
+        ../../jobconfig.cpp
+
+HEADERS  += ../../jobconfig.h
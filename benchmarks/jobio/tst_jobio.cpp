@@ -0,0 +1,266 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by Саша Миленковић                                 *
+ *   sasa.milenkovic.xyz@gmail.com                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *   ( http://www.gnu.org/licenses/gpl-3.0.en.html )                       *
+ *									   *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <QString>
+#include <QStringList>
+#include <QTextStream>
+#include <QtTest>
+
+#include "jobconfig.h"
+
+// Benchmarks of the update regions input and output: the *.txt/*.tip rows
+// parsed with JobIO::readUpdateRows and validated with JobIO::validateUpdateRow,
+// the *.tip files written with JobIO::writeTip and read with JobIO::readTip and
+// the tilemaker lines formatted with JobIO::formatUBox, over generated lists
+// of 10 to 1M UBOXes.
+//
+//   qmake benchmarks/benchmarks.pro && make && ./jobio/tst_jobio
+
+static const BBox JOBBOX(0.0, 0.0, 1000000.0, 1000000.0);
+static const double HIGHRES = 0.5;
+static const double LOWRES = 1024.0;
+
+//----------------------------------------------
+// the same regions for the same count; a third with all the resolutions
+static QString generateRows(int count)
+{
+    QString text;
+    QTextStream out(&text);
+
+    quint32 seed = 12345;
+    for(int i=0; i<count; i++)
+    {
+        double v[4];
+        for(int j=0; j<4; j++)
+        {
+            seed = seed * 1103515245u + 12345u;
+            v[j] = (seed >> 8) % 1000000;
+        }
+
+        double left = qMin(v[0], v[1]), right = qMax(v[0], v[1]) + 1.0;
+        double bottom = qMin(v[2], v[3]), top = qMax(v[2], v[3]) + 1.0;
+        out << QString::number(left, 'f', 2) << "," << QString::number(bottom, 'f', 2) << ","
+            << QString::number(qMin(right, JOBBOX.right), 'f', 2) << "," << QString::number(qMin(top, JOBBOX.top), 'f', 2);
+
+        if(i % 3 == 0)
+            out << "," << HIGHRES * 2 << "," << LOWRES / 2 << "," << HIGHRES * 8;
+
+        out << "\n";
+    }
+
+    out.flush();
+    return text;
+}
+
+//----------------------------------------------
+// a job with the generated rows as its update regions
+static JobConfig tipConfig(const QString& text)
+{
+    JobConfig cfg;
+    cfg.url = "http://localhost/wms";
+    cfg.layer = "ortho";
+    cfg.bbox = "0,0,1000000,1000000";
+    cfg.res = QString::number(HIGHRES) + "," + QString::number(LOWRES);
+    cfg.srs = "EPSG:3857";
+    cfg.background = "white";
+    cfg.exceptions = "moderate";
+    cfg.format = "jpeg";
+    cfg.updates = true;
+
+    QString copy = text;
+    QTextStream in(&copy);
+    JobIO::readUpdateRows(in, cfg.updaterows, 0);
+    return cfg;
+}
+
+//----------------------------------------------
+class JobIOBenchmark : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void readUpdateRows_data();
+    void readUpdateRows();
+    void validateUpdateRows_data();
+    void validateUpdateRows();
+    void writeTip_data();
+    void writeTip();
+    void readTip_data();
+    void readTip();
+    void formatUBox_data();
+    void formatUBox();
+
+private:
+    void counts();
+};
+
+//----------------------------------------------
+void JobIOBenchmark::counts()
+{
+    QTest::addColumn<QString>("text");
+    QTest::addColumn<int>("count");
+
+    const int sizes[] = { 10, 1000, 100000, 1000000 };
+    for(int i=0; i<4; i++)
+        QTest::newRow(QByteArray::number(sizes[i]).constData()) << generateRows(sizes[i]) << sizes[i];
+}
+
+//----------------------------------------------
+void JobIOBenchmark::readUpdateRows_data()
+{
+    counts();
+}
+
+//----------------------------------------------
+void JobIOBenchmark::readUpdateRows()
+{
+    QFETCH(QString, text);
+    QFETCH(int, count);
+
+    QList<QStringList> rows;
+    QString error;
+    QBENCHMARK
+    {
+        QTextStream in(&text);
+        QVERIFY(JobIO::readUpdateRows(in, rows, &error));
+    }
+
+    QCOMPARE(rows.size(), count);
+}
+
+//----------------------------------------------
+void JobIOBenchmark::validateUpdateRows_data()
+{
+    counts();
+}
+
+//----------------------------------------------
+void JobIOBenchmark::validateUpdateRows()
+{
+    QFETCH(QString, text);
+    QFETCH(int, count);
+
+    QList<QStringList> rows;
+    QTextStream in(&text);
+    QVERIFY(JobIO::readUpdateRows(in, rows, 0));
+
+    int valid = 0;
+    QBENCHMARK
+    {
+        valid = 0;
+        UBox ubox;
+        for(int row=0; row<rows.size(); row++)
+            if(!JobIO::validateUpdateRow(row, rows[row], JOBBOX, HIGHRES, LOWRES, 0, &ubox).startsWith("Error"))
+                valid++;
+    }
+
+    QCOMPARE(valid, count);
+}
+
+//----------------------------------------------
+void JobIOBenchmark::writeTip_data()
+{
+    counts();
+}
+
+//----------------------------------------------
+void JobIOBenchmark::writeTip()
+{
+    QFETCH(QString, text);
+    QFETCH(int, count);
+
+    JobConfig cfg = tipConfig(text);
+    QCOMPARE(cfg.updaterows.size(), count);
+
+    QString tip;
+    QBENCHMARK
+    {
+        tip.clear();
+        QTextStream out(&tip);
+        JobIO::writeTip(out, cfg);
+    }
+
+    QCOMPARE(tip.count('\n'), count + 14);
+}
+
+//----------------------------------------------
+void JobIOBenchmark::readTip_data()
+{
+    counts();
+}
+
+//----------------------------------------------
+void JobIOBenchmark::readTip()
+{
+    QFETCH(QString, text);
+    QFETCH(int, count);
+
+    QString tip;
+    QTextStream out(&tip);
+    JobIO::writeTip(out, tipConfig(text));
+
+    JobConfig cfg;
+    QBENCHMARK
+    {
+        QTextStream in(&tip);
+        QVERIFY(JobIO::readTip(in, cfg));
+    }
+
+    QCOMPARE(cfg.updaterows.size(), count);
+}
+
+//----------------------------------------------
+void JobIOBenchmark::formatUBox_data()
+{
+    counts();
+}
+
+//----------------------------------------------
+void JobIOBenchmark::formatUBox()
+{
+    QFETCH(QString, text);
+    QFETCH(int, count);
+
+    QList<QStringList> rows;
+    QTextStream in(&text);
+    QVERIFY(JobIO::readUpdateRows(in, rows, 0));
+
+    QList<UBox> uboxes;
+    UBox ubox;
+    for(int row=0; row<rows.size(); row++)
+        if(!JobIO::validateUpdateRow(row, rows[row], JOBBOX, HIGHRES, LOWRES, 0, &ubox).startsWith("Error"))
+            uboxes.append(ubox);
+    QCOMPARE(uboxes.size(), count);
+
+    // the dialog feeds the tilemaker the same way
+    QByteArray lines;
+    QBENCHMARK
+    {
+        lines.clear();
+        for(int i=0; i<uboxes.size(); i++)
+            lines += JobIO::formatUBox(uboxes[i]).toLatin1() + '\n';
+    }
+
+    QCOMPARE(lines.count('\n'), count);
+}
+
+QTEST_APPLESS_MAIN(JobIOBenchmark)
+
+#include "tst_jobio.moc"
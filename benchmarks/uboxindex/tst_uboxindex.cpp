@@ -0,0 +1,149 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by Саша Миленковић                                 *
+ *   sasa.milenkovic.xyz@gmail.com                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *   ( http://www.gnu.org/licenses/gpl-3.0.en.html )                       *
+ *									   *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <QList>
+#include <QVector>
+#include <QtTest>
+
+#include <algorithm>
+
+#include "uboxindex.h"
+
+// Benchmark of the update regions optimizer (the grid index of the boxes,
+// the nested boxes, the cutting on the tile edges of every level and the
+// joining) over generated lists of 1k to 100k overlapping UBOXes.
+
+//----------------------------------------------
+// the same boxes for the same count; a quarter with a resolution range,
+// a quarter with a fitting resolution
+static QList<UBox> generateBoxes(const TileGrid& grid, int count)
+{
+    const BBox& extent = grid.extent();
+    const double width = extent.right - extent.left;
+
+    QList<UBox> uboxes;
+    quint32 seed = 4321;
+    for(int i=0; i<count; i++)
+    {
+        double v[4];
+        for(int j=0; j<4; j++)
+        {
+            seed = seed * 1103515245u + 12345u;
+            v[j] = ((seed >> 8) % 100000) / 100000.0;
+        }
+
+        UBox ubox;
+        double left = extent.left + v[0] * width * 0.99;
+        double bottom = extent.bottom + v[1] * width * 0.99;
+        ubox.box = BBox(left, bottom, qMin(extent.right, left + 1.0 + v[2] * width / 300),
+                        qMin(extent.top, bottom + 1.0 + v[3] * width / 300));
+
+        if(i % 4 == 1)
+        {
+            ubox.hres = grid.resolution(2);
+            ubox.lres = grid.resolution(6);
+        }
+        else if(i % 4 == 2)
+        {
+            ubox.hres = grid.highResolution();
+            ubox.lres = grid.resolution(8);
+            ubox.fitres = grid.resolution(3);
+        }
+
+        uboxes.append(ubox);
+    }
+
+    return uboxes;
+}
+
+//----------------------------------------------
+// the tiles of every level the boxes render, sorted, once per render
+static QVector<qint64> renderedTiles(const TileGrid& grid, const QList<UBox>& uboxes)
+{
+    QVector<qint64> tiles;
+    for(int i=0; i<uboxes.size(); i++)
+    {
+        int kmin, kmax;
+        grid.levelRange(uboxes[i], kmin, kmax);
+        for(int k=kmin; k<=kmax; k++)
+        {
+            TileRange range = grid.range(uboxes[i], k);
+            for(qint64 c=range.c0; c<=range.c1; c++)
+                for(qint64 r=range.r0; r<=range.r1; r++)
+                    tiles.append((qint64(k) << 58) | (c << 29) | r);
+        }
+    }
+
+    std::sort(tiles.begin(), tiles.end());
+    return tiles;
+}
+
+//----------------------------------------------
+class UBoxIndexBenchmark : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void optimize_data();
+    void optimize();
+};
+
+//----------------------------------------------
+void UBoxIndexBenchmark::optimize_data()
+{
+    QTest::addColumn<int>("count");
+    QTest::addColumn<int>("budget");    // ms, 0 - none
+
+    QTest::newRow("1000") << 1000 << 0;
+    QTest::newRow("10000") << 10000 << 0;
+    QTest::newRow("100000") << 100000 << 1000;
+}
+
+//----------------------------------------------
+void UBoxIndexBenchmark::optimize()
+{
+    QFETCH(int, count);
+    QFETCH(int, budget);
+
+    TileGrid grid(BBox(0.0, 0.0, 1000000.0, 1000000.0), 2.0, 1024.0, 256);
+    const QList<UBox> input = generateBoxes(grid, count);
+
+    UBoxStats stats;
+    QList<UBox> output;
+    QBENCHMARK
+    {
+        output = input;
+        stats = UBoxOptimizer::optimize(output, grid);
+    }
+
+    QVERIFY(budget == 0 || stats.msecs < budget);
+
+    // the optimized boxes render the tiles of the given ones, every tile once
+    QVector<qint64> before = renderedTiles(grid, input);
+    before.erase(std::unique(before.begin(), before.end()), before.end());
+
+    QVector<qint64> after = renderedTiles(grid, output);
+    QVERIFY(std::adjacent_find(after.begin(), after.end()) == after.end());
+    QVERIFY(after == before);
+}
+
+QTEST_APPLESS_MAIN(UBoxIndexBenchmark)
+
+#include "tst_uboxindex.moc"
@@ -0,0 +1,24 @@
+#-------------------------------------------------
+#
+# UBoxOptimizer over generated update regions
+#
+#-------------------------------------------------
+
+QT       += core testlib
+QT       -= gui
+
+TARGET = tst_uboxindex
+TEMPLATE = app
+
+CONFIG += c++11 console testcase
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../..
+
+SOURCES += tst_uboxindex.cpp \
+        ../../uboxindex.cpp \
+        ../../tilegrid.cpp
+
+HEADERS  += ../../uboxindex.h \
+        ../../tilegrid.h \
+        ../../jobconfig.h
@@ -0,0 +1,304 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by Саша Миленковић                                 *
+ *   sasa.milenkovic.xyz@gmail.com                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *   ( http://www.gnu.org/licenses/gpl-3.0.en.html )                       *
+ *									   *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
+#include <QAtomicInt>
+#include <QAtomicInteger>
+#include <QVector>
+#include <cstdlib>
+
+#include "bufferarena.h"
+#include "tracer.h"
+
+const int NCLASSES = BufferArena::MAXCLASS - BufferArena::MINCLASS + 1;
+const int THREADCACHED = 2;     // free buffers a thread keeps per class
+
+static QMutex arenamutex;
+static QWaitCondition released;
+static QVector<uchar*> pool[NCLASSES];     // shared free buffers (under arenamutex)
+static qint64 arenalimit = 0;
+static QAtomicInt waiting(0);   // threads held back by the cap
+
+static QAtomicInteger<qint64> inuse(0);
+static QAtomicInteger<qint64> cached(0);
+static QAtomicInteger<qint64> threadcached(0);     // the part of 'cached' in the thread caches
+static QAtomicInteger<qint64> peak(0);
+static QAtomicInt acquired(0);
+static QAtomicInt reused(0);
+static QAtomicInt waits(0);
+
+//----------------------------------------------
+static int sizeClass(qint64 size)
+{
+    int c = 0;
+    while(c < NCLASSES && (qint64(1) << (BufferArena::MINCLASS + c)) < size)
+        c++;
+
+    return c; // NCLASSES - too large for the classes
+}
+
+//----------------------------------------------
+static qint64 classBytes(int c)
+{
+    return qint64(1) << (BufferArena::MINCLASS + c);
+}
+
+//----------------------------------------------
+static void addInUse(qint64 bytes)
+{
+    qint64 now = inuse.fetchAndAddRelaxed(bytes) + bytes;
+    qint64 top = peak.load();
+    while(now > top && !peak.testAndSetRelaxed(top, now))
+        top = peak.load();
+}
+
+//----------------------------------------------
+// the free buffers of one thread, returned to the pool when it finishes
+struct ThreadCache
+{
+    ~ThreadCache()
+    {
+        QMutexLocker locker(&arenamutex);
+        for(int c=0; c<NCLASSES; c++)
+        {
+            threadcached.fetchAndAddRelaxed(-classBytes(c) * free[c].size());
+            pool[c] += free[c];
+        }
+        released.wakeAll();
+    }
+
+    QVector<uchar*> free[NCLASSES];
+};
+
+static thread_local ThreadCache threadcache;
+
+//----------------------------------------------
+qint64 BufferArena::tileWorkingSet(int tilesize, int rasters)
+{
+    qint64 raster = classBytes(sizeClass(qint64(tilesize) * tilesize * 4));
+    qint64 file = classBytes(sizeClass(raster / 4));
+    return rasters * raster + file;
+}
+
+//----------------------------------------------
+void BufferArena::configure(int threads, int tilesize, int rasters)
+{
+    qint64 bytes = qMax(1, threads) * tileWorkingSet(tilesize, rasters);
+
+    QMutexLocker locker(&arenamutex);
+    if(bytes > arenalimit)
+    {
+        arenalimit = bytes;
+        released.wakeAll();
+    }
+}
+
+//----------------------------------------------
+qint64 BufferArena::limit()
+{
+    QMutexLocker locker(&arenamutex);
+    return arenalimit;
+}
+
+//----------------------------------------------
+BufferArena::Stats BufferArena::stats()
+{
+    Stats s;
+    s.inuse = inuse.load();
+    s.cached = cached.load();
+    s.peak = peak.load();
+    s.acquired = acquired.load();
+    s.reused = reused.load();
+    s.waits = waits.load();
+    return s;
+}
+
+//----------------------------------------------
+QString BufferArena::report()
+{
+    Stats s = stats();
+    if(s.acquired == 0)
+        return QString();
+
+    return "Buffers: peak " + QString::number(s.peak >> 20) + " MB in use of the " +
+           QString::number(limit() >> 20) + " MB cap, " +
+           QString::number(100 * s.reused / s.acquired) + "% reused, " +
+           QString::number(s.waits) + " waits";
+}
+
+//----------------------------------------------
+void BufferArena::trim()
+{
+    QMutexLocker locker(&arenamutex);
+    for(int c=0; c<NCLASSES; c++)
+    {
+        for(int i=0; i<pool[c].size(); i++)
+            std::free(pool[c][i]);
+        cached.fetchAndAddRelaxed(-classBytes(c) * pool[c].size());
+        pool[c].clear();
+    }
+}
+
+//==============================================
+// the buffer
+
+//----------------------------------------------
+ArenaBuffer::ArenaBuffer(qint64 size) :
+    block(0),
+    bytes(size),
+    capacity(0)
+{
+    acquired.fetchAndAddRelaxed(1);
+
+    int c = sizeClass(size);
+    if(c == NCLASSES)
+    {
+        // not cached, but counted
+        capacity = size;
+        block = (uchar*)std::malloc(size);
+        addInUse(capacity);
+        return;
+    }
+
+    capacity = classBytes(c);
+
+    // the thread's own cache - no lock
+    if(!threadcache.free[c].isEmpty())
+    {
+        block = threadcache.free[c].takeLast();
+        cached.fetchAndAddRelaxed(-capacity);
+        threadcached.fetchAndAddRelaxed(-capacity);
+        addInUse(capacity);
+        reused.fetchAndAddRelaxed(1);
+        return;
+    }
+
+    QMutexLocker locker(&arenamutex);
+    bool bwaited = false;
+    bool btimedout = false;
+    for(;;)
+    {
+        if(!pool[c].isEmpty())
+        {
+            block = pool[c].takeLast();
+            cached.fetchAndAddRelaxed(-capacity);
+            reused.fetchAndAddRelaxed(1);
+            break;
+        }
+
+        // nothing in use - the only buffer may go over the cap; the caches of
+        // the idle threads are freed only when the threads finish, after a
+        // wait which no release has ended they don't count
+        qint64 total = inuse.load() + cached.load() - (btimedout ? threadcached.load() : 0);
+        if(arenalimit <= 0 || total + capacity <= arenalimit || inuse.load() == 0)
+        {
+            block = (uchar*)std::malloc(capacity);
+            break;
+        }
+
+        // the free buffers of this thread are room as well; kept while it
+        // waits, they could hold back the releases it waits for
+        bool bflushed = false;
+        for(int k=0; k<NCLASSES; k++)
+        {
+            if(!threadcache.free[k].isEmpty())
+            {
+                threadcached.fetchAndAddRelaxed(-classBytes(k) * threadcache.free[k].size());
+                pool[k] += threadcache.free[k];
+                threadcache.free[k].clear();
+                bflushed = true;
+            }
+        }
+        if(bflushed)
+            continue;
+
+        // room from the free buffers of the other classes
+        bool bfreed = false;
+        for(int k=0; k<NCLASSES && !bfreed; k++)
+        {
+            if(!pool[k].isEmpty())
+            {
+                std::free(pool[k].takeLast());
+                cached.fetchAndAddRelaxed(-classBytes(k));
+                bfreed = true;
+            }
+        }
+        if(bfreed)
+            continue;
+
+        if(!bwaited)
+        {
+            waits.fetchAndAddRelaxed(1);
+            bwaited = true;
+        }
+
+        // a release which has missed the waiter is caught by the timeout
+        TraceSpan span("arena wait", "arena", capacity);
+        waiting.fetchAndAddOrdered(1);
+        btimedout = !released.wait(&arenamutex, 100);
+        waiting.fetchAndAddOrdered(-1);
+    }
+
+    addInUse(capacity);
+}
+
+//----------------------------------------------
+ArenaBuffer::~ArenaBuffer()
+{
+    if(!block)
+        return;
+
+    int c = sizeClass(capacity);
+    if(c == NCLASSES)
+    {
+        std::free(block);
+        inuse.fetchAndAddRelaxed(-capacity);
+
+        QMutexLocker locker(&arenamutex);
+        released.wakeAll();
+        return;
+    }
+
+    cached.fetchAndAddOrdered(capacity);
+    inuse.fetchAndAddOrdered(-capacity);
+
+    // the waiting threads get it through the pool
+    if(waiting.loadAcquire() == 0 && threadcache.free[c].size() < THREADCACHED)
+    {
+        threadcache.free[c].append(block);
+        threadcached.fetchAndAddRelaxed(capacity);
+        return;
+    }
+
+    QMutexLocker locker(&arenamutex);
+    pool[c].append(block);
+    released.wakeAll();
+}
+
+//----------------------------------------------
+QImage ArenaBuffer::image(int width, int height, QImage::Format format) const
+{
+    if(qint64(width) * height * 4 > bytes)
+        return QImage();
+
+    return QImage(block, width, height, width * 4, format);
+}
@@ -0,0 +1,98 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by Саша Миленковић                                 *
+ *   sasa.milenkovic.xyz@gmail.com                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *   ( http://www.gnu.org/licenses/gpl-3.0.en.html )                       *
+ *									   *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef BUFFERARENA_H
+#define BUFFERARENA_H
+
+#include <QString>
+#include <QImage>
+#include <QtGlobal>
+
+//----------------------------------------------
+// Buffers of the tile pipelines come from one arena instead of the heap:
+// the read tile files (verifier, optimizer, stager, change tracker), the
+// warper's cached source tiles and the rasters the warper and the
+// compositor write into. They are rounded
+// up to power-of-two size classes; a released buffer goes to a small
+// cache of its thread and then to a shared pool, so a long run reuses the
+// same few blocks instead of fragmenting the heap.
+//
+// The bytes of all buffers (in use and cached) are capped: a thread which
+// would exceed the cap waits until another one releases a buffer, which
+// holds the readers back while the encoders are behind. A waiting thread
+// gives its own cache up; the caches of idle threads don't hold it back
+// longer than one wait. The cap is derived from the thread count and the
+// tile size.
+//
+// Not in the arena, and not capped: the images Qt decodes into
+// (QImage::loadFromData / load, one or two per thread at a time) and the
+// byte arrays the encoders write into.
+namespace BufferArena
+{
+    const int MINCLASS = 14;    // 16 KB
+    const int MAXCLASS = 22;    // 4 MB, a 1024x1024 raster; larger buffers are not cached
+
+    // the bytes one pipeline thread holds for a tile: the file and 'rasters'
+    qint64 tileWorkingSet(int tilesize, int rasters = 2);
+
+    // raises the cap to 'threads' working sets of the tile size (it is never lowered)
+    void configure(int threads, int tilesize, int rasters = 2);
+    qint64 limit();
+
+    struct Stats
+    {
+        qint64 inuse, cached, peak;
+        int acquired;
+        int reused;     // taken from a cache
+        int waits;      // acquisitions held back by the cap
+    };
+
+    Stats stats();
+    QString report();
+
+    // frees the shared pool (the thread caches are freed with their threads)
+    void trim();
+}
+
+//----------------------------------------------
+// a buffer of the arena for the lifetime of the object
+class ArenaBuffer
+{
+public:
+    explicit ArenaBuffer(qint64 size);  // may wait for the cap
+    ~ArenaBuffer();
+
+    uchar* data() const { return block; }
+    qint64 size() const { return bytes; }
+
+    // the buffer as a 32-bit image (it must outlive the image), null if too small
+    QImage image(int width, int height, QImage::Format format) const;
+
+private:
+    uchar* block;
+    qint64 bytes;
+    qint64 capacity;
+
+    // not copyable
+    ArenaBuffer(const ArenaBuffer&);
+    ArenaBuffer& operator=(const ArenaBuffer&);
+};
+
+#endif // BUFFERARENA_H
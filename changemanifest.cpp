@@ -0,0 +1,654 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by Саша Миленковић                                 *
+ *   sasa.milenkovic.xyz@gmail.com                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *   ( http://www.gnu.org/licenses/gpl-3.0.en.html )                       *
+ *									   *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QDateTime>
+#include <QDataStream>
+#include <QCryptographicHash>
+#include <QThreadPool>
+#include <QtConcurrentRun>
+#include <QtConcurrentMap>
+
+#include <algorithm>
+#include <cstring>
+
+#include "changemanifest.h"
+#include "tracer.h"
+#include "bufferarena.h"
+#include "uboxindex.h"
+
+static const char* const extensions[] = { "jpg", "jpeg", "png", "gif" };
+static const int EXTENSIONS = 4;
+
+static const char* const statenames[TileChange::Unknown] = { "created", "replaced", "unchanged" };
+
+static const quint16 VERSION = 1;
+static const qint64 HEADERSIZE = 6;         // "TCMF", version
+static const qint64 RUNSIZE = 24;           // "RUN ", started, finished, tiles
+static const qint64 TILERECORDSIZE = 31;    // z, x, y, ext, state, size, MD5
+
+// coarse file systems keep the modification time in whole (or even) seconds
+static const qint64 MTIMESLACK = 2000;
+
+// the tiles of the regions are listed one by one up to this count, over
+// it the cache is walked for the modified files
+static const qint64 MAXLISTED = 1 << 20;
+
+//----------------------------------------------
+TileChange::TileChange() :
+    z(0), x(0), y(0), ext(0), state(Unknown), written(false), size(0)
+{
+    memset(md5, 0, sizeof(md5));
+}
+
+//==============================================
+// the manifest file
+
+//----------------------------------------------
+QString ChangeManifest::fileName(const QString& root)
+{
+    return root + "/changes.tcm";
+}
+
+//----------------------------------------------
+QString ChangeManifest::extension(int ext)
+{
+    return ext >= 0 && ext < EXTENSIONS ? extensions[ext] : "";
+}
+
+//----------------------------------------------
+static void prepare(QDataStream& stream)
+{
+    stream.setByteOrder(QDataStream::LittleEndian);
+}
+
+//----------------------------------------------
+// checks the header; the file is positioned at the first run
+static bool readHeader(QFile& file)
+{
+    QDataStream in(&file);
+    prepare(in);
+
+    char magic[4];
+    quint16 version = 0;
+    if(in.readRawData(magic, 4) != 4 || memcmp(magic, "TCMF", 4) != 0)
+        return false;
+
+    in >> version;
+    return in.status() == QDataStream::Ok && version == VERSION;
+}
+
+//----------------------------------------------
+// reads a run header at the current position
+static bool readRun(QDataStream& in, qint64& started, qint64& finished, quint32& count)
+{
+    char magic[4];
+    if(in.readRawData(magic, 4) != 4 || memcmp(magic, "RUN ", 4) != 0)
+        return false;
+
+    in >> started >> finished >> count;
+    return in.status() == QDataStream::Ok;
+}
+
+//----------------------------------------------
+// the number of complete runs; 'end' - where the last one ends
+static int countRuns(QFile& file, qint64& end)
+{
+    QDataStream in(&file);
+    prepare(in);
+
+    int runs = 0;
+    end = HEADERSIZE;
+    while(file.seek(end))
+    {
+        qint64 started, finished;
+        quint32 count;
+        if(!readRun(in, started, finished, count) || end + RUNSIZE + count * TILERECORDSIZE > file.size())
+            break;
+
+        end += RUNSIZE + count * TILERECORDSIZE;
+        runs++;
+    }
+
+    return runs;
+}
+
+//----------------------------------------------
+int ChangeManifest::append(const QString& path, qint64 started, qint64 finished,
+                           const QVector<TileChange>& tiles, QString* error)
+{
+    QFile file(path);
+    if(!file.open(QIODevice::ReadWrite))
+    {
+        if(error)
+            *error = "Can't open " + path + ": " + file.errorString();
+        return -1;
+    }
+
+    int runs = 0;
+    qint64 end = HEADERSIZE;
+    if(file.size() > 0)
+    {
+        if(!readHeader(file))
+        {
+            if(error)
+                *error = path + " is not a change manifest.";
+            return -1;
+        }
+
+        runs = countRuns(file, end);
+        if(end < file.size())
+            file.resize(end);
+    }
+
+    // the whole block is built first and written at once
+    QByteArray block;
+    QDataStream out(&block, QIODevice::WriteOnly);
+    prepare(out);
+
+    if(file.size() == 0)
+    {
+        out.writeRawData("TCMF", 4);
+        out << VERSION;
+    }
+
+    out.writeRawData("RUN ", 4);
+    out << started << finished << quint32(tiles.size());
+    for(int i=0; i<tiles.size(); i++)
+    {
+        const TileChange& tile = tiles[i];
+        out << quint8(tile.z) << tile.x << tile.y << tile.ext << tile.state << tile.size;
+        out.writeRawData(tile.md5, 16);
+    }
+
+    if(!file.seek(file.size()) || file.write(block) != block.size() || !file.flush())
+    {
+        if(error)
+            *error = "Can't write " + path + ": " + file.errorString();
+        return -1;
+    }
+
+    return runs + 1;
+}
+
+//----------------------------------------------
+int ChangeManifest::latest(const QString& path, QHash<qint64, TileChange>& tiles, int from, int to,
+                           bool bknownonly)
+{
+    QFile file(path);
+    if(!file.exists())
+        return 0;
+
+    if(!file.open(QIODevice::ReadOnly) || !readHeader(file))
+        return -1;
+
+    qint64 end;
+    int runs = countRuns(file, end);
+    if(to < 0 || to > runs)
+        to = runs;
+
+    QDataStream in(&file);
+    prepare(in);
+
+    qint64 position = HEADERSIZE;
+    for(int run=1; run<=to && file.seek(position); run++)
+    {
+        qint64 started, finished;
+        quint32 count;
+        readRun(in, started, finished, count);
+        position += RUNSIZE + count * TILERECORDSIZE;
+
+        // only the headers of the runs before
+        if(run < from)
+            continue;
+
+        for(quint32 i=0; i<count; i++)
+        {
+            TileChange tile;
+            quint8 z;
+            in >> z >> tile.x >> tile.y >> tile.ext >> tile.state >> tile.size;
+            in.readRawData(tile.md5, 16);
+            tile.z = z;
+
+            QHash<qint64, TileChange>::iterator it = tiles.find(tile.key());
+            if(it == tiles.end())
+            {
+                if(!bknownonly)
+                    tiles.insert(tile.key(), tile);
+                continue;
+            }
+
+            if(tile.state == TileChange::Unchanged &&
+               (it->state == TileChange::Created || it->state == TileChange::Replaced))
+                tile.state = it->state;
+
+            *it = tile;
+        }
+    }
+
+    return runs;
+}
+
+//----------------------------------------------
+static void octal(char* field, int width, qint64 value)
+{
+    QByteArray digits = QByteArray::number(value, 8).rightJustified(width - 1, '0');
+    memcpy(field, digits.constData(), width - 1);
+}
+
+//----------------------------------------------
+// a ustar header and the content padded to the 512 byte blocks
+static bool writeTarEntry(QIODevice* out, const QByteArray& name, const char* data, qint64 size, qint64 mtime)
+{
+    char header[512];
+    memset(header, 0, sizeof(header));
+
+    memcpy(header, name.constData(), qMin(name.size(), 100));
+    octal(header + 100, 8, 0644);
+    octal(header + 108, 8, 0);
+    octal(header + 116, 8, 0);
+    octal(header + 124, 12, size);
+    octal(header + 136, 12, mtime);
+    memset(header + 148, ' ', 8);
+    header[156] = '0';
+    memcpy(header + 257, "ustar", 6);
+    memcpy(header + 263, "00", 2);
+
+    unsigned int sum = 0;
+    for(int i=0; i<512; i++)
+        sum += (unsigned char)header[i];
+    octal(header + 148, 7, sum);
+    header[154] = 0;
+
+    static const char zeros[512] = { 0 };
+    int padding = int((512 - size % 512) % 512);
+
+    return out->write(header, 512) == 512 &&
+           out->write(data, size) == size &&
+           out->write(zeros, padding) == padding;
+}
+
+//----------------------------------------------
+int ChangeManifest::exportTar(const QString& root, const QHash<qint64, TileChange>& tiles, QIODevice* out,
+                              int* missing)
+{
+    TraceSpan span("export", "manifest");
+
+    // by level and column, as the tiles lie in the cache
+    QList<qint64> keys = tiles.keys();
+    std::sort(keys.begin(), keys.end());
+
+    int exported = 0;
+    if(missing)
+        *missing = 0;
+
+    for(int i=0; i<keys.size(); i++)
+    {
+        TileChange tile = tiles.value(keys[i]);
+        if(tile.state != TileChange::Created && tile.state != TileChange::Replaced)
+            continue;
+
+        QString name = QString::number(tile.z) + "/" + QString::number(tile.x) + "/" +
+                       QString::number(tile.y) + "." + extension(tile.ext);
+
+        QFile file(root + "/" + name);
+        if(!file.open(QIODevice::ReadOnly))
+        {
+            if(missing)
+                (*missing)++;
+            continue;
+        }
+
+        ArenaBuffer raw(file.size());
+        qint64 length = qMax(qint64(0), file.read((char*)raw.data(), raw.size()));
+        if(!writeTarEntry(out, name.toLatin1(), (const char*)raw.data(), length,
+                          QFileInfo(file).lastModified().toMSecsSinceEpoch() / 1000))
+            return -1;
+
+        exported++;
+    }
+
+    // the end of the archive
+    static const char zeros[1024] = { 0 };
+    if(out->write(zeros, 1024) != 1024)
+        return -1;
+
+    return exported;
+}
+
+//==============================================
+// the tracker
+
+//----------------------------------------------
+// runs in the pool threads: finds the tile and hashes it if the run has written it
+struct HashTile
+{
+    HashTile(const QString& r, qint64 s) : root(r), since(s) {}
+
+    void operator()(TileChange& tile) const
+    {
+        TraceSpan span("hash", "manifest", tile.x);
+
+        QString base = root + "/" + QString::number(tile.z) + "/" + QString::number(tile.x) + "/" +
+                       QString::number(tile.y) + ".";
+
+        // the expected format first
+        QFileInfo info(base + extensions[tile.ext]);
+        for(int i=0; i<EXTENSIONS && !info.exists(); i++)
+        {
+            info.setFile(base + extensions[i]);
+            tile.ext = i;
+        }
+
+        if(!info.exists() || info.lastModified().toMSecsSinceEpoch() < since)
+            return;
+
+        QFile file(info.filePath());
+        if(!file.open(QIODevice::ReadOnly))
+            return;
+
+        ArenaBuffer raw(file.size());
+        qint64 length = qMax(qint64(0), file.read((char*)raw.data(), raw.size()));
+
+        QCryptographicHash md5(QCryptographicHash::Md5);
+        md5.addData((const char*)raw.data(), int(length));
+        memcpy(tile.md5, md5.result().constData(), 16);
+
+        tile.size = quint32(length);
+        tile.written = true;
+    }
+
+    QString root;
+    qint64 since;
+};
+
+//----------------------------------------------
+ChangeTracker::ChangeTracker(QObject *parent) :
+    QObject(parent),
+    ext(0),
+    started(0),
+    run(0),
+    bcancelled(false)
+{
+    memset(counts, 0, sizeof(counts));
+
+    connect(&planwatcher, SIGNAL(finished()), this, SLOT(planned()));
+    connect(&hashwatcher, SIGNAL(progressValueChanged(int)), this, SLOT(hashProgress(int)));
+    connect(&hashwatcher, SIGNAL(finished()), this, SLOT(hashed()));
+}
+
+//----------------------------------------------
+ChangeTracker::~ChangeTracker()
+{
+    cancel();
+    planwatcher.waitForFinished();
+    hashwatcher.waitForFinished();
+}
+
+//----------------------------------------------
+void ChangeTracker::start(const QString& dir, const TileGrid& g, const QList<UBox>& regions,
+                          const QString& format, qint64 startms)
+{
+    root = dir;
+    grid = g;
+    uboxes = regions;
+    ext = format == "png" ? 2 : format == "gif" ? 3 : 0;
+    started = startms;
+    BufferArena::configure(QThreadPool::globalInstance()->maxThreadCount(), grid.tileSize());
+
+    if(uboxes.isEmpty())
+    {
+        UBox whole;
+        whole.box = grid.extent();
+        uboxes.append(whole);
+    }
+
+    tiles.clear();
+    previous.clear();
+    memset(counts, 0, sizeof(counts));
+    run = 0;
+    error.clear();
+    bcancel.store(0);
+    bcancelled = false;
+    timer.start();
+
+    planwatcher.setFuture(QtConcurrent::run(this, &ChangeTracker::plan));
+}
+
+//----------------------------------------------
+void ChangeTracker::cancel()
+{
+    bcancel.store(1);
+    bcancelled = true;
+    hashwatcher.cancel();
+}
+
+//----------------------------------------------
+bool ChangeTracker::isRunning() const
+{
+    return planwatcher.isRunning() || hashwatcher.isRunning();
+}
+
+//----------------------------------------------
+// the tiles of the regions, once each, and their last records (in a pool thread)
+void ChangeTracker::plan()
+{
+    TraceSpan span("plan", "manifest");
+
+    if(grid.countTiles(uboxes) > MAXLISTED)
+        walk();
+    else
+    {
+        QVector<qint64> keys;
+        for(int i=0; i<uboxes.size() && !bcancel.load(); i++)
+        {
+            int kmin, kmax;
+            grid.levelRange(uboxes[i], kmin, kmax);
+            for(int k=kmin; k<=kmax; k++)
+            {
+                TileRange range = grid.range(uboxes[i], k);
+                int z = grid.zoom(k);
+                for(qint64 c=range.c0; c<=range.c1 && !bcancel.load(); c++)
+                    for(qint64 r=range.r0; r<=range.r1; r++)
+                        keys.append(TileChange::key(z, c, r));
+            }
+        }
+
+        // the regions may overlap
+        std::sort(keys.begin(), keys.end());
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+        tiles.reserve(keys.size());
+        for(int i=0; i<keys.size() && !bcancel.load(); i++)
+        {
+            TileChange tile;
+            tile.z = int(keys[i] >> 58);
+            tile.x = quint32((keys[i] >> 29) & 0x1fffffff);
+            tile.y = quint32(keys[i] & 0x1fffffff);
+            tile.ext = quint8(ext);
+            tiles.append(tile);
+        }
+    }
+
+    for(int i=0; i<tiles.size() && !bcancel.load(); i++)
+        previous.insert(tiles[i].key(), TileChange());
+
+    run = ChangeManifest::latest(ChangeManifest::fileName(root), previous, 1, -1, true);
+    if(run < 0)
+        error = ChangeManifest::fileName(root) + " is not a change manifest.";
+}
+
+//----------------------------------------------
+// the tiles of the regions modified since the run has started, from the
+// z/x directories of the cache; large regions have far more tiles than a
+// run rewrites
+void ChangeTracker::walk()
+{
+    QStringList filters;
+    for(int i=0; i<EXTENSIONS; i++)
+        filters << QString("*.") + extensions[i];
+
+    const qint64 since = started - MTIMESLACK;
+
+    for(int k=grid.levels()-1; k>=0 && !bcancel.load(); k--)
+    {
+        int z = grid.zoom(k);
+        TileRange level = grid.levelTiles(k);
+
+        // the regions of the level, in tile units
+        UBoxIndex index(BBox(level.c0, level.r0, level.c1 + 1, level.r1 + 1), 16.0);
+        QVector<TileRange> ranges;
+        TileRange span;
+        for(int i=0; i<uboxes.size(); i++)
+        {
+            int kmin, kmax;
+            grid.levelRange(uboxes[i], kmin, kmax);
+            TileRange range = grid.range(uboxes[i], k);
+            if(k < kmin || k > kmax || range.isEmpty())
+                continue;
+
+            index.insert(ranges.size(), BBox(range.c0, range.r0, range.c1 + 0.5, range.r1 + 0.5));
+            ranges.append(range);
+            span = ranges.size() == 1 ? range : TileRange(qMin(span.c0, range.c0), qMax(span.c1, range.c1),
+                                                          qMin(span.r0, range.r0), qMax(span.r1, range.r1));
+        }
+
+        if(ranges.isEmpty())
+            continue;
+
+        QVector<int> ids;
+        QDir zdir(root + "/" + QString::number(z));
+        QStringList columns = zdir.entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+        for(int i=0; i<columns.size() && !bcancel.load(); i++)
+        {
+            bool bx;
+            qint64 x = columns[i].toLongLong(&bx);
+            if(!bx || x < span.c0 || x > span.c1)
+                continue;
+
+            QFileInfoList files = QDir(zdir.filePath(columns[i])).entryInfoList(filters, QDir::Files);
+            for(int j=0; j<files.size(); j++)
+            {
+                bool by;
+                qint64 y = files[j].completeBaseName().toLongLong(&by);
+                if(!by || y < span.r0 || y > span.r1 || files[j].lastModified().toMSecsSinceEpoch() < since)
+                    continue;
+
+                bool bin = false;
+                index.query(BBox(x, y, x + 0.5, y + 0.5), ids);
+                for(int r=0; r<ids.size() && !bin; r++)
+                    bin = x >= ranges[ids[r]].c0 && x <= ranges[ids[r]].c1 && y >= ranges[ids[r]].r0 && y <= ranges[ids[r]].r1;
+                if(!bin)
+                    continue;
+
+                TileChange tile;
+                tile.z = z;
+                tile.x = quint32(x);
+                tile.y = quint32(y);
+                tile.ext = quint8(ext);
+
+                QString suffix = files[j].suffix().toLower();
+                for(int e=0; e<EXTENSIONS; e++)
+                    if(suffix == extensions[e])
+                        tile.ext = quint8(e);
+
+                tiles.append(tile);
+            }
+        }
+    }
+}
+
+//----------------------------------------------
+void ChangeTracker::planned()
+{
+    if(bcancelled || !error.isEmpty() || tiles.isEmpty())
+    {
+        run = 0;
+        emit finished();
+        return;
+    }
+
+    emit progress(0, tiles.size());
+    hashwatcher.setFuture(QtConcurrent::map(tiles, HashTile(root, started - MTIMESLACK)));
+}
+
+//----------------------------------------------
+void ChangeTracker::hashProgress(int done)
+{
+    emit progress(done, tiles.size());
+}
+
+//----------------------------------------------
+void ChangeTracker::hashed()
+{
+    // the tiles hashed before a cancel are real changes as well
+    record();
+    emit finished();
+}
+
+//----------------------------------------------
+// classifies the written tiles against their last records and appends the run
+void ChangeTracker::record()
+{
+    QVector<TileChange> written;
+    for(int i=0; i<tiles.size(); i++)
+    {
+        TileChange tile = tiles[i];
+        if(!tile.written)
+            continue;
+
+        const TileChange& last = previous[tile.key()];
+        tile.state = last.state == TileChange::Unknown ? TileChange::Created :
+                     memcmp(last.md5, tile.md5, 16) == 0 ? TileChange::Unchanged : TileChange::Replaced;
+
+        counts[tile.state]++;
+        written.append(tile);
+    }
+
+    tiles = written;
+    previous.clear();
+
+    run = written.isEmpty() ? 0 :
+          ChangeManifest::append(ChangeManifest::fileName(root), started, QDateTime::currentMSecsSinceEpoch(),
+                                 written, &error);
+}
+
+//----------------------------------------------
+QString ChangeTracker::report() const
+{
+    if(!error.isEmpty())
+        return "Changes not recorded: " + error;
+
+    QString sretval = "Changes of the run in " + QString::number(timer.elapsed() / 1000.0, 'f', 1) + " s" +
+                      (bcancelled ? " (cancelled)" : "") + ": ";
+
+    for(int s=0; s<TileChange::Unknown; s++)
+        sretval += (s > 0 ? ", " : "") + QString::number(counts[s]) + " " + statenames[s];
+
+    if(run > 0)
+        sretval += "\nRecorded as the run " + QString::number(run) + " in " + ChangeManifest::fileName(root) +
+                   "; its delta: tilemaker_wms_gui --delta " + root + " --run " + QString::number(run) + " > delta.tar";
+    else
+        sretval += "\nNo tiles written, nothing recorded.";
+
+    return sretval;
+}
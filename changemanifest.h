@@ -0,0 +1,147 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by Саша Миленковић                                 *
+ *   sasa.milenkovic.xyz@gmail.com                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *   ( http://www.gnu.org/licenses/gpl-3.0.en.html )                       *
+ *									   *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef CHANGEMANIFEST_H
+#define CHANGEMANIFEST_H
+
+#include <QObject>
+#include <QVector>
+#include <QHash>
+#include <QFutureWatcher>
+#include <QElapsedTimer>
+#include <QAtomicInt>
+
+#include "tilegrid.h"
+
+class QIODevice;
+
+//----------------------------------------------
+// one tile written by a run, as the change manifest records it
+struct TileChange
+{
+    enum State { Created, Replaced, Unchanged, Unknown };
+
+    TileChange();
+
+    // x and y below 2^29
+    static qint64 key(int z, qint64 x, qint64 y) { return (qint64(z) << 58) | (x << 29) | y; }
+    qint64 key() const { return key(z, x, y); }
+
+    int z;
+    quint32 x, y;
+    quint8 ext;         // index into the tile extensions
+    quint8 state;
+    bool written;       // by the run being recorded (not stored)
+    quint32 size;
+    char md5[16];
+};
+
+//----------------------------------------------
+// The change manifest of a tile cache, <root>/changes.tcm: an append-only
+// binary file with a block per recorded run, the tiles the run has written
+// with their state and the MD5 of their content (as md5sum prints it on a
+// serving node). Little-endian:
+//   header   "TCMF", quint16 version
+//   run      "RUN ", qint64 started, qint64 finished (ms since the epoch), quint32 tiles
+//   tile     quint8 z, quint32 x, quint32 y, quint8 ext, quint8 state, quint32 size, MD5
+// A run block is written at once; a truncated last block (a crash) is cut
+// off before the next one is appended. Runs are numbered from 1.
+namespace ChangeManifest
+{
+    QString fileName(const QString& root);
+    QString extension(int ext);
+
+    // returns the number of the appended run, -1 - error
+    int append(const QString& path, qint64 started, qint64 finished, const QVector<TileChange>& tiles,
+               QString* error = 0);
+
+    // the last record of every tile of the runs [from, to] (to < 0 - the last
+    // run); a later Unchanged doesn't hide a change within the runs. With
+    // 'bknownonly' only the tiles already in 'tiles' are looked up. Returns
+    // the number of runs in the file (0 - no file), -1 - not a manifest.
+    int latest(const QString& path, QHash<qint64, TileChange>& tiles, int from = 1, int to = -1,
+               bool bknownonly = false);
+
+    // a ustar stream of the created and replaced tiles with their current
+    // content, named <z>/<x>/<y>.<ext>; the tiles gone from the cache since
+    // are counted in 'missing'. Returns the number of tiles, -1 - write error.
+    int exportTar(const QString& root, const QHash<qint64, TileChange>& tiles, QIODevice* out,
+                  int* missing = 0);
+}
+
+//----------------------------------------------
+// Records a finished (or broken) run in the change manifest of its cache.
+// The tiles of its update regions, or of the whole BBOX, which have been
+// modified since the run has started are hashed in parallel and compared
+// with their last records; identical rewrites are recorded as unchanged.
+// The tiles of a run over many tiles (a whole BBOX, large regions) are
+// found by walking the z/x directories rather than by enumerating them.
+// A tile without any record counts as created, so the first recorded run
+// of an existing cache is its baseline.
+class ChangeTracker : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ChangeTracker(QObject *parent = 0);
+    ~ChangeTracker();
+
+    // 'format' - jpeg, png or gif; 'started' - ms since the epoch
+    void start(const QString& root, const TileGrid& grid, const QList<UBox>& uboxes,
+               const QString& format, qint64 started);
+    void cancel();
+    bool isRunning() const;
+
+    QString report() const;
+
+signals:
+    void progress(int done, int total);
+    void finished();
+
+private slots:
+    void planned();
+    void hashProgress(int);
+    void hashed();
+
+private:
+    QString root;
+    TileGrid grid;
+    QList<UBox> uboxes;
+    int ext;
+    qint64 started;
+
+    QVector<TileChange> tiles;          // of the regions, then the written ones
+    QHash<qint64, TileChange> previous; // the last records of the tiles
+    int counts[TileChange::Unknown];
+    int run;                            // the recorded one, 0 - none
+    QString error;
+    QAtomicInt bcancel;
+    bool bcancelled;
+    QElapsedTimer timer;
+
+    QFutureWatcher<void> planwatcher;
+    QFutureWatcher<void> hashwatcher;
+
+    void plan();
+    void walk();
+    void record();
+};
+
+#endif // CHANGEMANIFEST_H
@@ -0,0 +1,773 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by Саша Миленковић                                 *
+ *   sasa.milenkovic.xyz@gmail.com                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *   ( http://www.gnu.org/licenses/gpl-3.0.en.html )                       *
+ *									   *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QHostAddress>
+#include <QHostInfo>
+#include <QProcess>
+#include <QTemporaryFile>
+#include <QTextStream>
+#include <QDir>
+#include <QCoreApplication>
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <QUuid>
+#include <QMessageAuthenticationCode>
+
+#include "cluster.h"
+#include "tracer.h"
+
+const int MAXATTEMPTS = 3;  // a unit which has failed so many times is given up
+const int BEATSPERLEASE = 3;
+
+//----------------------------------------------
+QList<UBox> ClusterPlan::split(const TileGrid& grid, int splitlevel)
+{
+    QList<UBox> units;
+
+    int count = grid.levels();
+    splitlevel = qBound(0, splitlevel, count - 1);
+
+    const BBox& bbox = grid.extent();
+    TileRange tiles = grid.levelTiles(splitlevel);
+
+    // a quarter of the finest pixel inside the tile edges - the neighbour
+    // tiles are not touched at any level
+    double inset = grid.highResolution() / 4.0;
+
+    for(qint64 r=tiles.r0; r<=tiles.r1; r++)
+    {
+        for(qint64 c=tiles.c0; c<=tiles.c1; c++)
+        {
+            BBox tile = grid.tileBox(splitlevel, c, r);
+
+            UBox unit;
+            unit.box.left = tile.left + inset;
+            unit.box.bottom = tile.bottom + inset;
+            unit.box.right = qMin(bbox.right, tile.right) - inset;
+            unit.box.top = qMin(bbox.top, tile.top) - inset;
+            unit.hres = grid.highResolution();
+            unit.lres = grid.resolution(splitlevel);
+            units.append(unit);
+        }
+    }
+
+    if(splitlevel < count - 1)
+    {
+        UBox top;
+        top.box = bbox;
+        top.hres = grid.resolution(splitlevel + 1);
+        top.lres = grid.lowResolution();
+        units.append(top);
+    }
+
+    return units;
+}
+
+//----------------------------------------------
+QString ClusterPlan::formatUnit(const UBox& ubox)
+{
+    QString sretval = QString::number(ubox.box.left,'g',17) + "," +
+                      QString::number(ubox.box.bottom,'g',17) + "," +
+                      QString::number(ubox.box.right,'g',17) + "," +
+                      QString::number(ubox.box.top,'g',17);
+
+    if(ubox.hres > 0.0)
+        sretval += "," + QString::number(ubox.hres,'g',17);
+
+    if(ubox.lres > 0.0)
+        sretval += "," + QString::number(ubox.lres,'g',17);
+
+    if(ubox.fitres > 0.0)
+        sretval += "," + QString::number(ubox.fitres,'g',17);
+
+    return sretval;
+}
+
+//----------------------------------------------
+// 128 random bits, hex
+QByteArray ClusterPlan::nonce()
+{
+    return QUuid::createUuid().toRfc4122().toHex() + QUuid::createUuid().toRfc4122().toHex();
+}
+
+//----------------------------------------------
+// 'role' - of the side which proves, so a proof cannot be sent back
+QByteArray ClusterPlan::proof(const QByteArray& token, const QByteArray& role, const QByteArray& nonce)
+{
+    return QMessageAuthenticationCode::hash(role + " " + nonce, token, QCryptographicHash::Sha256).toHex();
+}
+
+//----------------------------------------------
+// in a time which doesn't depend on where they differ
+bool ClusterPlan::sameProof(const QByteArray& a, const QByteArray& b)
+{
+    if(a.size() != b.size() || a.isEmpty())
+        return false;
+
+    char diff = 0;
+    for(int i=0; i<a.size(); i++)
+        diff |= a[i] ^ b[i];
+
+    return diff == 0;
+}
+
+//==============================================
+// the coordinator
+
+//----------------------------------------------
+ClusterCoordinator::ClusterCoordinator(QObject *parent) :
+    QObject(parent),
+    pServer(0),
+    leasemsecs(30000),
+    donecount(0),
+    failedcount(0)
+{
+    leasetimer.setInterval(1000);
+    connect(&leasetimer, SIGNAL(timeout()), this, SLOT(checkLeases()));
+}
+
+//----------------------------------------------
+ClusterCoordinator::~ClusterCoordinator()
+{
+    stop();
+}
+
+//----------------------------------------------
+bool ClusterCoordinator::start(quint16 port, const QByteArray& secret, const QStringList& args, const QList<UBox>& uboxes,
+                               int leasesecs, QString* error)
+{
+    stop();
+
+    if(secret.isEmpty())
+    {
+        if(error)
+            *error = "The workers cannot be authenticated without a token.";
+        return false;
+    }
+
+    pServer = new QTcpServer(this);
+    if(!pServer->listen(QHostAddress::Any, port))
+    {
+        if(error)
+            *error = "Cannot listen on the port " + QString::number(port) + ": " + pServer->errorString();
+        delete pServer;
+        pServer = 0;
+        return false;
+    }
+
+    connect(pServer, SIGNAL(newConnection()), this, SLOT(newConnection()));
+
+    token = secret;
+    jobargs = args;
+    leasemsecs = qMax(3, leasesecs) * 1000;
+    donecount = failedcount = 0;
+
+    units.clear();
+    pending.clear();
+    for(int i=0; i<uboxes.size(); i++)
+    {
+        ClusterUnit unit;
+        unit.ubox = uboxes[i];
+        units.append(unit);
+        pending.append(i);
+    }
+
+    clock.start();
+    leasetimer.start();
+
+    emit message("Coordinator listening on the port " + QString::number(port) + ", " +
+                 QString::number(units.size()) + " work units.");
+    emit progress(0, 0, units.size());
+
+    return true;
+}
+
+//----------------------------------------------
+void ClusterCoordinator::stop()
+{
+    leasetimer.stop();
+
+    QList<QTcpSocket*> sockets = workers.keys();
+    for(int i=0; i<sockets.size(); i++)
+    {
+        sockets[i]->disconnect(this);
+        send(sockets[i], "BYE");
+        sockets[i]->disconnectFromHost();
+        sockets[i]->deleteLater();
+    }
+    workers.clear();
+
+    if(pServer)
+    {
+        pServer->close();
+        delete pServer;
+        pServer = 0;
+    }
+}
+
+//----------------------------------------------
+bool ClusterCoordinator::isRunning() const
+{
+    return pServer != 0;
+}
+
+//----------------------------------------------
+void ClusterCoordinator::newConnection()
+{
+    while(pServer && pServer->hasPendingConnections())
+    {
+        QTcpSocket* socket = pServer->nextPendingConnection();
+        connect(socket, SIGNAL(readyRead()), this, SLOT(readWorker()));
+        connect(socket, SIGNAL(disconnected()), this, SLOT(workerDisconnected()));
+
+        ClusterWorker worker;
+        worker.name = socket->peerAddress().toString();
+        worker.slotcount = 0; // nothing is leased before HELLO
+        worker.nonce = ClusterPlan::nonce();
+        workers.insert(socket, worker);
+
+        send(socket, "CHALLENGE " + worker.nonce);
+    }
+}
+
+//----------------------------------------------
+void ClusterCoordinator::readWorker()
+{
+    QTcpSocket* socket = qobject_cast<QTcpSocket*>(sender());
+    if(!socket || !workers.contains(socket))
+        return;
+
+    QByteArray& buffer = workers[socket].buffer;
+    buffer += socket->readAll();
+
+    int end;
+    while((end = buffer.indexOf('\n')) >= 0)
+    {
+        QByteArray line = buffer.left(end).trimmed();
+        buffer.remove(0, end + 1);
+
+        if(!line.isEmpty())
+            handleLine(socket, line);
+
+        if(!workers.contains(socket)) // dropped while handling
+            return;
+    }
+}
+
+//----------------------------------------------
+void ClusterCoordinator::handleLine(QTcpSocket* socket, const QByteArray& line)
+{
+    ClusterWorker& worker = workers[socket];
+    QList<QByteArray> words = line.split(' ');
+
+    if(!worker.bauthenticated)
+    {
+        if(words[0] != "HELLO" || words.size() < 5)
+        {
+            reject(socket, "no HELLO");
+            return;
+        }
+
+        if(!ClusterPlan::sameProof(words[4], ClusterPlan::proof(token, "worker", worker.nonce)))
+        {
+            reject(socket, "wrong token");
+            return;
+        }
+
+        worker.bauthenticated = true;
+        worker.name = QString::fromUtf8(words[1]) + "@" + socket->peerAddress().toString();
+        worker.slotcount = qBound(1, words[2].toInt(), 64);
+
+        QJsonArray array;
+        for(int i=0; i<jobargs.size(); i++)
+            array.append(jobargs[i]);
+
+        send(socket, "WELCOME " + ClusterPlan::proof(token, "coordinator", words[3]) + " " + QByteArray::number(leasemsecs));
+        send(socket, "JOB " + QJsonDocument(array).toJson(QJsonDocument::Compact));
+        emit message("Worker " + worker.name + " has joined (" + QString::number(worker.slotcount) + " slots).");
+
+        dispatch();
+    }
+    else if(words[0] == "BEAT" && words.size() >= 2)
+    {
+        int id = words[1].toInt();
+        if(id >= 0 && id < units.size() && units[id].worker == socket && units[id].state == ClusterUnit::Leased)
+            units[id].leaseuntil = clock.elapsed() + leasemsecs;
+    }
+    else if(words[0] == "DONE" && words.size() >= 4)
+    {
+        int id = words[1].toInt();
+        int exitcode = words[2].toInt();
+        qint64 msecs = words[3].toLongLong();
+
+        // a late report of an expired lease - the unit is someone else's now
+        if(id < 0 || id >= units.size() || units[id].worker != socket || units[id].state != ClusterUnit::Leased)
+            return;
+
+        ClusterUnit& unit = units[id];
+        worker.units.removeAll(id);
+        worker.busymsecs += msecs;
+        unit.worker = 0;
+        unit.msecs = msecs;
+
+        if(Tracer::isEnabled())
+            Tracer::complete("unit", "cluster", Tracer::now() - msecs * 1000, msecs * 1000, id);
+
+        if(exitcode == 0)
+        {
+            unit.state = ClusterUnit::Done;
+            worker.done++;
+            donecount++;
+        }
+        else
+        {
+            worker.failed++;
+            emit message("Unit " + QString::number(id) + " has failed on " + worker.name +
+                         " (exit code " + QString::number(exitcode) + ").");
+            release(id, true);
+        }
+
+        emit progress(donecount, failedcount, units.size());
+
+        dispatch();
+        checkFinished();
+    }
+}
+
+//----------------------------------------------
+// a peer which cannot prove the token; it has no units yet
+void ClusterCoordinator::reject(QTcpSocket* socket, const QString& why)
+{
+    ClusterWorker worker = workers.take(socket);
+    emit message("The connection from " + worker.name + " has been rejected (" + why + ").");
+
+    socket->disconnect(this);
+    send(socket, "BYE");
+    socket->disconnectFromHost();
+    socket->deleteLater();
+}
+
+//----------------------------------------------
+// leases pending units to the workers with free slots
+void ClusterCoordinator::dispatch()
+{
+    for(QHash<QTcpSocket*, ClusterWorker>::iterator it=workers.begin(); it!=workers.end() && !pending.isEmpty(); ++it)
+    {
+        ClusterWorker& worker = it.value();
+        while(worker.units.size() < worker.slotcount && !pending.isEmpty())
+        {
+            int id = pending.takeFirst();
+            ClusterUnit& unit = units[id];
+            unit.state = ClusterUnit::Leased;
+            unit.attempts++;
+            unit.worker = it.key();
+            unit.leaseuntil = clock.elapsed() + leasemsecs;
+            worker.units.append(id);
+
+            send(it.key(), "UNIT " + QByteArray::number(id) + " " + ClusterPlan::formatUnit(unit.ubox).toLatin1());
+        }
+    }
+}
+
+//----------------------------------------------
+// the unit goes back to the queue (or is given up); 'bcount' - it was an attempt
+void ClusterCoordinator::release(int id, bool bcount)
+{
+    ClusterUnit& unit = units[id];
+
+    if(unit.worker && workers.contains(unit.worker))
+        workers[unit.worker].units.removeAll(id);
+    unit.worker = 0;
+
+    if(!bcount)
+        unit.attempts--;
+
+    if(unit.attempts >= MAXATTEMPTS)
+    {
+        unit.state = ClusterUnit::Failed;
+        failedcount++;
+        emit message("Unit " + QString::number(id) + " (" + ClusterPlan::formatUnit(unit.ubox) +
+                     ") has been given up after " + QString::number(unit.attempts) + " attempts.");
+    }
+    else
+    {
+        unit.state = ClusterUnit::Pending;
+        pending.prepend(id);
+    }
+}
+
+//----------------------------------------------
+void ClusterCoordinator::workerDisconnected()
+{
+    QTcpSocket* socket = qobject_cast<QTcpSocket*>(sender());
+    if(!socket || !workers.contains(socket))
+        return;
+
+    ClusterWorker worker = workers.take(socket);
+    socket->deleteLater();
+
+    for(int i=0; i<worker.units.size(); i++)
+    {
+        units[worker.units[i]].worker = 0;
+        release(worker.units[i], false);
+    }
+
+    emit message("Worker " + worker.name + " is gone" +
+                 (worker.units.isEmpty() ? QString(".") : ", " + QString::number(worker.units.size()) + " units are reassigned."));
+    emit progress(donecount, failedcount, units.size());
+
+    dispatch();
+    checkFinished();
+}
+
+//----------------------------------------------
+// a worker which has stopped beating (hung, or its network is down) loses its leases
+void ClusterCoordinator::checkLeases()
+{
+    qint64 now = clock.elapsed();
+
+    bool bexpired = false;
+    for(int id=0; id<units.size(); id++)
+    {
+        ClusterUnit& unit = units[id];
+        if(unit.state != ClusterUnit::Leased || unit.leaseuntil > now)
+            continue;
+
+        QTcpSocket* socket = unit.worker;
+        if(socket && workers.contains(socket))
+        {
+            workers[socket].expired++;
+            send(socket, "DROP " + QByteArray::number(id));
+            emit message("The lease of the unit " + QString::number(id) + " on " + workers[socket].name + " has expired.");
+        }
+
+        release(id, true);
+        bexpired = true;
+    }
+
+    if(bexpired)
+    {
+        emit progress(donecount, failedcount, units.size());
+        dispatch();
+        checkFinished();
+    }
+}
+
+//----------------------------------------------
+void ClusterCoordinator::checkFinished()
+{
+    if(!pServer || donecount + failedcount < units.size())
+        return;
+
+    emit message(report());
+    stop();
+    emit finished(failedcount == 0);
+}
+
+//----------------------------------------------
+void ClusterCoordinator::send(QTcpSocket* socket, const QByteArray& line)
+{
+    socket->write(line + "\n");
+}
+
+//----------------------------------------------
+QString ClusterCoordinator::report() const
+{
+    qint64 elapsed = clock.isValid() ? clock.elapsed() : 0;
+
+    QString sretval = "Units: " + QString::number(donecount) + " done, " +
+                      QString::number(failedcount) + " failed, " +
+                      QString::number(units.size()) + " total, " +
+                      QString::number(elapsed / 1000.0, 'f', 1) + " s";
+
+    for(QHash<QTcpSocket*, ClusterWorker>::const_iterator it=workers.constBegin(); it!=workers.constEnd(); ++it)
+    {
+        const ClusterWorker& worker = it.value();
+        sretval += "\n  " + worker.name + ": " + QString::number(worker.done) + " done, " +
+                   QString::number(worker.failed) + " failed, " +
+                   QString::number(worker.expired) + " expired, busy " +
+                   QString::number(worker.busymsecs / 1000.0, 'f', 1) + " s";
+    }
+
+    return sretval;
+}
+
+//==============================================
+// the worker agent
+
+//----------------------------------------------
+ClusterWorkerAgent::ClusterWorkerAgent(const QString& h, quint16 p, int n, const QByteArray& t, QObject *parent) :
+    QObject(parent),
+    host(h),
+    port(p),
+    slotcount(qMax(1, n)),
+    token(t),
+    bjoined(false),
+    bwelcomed(false),
+    bgone(false)
+{
+    pSocket = new QTcpSocket(this);
+    connect(pSocket, SIGNAL(connected()), this, SLOT(connected()));
+    connect(pSocket, SIGNAL(readyRead()), this, SLOT(readCoordinator()));
+    connect(pSocket, SIGNAL(disconnected()), this, SLOT(disconnected()));
+    connect(pSocket, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(disconnected()));
+
+    connect(&beattimer, SIGNAL(timeout()), this, SLOT(beat()));
+}
+
+//----------------------------------------------
+ClusterWorkerAgent::~ClusterWorkerAgent()
+{
+    for(QHash<int, Run>::iterator it=runs.begin(); it!=runs.end(); ++it)
+    {
+        it.value().process->disconnect(this);
+        it.value().process->kill();
+        it.value().process->waitForFinished(3000);
+    }
+}
+
+//----------------------------------------------
+void ClusterWorkerAgent::start()
+{
+    QTextStream(stdout) << "Worker: connecting to " << host << ":" << port << "\n";
+    pSocket->connectToHost(host, port);
+}
+
+//----------------------------------------------
+void ClusterWorkerAgent::connected()
+{
+    bjoined = true;
+
+    // HELLO answers the CHALLENGE
+}
+
+//----------------------------------------------
+void ClusterWorkerAgent::readCoordinator()
+{
+    buffer += pSocket->readAll();
+
+    int end;
+    while((end = buffer.indexOf('\n')) >= 0)
+    {
+        QByteArray line = buffer.left(end).trimmed();
+        buffer.remove(0, end + 1);
+
+        if(!line.isEmpty())
+            handleLine(line);
+    }
+}
+
+//----------------------------------------------
+void ClusterWorkerAgent::handleLine(const QByteArray& line)
+{
+    int space = line.indexOf(' ');
+    QByteArray command = space < 0 ? line : line.left(space);
+    QByteArray rest = space < 0 ? QByteArray() : line.mid(space + 1);
+
+    if(command == "CHALLENGE" && !bwelcomed && nonce.isEmpty())
+    {
+        nonce = ClusterPlan::nonce();
+        send("HELLO " + QHostInfo::localHostName().toUtf8() + "/" +
+             QByteArray::number(QCoreApplication::applicationPid()) + " " + QByteArray::number(slotcount) + " " +
+             nonce + " " + ClusterPlan::proof(token, "worker", rest.trimmed()));
+    }
+    else if(command == "WELCOME" && !bwelcomed && !nonce.isEmpty())
+    {
+        QList<QByteArray> words = rest.split(' ');
+        if(!ClusterPlan::sameProof(words[0], ClusterPlan::proof(token, "coordinator", nonce)))
+        {
+            QTextStream(stdout) << "Worker: the coordinator doesn't know the token\n";
+            pSocket->disconnectFromHost();
+            return;
+        }
+
+        bwelcomed = true;
+        int leasemsecs = words.size() > 1 ? words[1].toInt() : 0;
+        beattimer.start(qMax(500, (leasemsecs > 0 ? leasemsecs : 15000) / BEATSPERLEASE));
+    }
+    else if(!bwelcomed)
+    {
+        // nothing is taken from a coordinator which has not proven the token
+        if(command == "BYE")
+            pSocket->disconnectFromHost();
+    }
+    else if(command == "JOB")
+    {
+        QJsonArray array = QJsonDocument::fromJson(rest).array();
+        jobargs.clear();
+        for(int i=0; i<array.size(); i++)
+            jobargs << array.at(i).toString();
+    }
+    else if(command == "UNIT")
+    {
+        space = rest.indexOf(' ');
+        if(space > 0)
+            startUnit(rest.left(space).toInt(), QString::fromLatin1(rest.mid(space + 1)));
+    }
+    else if(command == "DROP")
+    {
+        int id = rest.toInt();
+        if(runs.contains(id))
+        {
+            QTextStream(stdout) << "Worker: unit " << id << " dropped\n";
+            runs[id].process->kill();
+        }
+    }
+    else if(command == "BYE")
+    {
+        pSocket->disconnectFromHost();
+    }
+}
+
+//----------------------------------------------
+void ClusterWorkerAgent::startUnit(int id, const QString& line)
+{
+    if(runs.contains(id) || jobargs.isEmpty())
+        return;
+
+    QStringList args = jobargs;
+
+    Run run;
+    run.process = new QProcess(this);
+    run.process->setProcessChannelMode(QProcess::ForwardedChannels);
+    run.line = line;
+
+#ifdef Q_OS_UNIX
+    args << "--file" << "/dev/stdin";
+    connect(run.process, SIGNAL(started()), this, SLOT(unitStarted()));
+#else
+    QTemporaryFile* pFile = new QTemporaryFile(QDir::tempPath() + QDir::separator() + "tilemaker_unit_XXXXXX.txt", run.process);
+    if(pFile->open())
+    {
+        QTextStream(pFile) << line << "\n";
+        pFile->close();
+    }
+    args << "--file" << pFile->fileName();
+#endif
+
+    connect(run.process, SIGNAL(finished(int)), this, SLOT(unitFinished()));
+    connect(run.process, SIGNAL(error(QProcess::ProcessError)), this, SLOT(unitError()));
+
+    QTextStream(stdout) << "Worker: unit " << id << " " << line << "\n";
+
+    run.timer.start();
+    runs.insert(id, run);
+
+    run.process->start(QDir::currentPath() + QDir::separator() + "tilemaker_wms", args);
+}
+
+//----------------------------------------------
+void ClusterWorkerAgent::unitStarted()
+{
+    int id = unitOf(sender());
+    if(id < 0)
+        return;
+
+    QProcess* process = runs[id].process;
+    process->write(runs[id].line.toLatin1() + "\n");
+    process->closeWriteChannel();
+}
+
+//----------------------------------------------
+void ClusterWorkerAgent::unitFinished()
+{
+    int id = unitOf(sender());
+    if(id >= 0)
+        reportUnit(id);
+}
+
+//----------------------------------------------
+// a tilemaker which could not start doesn't emit finished()
+void ClusterWorkerAgent::unitError()
+{
+    QProcess* process = qobject_cast<QProcess*>(sender());
+    int id = unitOf(process);
+    if(id >= 0 && process->error() == QProcess::FailedToStart)
+        reportUnit(id);
+}
+
+//----------------------------------------------
+void ClusterWorkerAgent::reportUnit(int id)
+{
+    Run run = runs.take(id);
+
+    int exitcode = run.process->exitStatus() == QProcess::NormalExit &&
+                   run.process->state() == QProcess::NotRunning ? run.process->exitCode() : -1;
+
+    send("DONE " + QByteArray::number(id) + " " + QByteArray::number(exitcode) + " " +
+         QByteArray::number(run.timer.elapsed()));
+
+    run.process->disconnect(this);
+    run.process->deleteLater();
+}
+
+//----------------------------------------------
+int ClusterWorkerAgent::unitOf(QObject* process) const
+{
+    for(QHash<int, Run>::const_iterator it=runs.constBegin(); it!=runs.constEnd(); ++it)
+        if(it.value().process == process)
+            return it.key();
+
+    return -1;
+}
+
+//----------------------------------------------
+void ClusterWorkerAgent::beat()
+{
+    for(QHash<int, Run>::const_iterator it=runs.constBegin(); it!=runs.constEnd(); ++it)
+        send("BEAT " + QByteArray::number(it.key()));
+}
+
+//----------------------------------------------
+// both disconnected() and error() come here, finished() is emitted once
+void ClusterWorkerAgent::disconnected()
+{
+    if(bgone)
+        return;
+
+    if(!bjoined)
+    {
+        // the coordinator is not listening yet
+        if(pSocket->state() == QAbstractSocket::UnconnectedState)
+            QTimer::singleShot(2000, this, SLOT(start()));
+        return;
+    }
+
+    bgone = true;
+    beattimer.stop();
+
+    for(QHash<int, Run>::iterator it=runs.begin(); it!=runs.end(); ++it)
+    {
+        it.value().process->disconnect(this);
+        it.value().process->kill();
+    }
+
+    QTextStream(stdout) << "Worker: the coordinator is gone (" << pSocket->errorString() << ")\n";
+    emit finished();
+}
+
+//----------------------------------------------
+void ClusterWorkerAgent::send(const QByteArray& line)
+{
+    if(pSocket->state() == QAbstractSocket::ConnectedState)
+        pSocket->write(line + "\n");
+}
@@ -0,0 +1,221 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by Саша Миленковић                                 *
+ *   sasa.milenkovic.xyz@gmail.com                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *   ( http://www.gnu.org/licenses/gpl-3.0.en.html )                       *
+ *									   *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include <QObject>
+#include <QStringList>
+#include <QList>
+#include <QHash>
+#include <QTimer>
+#include <QElapsedTimer>
+
+#include "tilegrid.h"
+
+class QTcpServer;
+class QTcpSocket;
+class QProcess;
+
+// Distributed seeding. The coordinator (the dialog) cuts a validated job
+// into tile aligned work units and leases them to worker agents - this
+// program started with "--worker host:port" on other nodes - over a line
+// based TCP protocol:
+//
+//   coordinator -> worker:  CHALLENGE <nonce>           (on connect)
+//   worker -> coordinator:  HELLO <name> <slotcount> <nonce> <proof>
+//   coordinator -> worker:  WELCOME <proof> <lease msecs>
+//                           JOB <tilemaker arguments as a JSON array>
+//                           UNIT <unit> <update region line>
+//                           DROP <unit>                 (the lease is gone)
+//                           BYE
+//   worker -> coordinator:  BEAT <unit>                 (renews the lease)
+//                           DONE <unit> <exitcode> <msecs>
+//
+// Both sides share a token. A proof is the HMAC-SHA256 of the other
+// side's nonce keyed with the token; a peer without it is dropped before
+// a unit is leased to it or a job is taken from it. The worker beats
+// three times per lease.
+
+// A worker runs the tilemaker from its working directory for every unit,
+// with the unit as its only update region. The tiles of different units
+// don't overlap, so the workers (sharing the output directory) produce
+// the same cache as a single run.
+
+const quint16 CLUSTERPORT = 5770;
+
+//----------------------------------------------
+namespace ClusterPlan
+{
+    // the token a worker takes if none is given on the command line
+    const char* const TOKENVARIABLE = "TILEMAKER_CLUSTER_TOKEN";
+
+    QByteArray nonce();
+    QByteArray proof(const QByteArray& token, const QByteArray& role, const QByteArray& nonce);
+    bool sameProof(const QByteArray& a, const QByteArray& b);
+
+    // The BBOX cut along the tiles of the level 'splitlevel' (0 - the high
+    // resolution); each cut renders the levels 0..splitlevel, one more unit
+    // renders the coarser levels of the whole BBOX.
+    QList<UBox> split(const TileGrid& grid, int splitlevel);
+
+    // update region line with the full precision (the unit edges are tile edges)
+    QString formatUnit(const UBox&);
+}
+
+//----------------------------------------------
+struct ClusterUnit
+{
+    enum State { Pending, Leased, Done, Failed };
+
+    ClusterUnit() : state(Pending), attempts(0), leaseuntil(0), msecs(0), worker(0) {}
+
+    UBox ubox;
+    State state;
+    int attempts;
+    qint64 leaseuntil;      // coordinator clock
+    qint64 msecs;           // tilemaker run time reported by the worker
+    QTcpSocket* worker;
+};
+
+//----------------------------------------------
+struct ClusterWorker
+{
+    ClusterWorker() : bauthenticated(false), slotcount(1), done(0), failed(0), expired(0), busymsecs(0) {}
+
+    QString name;
+    QByteArray nonce;       // of the challenge
+    bool bauthenticated;
+    int slotcount;
+    QList<int> units;       // leased ones
+    int done;
+    int failed;             // non-zero exit codes
+    int expired;            // leases which have timed out
+    qint64 busymsecs;
+    QByteArray buffer;      // incomplete line
+};
+
+//----------------------------------------------
+class ClusterCoordinator : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ClusterCoordinator(QObject *parent = 0);
+    ~ClusterCoordinator();
+
+    // 'args' - the tilemaker arguments without --file
+    bool start(quint16 port, const QByteArray& token, const QStringList& args, const QList<UBox>& units,
+               int leasesecs, QString* error);
+    void stop();
+    bool isRunning() const;
+
+    int unitCount() const { return units.size(); }
+
+    // per worker metrics, as text
+    QString report() const;
+
+signals:
+    void progress(int done, int failed, int total);
+    void message(const QString&);
+    void finished(bool bOK);
+
+private slots:
+    void newConnection();
+    void readWorker();
+    void workerDisconnected();
+    void checkLeases();
+
+private:
+    QTcpServer* pServer;
+    QTimer leasetimer;
+    QElapsedTimer clock;
+
+    QByteArray token;
+    QStringList jobargs;
+    QList<ClusterUnit> units;
+    QList<int> pending;
+    QHash<QTcpSocket*, ClusterWorker> workers;
+    int leasemsecs;
+    int donecount, failedcount;
+
+    void handleLine(QTcpSocket*, const QByteArray&);
+    void reject(QTcpSocket*, const QString& why);
+    void dispatch();
+    void release(int unit, bool bcount);
+    void send(QTcpSocket*, const QByteArray&);
+    void checkFinished();
+};
+
+//----------------------------------------------
+// the "--worker" mode; runs headless and quits when the coordinator is gone
+class ClusterWorkerAgent : public QObject
+{
+    Q_OBJECT
+
+public:
+    ClusterWorkerAgent(const QString& host, quint16 port, int slotcount, const QByteArray& token, QObject *parent = 0);
+    ~ClusterWorkerAgent();
+
+signals:
+    void finished();
+
+public slots:
+    void start();
+
+private slots:
+    void connected();
+    void readCoordinator();
+    void disconnected();
+    void unitStarted();
+    void unitFinished();
+    void unitError();
+    void beat();
+
+private:
+    QTcpSocket* pSocket;
+    QString host;
+    quint16 port;
+    int slotcount;
+    QByteArray token;
+    QByteArray nonce;   // of the HELLO, the coordinator proves the token with it
+    QStringList jobargs;
+    QByteArray buffer;
+    QTimer beattimer;
+    bool bjoined;       // has been connected - a refused first connection is retried
+    bool bwelcomed;     // the coordinator has proven the token
+    bool bgone;         // finished() has been emitted
+
+    struct Run
+    {
+        QProcess* process;
+        QString line;
+        QElapsedTimer timer;
+    };
+    QHash<int, Run> runs;
+
+    void handleLine(const QByteArray&);
+    void startUnit(int unit, const QString& line);
+    int unitOf(QObject*) const;
+    void reportUnit(int unit);
+    void send(const QByteArray&);
+};
+
+#endif // CLUSTER_H
@@ -20,15 +20,31 @@
  
 #include <QDir>
 #include <QTextStream>
+#include <QTemporaryFile>
+#include <QtConcurrentRun>
 #include <QFileDialog>
+#include <QDateTime>
 
 #include <QDebug>
 
 #include "dialog.h"
 #include "ui_dialog.h"
-
-const int TILESIZE = 512;
-double dleft=-180.0, dbottom=-90.0, dright=180.0, dtop=90.0, dhres=.0, dlres=100000.0;
+#include "procmonitor.h"
+#include "tracer.h"
+#include "uboxindex.h"
+#include "cluster.h"
+#include "tileverifier.h"
+#include "tileoptimizer.h"
+#include "tilewarper.h"
+#include "requestplan.h"
+#include "serverprofile.h"
+#include "layerset.h"
+#include "bufferarena.h"
+#include "footprint.h"
+#include "accesslog.h"
+#include "changemanifest.h"
+#include "tilestager.h"
+#include "jobvalidator.h"
 
 //----------------------------------------------
 Dialog::Dialog(QWidget *parent) :
@@ -44,6 +60,104 @@ Dialog::Dialog(QWidget *parent) :
     connect(pTilemaker, SIGNAL(readyReadStandardOutput()),this, SLOT(rightMessage()) );
     connect(pTilemaker, SIGNAL(readyReadStandardError()), this, SLOT(wrongMessage()) );
     connect(pTilemaker, SIGNAL(finished(int)), this, SLOT(on_finish(int)));
+    connect(pTilemaker, SIGNAL(started()), this, SLOT(processStarted()));
+    connect(pTilemaker, SIGNAL(bytesWritten(qint64)), this, SLOT(feedUpdates()));
+
+    // resource monitor and governor of the tilemaker process
+    pMonitor = new ProcMonitor(this);
+    connect(pMonitor, SIGNAL(sampled(ProcSample)), ui->graphResources, SLOT(addSample(ProcSample)));
+    connect(pMonitor, SIGNAL(governorMessage(QString)), this, SLOT(governorMessage(QString)));
+
+    connect(ui->spinInterval, SIGNAL(valueChanged(int)), this, SLOT(updateBudget()));
+    connect(ui->groupGovernor, SIGNAL(toggled(bool)), this, SLOT(updateBudget()));
+    connect(ui->spinNice, SIGNAL(valueChanged(int)), this, SLOT(updateBudget()));
+    connect(ui->checkIdleIO, SIGNAL(toggled(bool)), this, SLOT(updateBudget()));
+    connect(ui->spinCpuLimit, SIGNAL(valueChanged(int)), this, SLOT(updateBudget()));
+    connect(ui->spinRssLimit, SIGNAL(valueChanged(int)), this, SLOT(updateBudget()));
+    connect(ui->spinIoLimit, SIGNAL(valueChanged(int)), this, SLOT(updateBudget()));
+    connect(ui->editCgroup, SIGNAL(editingFinished()), this, SLOT(updateBudget()));
+
+    // coordinator of distributed jobs
+    pCoordinator = new ClusterCoordinator(this);
+    connect(pCoordinator, SIGNAL(progress(int,int,int)), this, SLOT(clusterProgress(int,int,int)));
+    connect(pCoordinator, SIGNAL(message(QString)), this, SLOT(clusterMessage(QString)));
+    connect(pCoordinator, SIGNAL(finished(bool)), this, SLOT(clusterFinished(bool)));
+
+    // verification of the cache
+    pVerifier = new TileVerifier(this);
+    connect(pVerifier, SIGNAL(progress(int,int)), this, SLOT(verifyProgress(int,int)));
+    connect(pVerifier, SIGNAL(finished()), this, SLOT(verifyFinished()));
+
+    // recompression of the cache
+    pOptimizer = new TileOptimizer(this);
+    connect(pOptimizer, SIGNAL(progress(int,int)), this, SLOT(optimizeProgress(int,int)));
+    connect(pOptimizer, SIGNAL(finished()), this, SLOT(optimizeFinished()));
+
+    // reprojection of the cache
+    pWarper = new TileWarper(this);
+    connect(pWarper, SIGNAL(progress(int,int)), this, SLOT(warpProgress(int,int)));
+    connect(pWarper, SIGNAL(message(QString)), this, SLOT(warpMessage(QString)));
+    connect(pWarper, SIGNAL(finished()), this, SLOT(warpFinished()));
+
+    // jobs of several layers
+    pLayerRun = new LayerRun(this);
+    connect(pLayerRun, SIGNAL(message(QString)), this, SLOT(layerMessage(QString)));
+    connect(pLayerRun, SIGNAL(output(QString,QByteArray)), this, SLOT(layerOutput(QString,QByteArray)));
+    connect(pLayerRun, SIGNAL(finished(int)), this, SLOT(layersFinished(int)));
+    pCompositor = new LayerCompositor(this);
+    connect(pCompositor, SIGNAL(progress(int,int)), this, SLOT(compositeProgress(int,int)));
+    connect(pCompositor, SIGNAL(finished()), this, SLOT(compositeFinished()));
+
+    // heat map of the tile requests
+    pImporter = new AccessLogImporter(this);
+    connect(pImporter, SIGNAL(progress(int,int)), this, SLOT(heatProgress(int,int)));
+    connect(pImporter, SIGNAL(finished()), this, SLOT(heatFinished()));
+
+    // change manifest of the cache
+    pTracker = new ChangeTracker(this);
+    connect(pTracker, SIGNAL(finished()), this, SLOT(changesFinished()));
+
+    // compare-before-write
+    pStager = new TileStager(this);
+    connect(pStager, SIGNAL(finished()), this, SLOT(stagingFinished()));
+
+    // preview of the cache
+    connect(ui->viewPreview, SIGNAL(status(QString)), ui->labelPreview, SLOT(setText(QString)));
+    connect(ui->pushPreviewReload, SIGNAL(clicked()), ui->viewPreview, SLOT(reload()));
+
+    // dry run
+    pPlanWatcher = new QFutureWatcher<RequestPlan::Summary>(this);
+    connect(pPlanWatcher, SIGNAL(finished()), this, SLOT(dryRunFinished()));
+    pPlanFile = 0;
+
+    // server profiles
+    pProbe = new ServerProbe(this);
+    connect(pProbe, SIGNAL(message(QString)), this, SLOT(probeMessage(QString)));
+    connect(pProbe, SIGNAL(finished(bool)), this, SLOT(probeFinished(bool)));
+    connect(ui->editUrl, SIGNAL(editingFinished()), this, SLOT(profileLookup()));
+    connect(ui->editLayer, SIGNAL(editingFinished()), this, SLOT(profileLookup()));
+    runtiles = 0;
+    runstartms = 0;
+    runok = false;
+    runthreads = runquality = runerrors = 0;
+
+    runstartus = -1;
+    pUpdatesFile = 0;
+    updatesfed = -1;
+
+    // validation while editing
+    pValidator = new JobValidator(this);
+    connect(pValidator, SIGNAL(fieldsChecked()), this, SLOT(markFields()));
+    connect(pValidator, SIGNAL(rowsChecked(QList<int>)), this, SLOT(markRows(QList<int>)));
+    connect(ui->editUrl, SIGNAL(textChanged(QString)), this, SLOT(jobEdited()));
+    connect(ui->editLayer, SIGNAL(textChanged(QString)), this, SLOT(jobEdited()));
+    connect(ui->editBBOX, SIGNAL(textChanged(QString)), this, SLOT(jobEdited()));
+    connect(ui->editRes, SIGNAL(textChanged(QString)), this, SLOT(jobEdited()));
+    connect(ui->editSRS, SIGNAL(textChanged(QString)), this, SLOT(jobEdited()));
+    connect(ui->comboTileSize, SIGNAL(currentIndexChanged(int)), this, SLOT(jobEdited()));
+    connect(ui->tableUpdates, SIGNAL(cellChanged(int,int)), this, SLOT(updateCellChanged(int,int)));
+    syncTableRows();
+    jobEdited();
 }
 
 //----------------------------------------------
@@ -59,48 +173,19 @@ Dialog::~Dialog()
 }
 
 //----------------------------------------------
-void Dialog::on_pushExecute_clicked()
+// turns the job parameters into the tilemaker arguments (without the
+// update regions); the fields have been validated while they were edited
+bool Dialog::jobArguments(QStringList& args)
 {
-    QStringList args;
-
-    if(!validateUrl())
-    {
-        ui->editUrl->setFocus(Qt::ActiveWindowFocusReason);
-        return;
-    }
+    if(!validateField(JobValidator::FieldUrl) || !validateField(JobValidator::FieldLayer) ||
+       !validateGrid() || !validateField(JobValidator::FieldSRS))
+        return false;
 
     args << "--url" << ui->editUrl->text().simplified();
-
-    if(!validateLayer())
-    {
-        ui->editLayer->setFocus(Qt::ActiveWindowFocusReason);
-        return;
-    }
-
     args << "--layer" << ui->editLayer->text().simplified();
-
-    if(!validateBBOX())
-    {
-        ui->editBBOX->setFocus(Qt::ActiveWindowFocusReason);
-        return;
-    }
-
     args << "--bbox" << ui->editBBOX->text().simplified();
-
-    if(!validateResolution())
-    {
-        ui->editRes->setFocus(Qt::ActiveWindowFocusReason);
-        return;
-    }
-
     args << "--res" << ui->editRes->text().simplified();
 
-    if(!validateSRS())
-    {
-        ui->editRes->setFocus(Qt::ActiveWindowFocusReason);
-        return;
-    }
-
     QString ssrs = ui->editSRS->text().simplified();
     if(!ssrs.isEmpty())
         args << "--crs" << ssrs;
@@ -128,20 +213,35 @@ void Dialog::on_pushExecute_clicked()
     if(ui->spinThreads->value() != 1)
         args << "--threads" << QString::number(ui->spinThreads->value());
 
+    if(tileSize() != DEFAULTTILESIZE)
+        args << "--tilesize" << QString::number(tileSize());
+
+    return true;
+}
+
+//----------------------------------------------
+void Dialog::on_pushExecute_clicked()
+{
+    TraceSpan span("execute");
+
+    QStringList args;
+    if(!jobArguments(args))
+        return;
+
+    QStringList layers = LayerSet::parse(ui->editLayer->text());
+    QList<UBox> uboxes;
+
     if(ui->groupUBox->isChecked())
     {
-        if(!validateAndSaveUpdates())
-        {
-            if(fileExists("temp.txt"))
-            {
-                QFile file("temp.txt");
-                file.remove();
-            }
+        if(!validateUpdates(uboxes))
+            return;
 
+        // the tilemakers of several layers read the same file
+        QString source = openUpdatesSource(uboxes, layers.size() > 1);
+        if(source.isEmpty())
             return;
-        }
 
-        args << "--file" << "temp.txt";
+        args << "--file" << source;
     }
 
     ui->pushExecute->setEnabled(false);
@@ -150,8 +250,58 @@ void Dialog::on_pushExecute_clicked()
     ui->textProcessOutput->clear();
     ui->textProcessOutput->setStyleSheet("");
 
+    if(ui->groupUBox->isChecked() && !updatesreport.isEmpty())
+    {
+        ui->textProcessOutput->setTextColor(Qt::darkGreen);
+        ui->textProcessOutput->append(updatesreport);
+    }
+
     QString command = QDir::currentPath() + QDir::separator() + "tilemaker_wms";
 
+    // the regions are validated and optimized once for all layers
+    if(layers.size() > 1)
+    {
+        if((ui->groupUBox->isChecked() && ui->checkStaging->isChecked()) || ui->checkRecordChanges->isChecked())
+        {
+            ui->textProcessOutput->setTextColor(Qt::red);
+            ui->textProcessOutput->append("The layers are written into their caches directly, their changes are not recorded.");
+        }
+
+        pLayerRun->start(command, args, layers, QDir::currentPath(), ui->spinThreads->value(),
+                         grid, uboxes, ui->groupUBox->isChecked());
+        return;
+    }
+
+    // what the run is measured by for the server profile; counting alone
+    // doesn't walk the tiles
+    runtiles = RequestPlan::write(planJob(uboxes), 0).requests;
+    runkey = ProfileStore::key(ui->editUrl->text(), ui->editLayer->text());
+    runthreads = ui->spinThreads->value();
+    runquality = ui->radioJpeg->isChecked() ? ui->spinQuality->value() : 0;
+    runerrors = 0;
+    runclock.start();
+    runstartms = QDateTime::currentMSecsSinceEpoch();
+    runregions = uboxes;
+
+    // the update regions into the staging directory, merged when the run ends
+    runstaging.clear();
+    if(ui->groupUBox->isChecked() && ui->checkStaging->isChecked())
+    {
+        runstaging = TileStager::stagingDir(QDir::currentPath());
+        QDir(runstaging).removeRecursively();
+        if(!QDir().mkpath(runstaging))
+        {
+            ui->textProcessOutput->setTextColor(Qt::red);
+            ui->textProcessOutput->append("Can't create " + runstaging + ", the tiles are written into the cache.");
+            runstaging.clear();
+        }
+    }
+
+    // the staging directory is empty, the tilemaker creates its z/x directories
+    if(!runstaging.isEmpty())
+        args.removeAll("--skipdirs");
+    pTilemaker->setWorkingDirectory(runstaging.isEmpty() ? QDir::currentPath() : runstaging);
+
     pTilemaker->start(command, args);
 }
 
@@ -160,6 +310,13 @@ void Dialog::on_pushExecute_clicked()
 void Dialog::rightMessage()
 {
     QByteArray strdata = pTilemaker->readAllStandardOutput();
+    Tracer::instant("output", "process", strdata.size());
+
+    QList<QByteArray> lines = strdata.toLower().split('\n');
+    for(int i=0; i<lines.size(); i++)
+        if(lines[i].contains("error") || lines[i].contains("exception"))
+            runerrors++;
+
     ui->textProcessOutput->setTextColor(Qt::black);
     ui->textProcessOutput->append(strdata);
 }
@@ -177,7 +334,30 @@ void Dialog::wrongMessage()
 // on finish slot
 void Dialog::on_finish(int exitcode)
 {
-    Q_UNUSED(exitcode)
+    qint64 peakrss = pMonitor->peakRss();
+    qint64 written = pMonitor->writeTotal();
+    pMonitor->stop(true);
+
+    if(runstartus >= 0)
+        Tracer::complete("tilemaker run", "process", runstartus, Tracer::now() - runstartus, exitcode);
+    runstartus = -1;
+
+    if(pTilemaker->exitStatus() == QProcess::CrashExit)
+    {
+        ui->textProcessOutput->setTextColor(Qt::red);
+        ui->textProcessOutput->append("The tilemaker has been terminated (crash or break).");
+    }
+    else if(exitcode != 0)
+    {
+        ui->textProcessOutput->setTextColor(Qt::red);
+        ui->textProcessOutput->append("The tilemaker has finished with the exit code " + QString::number(exitcode) + ".");
+    }
+
+    if(peakrss > 0)
+    {
+        ui->textProcessOutput->setTextColor(Qt::black);
+        ui->textProcessOutput->append("Peak RSS: " + QString::number(peakrss >> 20) + " MB");
+    }
 
     ui->pushBreak->setEnabled(false);
     ui->pushExecute->setEnabled(true);
@@ -185,503 +365,1215 @@ void Dialog::on_finish(int exitcode)
 
     ui->textProcessOutput->setStyleSheet("background-image: url(:/icons/glonass_f.png);");
 
-    if(fileExists("temp.txt"))
+    closeUpdatesSource();
+
+    if(exitcode == 0 && pTilemaker->exitStatus() == QProcess::NormalExit && runtiles > 0)
     {
-        QFile file("temp.txt");
-        file.remove();
+        ProfileStore::recordRun(runkey, runthreads, runquality, runtiles, runclock.elapsed(),
+                                runquality > 0 ? written : 0, runerrors);
+        if(runkey == profilekey)
+            profileLookup();
     }
+    runtiles = 0;
+
+    runok = exitcode == 0 && pTilemaker->exitStatus() == QProcess::NormalExit;
+
+    // the staged tiles of a broken run are good as well
+    if(!runstaging.isEmpty())
+    {
+        ui->pushExecute->setEnabled(false);
+        ui->textProcessOutput->setTextColor(Qt::black);
+        ui->textProcessOutput->append("Merging the changed tiles into the cache ...");
+        pStager->start(runstaging, QDir::currentPath(), grid, runregions, ui->checkComparePixels->isChecked());
+        return;
+    }
+
+    afterRun(runok);
 }
 
 //----------------------------------------------
-// on finish slot
-void Dialog::on_pushBreak_clicked()
+// the run's tiles are in the cache
+void Dialog::afterRun(bool bOK)
 {
-    pTilemaker->kill();
-    ui->pushBreak->setEnabled(false);
-    ui->pushExecute->setEnabled(true);
-    ui->pushExecute->setFocus();
+    ui->viewPreview->reload();
+
+    if(ui->checkVerifyAfterRun->isChecked() && bOK)
+        ui->pushVerify->setChecked(true);
+
+    // a broken run has changed tiles as well
+    if(ui->checkRecordChanges->isChecked() && !pTracker->isRunning())
+    {
+        QString format = ui->radioJpeg->isChecked() ? "jpeg" : ui->radioPng->isChecked() ? "png" : "gif";
+        pTracker->start(QDir::currentPath(), grid, runregions, format, runstartms);
+    }
 }
 
+//----------------------------------------------
+void Dialog::stagingFinished()
+{
+    ui->textProcessOutput->setTextColor(Qt::darkGreen);
+    ui->textProcessOutput->append(pStager->report());
+    showArenaUsage();
 
+    runstaging.clear();
+    ui->pushExecute->setEnabled(true);
+    afterRun(runok);
+}
 
-//==============================================
-// set of private manual functions
+//----------------------------------------------
+void Dialog::changesFinished()
+{
+    ui->textProcessOutput->setTextColor(Qt::darkGreen);
+    ui->textProcessOutput->append(pTracker->report());
+}
 
 //----------------------------------------------
-bool Dialog::fileExists(const QString& path)
+// the tilemaker is running - start monitoring it
+void Dialog::processStarted()
 {
-    QFileInfo check_file(path);
-    return check_file.exists() && check_file.isFile();
+    ui->graphResources->clear();
+    updateBudget();
+    pMonitor->start(pTilemaker->processId());
+
+    runstartus = Tracer::isEnabled() ? Tracer::now() : -1;
+
+    if(updatesfed >= 0)
+        feedUpdates();
+    else
+        pTilemaker->closeWriteChannel();
 }
 
 //----------------------------------------------
-bool Dialog::validateUrl()
+// Where the tilemaker reads the update regions from. On Unix they are
+// streamed into its stdin by feedUpdates() once it is running; elsewhere,
+// or if several tilemakers read them ('bshared'), they go to a unique
+// per-job file which is removed when the job ends.
+QString Dialog::openUpdatesSource(const QList<UBox>& uboxes, bool bshared)
 {
-    QString surl = ui->editUrl->text().simplified();
-    if(surl.isEmpty())
+    closeUpdatesSource(); // left over if the previous start has failed
+
+#ifdef Q_OS_UNIX
+    if(!bshared)
     {
-        QMessageBox::warning(this, "Irregular Input Data",
-                             "The caching cannot start if the URL of WMS server is not set.\n\nEnter the URL, please.");
-        return false;
+        pendingupdates = uboxes;
+        updatesfed = 0;
+        return "/dev/stdin";
     }
+#else
+    Q_UNUSED(bshared);
+#endif
 
-    if(surl.contains(" "))
+    pUpdatesFile = new QTemporaryFile(QDir::tempPath() + QDir::separator() + "tilemaker_updates_XXXXXX.txt", this);
+    if(!pUpdatesFile->open())
     {
-        QMessageBox::warning(this, "Irregular Input Data",
-                             "The caching will not start because of invalid URL (two strings instead of just one).\n\nCorrect the data, please.");
-        return false;
+        QMessageBox::warning(this, "Error", "Cannnot open the temporary updates-file for writing.");
+        closeUpdatesSource();
+        return QString();
     }
 
-    return true;
+    QTextStream out(pUpdatesFile);
+    for(int i = 0; i<uboxes.size(); i++)
+        out << JobIO::formatUBox(uboxes[i]) << "\n";
+
+    out.flush();
+    pUpdatesFile->close();
+
+    return pUpdatesFile->fileName();
 }
 
 //----------------------------------------------
-bool Dialog::validateLayer()
+// Writes the next part of the pending update regions into the tilemaker's
+// stdin. It is called again on every bytesWritten(), so no more than about
+// UPDATESBUFFER bytes wait in the pipe buffer at any time.
+void Dialog::feedUpdates()
 {
-    QString slayer = ui->editLayer->text().simplified();
-    if(slayer.isEmpty())
+    const qint64 UPDATESBUFFER = 64*1024;
+
+    if(updatesfed < 0 || pTilemaker->state() != QProcess::Running)
+        return;
+
+    while(updatesfed < pendingupdates.size() && pTilemaker->bytesToWrite() < UPDATESBUFFER)
     {
-        QMessageBox::warning(this, "Irregular Input Data",
-                             "The caching cannot start if the WMS layer is not set.\n\nEnter the layer, please.");
-        return false;
+        QByteArray chunk;
+        for(int n = 0; n<256 && updatesfed < pendingupdates.size(); n++)
+            chunk += JobIO::formatUBox(pendingupdates[updatesfed++]).toLatin1() + '\n';
+
+        pTilemaker->write(chunk);
     }
 
-    if(slayer.contains(" "))
+    if(updatesfed == pendingupdates.size())
     {
-        QMessageBox::warning(this, "Irregular Input Data",
-                             "The caching will not start because of invalid 'layer' (two strings instead of just one).\n\nCorrect the data, please.");
-        return false;
+        pTilemaker->closeWriteChannel();
+        pendingupdates.clear();
+        updatesfed = -1;
     }
-
-    return true;
 }
 
 //----------------------------------------------
-bool Dialog::validateResolution()
+void Dialog::closeUpdatesSource()
 {
-    bool bretval;
+    pendingupdates.clear();
+    updatesfed = -1;
 
-    QString sres = ui->editRes->text().simplified();
-    if(sres.isEmpty())
+    if(pUpdatesFile)
     {
-        QMessageBox::warning(this, "Irregular Input Data",
-                             "The caching cannot start if the resolution is not set.\n\nEnter the resolution, please.");
-        return false;
+        delete pUpdatesFile; // removes the file
+        pUpdatesFile = 0;
+    }
+}
+
+//----------------------------------------------
+// start/stop the capture; the captured trace is saved right away
+void Dialog::on_pushTrace_toggled(bool checked)
+{
+    if(checked)
+    {
+        Tracer::start();
+        Tracer::setThreadName("GUI");
+
+        // a capture started on a live job still gets the (partial) run span
+        if(pTilemaker->state() == QProcess::Running)
+            runstartus = Tracer::now();
+        return;
     }
 
-    dhres = sres.toDouble(&bretval);
-    if(!bretval)
-        QMessageBox::warning(this, "Irregular Input Data",
-                             "The caching will not start because\nthe resolution is not valid.\n\nCorrect the data, please.");
+    if(runstartus >= 0)
+        Tracer::complete("tilemaker run", "process", runstartus, Tracer::now() - runstartus);
+    runstartus = -1;
 
-    double hspan = dright - dleft;
-    double wspan = dtop - dbottom;
-    double minspan = hspan < wspan ? hspan : wspan;
+    Tracer::stop();
+
+    QString filename = QFileDialog::getSaveFileName(this, tr("Save Trace As ..."),
+                                                    QDir::currentPath(),
+                                                    tr("Chrome Trace (*.json);;All files (*.*)"));
+    if(filename.isEmpty())
+        return;
 
-    dlres = minspan * 2.0 / TILESIZE;
+    if(!filename.endsWith(".json"))
+        filename += ".json";
 
-    return bretval;
+    QString error;
+    if(!Tracer::dump(filename, &error))
+        QMessageBox::warning(this, "Error", "Cannnot save the trace.\n\n" + error);
 }
 
 //----------------------------------------------
-bool Dialog::validateBBOX()
+void Dialog::on_pushTraceLoad_clicked()
 {
-    QString sbbox = ui->editBBOX->text().simplified();
-    if(sbbox.isEmpty())
-    {
-        QMessageBox::warning(this, "Irregular Input Data",
-                             "The caching cannot start if the bounding box (BBOX) is not set.\n\nEnter the BBOX, please.");
-        return false;
-    }
+    QString filename = QFileDialog::getOpenFileName(this, tr("Load Trace"),
+                                                    QDir::currentPath(),
+                                                    tr("Chrome Trace (*.json);;All files (*.*)"));
+    if(filename.isEmpty())
+        return;
 
-    QStringList strlist;
-    strlist = sbbox.split(",");
-    if(strlist.size()!=4)
+    QString error;
+    QString summary = Tracer::summary(filename, &error);
+    if(summary.isEmpty())
     {
-        QMessageBox::warning(this, "Irregular Input Data",
-                             "The bounding box (BBOX) is not valid.\nIt should have 4 parameters (left, bottom, right, top), but it is not so?!\n\nCorrect the data, please.");
-        return false;
+        QMessageBox::warning(this, "Error Reading File", "File " + filename + " is not a regular trace file!?\n\n" + error);
+        return;
     }
 
-    bool bretval;
+    ui->tabRight->setCurrentWidget(ui->tabOutput);
+    ui->textProcessOutput->setTextColor(Qt::black);
+    ui->textProcessOutput->append("<pre>" + summary.toHtmlEscaped() + "</pre>");
+}
+
+//----------------------------------------------
+void Dialog::governorMessage(const QString& msg)
+{
+    ui->textProcessOutput->setTextColor(Qt::darkYellow);
+    ui->textProcessOutput->append(msg);
+}
+
+//----------------------------------------------
+// the budget may be changed while the tilemaker is running
+void Dialog::updateBudget()
+{
+    pMonitor->setInterval(ui->spinInterval->value());
 
-    dleft = strlist[0].trimmed().toDouble(&bretval);
-    if(!bretval)
+    ProcBudget budget;
+    if(ui->groupGovernor->isChecked())
     {
-        QMessageBox::warning(this, "Irregular Input Data",
-                             "The caching will not start because\nthe BBOX.left is not valid.\n\nCorrect the data, please.");
-        return false;
+        budget.nice = ui->spinNice->value();
+        budget.idleio = ui->checkIdleIO->isChecked();
+        budget.cpulimit = ui->spinCpuLimit->value();
+        budget.rsslimit = qint64(ui->spinRssLimit->value()) << 20;
+        budget.iolimit = qint64(ui->spinIoLimit->value()) << 20;
+        budget.cgroup = ui->editCgroup->text().simplified();
     }
 
-    dbottom = strlist[1].trimmed().toDouble(&bretval);
-    if(!bretval)
+    pMonitor->setBudget(budget);
+}
+
+//----------------------------------------------
+// on finish slot
+void Dialog::on_pushBreak_clicked()
+{
+    pTilemaker->kill();
+    pLayerRun->stop();
+    pCompositor->cancel();
+    ui->pushBreak->setEnabled(false);
+    ui->pushExecute->setEnabled(true);
+    ui->pushExecute->setFocus();
+}
+
+//----------------------------------------------
+// start/stop a distributed job; the work units are the update regions if
+// there are any, otherwise the BBOX cut along the tiles of the split level
+void Dialog::on_pushDistribute_toggled(bool checked)
+{
+    if(!checked)
     {
-        QMessageBox::warning(this, "Irregular Input Data",
-                             "The caching will not start because\nthe BBOX.bottom is not valid.\n\nCorrect the data, please.");
-        return false;
+        if(pCoordinator->isRunning())
+        {
+            clusterMessage("The distributed job has been stopped.\n" + pCoordinator->report());
+            pCoordinator->stop();
+        }
+        ui->pushExecute->setEnabled(true);
+        return;
     }
 
-    dright = strlist[2].trimmed().toDouble(&bretval);
-    if(!bretval)
+    TraceSpan span("distribute");
+
+    QStringList args;
+    QList<UBox> units;
+
+    bool bOK = jobArguments(args);
+    if(bOK && ui->groupUBox->isChecked())
+        bOK = validateUpdates(units);
+    else if(bOK)
+        units = ClusterPlan::split(grid, ui->spinSplitLevel->value());
+
+    if(bOK && units.isEmpty())
     {
-        QMessageBox::warning(this, "Irregular Input Data",
-                             "The caching will not start because\nthe BBOX.right is not valid.\n\nCorrect the data, please.");
-        return false;
+        QMessageBox::warning(this, "Irregular Input Data", "There is nothing to distribute?!");
+        bOK = false;
     }
 
-    dtop = strlist[3].trimmed().toDouble(&bretval);
-    if(!bretval)
+    // a token for the workers of this machine only
+    if(ui->editToken->text().simplified().isEmpty())
+        ui->editToken->setText(ClusterPlan::nonce());
+    QByteArray token = ui->editToken->text().simplified().toUtf8();
+
+    QString error;
+    if(bOK && !pCoordinator->start(ui->spinPort->value(), token, args, units, ui->spinLease->value(), &error))
     {
-        QMessageBox::warning(this, "Irregular Input Data",
-                             "The caching will not start because\nthe BBOX.top is not valid.\n\nCorrect the data, please.");
-        return false;
+        QMessageBox::warning(this, "Error", error);
+        bOK = false;
     }
 
-    if(dleft >= dright)
+    if(!bOK)
     {
-        QMessageBox::warning(this, "Irregular Input Data",
-                             "The caching will not start because\nBBOX.left should be less than BBOX.right, but it is not so?!\n\nCorrect the data, please.");
-        return false;
+        ui->pushDistribute->blockSignals(true);
+        ui->pushDistribute->setChecked(false);
+        ui->pushDistribute->blockSignals(false);
+        return;
     }
 
-    if(dbottom >= dtop)
+    ui->pushExecute->setEnabled(false);
+    ui->textProcessOutput->clear();
+    ui->textProcessOutput->setStyleSheet("");
+
+    if(ui->groupUBox->isChecked() && !updatesreport.isEmpty())
     {
-        QMessageBox::warning(this, "Irregular Input Data",
-                             "The caching will not start because\nBBOX.bottom should be less than BBOX.top, but it is not so?!\n\nCorrect the data, please.");
-        return false;
+        ui->textProcessOutput->setTextColor(Qt::darkGreen);
+        ui->textProcessOutput->append(updatesreport);
     }
 
-    return true;
+    // workers on this machine; the token goes through their environment only - not the
+    // (visible) command line, nor this process and the tilemakers it starts later
+    QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
+    env.insert(ClusterPlan::TOKENVARIABLE, QString::fromUtf8(token));
+
+    QStringList workerargs;
+    workerargs << "--worker" << "127.0.0.1:" + QString::number(ui->spinPort->value());
+
+    QProcess worker;
+    worker.setProgram(QCoreApplication::applicationFilePath());
+    worker.setArguments(workerargs);
+    worker.setProcessEnvironment(env);
+    for(int i=0; i<ui->spinLocalWorkers->value(); i++)
+        worker.startDetached();
 }
 
 //----------------------------------------------
-bool Dialog::validateSRS()
+void Dialog::clusterProgress(int done, int failed, int total)
 {
-    QString ssrs = ui->editSRS->text().simplified();
-    if(ssrs.contains(" "))
-    {
-        QMessageBox::warning(this, "Irregular Input Data",
-                             "The caching will not start because of invalid SRS (two strings instead of just one).\n\nCorrect the data, please.");
-        return false;
-    }
+    QString text = QString::number(done) + " / " + QString::number(total) + " units";
+    if(failed > 0)
+        text += ", " + QString::number(failed) + " failed";
 
-    return true;
+    ui->labelCluster->setText(text);
 }
 
-//----------------------------------------------------------
-QString Dialog::validateUpdateRow(int row,
-                                  double left, double bottom, double right, double top,
-                                  double minres, double maxres)
-{
-    bool bOK;
-    QString srow = QString::number(row);
-    QString sleft, sbottom, sright, stop, shres, slres, sfitres;
-    double  dleft, dbottom, dright, dtop, dhres, dlres, dfitres;
-
-    QTableWidgetItem* itemleft = ui->tableUpdates->item(row, 0);
-    QTableWidgetItem* itembottom = ui->tableUpdates->item(row, 1);
-    QTableWidgetItem* itemright = ui->tableUpdates->item(row, 2);
-    QTableWidgetItem* itemtop = ui->tableUpdates->item(row, 3);
-
-    QTableWidgetItem* itemhres = ui->tableUpdates->item(row, 4);
-    QTableWidgetItem* itemlres = ui->tableUpdates->item(row, 5);
-    QTableWidgetItem* itemfitres = ui->tableUpdates->item(row, 6);
-
-    bool bEmptyRegion = (!itemleft || itemleft->text().simplified().isEmpty()) &&
-                        (!itembottom || itembottom->text().simplified().isEmpty()) &&
-                        (!itemright || itemright->text().simplified().isEmpty()) &&
-                        (!itemtop || itemtop->text().simplified().isEmpty());
-
-    bool bEmptyRow =bEmptyRegion &&
-                    (!itemhres || itemhres->text().simplified().isEmpty()) &&
-                    (!itemlres || itemlres->text().simplified().isEmpty()) &&
-                    (!itemfitres || itemfitres->text().simplified().isEmpty());
-
-    if(bEmptyRow)
-        return "empty";
-    else if(bEmptyRegion)
+//----------------------------------------------
+void Dialog::clusterMessage(const QString& msg)
+{
+    ui->textProcessOutput->setTextColor(Qt::darkGreen);
+    ui->textProcessOutput->append(msg);
+}
+
+//----------------------------------------------
+void Dialog::clusterFinished(bool bOK)
+{
+    if(!bOK)
     {
-        ui->tableUpdates->setFocus();
-        ui->tableUpdates->selectRow(row);
-        return "Error at UBOX " + srow + ": Not all the mandatory values (left,bottom,right,top) have been set?!";
+        ui->textProcessOutput->setTextColor(Qt::red);
+        ui->textProcessOutput->append("The distributed job has finished with failed units.");
     }
 
-    // tho following is for - no bEmptyRow and no bEmptyRegion
+    ui->pushDistribute->blockSignals(true);
+    ui->pushDistribute->setChecked(false);
+    ui->pushDistribute->blockSignals(false);
+    ui->pushExecute->setEnabled(true);
 
-    //------ left ------------
-    if(!itemleft || itemleft->text().simplified().isEmpty())
-    {
-        ui->tableUpdates->setFocus();
-        ui->tableUpdates->setCurrentCell(row,0);
-        return "Error at UBOX " + srow + ":  there is no 'left' parameter?!";
-    }
-    else
-    {
-        sleft = itemleft->text().simplified();
-        dleft = sleft.toDouble(&bOK);
-        if(!bOK)
-        {
-            ui->tableUpdates->setFocus();
-            ui->tableUpdates->setCurrentCell(row,0);
-            return "Error at UBOX " + srow + ":  the 'left' parameter is not valid?!";
-        }
+    ui->textProcessOutput->setStyleSheet("background-image: url(:/icons/glonass_f.png);");
+}
 
-        sleft = QString::number(dleft,'g',8); // thus, sleft may be a bit more formatted
-    }
 
-    //------ bottom ------------
-    if(!itembottom || itembottom->text().simplified().isEmpty())
+
+//----------------------------------------------
+// the request plan of the current job; it is written in a pool thread
+// (it may have hundreds of millions of lines), toggling again cancels it
+void Dialog::on_pushDryRun_toggled(bool checked)
+{
+    if(!checked)
     {
-        ui->tableUpdates->setFocus();
-        ui->tableUpdates->setCurrentCell(row,1);
-        return "Error at UBOX " + srow + ":  there is no 'bottom' parameter?!";
+        plancancel.store(1);
+        return;
     }
-    else
-    {
-        sbottom = itembottom->text().simplified();
-        dbottom = sbottom.toDouble(&bOK);
-        if(!bOK)
-        {
-            ui->tableUpdates->setFocus();
-            ui->tableUpdates->setCurrentCell(row,1);
-            return "Error at UBOX " + srow + ":  the 'bottom' parameter is not valid?!";
-        }
 
-        sbottom = QString::number(dbottom,'g',8); // thus, sbottom may be a bit more formatted
-    }
+    TraceSpan span("dry run");
 
-    //------ right ------------
-    if(!itemright || itemright->text().simplified().isEmpty())
-    {
-        ui->tableUpdates->setFocus();
-        ui->tableUpdates->setCurrentCell(row,2);
-        return "Error at UBOX " + srow + ":  there is no 'right' parameter?!";
-    }
-    else
-    {
-        sright = itemright->text().simplified();
-        dright = sright.toDouble(&bOK);
-        if(!bOK)
-        {
-            ui->tableUpdates->setFocus();
-            ui->tableUpdates->setCurrentCell(row,2);
-            return "Error at UBOX " + srow + ":  the 'right' parameter is not valid?!";
-        }
+    QStringList args;
+    QList<UBox> uboxes;
 
-        sright = QString::number(dright,'g',8); // thus, sright may be a bit more formatted
-    }
+    bool bOK = jobArguments(args) && (!ui->groupUBox->isChecked() || validateUpdates(uboxes));
 
-    //------ top ------------
-    if(!itemtop || itemtop->text().simplified().isEmpty())
-    {
-        ui->tableUpdates->setFocus();
-        ui->tableUpdates->setCurrentCell(row,3);
-        return "Error at UBOX " + srow + ":  there is no 'top' parameter?!";
-    }
-    else
+    QString filename;
+    if(bOK)
     {
-        stop = itemtop->text().simplified();
-        dtop = stop.toDouble(&bOK);
-        if(!bOK)
+        filename = QFileDialog::getSaveFileName(this, tr("Save the Request Plan (Cancel - Count Only)"),
+                                                "", tr("Request plan (*.tsv);;All files (*)"));
+        if(!filename.isEmpty())
         {
-            ui->tableUpdates->setFocus();
-            ui->tableUpdates->setCurrentCell(row,3);
-            return "Error at UBOX " + srow + ":  the 'top' parameter is not valid?!";
+            pPlanFile = new QFile(filename);
+            if(!pPlanFile->open(QIODevice::WriteOnly))
+            {
+                QMessageBox::warning(this, "Error", "Cannot open " + filename + " for writing.");
+                delete pPlanFile;
+                pPlanFile = 0;
+                bOK = false;
+            }
         }
-
-        stop = QString::number(dtop,'g',8); // thus, stop may be a bit more formatted
     }
 
-    //------ logical inconsistencies ------------
-    if(dleft >= dright)
-    {
-        ui->tableUpdates->setFocus();
-        ui->tableUpdates->setCurrentCell(row,2);
-        return "Error at UBOX " + srow + ":  the 'left' parameter is bigger than the 'right' parameter?!";
-    }
-    if(dbottom >= dtop)
+    if(!bOK)
     {
-        ui->tableUpdates->setFocus();
-        ui->tableUpdates->setCurrentCell(row,3);
-        return "Error at UBOX " + srow + ":  the 'bottom' parameter is bigger than the 'top' parameter?!";
+        ui->pushDryRun->blockSignals(true);
+        ui->pushDryRun->setChecked(false);
+        ui->pushDryRun->blockSignals(false);
+        return;
     }
 
-    if(dleft < left)
-    {
-        ui->tableUpdates->setFocus();
-        ui->tableUpdates->setCurrentCell(row,0);
-        return "Error at UBOX " + srow + ":  the 'left' parameter is less than the BBOX.left parameter?!";
-    }
-    if(dbottom < bottom)
-    {
-        ui->tableUpdates->setFocus();
-        ui->tableUpdates->setCurrentCell(row,1);
-        return "Error at UBOX " + srow + ":  the 'bottom' parameter is less than the BBOX.bottom parameter?!";
-    }
-    if(dright > right)
-    {
-        ui->tableUpdates->setFocus();
-        ui->tableUpdates->setCurrentCell(row,2);
-        return "Error at UBOX " + srow + ":  the 'right' parameter is bigger than the BBOX.right parameter?!";
-    }
-    if(dtop > top)
-    {
-        ui->tableUpdates->setFocus();
-        ui->tableUpdates->setCurrentCell(row,3);
-        return "Error at UBOX " + srow + ":  the 'top' parameter is bigger than the BBOX.top parameter?!";
-    }
+    ui->textProcessOutput->setTextColor(Qt::black);
+    ui->textProcessOutput->append(filename.isEmpty() ? QString("Counting the requests ...") :
+                                                       "Writing the request plan to " + filename + " ...");
 
-    // resolutions
+    // the regions in the order of the run (the heat map is not a part of the job file)
+    plancancel.store(0);
+    pPlanWatcher->setFuture(QtConcurrent::run(RequestPlan::write, planJob(uboxes), (QIODevice*)pPlanFile, (const QAtomicInt*)&plancancel));
+}
 
-    bool bhres = itemhres && !itemhres->text().simplified().isEmpty();
-    if(bhres)
+//----------------------------------------------
+void Dialog::dryRunFinished()
+{
+    if(pPlanFile)
     {
-        shres = itemhres->text().simplified();
-        dhres = shres.toDouble(&bOK);
-        if(!bOK)
-        {
-            ui->tableUpdates->setFocus();
-            ui->tableUpdates->setCurrentCell(row,4);
-            return "Error at UBOX " + srow + ":  the 'high resolution' parameter is not valid?!";
-        }
+        pPlanFile->close();
+        delete pPlanFile;
+        pPlanFile = 0;
+    }
 
-        if(dhres < minres)
-        {
-            ui->tableUpdates->setFocus();
-            ui->tableUpdates->setCurrentCell(row,4);
-            return "Error at UBOX " + srow + ":  the 'high resolution' parameter is better than general resolution?!";
-        }
+    ui->pushDryRun->blockSignals(true);
+    ui->pushDryRun->setChecked(false);
+    ui->pushDryRun->blockSignals(false);
 
-        if(dhres > maxres)
-        {
-            ui->tableUpdates->setFocus();
-            ui->tableUpdates->setCurrentCell(row,4);
-            return "Error at UBOX " + srow + ":  the 'high resolution' parameter is too low?!";
-        }
+    ui->textProcessOutput->setTextColor(Qt::darkGreen);
+    ui->textProcessOutput->append(RequestPlan::report(pPlanWatcher->result()));
+}
 
-        shres = QString::number(dhres); // thus, shres may be a bit more formatted
-    }
-    else
-        shres = "";
+//----------------------------------------------
+// the profile of the entered server and layer; its recommendations are
+// applied when the server changes
+void Dialog::profileLookup()
+{
+    QString key = ProfileStore::key(ui->editUrl->text(), ui->editLayer->text());
+    bool bchanged = key != profilekey;
+    profilekey = key;
 
-    bool blres = itemlres && !itemlres->text().simplified().isEmpty();
-    if(blres)
+    ServerProfile profile;
+    if(!ProfileStore::load(key, profile))
     {
-        if(!bhres)
-        {
-            ui->tableUpdates->setFocus();
-            ui->tableUpdates->setCurrentCell(row,4);
-            return "Error at UBOX " + srow + ":  there is 'low resolution' but there is no 'high resolution'?!";
-        }
+        ui->labelProfile->setText("No profile of " + key + " yet.");
+        return;
+    }
 
-        slres = itemlres->text().simplified();
-        dlres = slres.toDouble(&bOK);
-        if(!bOK)
-        {
-            ui->tableUpdates->setFocus();
-            ui->tableUpdates->setCurrentCell(row,5);
-            return "Error at UBOX " + srow + ":  the 'low resolution' parameter is not valid?!";
-        }
+    showProfile(profile);
 
-        if(dlres < dhres)
-        {
-            ui->tableUpdates->setFocus();
-            ui->tableUpdates->setCurrentCell(row,5);
-            return "Error at UBOX " + srow + ":  the 'low resolution' is better than 'the high' resolution?!";
-        }
+    if(bchanged && ui->checkAutoProfile->isChecked() && pTilemaker->state() == QProcess::NotRunning)
+        on_pushApplyProfile_clicked();
+}
+
+//----------------------------------------------
+void Dialog::showProfile(const ServerProfile& profile)
+{
+    ui->labelProfile->setText(profile.describe());
+}
+
+//----------------------------------------------
+void Dialog::on_pushApplyProfile_clicked()
+{
+    ServerProfile profile;
+    ProfileStore::load(ProfileStore::key(ui->editUrl->text(), ui->editLayer->text()), profile);
+
+    int threads = profile.recommendedThreads();
+    if(threads > 0)
+        ui->spinThreads->setValue(threads);
 
-        if(dlres > maxres)
+    int quality = profile.recommendedQuality();
+    if(quality > 0)
+        ui->spinQuality->setValue(quality);
+}
+
+//----------------------------------------------
+// calibration of the server with sample requests of the current job
+void Dialog::on_pushProbe_toggled(bool checked)
+{
+    if(!checked)
+    {
+        if(pProbe->isRunning())
         {
-            ui->tableUpdates->setFocus();
-            ui->tableUpdates->setCurrentCell(row,5);
-            return "Error at UBOX " + srow + ":  the 'low resolution' parameter is too low?!";
+            pProbe->cancel();
+            ui->textProcessOutput->setTextColor(Qt::red);
+            ui->textProcessOutput->append("The probe has been cancelled.");
         }
+        return;
+    }
+
+    QStringList args;
+    QList<UBox> uboxes;
 
-        slres = QString::number(dlres,'g',8); // thus, slres may be a bit more formatted
+    bool bOK = jobArguments(args) && (!ui->groupUBox->isChecked() || validateUpdates(uboxes));
+
+    if(!bOK)
+    {
+        ui->pushProbe->blockSignals(true);
+        ui->pushProbe->setChecked(false);
+        ui->pushProbe->blockSignals(false);
+        return;
     }
-    else
-        slres = "";
 
-    bool bfitres = itemfitres && !itemfitres->text().simplified().isEmpty();
-    if(bfitres)
+    profilekey = ProfileStore::key(ui->editUrl->text(), ui->editLayer->text());
+
+    ui->textProcessOutput->setTextColor(Qt::black);
+    ui->textProcessOutput->append("Probing " + profilekey + " ...");
+
+    pProbe->start(profilekey, RequestPlan::sample(planJob(uboxes), 200), ui->spinThreads->maximum());
+}
+
+//----------------------------------------------
+void Dialog::probeMessage(const QString& msg)
+{
+    ui->textProcessOutput->setTextColor(Qt::black);
+    ui->textProcessOutput->append(msg);
+}
+
+//----------------------------------------------
+void Dialog::probeFinished(bool bOK)
+{
+    ui->pushProbe->blockSignals(true);
+    ui->pushProbe->setChecked(false);
+    ui->pushProbe->blockSignals(false);
+
+    if(!bOK)
     {
-        if(!blres)
-        {
-            ui->tableUpdates->setFocus();
-            ui->tableUpdates->setCurrentCell(row,5);
-            return "Error at UBOX " + srow + ":  there is 'fitting resolution' but there is no 'low resolution'?!";
-        }
+        ui->textProcessOutput->setTextColor(Qt::red);
+        ui->textProcessOutput->append("The probe has failed - no requests to send.");
+        return;
+    }
 
-        sfitres = itemfitres->text().simplified();
-        dfitres = sfitres.toDouble(&bOK);
-        if(!bOK)
-        {
-            ui->tableUpdates->setFocus();
-            ui->tableUpdates->setCurrentCell(row,6);
-            return "Error at UBOX " + srow + ":  the 'fitting resolution' parameter is not valid?!";
-        }
+    showProfile(pProbe->profile());
+
+    ui->textProcessOutput->setTextColor(Qt::darkGreen);
+    ui->textProcessOutput->append(pProbe->profile().describe());
+}
+
+//----------------------------------------------
+// start/cancel the verification of the tile tree
+void Dialog::on_pushVerify_toggled(bool checked)
+{
+    if(!checked)
+    {
+        if(pVerifier->isRunning())
+            pVerifier->cancel();
+        return;
+    }
+
+    QString root = ui->editVerifyRoot->text().simplified();
+    if(root.isEmpty())
+        root = QDir::currentPath();
+
+    bool bOK = validateGrid();
+    if(bOK && !QDir(root).exists())
+    {
+        QMessageBox::warning(this, "Irregular Input Data", "The directory '" + root + "' doesn't exist?!");
+        bOK = false;
+    }
 
-        if(dfitres < dhres || dfitres > dlres)
+    QVector<QRgb> errorcolors;
+    QStringList colors = ui->editErrorColors->text().split(",", QString::SkipEmptyParts);
+    for(int i=0; bOK && i<colors.size(); i++)
+    {
+        QColor color(colors[i].trimmed());
+        if(color.isValid())
+            errorcolors.append(color.rgba());
+        else
         {
-            ui->tableUpdates->setFocus();
-            ui->tableUpdates->setCurrentCell(row,6);
-            return "Error at UBOX " + srow + ":  the 'fitting resolution' parameter is not between 'high resolution' and 'low resolution'?!";
+            QMessageBox::warning(this, "Irregular Input Data", "'" + colors[i].trimmed() + "' isn't a color (#rrggbb)?!");
+            bOK = false;
         }
+    }
 
-        sfitres = QString::number(dfitres,'g',8); // thus, sleft may be a bit more formatted
+    if(!bOK)
+    {
+        ui->pushVerify->blockSignals(true);
+        ui->pushVerify->setChecked(false);
+        ui->pushVerify->blockSignals(false);
+        return;
     }
-    else
-        sfitres = "";
 
-    QString sretval = sleft + "," + sbottom + "," + sright + "," + stop;
+    QRgb background = ui->radioWhite->isChecked() ? qRgb(255, 255, 255) :
+                      ui->radioBlack->isChecked() ? qRgb(0, 0, 0) : qRgba(0, 0, 0, 0);
+
+    ui->progressVerify->setValue(0);
+    ui->textProcessOutput->setTextColor(Qt::black);
+    ui->textProcessOutput->append("Verifying the tiles in " + root + " ...");
+
+    pVerifier->start(root, grid, background, errorcolors);
+}
+
+//----------------------------------------------
+void Dialog::on_pushVerifyBrowse_clicked()
+{
+    QString dir = QFileDialog::getExistingDirectory(this, tr("Tile Cache Directory"), ui->editVerifyRoot->text());
+    if(!dir.isEmpty())
+        ui->editVerifyRoot->setText(dir);
+}
+
+//----------------------------------------------
+void Dialog::verifyProgress(int done, int total)
+{
+    ui->progressVerify->setMaximum(qMax(1, total));
+    ui->progressVerify->setValue(done);
+}
+
+//----------------------------------------------
+// the bad tiles become the update regions
+void Dialog::verifyFinished()
+{
+    ui->pushVerify->blockSignals(true);
+    ui->pushVerify->setChecked(false);
+    ui->pushVerify->blockSignals(false);
+
+    ui->textProcessOutput->setTextColor(Qt::darkGreen);
+    ui->textProcessOutput->append(pVerifier->report());
+    showArenaUsage();
 
-    if(!shres.isEmpty())
-        sretval += "," + shres;
+    QList<UBox> regions = pVerifier->badRegions();
+    if(regions.isEmpty())
+        return;
 
-    if(!slres.isEmpty())
-        sretval += "," + slres;
+    QList<QStringList> rows;
+    for(int i=0; i<regions.size(); i++)
+        rows.append(JobIO::formatUBox(regions[i]).split(","));
 
-    if(!sfitres.isEmpty())
-        sretval += "," + sfitres;
+    setTableRows(rows);
+    ui->groupUBox->setChecked(true);
 
-    return sretval;
+    ui->textProcessOutput->setTextColor(Qt::red);
+    ui->textProcessOutput->append(QString::number(regions.size()) + " update regions for re-fetching the bad tiles have been set.");
 }
 
 //----------------------------------------------
-bool Dialog::validateAndSaveUpdates()
+// start/cancel the recompression of the tile tree (the cache of the Verify group)
+void Dialog::on_pushOptimize_toggled(bool checked)
 {
-    QFile outfile("temp.txt");
-    if (outfile.open(QIODevice::WriteOnly))
+    if(!checked)
+    {
+        if(pOptimizer->isRunning())
+            pOptimizer->cancel();
+        return;
+    }
+
+    QString root = ui->editVerifyRoot->text().simplified();
+    if(root.isEmpty())
+        root = QDir::currentPath();
+
+    bool bOK = validateGrid();
+    if(bOK && !QDir(root).exists())
+    {
+        QMessageBox::warning(this, "Irregular Input Data", "The directory '" + root + "' doesn't exist?!");
+        bOK = false;
+    }
+
+    if(!bOK)
     {
-        QTextStream out(&outfile);
+        ui->pushOptimize->blockSignals(true);
+        ui->pushOptimize->setChecked(false);
+        ui->pushOptimize->blockSignals(false);
+        return;
+    }
+
+    OptimizeOptions options;
+    options.bpng = ui->checkOptPng->isChecked();
+    options.bjpeg = ui->checkOptJpeg->isChecked();
+    options.quality = ui->spinOptQuality->value();
+    options.budget = ui->spinOptBudget->value() * 1024;
+    options.fromlevel = ui->spinOptFromLevel->value();
+    options.ssim = ui->spinOptSsim->value();
+
+    if(!options.setLevelBudgets(ui->editOptLevelBudgets->text()))
+    {
+        QMessageBox::warning(this, "Irregular Input Data", "The budgets per level should be like 14:24, 16:16 (level:KB).");
+        ui->pushOptimize->blockSignals(true);
+        ui->pushOptimize->setChecked(false);
+        ui->pushOptimize->blockSignals(false);
+        return;
+    }
+
+    ui->progressOptimize->setValue(0);
+    ui->textProcessOutput->setTextColor(Qt::black);
+    ui->textProcessOutput->append("Optimizing the tiles in " + root + " ...");
+
+    pOptimizer->start(root, grid, options);
+}
+
+//----------------------------------------------
+void Dialog::optimizeProgress(int done, int total)
+{
+    ui->progressOptimize->setMaximum(qMax(1, total));
+    ui->progressOptimize->setValue(done);
+}
+
+//----------------------------------------------
+void Dialog::optimizeFinished()
+{
+    ui->pushOptimize->blockSignals(true);
+    ui->pushOptimize->setChecked(false);
+    ui->pushOptimize->blockSignals(false);
+
+    ui->textProcessOutput->setTextColor(Qt::darkGreen);
+    ui->textProcessOutput->append(pOptimizer->report());
+    showArenaUsage();
+}
+
+//----------------------------------------------
+// start/cancel the reprojection of the cache (the cache of the Verify group,
+// in the grid and the SRS of the job)
+void Dialog::on_pushWarp_toggled(bool checked)
+{
+    if(!checked)
+    {
+        if(pWarper->isRunning())
+            pWarper->cancel();
+        return;
+    }
+
+    QString root = ui->editVerifyRoot->text().simplified();
+    if(root.isEmpty())
+        root = QDir::currentPath();
+
+    QString output = ui->editWarpRoot->text().simplified();
+    QStringList targets = ui->editWarpSrs->text().split(',', QString::SkipEmptyParts);
+
+    bool bOK = validateGrid() && validateField(JobValidator::FieldSRS);
+    QString error;
+    if(bOK && !QDir(root).exists())
+        error = "The directory '" + root + "' doesn't exist?!";
+    else if(bOK && (output.isEmpty() || QDir(output) == QDir(root)))
+        error = "Choose an output directory other than the cache, please.";
+    else if(bOK && targets.isEmpty())
+        error = "Enter the target SRS, please.";
+
+    QRgb background = ui->radioWhite->isChecked() ? qRgb(255, 255, 255) :
+                      ui->radioBlack->isChecked() ? qRgb(0, 0, 0) : qRgba(0, 0, 0, 0);
+    QString format = ui->radioJpeg->isChecked() ? "jpeg" : ui->radioPng->isChecked() ? "png" : "gif";
+
+    if(bOK && error.isEmpty())
+        pWarper->start(root, grid, ui->editSRS->text(), format, targets, output,
+                       ui->comboResampling->currentIndex() == 1, ui->spinQuality->value(), background, &error);
+
+    if(!error.isEmpty())
+        QMessageBox::warning(this, "Irregular Input Data", error);
+
+    if(!bOK || !error.isEmpty())
+    {
+        ui->pushWarp->blockSignals(true);
+        ui->pushWarp->setChecked(false);
+        ui->pushWarp->blockSignals(false);
+        return;
+    }
+
+    ui->progressWarp->setValue(0);
+}
+
+//----------------------------------------------
+void Dialog::on_pushWarpBrowse_clicked()
+{
+    QString dir = QFileDialog::getExistingDirectory(this, tr("Output Directory"), ui->editWarpRoot->text());
+    if(!dir.isEmpty())
+        ui->editWarpRoot->setText(dir);
+}
+
+//----------------------------------------------
+// the cache of the Cache tab in the grid of the job
+void Dialog::on_pushPreview_clicked()
+{
+    if(!validateGrid())
+        return;
+
+    QString root = ui->editVerifyRoot->text().simplified();
+    if(root.isEmpty())
+        root = QDir::currentPath();
+
+    if(!QDir(root).exists())
+    {
+        QMessageBox::warning(this, "Irregular Input Data", "The directory '" + root + "' doesn't exist?!");
+        return;
+    }
+
+    ui->viewPreview->setPyramid(root, grid);
+}
+
+//----------------------------------------------
+void Dialog::warpProgress(int done, int total)
+{
+    ui->progressWarp->setMaximum(qMax(1, total));
+    ui->progressWarp->setValue(done);
+}
+
+//----------------------------------------------
+void Dialog::warpMessage(const QString& msg)
+{
+    ui->textProcessOutput->setTextColor(Qt::black);
+    ui->textProcessOutput->append(msg);
+}
+
+//----------------------------------------------
+void Dialog::warpFinished()
+{
+    ui->pushWarp->blockSignals(true);
+    ui->pushWarp->setChecked(false);
+    ui->pushWarp->blockSignals(false);
+
+    ui->textProcessOutput->setTextColor(Qt::darkGreen);
+    ui->textProcessOutput->append(pWarper->report());
+    showArenaUsage();
+}
+
+//----------------------------------------------
+void Dialog::layerMessage(const QString& msg)
+{
+    ui->textProcessOutput->setTextColor(Qt::darkGreen);
+    ui->textProcessOutput->append(msg);
+}
+
+//----------------------------------------------
+// the output of the layers' tilemakers, line by line with the layer name
+void Dialog::layerOutput(const QString& layer, const QByteArray& data)
+{
+    QList<QByteArray> lines = data.split('\n');
+    ui->textProcessOutput->setTextColor(Qt::black);
+    for(int i=0; i<lines.size(); i++)
+        if(!lines[i].trimmed().isEmpty())
+            ui->textProcessOutput->append("[" + layer + "] " + QString::fromLocal8Bit(lines[i]));
+}
+
+//----------------------------------------------
+void Dialog::layersFinished(int failed)
+{
+    closeUpdatesSource();
+    ui->viewPreview->reload();
+
+    if(failed > 0)
+    {
+        ui->textProcessOutput->setTextColor(Qt::red);
+        ui->textProcessOutput->append(QString::number(failed) + " of the layers have not been completed.");
+    }
+
+    if(failed == 0 && ui->checkComposite->isChecked())
+    {
+        QRgb background = ui->radioWhite->isChecked() ? qRgb(255, 255, 255) : qRgb(0, 0, 0);
+        ui->textProcessOutput->setTextColor(Qt::darkGreen);
+        ui->textProcessOutput->append("Compositing the layers ...");
+        pCompositor->start(pLayerRun->roots(), QDir::currentPath() + "/composite", grid,
+                           ui->radioJpeg->isChecked(), ui->spinQuality->value(), background);
+        return;
+    }
+
+    ui->pushBreak->setEnabled(false);
+    ui->pushExecute->setEnabled(true);
+    ui->pushExecute->setFocus();
+    ui->textProcessOutput->setStyleSheet("background-image: url(:/icons/glonass_f.png);");
+}
+
+//----------------------------------------------
+void Dialog::compositeProgress(int done, int total)
+{
+    if(done > 0 && (done == total || done % 100 == 0))
+    {
+        ui->textProcessOutput->setTextColor(Qt::black);
+        ui->textProcessOutput->append("Composited " + QString::number(done) + " of " + QString::number(total) + " columns");
+    }
+}
+
+//----------------------------------------------
+void Dialog::compositeFinished()
+{
+    ui->textProcessOutput->setTextColor(Qt::darkGreen);
+    ui->textProcessOutput->append(pCompositor->report());
+    showArenaUsage();
 
-        for(int row = 0; row<ui->tableUpdates->rowCount(); row++)
+    ui->pushBreak->setEnabled(false);
+    ui->pushExecute->setEnabled(true);
+    ui->pushExecute->setFocus();
+    ui->textProcessOutput->setStyleSheet("background-image: url(:/icons/glonass_f.png);");
+}
+
+
+
+//==============================================
+// set of private manual functions
+
+//----------------------------------------------
+bool Dialog::fileExists(const QString& path)
+{
+    QFileInfo check_file(path);
+    return check_file.exists() && check_file.isFile();
+}
+
+//----------------------------------------------
+// the memory of the tile pipelines (verify, optimize, warp, composite)
+void Dialog::showArenaUsage()
+{
+    QString sreport = BufferArena::report();
+    if(sreport.isEmpty())
+        return;
+
+    ui->textProcessOutput->setTextColor(Qt::darkGreen);
+    ui->textProcessOutput->append(sreport);
+}
+
+//----------------------------------------------
+int Dialog::tileSize() const
+{
+    return ui->comboTileSize->currentText().toInt();
+}
+
+//----------------------------------------------
+// the verdict of the validator, the field is focused when it is wrong
+bool Dialog::validateField(int field)
+{
+    QLineEdit* edits[JobValidator::Fields] = { ui->editUrl, ui->editLayer, ui->editBBOX, ui->editRes, ui->editSRS };
+
+    QString error = pValidator->fieldError(field);
+    if(error.isEmpty())
+        return true;
+
+    edits[field]->setFocus(Qt::ActiveWindowFocusReason);
+    QMessageBox::warning(this, "Irregular Input Data", error);
+    return false;
+}
+
+//----------------------------------------------
+// the BBOX and the resolution, as the validator has parsed them
+bool Dialog::validateGrid()
+{
+    if(!validateField(JobValidator::FieldBBOX) || !validateField(JobValidator::FieldRes))
+        return false;
+
+    grid = pValidator->grid();
+
+    return true;
+}
+
+//----------------------------------------------
+void Dialog::jobEdited()
+{
+    pValidator->setFields(ui->editUrl->text(), ui->editLayer->text(), ui->editBBOX->text(),
+                          ui->editRes->text(), ui->editSRS->text(), tileSize());
+
+    // the changes are recorded and the tiles staged in the cache of a single layer only
+    bool bsingle = LayerSet::parse(ui->editLayer->text()).size() <= 1;
+    ui->checkRecordChanges->setEnabled(bsingle);
+    ui->checkStaging->setEnabled(bsingle);
+    ui->checkComparePixels->setEnabled(bsingle && ui->checkStaging->isChecked());
+}
+
+//----------------------------------------------
+void Dialog::markFields()
+{
+    QLineEdit* edits[JobValidator::Fields] = { ui->editUrl, ui->editLayer, ui->editBBOX, ui->editRes, ui->editSRS };
+
+    for(int f=0; f<JobValidator::Fields; f++)
+        edits[f]->setStyleSheet(pValidator->fieldError(f).isEmpty() ? "" : "QLineEdit { background-color: #ffd0d0; }");
+
+    markRows(QList<int>());
+}
+
+//----------------------------------------------------------
+QStringList Dialog::tableRow(int row) const
+{
+    QStringList cells;
+    for(int col = 0; col<UBOXCOLUMNS; col++)
+    {
+        QTableWidgetItem* item = ui->tableUpdates->item(row, col);
+        cells << (item ? item->text() : QString());
+    }
+
+    return cells;
+}
+
+//----------------------------------------------------------
+// the table always keeps at least 20 rows
+void Dialog::setTableRows(const QList<QStringList>& rows)
+{
+    on_pushClearUpdates_clicked();
+
+    ui->tableUpdates->blockSignals(true);
+    if(rows.size() > ui->tableUpdates->rowCount())
+        ui->tableUpdates->setRowCount(rows.size());
+
+    for(int row = 0; row<rows.size(); row++)
+    {
+        for(int col = 0; col<UBOXCOLUMNS && col<rows[row].size(); col++)
         {
-            QString const strrow = validateUpdateRow(row, dleft, dbottom, dright, dtop, dhres, dlres);
+            QString str = rows[row][col].simplified();
+            if(!str.isEmpty())
+                ui->tableUpdates->setItem(row, col, new QTableWidgetItem(str));
+        }
+    }
+    ui->tableUpdates->blockSignals(false);
+    syncTableRows();
+}
+
+//----------------------------------------------------------
+void Dialog::focusRowError(int row)
+{
+    const RowCheck& check = pValidator->row(row);
 
-            if(strrow == "empty")
+    ui->tableUpdates->setFocus();
+    if(check.errcolumn < 0)
+        ui->tableUpdates->selectRow(row);
+    else
+        ui->tableUpdates->setCurrentCell(row, check.errcolumn);
+}
+
+//----------------------------------------------------------
+// the whole table to the validator, after it has been filled with the signals blocked
+void Dialog::syncTableRows()
+{
+    pValidator->setRowCount(ui->tableUpdates->rowCount());
+    for(int row = 0; row<ui->tableUpdates->rowCount(); row++)
+        pValidator->setRow(row, tableRow(row));
+}
+
+//----------------------------------------------------------
+void Dialog::updateCellChanged(int row, int)
+{
+    pValidator->setRow(row, tableRow(row));
+    ui->labelValidation->setText(pValidator->summary());
+}
+
+//----------------------------------------------------------
+// the cells of the errors in red, the message in their tooltip
+void Dialog::markRows(const QList<int>& rows)
+{
+    ui->tableUpdates->blockSignals(true);
+    for(int i=0; i<rows.size(); i++)
+    {
+        int row = rows[i];
+        if(row >= ui->tableUpdates->rowCount())
+            continue;
+
+        const RowCheck& check = pValidator->row(row);
+        for(int col = 0; col<UBOXCOLUMNS; col++)
+        {
+            bool bmark = !check.error.isEmpty() && (check.errcolumn < 0 || check.errcolumn == col);
+
+            QTableWidgetItem* item = ui->tableUpdates->item(row, col);
+            if(!item && !bmark)
                 continue;
 
-            if(strrow.startsWith("Error"))
+            if(!item)
             {
-                QMessageBox::warning(this, "Irregular Input Data", strrow);
-                return false;
+                item = new QTableWidgetItem();
+                ui->tableUpdates->setItem(row, col, item);
             }
 
-            out << strrow << endl;
+            item->setBackground(bmark ? QBrush(QColor(255, 208, 208)) : QBrush());
+            item->setToolTip(check.error);
         }
+    }
+    ui->tableUpdates->blockSignals(false);
+
+    // all the errors in the tooltip of the summary
+    QStringList errors;
+    for(int f=0; f<JobValidator::Fields; f++)
+        if(!pValidator->fieldError(f).isEmpty())
+            errors << pValidator->fieldError(f).simplified();
+    for(int row = 0; row<pValidator->rowCount() && errors.size()<20; row++)
+        if(!pValidator->row(row).error.isEmpty())
+            errors << pValidator->row(row).error;
+
+    ui->labelValidation->setText(pValidator->summary());
+    ui->labelValidation->setToolTip(errors.join("\n"));
+}
+
+//----------------------------------------------
+bool Dialog::validateUpdates(QList<UBox>& uboxes)
+{
+    TraceSpan span("validate updates");
+
+    updatesreport.clear();
 
-        outfile.close();
+    // the rows have been checked while they were edited, only the rest now
+    pValidator->waitForFinished();
+
+    QString error = pValidator->fieldError(JobValidator::FieldBBOX) + pValidator->fieldError(JobValidator::FieldRes);
+    if(!error.isEmpty())
+    {
+        QMessageBox::warning(this, "Irregular Input Data", error);
+        return false;
     }
-    else // it should never happen
+
+    int errrow = pValidator->firstErrorRow();
+    if(errrow >= 0)
     {
-        QMessageBox::warning(this, "Error", "Cannnot open the the temporary updates-file for writing.");
+        focusRowError(errrow);
+
+        int errors = pValidator->rowErrors();
+        QMessageBox::warning(this, "Irregular Input Data", pValidator->row(errrow).error +
+                             (errors > 1 ? "\n\n" + QString::number(errors - 1) + " more UBOXes are marked in the table." : QString()));
         return false;
     }
 
+    uboxes = pValidator->uboxes();
+
+    // the tiles of the footprint, level by level
+    QString footprintpath = ui->editFootprint->text().trimmed();
+    if(!footprintpath.isEmpty())
+    {
+        Footprint footprint;
+        QString error = FootprintIO::load(footprintpath, footprint);
+        if(!error.isEmpty())
+        {
+            QMessageBox::warning(this, "Irregular Input Data", error);
+            return false;
+        }
+
+        FootprintStats stats;
+        uboxes += FootprintRaster::regions(footprint, grid, ui->spinFootprintBuffer->value(), &stats);
+        updatesreport = FootprintRaster::report(stats);
+    }
+
+    if(ui->checkOptimizeUBoxes->isChecked())
+    {
+        TraceSpan optspan("optimize updates");
+        UBoxStats stats = UBoxOptimizer::optimize(uboxes, grid);
+        updatesreport += (updatesreport.isEmpty() ? "" : "\n") + UBoxOptimizer::report(stats);
+    }
+
+    // the most requested tiles first (after the optimizer, which doesn't keep the order)
+    if(ui->comboHeat->currentIndex() > 0 && !pImporter->isRunning() && !pImporter->heat().isEmpty())
+    {
+        bool bonly = ui->comboHeat->currentIndex() == 2;
+        int hot = 0;
+        uboxes = AccessLog::priorityRegions(pImporter->heat(), grid, ui->spinHotPercent->value(), uboxes, bonly, &hot);
+        updatesreport += (updatesreport.isEmpty() ? "" : "\n") + QString("Heat: ") + QString::number(hot) +
+                         " of the hottest tiles " + (bonly ? "only" : "first");
+    }
+
     return true;
 }
 
+//----------------------------------------------
+void Dialog::on_pushFootprint_clicked()
+{
+    QString filename = QFileDialog::getOpenFileName(this, tr("Footprint Polygon"),
+                                                    QDir::currentPath(),
+                                                    tr("WKT or GeoJSON (*.wkt *.txt *.json *.geojson);;All files (*.*)"));
+    if(filename.isEmpty())
+        return;
+
+    Footprint footprint;
+    QString error = FootprintIO::load(filename, footprint);
+    if(!error.isEmpty())
+    {
+        QMessageBox::warning(this, "Irregular Input Data", error);
+        return;
+    }
+
+    ui->editFootprint->setText(filename);
+    ui->groupUBox->setChecked(true);
+}
+
+//----------------------------------------------
+// start/cancel the import of access logs
+void Dialog::on_pushAccessLogs_toggled(bool checked)
+{
+    if(!checked)
+    {
+        if(pImporter->isRunning())
+            pImporter->cancel();
+        return;
+    }
+
+    QStringList files = QFileDialog::getOpenFileNames(this, tr("Access Logs of the Tile Server"),
+                                                      QDir::currentPath(),
+                                                      tr("Logs (*.log *.gz *.txt);;All files (*.*)"));
+    if(files.isEmpty())
+    {
+        ui->pushAccessLogs->blockSignals(true);
+        ui->pushAccessLogs->setChecked(false);
+        ui->pushAccessLogs->blockSignals(false);
+        return;
+    }
+
+    ui->labelHeat->setText("Reading the logs ...");
+    pImporter->start(files);
+}
+
+//----------------------------------------------
+void Dialog::heatProgress(int done, int total)
+{
+    ui->labelHeat->setText("Reading the logs: " + QString::number(done >> 10) + " of " + QString::number(total >> 10) + " MB");
+}
+
+//----------------------------------------------
+void Dialog::heatFinished()
+{
+    ui->pushAccessLogs->blockSignals(true);
+    ui->pushAccessLogs->setChecked(false);
+    ui->pushAccessLogs->blockSignals(false);
+
+    ui->labelHeat->setText(pImporter->heat().describe());
+    ui->textProcessOutput->setTextColor(Qt::darkGreen);
+    ui->textProcessOutput->append(pImporter->report());
+}
+
 //----------------------------------------------
 void Dialog::on_pushLoadUpdates_clicked()
 {
@@ -696,55 +1588,16 @@ void Dialog::on_pushLoadUpdates_clicked()
         if (inputfile.open(QIODevice::ReadOnly))
         {
            QTextStream in(&inputfile);
-           int uboxnumber = 0;
-           while (!in.atEnd())
-           {
-              QString line = in.readLine();
-              if(line.simplified().isEmpty())
-                  continue;
-
-              QStringList strlist = line.split(",");
-              if(strlist.size()<4 || strlist.size()>7)
-              {
-                  QString msg = "Irregular number of parameters of ubox No. " + QString::number(uboxnumber+1) + ".\n\nData will not be loaded.";
-                  QMessageBox::warning(this, "Irregular Input Data", msg);
-                  return;
-              }
-
-              QTableWidgetItem* itemleft = new QTableWidgetItem(strlist[0].simplified());
-              ui->tableUpdates->setItem(uboxnumber, 0, itemleft);
-
-              QTableWidgetItem* itembottom = new QTableWidgetItem(strlist[1].simplified());
-              ui->tableUpdates->setItem(uboxnumber, 1, itembottom);
-
-              QTableWidgetItem* itemright = new QTableWidgetItem(strlist[2].simplified());
-              ui->tableUpdates->setItem(uboxnumber, 2, itemright);
-
-              QTableWidgetItem* itemtop = new QTableWidgetItem(strlist[3].simplified());
-              ui->tableUpdates->setItem(uboxnumber, 3, itemtop);
-
-
-              if(strlist.size() > 4)
-              {
-                  QTableWidgetItem* itemhres = new QTableWidgetItem(strlist[4].simplified());
-                  ui->tableUpdates->setItem(uboxnumber, 4, itemhres);
-              }
-
-
-              if(strlist.size() > 5)
-              {
-                  QTableWidgetItem* itemlres = new QTableWidgetItem(strlist[5].simplified());
-                  ui->tableUpdates->setItem(uboxnumber, 5, itemlres);
-              }
 
-              if(strlist.size() > 6)
-              {
-                  QTableWidgetItem* itemfitres = new QTableWidgetItem(strlist[6].simplified());
-                  ui->tableUpdates->setItem(uboxnumber, 6, itemfitres);
-              }
-
-              ++uboxnumber;
+           QList<QStringList> rows;
+           QString error;
+           if(!JobIO::readUpdateRows(in, rows, &error))
+           {
+               QMessageBox::warning(this, "Irregular Input Data", error);
+               return;
            }
+
+           setTableRows(rows);
            inputfile.close();
         }
         else // it should never happen
@@ -757,8 +1610,11 @@ void Dialog::on_pushLoadUpdates_clicked()
 void Dialog::on_pushClearUpdates_clicked()
 {
     // tricky solution
+    ui->tableUpdates->blockSignals(true);
     ui->tableUpdates->setRowCount(0);
     ui->tableUpdates->setRowCount(20);
+    ui->tableUpdates->blockSignals(false);
+    syncTableRows();
 }
 
 //----------------------------------------------
@@ -769,185 +1625,22 @@ void Dialog::on_pushOpen_clicked()
                                                     tr("Tilemaker Input Parameters (*.tip);;All files (*.*)"));
     if(filename != QString::null)
     {
-        bool bOK;
-
         QFile inputfile(filename);
         if (inputfile.open(QIODevice::ReadOnly))
         {
            QTextStream in(&inputfile);
 
-           // edits
-           QString line = in.readLine();
-           if(!line.startsWith("url:")) goto error_report;
-           ui->editUrl->setText(line.right(line.length()-4));
-
-           line = in.readLine();
-           if(QString::null==line || !line.startsWith("layer:")) goto error_report;
-           ui->editLayer->setText(line.right(line.length()-6));
-
-           line = in.readLine();
-           if(QString::null==line || !line.startsWith("bbox:")) goto error_report;
-           ui->editBBOX->setText(line.right(line.length()-5));
-
-           line = in.readLine();
-           if(QString::null==line || !line.startsWith("res:")) goto error_report;
-           ui->editRes->setText(line.right(line.length()-4));
-
-           line = in.readLine();
-           if(QString::null==line || !line.startsWith("srs:")) goto error_report;
-           ui->editSRS->setText(line.right(line.length()-4));
-
-           // spins
-           line = in.readLine();
-           if(QString::null==line || !line.startsWith("threads:")) goto error_report;
-           int ithreads = line.right(line.length()-8).simplified().toInt(&bOK);
-           if(!bOK) goto error_report;
-           ui->spinThreads->setValue(ithreads);
-
-           line = in.readLine();
-           if(QString::null==line || !line.startsWith("quality:")) goto error_report;
-           int iquality = line.right(line.length()-8).simplified().toInt(&bOK);
-           if(!bOK) goto error_report;
-           ui->spinQuality->setValue(iquality);
-
-           // checks
-           line = in.readLine();
-           if(QString::null==line || !line.startsWith("noopt:")) goto error_report;
-           int inoopt = line.right(line.length()-6).simplified().toInt(&bOK);
-           if(!bOK) goto error_report;
-           ui->checkNoOpt->setChecked(inoopt != 0);
-
-           line = in.readLine();
-           if(QString::null==line || !line.startsWith("skipdirs:")) goto error_report;
-           int iskipdirs = line.right(line.length()-9).simplified().toInt(&bOK);
-           if(!bOK) goto error_report;
-           ui->checkSkipdirs->setChecked(iskipdirs != 0);
-
-           line = in.readLine();
-           if(QString::null==line || !line.startsWith("verbose:")) goto error_report;
-           int iverbose = line.right(line.length()-8).simplified().toInt(&bOK);
-           if(!bOK) goto error_report;
-           ui->checkVerbose->setChecked(iverbose != 0);
-
-           line = in.readLine();
-           if(QString::null==line || !line.startsWith("background:")) goto error_report;
-           QString sbgr = line.right(line.length()-11).simplified();
-           if("white" == sbgr)
-               ui->radioWhite->setChecked(true);
-           else if("black" == sbgr)
-               ui->radioBlack->setChecked(true);
-           else if("transparent" == sbgr)
-               ui->radioTransparent->setChecked(true);
-           else
-               goto error_report;
-
-           line = in.readLine();
-           if(QString::null==line || !line.startsWith("exceptions:")) goto error_report;
-           QString sexc = line.right(line.length()-11).simplified();
-           if("tolerant" == sexc)
-               ui->radioTolerant->setChecked(true);
-           else if("moderate" == sexc)
-               ui->radioModerate->setChecked(true);
-           else if("strict" == sexc)
-               ui->radioStrict->setChecked(true);
-           else
-               goto error_report;
-
-           line = in.readLine();
-           if(QString::null==line || !line.startsWith("format:")) goto error_report;
-           QString sfmt = line.right(line.length()-7).simplified();
-           if("jpeg" == sfmt)
-               ui->radioJpeg->setChecked(true);
-           else if("png" == sfmt)
-               ui->radioPng->setChecked(true);
-           else if("gif" == sfmt)
-               ui->radioGIF->setChecked(true);
-           else
-               goto error_report;
-
-           // updates
-           line = in.readLine();
-           if(QString::null==line || !line.startsWith("updates:")) goto error_report;
-           int iupdates = line.right(line.length()-8).simplified().toInt(&bOK);
-           if(!bOK) goto error_report;
-           ui->groupUBox->setChecked(iupdates != 0);
-
-           on_pushClearUpdates_clicked(); // clear the existing updates on the update-table
-
-           int uboxnumber = 0;
-           while (!in.atEnd())
+           JobConfig cfg;
+           if(!JobIO::readTip(in, cfg))
            {
-              line = in.readLine();
-              if(line.simplified().isEmpty())
-                  continue;
-
-              QStringList strlist = line.split(",");
-              if(strlist.size()<4 || strlist.size()>7) goto error_report;
-
-              QString str = strlist[0].simplified();
-              if(!str.isEmpty())
-              {
-                  QTableWidgetItem* itemleft = new QTableWidgetItem(str);
-                  ui->tableUpdates->setItem(uboxnumber, 0, itemleft);
-              }
-
-              str = strlist[1].simplified();
-              if(!str.isEmpty())
-              {
-                  QTableWidgetItem* itembottom = new QTableWidgetItem(str);
-                  ui->tableUpdates->setItem(uboxnumber, 1, itembottom);
-              }
-
-              str = strlist[2].simplified();
-              if(!str.isEmpty())
-              {
-                  QTableWidgetItem* itemright = new QTableWidgetItem(str);
-                  ui->tableUpdates->setItem(uboxnumber, 2, itemright);
-              }
-
-              str = strlist[3].simplified();
-              if(!str.isEmpty())
-              {
-                  QTableWidgetItem* itemtop = new QTableWidgetItem(str);
-                  ui->tableUpdates->setItem(uboxnumber, 3, itemtop);
-              }
-
-
-              if(strlist.size() > 4)
-              {
-                  str = strlist[4].simplified();
-                  if(!str.isEmpty())
-                  {
-                      QTableWidgetItem* itemhres = new QTableWidgetItem(str);
-                      ui->tableUpdates->setItem(uboxnumber, 4, itemhres);
-                  }
-              }
-
-
-              if(strlist.size() > 5)
-              {
-                  str = strlist[5].simplified();
-                  if(!str.isEmpty())
-                  {
-                      QTableWidgetItem* itemlres = new QTableWidgetItem(str);
-                      ui->tableUpdates->setItem(uboxnumber, 5, itemlres);
-                  }
-              }
-
-              if(strlist.size() > 6)
-              {
-                  str = strlist[6].simplified();
-                  if(!str.isEmpty())
-                  {
-                      QTableWidgetItem* itemfitres = new QTableWidgetItem(str);
-                      ui->tableUpdates->setItem(uboxnumber, 6, itemfitres);
-                  }
-              }
-
-              ++uboxnumber;
+               QString msg = "File " + filename + " is not a regular *.tip file!?\n\nDefault values will be set.";
+               QMessageBox::warning(this, "Error Reading File", msg);
+               on_pushDefault_clicked();
+               return;
            }
 
            inputfile.close();
+           jobToUi(cfg);
 
            QString msg = "File " + filename + " has been succesfully opened!";
            QMessageBox::information(this, "Success", msg);
@@ -956,13 +1649,101 @@ void Dialog::on_pushOpen_clicked()
             QMessageBox::warning(this, "Error",
                                  "Cannnot open the file for reading.");
     }
+}
+
+//----------------------------------------------
+JobConfig Dialog::jobFromUi() const
+{
+    JobConfig cfg;
+
+    cfg.url = ui->editUrl->text();
+    cfg.layer = ui->editLayer->text();
+    cfg.bbox = ui->editBBOX->text();
+    cfg.res = ui->editRes->text();
+    cfg.srs = ui->editSRS->text();
+
+    cfg.threads = ui->spinThreads->value();
+    cfg.quality = ui->spinQuality->value();
+    cfg.tilesize = tileSize();
+
+    cfg.noopt = ui->checkNoOpt->isChecked();
+    cfg.skipdirs = ui->checkSkipdirs->isChecked();
+    cfg.verbose = ui->checkVerbose->isChecked();
+
+    cfg.background = ui->radioWhite->isChecked() ? "white" : ui->radioBlack->isChecked() ? "black" : "transparent";
+    cfg.exceptions = ui->radioTolerant->isChecked() ? "tolerant" : ui->radioModerate->isChecked() ? "moderate" : "strict";
+    cfg.format = ui->radioJpeg->isChecked() ? "jpeg" : ui->radioPng->isChecked() ? "png" : "gif";
 
-    return;
+    cfg.updates = ui->groupUBox->isChecked();
+    for(int row = 0; row<ui->tableUpdates->rowCount(); row++)
+        cfg.updaterows.append(tableRow(row));
+    cfg.footprint = ui->editFootprint->text().trimmed();
+    cfg.footprintbuffer = ui->spinFootprintBuffer->value();
 
-error_report:
-    QString msg = "File " + filename + " is not a regular *.tip file!?\n\nDefault values will be set.";
-    QMessageBox::warning(this, "Error Reading File", msg);
-    on_pushDefault_clicked();
+    return cfg;
+}
+
+//----------------------------------------------
+// the job of the validated fields and regions, without parsing them again
+RequestPlan::Job Dialog::planJob(const QList<UBox>& uboxes) const
+{
+    RequestPlan::Job job;
+
+    job.url = ui->editUrl->text().simplified();
+    job.layer = ui->editLayer->text().simplified();
+    job.srs = ui->editSRS->text().simplified();
+    job.format = ui->radioJpeg->isChecked() ? "jpeg" : ui->radioPng->isChecked() ? "png" : "gif";
+    job.background = ui->radioWhite->isChecked() ? "white" : ui->radioBlack->isChecked() ? "black" : "transparent";
+    job.grid = grid;
+    job.updates = ui->groupUBox->isChecked();
+    job.regions = uboxes;
+
+    return job;
+}
+
+//----------------------------------------------
+void Dialog::jobToUi(const JobConfig& cfg)
+{
+    ui->editUrl->setText(cfg.url);
+    ui->editLayer->setText(cfg.layer);
+    ui->editBBOX->setText(cfg.bbox);
+    ui->editRes->setText(cfg.res);
+    ui->editSRS->setText(cfg.srs);
+
+    ui->spinThreads->setValue(cfg.threads);
+    ui->spinQuality->setValue(cfg.quality);
+    ui->comboTileSize->setCurrentText(QString::number(cfg.tilesize));
+
+    ui->checkNoOpt->setChecked(cfg.noopt);
+    ui->checkSkipdirs->setChecked(cfg.skipdirs);
+    ui->checkVerbose->setChecked(cfg.verbose);
+
+    if("black" == cfg.background)
+        ui->radioBlack->setChecked(true);
+    else if("transparent" == cfg.background)
+        ui->radioTransparent->setChecked(true);
+    else
+        ui->radioWhite->setChecked(true);
+
+    if("moderate" == cfg.exceptions)
+        ui->radioModerate->setChecked(true);
+    else if("strict" == cfg.exceptions)
+        ui->radioStrict->setChecked(true);
+    else
+        ui->radioTolerant->setChecked(true);
+
+    if("png" == cfg.format)
+        ui->radioPng->setChecked(true);
+    else if("gif" == cfg.format)
+        ui->radioGIF->setChecked(true);
+    else
+        ui->radioJpeg->setChecked(true);
+
+    ui->groupUBox->setChecked(cfg.updates);
+
+    setTableRows(cfg.updaterows); // the existing updates are cleared
+    ui->editFootprint->setText(cfg.footprint);
+    ui->spinFootprintBuffer->setValue(cfg.footprintbuffer);
 }
 
 //----------------------------------------------
@@ -976,50 +1757,11 @@ void Dialog::on_pushSave_clicked()
         if(!filename.endsWith(".tip"))
             filename += ".tip";
 
-        //qDebug() << filename;
-
         QFile outfile(filename);
         if (outfile.open(QIODevice::WriteOnly))
         {
            QTextStream out(&outfile);
-
-           out << "url:" << ui->editUrl->text() << endl;
-           out << "layer:" << ui->editLayer->text() << endl;
-           out << "bbox:" << ui->editBBOX->text() << endl;
-           out << "res:" << ui->editRes->text() << endl;
-           out << "srs:" << ui->editSRS->text() << endl;
-
-           out << "threads:" << ui->spinThreads->value() << endl;
-           out << "quality:" << ui->spinQuality->value() << endl;
-
-           out << "noopt:" << ui->checkNoOpt->isChecked() << endl;
-           out << "skipdirs:" << ui->checkSkipdirs->isChecked() << endl;
-           out << "verbose:" << ui->checkVerbose->isChecked() << endl;
-
-           out << "background:" << (ui->radioWhite->isChecked() ? "white" : ui->radioBlack->isChecked() ? "black" : "transparent") << endl;
-           out << "exceptions:" << (ui->radioTolerant->isChecked() ? "tolerant" : ui->radioModerate->isChecked() ? "moderate" : "strict") << endl;
-           out << "format:" << (ui->radioJpeg->isChecked() ? "jpeg" : ui->radioPng->isChecked() ? "png" : "gif") << endl;
-
-           out << "updates:" << ui->groupUBox->isChecked() << endl;
-           for(int row = 0; row<ui->tableUpdates->rowCount(); row++)
-           {
-               QTableWidgetItem* itemleft = ui->tableUpdates->item(row, 0);
-               QTableWidgetItem* itembottom = ui->tableUpdates->item(row, 1);
-               QTableWidgetItem* itemright = ui->tableUpdates->item(row, 2);
-               QTableWidgetItem* itemtop = ui->tableUpdates->item(row, 3);
-
-               QTableWidgetItem* itemhres = ui->tableUpdates->item(row, 4);
-               QTableWidgetItem* itemlres = ui->tableUpdates->item(row, 5);
-               QTableWidgetItem* itemfitres = ui->tableUpdates->item(row, 6);
-
-               out << (itemleft ? itemleft->text() : "") << ",";
-               out << (itembottom ? itembottom->text() : "") << ",";
-               out << (itemright ? itemright->text() : "") << ",";
-               out << (itemtop ? itemtop->text() : "") << ",";
-               out << (itemhres ? itemhres->text() : "") << ",";
-               out << (itemlres ? itemlres->text() : "") << ",";
-               out << (itemfitres ? itemfitres->text() : "") << endl;
-           }
+           JobIO::writeTip(out, jobFromUi());
 
            QString msg = "File " + filename + " has been succesfully saved!";
            QMessageBox::information(this, "Success", msg);
@@ -1041,9 +1783,12 @@ void Dialog::on_pushDefault_clicked()
 
     on_pushClearUpdates_clicked();
     ui->groupUBox->setChecked(false);
+    ui->editFootprint->setText("");
+    ui->spinFootprintBuffer->setValue(0);
 
     ui->spinThreads->setValue(1);
     ui->spinQuality->setValue(90);
+    ui->comboTileSize->setCurrentText(QString::number(DEFAULTTILESIZE));
 
     ui->checkNoOpt->setChecked(false);
     ui->checkSkipdirs->setChecked(false);
@@ -24,6 +24,29 @@
 #include <QDialog>
 #include <QProcess>
 #include <QMessageBox>
+#include <QFutureWatcher>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+
+#include "jobconfig.h"
+#include "requestplan.h"
+#include "tilegrid.h"
+
+class ProcMonitor;
+class QTemporaryFile;
+class ClusterCoordinator;
+class TileVerifier;
+class TileOptimizer;
+class TileWarper;
+class QFile;
+class ServerProbe;
+class LayerRun;
+class LayerCompositor;
+class AccessLogImporter;
+class ChangeTracker;
+class TileStager;
+class JobValidator;
+struct ServerProfile;
 
 namespace Ui {
 class Dialog;
@@ -41,29 +64,116 @@ private slots:
     void rightMessage();
     void wrongMessage();
     void on_finish(int);
+    void processStarted();
+    void governorMessage(const QString&);
+    void updateBudget();
+    void feedUpdates();
+    void clusterProgress(int, int, int);
+    void clusterMessage(const QString&);
+    void clusterFinished(bool);
+    void verifyProgress(int, int);
+    void verifyFinished();
+    void dryRunFinished();
+    void optimizeProgress(int, int);
+    void optimizeFinished();
+    void warpProgress(int, int);
+    void warpMessage(const QString&);
+    void warpFinished();
+    void layerMessage(const QString&);
+    void layerOutput(const QString&, const QByteArray&);
+    void layersFinished(int);
+    void compositeProgress(int, int);
+    void compositeFinished();
+    void heatProgress(int, int);
+    void heatFinished();
+    void changesFinished();
+    void stagingFinished();
+    void jobEdited();
+    void updateCellChanged(int, int);
+    void markFields();
+    void markRows(const QList<int>&);
+    void profileLookup();
+    void probeMessage(const QString&);
+    void probeFinished(bool);
 
     void on_pushExecute_clicked();
     void on_pushBreak_clicked();
     void on_pushLoadUpdates_clicked();
     void on_pushClearUpdates_clicked();
+    void on_pushFootprint_clicked();
+    void on_pushAccessLogs_toggled(bool);
     void on_pushOpen_clicked();
     void on_pushSave_clicked();
     void on_pushDefault_clicked();
     void on_groupUBox_toggled(bool);
+    void on_pushTrace_toggled(bool);
+    void on_pushTraceLoad_clicked();
+    void on_pushDistribute_toggled(bool);
+    void on_pushVerify_toggled(bool);
+    void on_pushVerifyBrowse_clicked();
+    void on_pushOptimize_toggled(bool);
+    void on_pushWarp_toggled(bool);
+    void on_pushWarpBrowse_clicked();
+    void on_pushPreview_clicked();
+    void on_pushDryRun_toggled(bool);
+    void on_pushProbe_toggled(bool);
+    void on_pushApplyProfile_clicked();
 
 private:
     Ui::Dialog *ui;
     QProcess* pTilemaker;
+    ProcMonitor* pMonitor;
+    ClusterCoordinator* pCoordinator;
+    TileVerifier* pVerifier;
+    TileOptimizer* pOptimizer;
+    TileWarper* pWarper;
+    LayerRun* pLayerRun;            // the job of several layers
+    LayerCompositor* pCompositor;
+    AccessLogImporter* pImporter;   // the heat map of the tile requests
+    ChangeTracker* pTracker;        // the change manifest of the cache
+    TileStager* pStager;            // compare-before-write of the update runs
+    JobValidator* pValidator;       // checks the job while it is edited
+    QFutureWatcher<RequestPlan::Summary>* pPlanWatcher;
+    QFile* pPlanFile;
+    QAtomicInt plancancel;
+    TileGrid grid;      // of the last validated BBOX and resolution
+    qint64 runstartus;  // trace timestamp of the tilemaker start
+    QString updatesreport;
+    QList<UBox> pendingupdates;     // regions not yet written to the tilemaker's stdin
+    int updatesfed;                 // next pending region, -1 - nothing to stream
+    QTemporaryFile* pUpdatesFile;   // used where the regions can't be streamed
+    ServerProbe* pProbe;
+    QString profilekey;             // of the shown profile
+    QString runkey;                 // statistics of the current run for the server profile
+    int runthreads, runquality, runerrors;
+    qint64 runtiles;
+    QElapsedTimer runclock;
+    qint64 runstartms;              // when the run has started, for the change manifest
+    QList<UBox> runregions;
+    QString runstaging;             // where the run renders, empty - into the cache
+    bool runok;
 
     bool fileExists(const QString&);
+    void afterRun(bool);
+    int tileSize() const;
+
+    bool jobArguments(QStringList&);
     
-    bool validateResolution();
-    bool validateBBOX();
-    bool validateUrl();
-    bool validateLayer();
-    bool validateSRS();
-    bool validateAndSaveUpdates();
-    QString validateUpdateRow(int, double, double, double, double, double, double);
+    bool validateField(int);
+    bool validateGrid();
+    bool validateUpdates(QList<UBox>&);
+    QString openUpdatesSource(const QList<UBox>&, bool bshared = false);
+    void closeUpdatesSource();
+    void focusRowError(int);
+    void syncTableRows();
+
+    QStringList tableRow(int) const;
+    void setTableRows(const QList<QStringList>&);
+    JobConfig jobFromUi() const;
+    RequestPlan::Job planJob(const QList<UBox>&) const;
+    void jobToUi(const JobConfig&);
+    void showProfile(const ServerProfile&);
+    void showArenaUsage();
 };
 
 #endif // DIALOG_H
@@ -0,0 +1,417 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by Саша Миленковић                                 *
+ *   sasa.milenkovic.xyz@gmail.com                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *   ( http://www.gnu.org/licenses/gpl-3.0.en.html )                       *
+ *									   *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <QFile>
+#include <QRegExp>
+#include <QStringList>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+
+#include <algorithm>
+#include <cmath>
+
+#include "footprint.h"
+#include "tracer.h"
+
+const double EPS = 1e-9;    // of a tile span: what only touches a tile edge is not in the tile
+
+//----------------------------------------------
+BBox Footprint::bounds() const
+{
+    BBox box(0.0, 0.0, 0.0, 0.0);
+    bool bfirst = true;
+    for(int i=0; i<rings.size(); i++)
+    {
+        for(int j=0; j<rings[i].size(); j++)
+        {
+            const QPointF& p = rings[i][j];
+            if(bfirst)
+            {
+                box = BBox(p.x(), p.y(), p.x(), p.y());
+                bfirst = false;
+                continue;
+            }
+
+            box.left = qMin(box.left, p.x());
+            box.right = qMax(box.right, p.x());
+            box.bottom = qMin(box.bottom, p.y());
+            box.top = qMax(box.top, p.y());
+        }
+    }
+
+    return box;
+}
+
+//==============================================
+// reading
+
+//----------------------------------------------
+// every innermost "( x y, x y, ... )" is a ring
+static QString parseWkt(const QString& text, Footprint& footprint)
+{
+    QString wkt = text.simplified();
+    if(wkt.startsWith("SRID=", Qt::CaseInsensitive))
+        wkt = wkt.mid(wkt.indexOf(';') + 1).trimmed();
+
+    if(!wkt.startsWith("POLYGON", Qt::CaseInsensitive) && !wkt.startsWith("MULTIPOLYGON", Qt::CaseInsensitive))
+        return "Only POLYGON and MULTIPOLYGON footprints are supported.";
+
+    int pos = 0;
+    while((pos = wkt.indexOf('(', pos)) >= 0)
+    {
+        int end = wkt.indexOf(')', pos);
+        int inner = wkt.lastIndexOf('(', end);
+        if(end < 0)
+            return "Unbalanced parentheses in the WKT.";
+
+        QStringList points = wkt.mid(inner + 1, end - inner - 1).split(',', QString::SkipEmptyParts);
+        QVector<QPointF> ring;
+        for(int i=0; i<points.size(); i++)
+        {
+            // Z and M are ignored
+            QStringList xy = points[i].simplified().split(' ');
+            bool bx = false, by = false;
+            double x = xy.size() >= 2 ? xy[0].toDouble(&bx) : 0.0;
+            double y = xy.size() >= 2 ? xy[1].toDouble(&by) : 0.0;
+            if(!bx || !by)
+                return "Invalid point '" + points[i].simplified() + "' in the WKT.";
+
+            ring.append(QPointF(x, y));
+        }
+
+        if(ring.size() >= 3)
+            footprint.rings.append(ring);
+
+        pos = end + 1;
+    }
+
+    return QString();
+}
+
+//----------------------------------------------
+static bool geoJsonRing(const QJsonArray& coordinates, QVector<QPointF>& ring)
+{
+    for(int i=0; i<coordinates.size(); i++)
+    {
+        QJsonArray xy = coordinates[i].toArray();
+        if(xy.size() < 2)
+            return false;
+
+        ring.append(QPointF(xy[0].toDouble(), xy[1].toDouble()));
+    }
+
+    return ring.size() >= 3;
+}
+
+//----------------------------------------------
+static QString parseGeoJson(const QJsonObject& object, Footprint& footprint)
+{
+    QString type = object.value("type").toString();
+
+    if(type == "FeatureCollection")
+    {
+        QJsonArray features = object.value("features").toArray();
+        for(int i=0; i<features.size(); i++)
+        {
+            QString error = parseGeoJson(features[i].toObject(), footprint);
+            if(!error.isEmpty())
+                return error;
+        }
+        return QString();
+    }
+
+    if(type == "Feature")
+        return parseGeoJson(object.value("geometry").toObject(), footprint);
+
+    if(type == "GeometryCollection")
+    {
+        QJsonArray geometries = object.value("geometries").toArray();
+        for(int i=0; i<geometries.size(); i++)
+        {
+            QString error = parseGeoJson(geometries[i].toObject(), footprint);
+            if(!error.isEmpty())
+                return error;
+        }
+        return QString();
+    }
+
+    QJsonArray polygons;
+    if(type == "Polygon")
+        polygons.append(object.value("coordinates"));
+    else if(type == "MultiPolygon")
+        polygons = object.value("coordinates").toArray();
+    else
+        return "The GeoJSON geometry '" + type + "' is not a polygon.";
+
+    for(int i=0; i<polygons.size(); i++)
+    {
+        QJsonArray rings = polygons[i].toArray();
+        for(int j=0; j<rings.size(); j++)
+        {
+            QVector<QPointF> ring;
+            if(!geoJsonRing(rings[j].toArray(), ring))
+                return "Invalid polygon ring in the GeoJSON.";
+
+            footprint.rings.append(ring);
+        }
+    }
+
+    return QString();
+}
+
+//----------------------------------------------
+QString FootprintIO::parse(const QByteArray& text, Footprint& footprint)
+{
+    footprint.rings.clear();
+
+    QString error;
+    if(text.trimmed().startsWith('{'))
+    {
+        QJsonParseError jsonerror;
+        QJsonDocument document = QJsonDocument::fromJson(text, &jsonerror);
+        if(!document.isObject())
+            return "Invalid GeoJSON: " + jsonerror.errorString();
+
+        error = parseGeoJson(document.object(), footprint);
+    }
+    else
+        error = parseWkt(QString::fromUtf8(text), footprint);
+
+    if(error.isEmpty() && footprint.isEmpty())
+        error = "There is no polygon in the footprint.";
+
+    return error;
+}
+
+//----------------------------------------------
+QString FootprintIO::load(const QString& path, Footprint& footprint)
+{
+    QFile file(path);
+    if(!file.open(QIODevice::ReadOnly))
+        return "Cannot open the footprint '" + path + "'.";
+
+    return parse(file.readAll(), footprint);
+}
+
+//==============================================
+// rasterizing
+
+//----------------------------------------------
+struct Span
+{
+    Span(double a = 0.0, double b = 0.0) : x0(a), x1(b) {}
+    bool operator<(const Span& other) const { return x0 < other.x0; }
+
+    double x0, x1;
+};
+
+//----------------------------------------------
+// the inside of the footprint along a scanline (even-odd)
+static void addCrossings(QVector<double>& crossings, QVector<Span>& spans)
+{
+    std::sort(crossings.begin(), crossings.end());
+    for(int i=0; i+1<crossings.size(); i+=2)
+        spans.append(Span(crossings[i], crossings[i+1]));
+}
+
+//----------------------------------------------
+// sorted, merged runs; 'spans' are in the tile units of the level
+static QVector<TileRange> columnRuns(QVector<Span>& spans, qint64 r, qint64 c0, qint64 c1)
+{
+    QVector<TileRange> runs;
+    std::sort(spans.begin(), spans.end());
+
+    for(int i=0; i<spans.size(); i++)
+    {
+        qint64 a = qMax(c0, qint64(std::floor(spans[i].x0 + EPS)));
+        qint64 b = qMin(c1, qint64(std::ceil(spans[i].x1 - EPS)) - 1);
+        if(b < a)
+            continue;
+
+        if(!runs.isEmpty() && a <= runs.last().c1 + 1)
+            runs.last().c1 = qMax(runs.last().c1, b);
+        else
+            runs.append(TileRange(a, b, r, r));
+    }
+
+    return runs;
+}
+
+//----------------------------------------------
+// Scanline rasterizing over the tile rows. The footprint touches the tile
+// row where the polygon meets the row's strip; the x extent of that is the
+// extent of the edge pieces within the strip together with the inside
+// along the strip's two (slightly inset) border lines. Every edge visits
+// only the rows it spans.
+QVector<QVector<TileRange> > FootprintRaster::rasterize(const Footprint& footprint, const TileGrid& grid, int k, int buffer)
+{
+    TraceSpan span("rasterize footprint", "footprint", k);
+
+    const TileRange all = grid.levelTiles(k);
+    const qint64 rows = all.rows();
+    const double s = grid.span(k);
+    const double ox = grid.extent().left, oy = grid.extent().bottom;
+
+    QVector<QVector<Span> > spans(rows);
+    QVector<QVector<double> > lower(rows), upper(rows);
+
+    for(int i=0; i<footprint.rings.size(); i++)
+    {
+        const QVector<QPointF>& ring = footprint.rings[i];
+        for(int j=0; j<ring.size(); j++)
+        {
+            // in the tile units of the level
+            const QPointF& p = ring[j];
+            const QPointF& q = ring[(j + 1) % ring.size()];
+            double px = (p.x() - ox) / s, py = (p.y() - oy) / s;
+            double qx = (q.x() - ox) / s, qy = (q.y() - oy) / s;
+
+            double ylo = qMin(py, qy), yhi = qMax(py, qy);
+            qint64 ra = qMax(all.r0, qint64(std::floor(ylo + EPS)));
+            qint64 rb = qMin(all.r1, qMax(qint64(std::floor(ylo + EPS)), qint64(std::ceil(yhi - EPS)) - 1));
+
+            for(qint64 r=ra; r<=rb; r++)
+            {
+                double yb = r + EPS, yt = r + 1 - EPS;
+                QVector<Span>& rowspans = spans[r - all.r0];
+
+                // the piece of the edge within the strip
+                double x0, x1;
+                if(yhi - ylo < EPS)
+                {
+                    x0 = px;
+                    x1 = qx;
+                }
+                else
+                {
+                    double t0 = (qMax(yb, ylo) - py) / (qy - py);
+                    double t1 = (qMin(yt, yhi) - py) / (qy - py);
+                    x0 = px + (qx - px) * t0;
+                    x1 = px + (qx - px) * t1;
+                }
+                rowspans.append(Span(qMin(x0, x1), qMax(x0, x1)));
+
+                // the crossings of the border lines (half open, a vertex counts once)
+                if(ylo <= yb && yb < yhi)
+                    lower[r - all.r0].append(px + (qx - px) * (yb - py) / (qy - py));
+                if(ylo <= yt && yt < yhi)
+                    upper[r - all.r0].append(px + (qx - px) * (yt - py) / (qy - py));
+            }
+        }
+    }
+
+    QVector<QVector<TileRange> > runs(rows);
+    for(qint64 i=0; i<rows; i++)
+    {
+        addCrossings(lower[i], spans[i]);
+        addCrossings(upper[i], spans[i]);
+        runs[i] = columnRuns(spans[i], all.r0 + i, all.c0, all.c1);
+    }
+
+    if(buffer <= 0)
+        return runs;
+
+    // grown by the buffer in both directions
+    QVector<QVector<TileRange> > grown(rows);
+    for(qint64 i=0; i<rows; i++)
+    {
+        QVector<Span> near;
+        for(qint64 j=qMax(qint64(0), i - buffer); j<=qMin(rows - 1, i + buffer); j++)
+            for(int n=0; n<runs[j].size(); n++)
+                near.append(Span(runs[j][n].c0 - buffer + 0.5, runs[j][n].c1 + buffer + 0.5));
+
+        grown[i] = columnRuns(near, all.r0 + i, all.c0, all.c1);
+    }
+
+    return grown;
+}
+
+//----------------------------------------------
+QList<UBox> FootprintRaster::regions(const Footprint& footprint, const TileGrid& grid, int buffer, FootprintStats* stats)
+{
+    TraceSpan span("footprint regions", "footprint");
+
+    QList<UBox> uboxes;
+    FootprintStats st;
+    const BBox bounds = footprint.bounds();
+
+    for(int k=0; k<grid.levels(); k++)
+    {
+        QVector<QVector<TileRange> > runs = rasterize(footprint, grid, k, buffer);
+
+        UBox ubox;
+        ubox.hres = ubox.lres = grid.resolution(k);
+        double inset = grid.span(k) / 4.0; // the region touches only its tiles
+
+        TileRange b = grid.range(bounds, k);
+        if(!b.isEmpty())
+            b = TileRange(b.c0 - buffer, b.c1 + buffer, b.r0 - buffer, b.r1 + buffer);
+        st.boundstiles += grid.range(grid.rangeBox(k, b), k).count();
+
+        // open rectangles by their columns; a row without the same run closes them
+        QHash<qint64, TileRange> open;
+        for(int i=0; i<=runs.size(); i++)
+        {
+            QHash<qint64, TileRange> next;
+            if(i < runs.size())
+            {
+                for(int n=0; n<runs[i].size(); n++)
+                {
+                    const TileRange& run = runs[i][n];
+                    qint64 key = (run.c0 << 32) | (run.c1 & 0xFFFFFFFF);
+
+                    TileRange rect = open.contains(key) ? open.take(key) : run;
+                    rect.r1 = run.r1;
+                    next.insert(key, rect);
+                    st.tiles += run.count();
+                }
+            }
+
+            for(QHash<qint64, TileRange>::const_iterator it=open.constBegin(); it!=open.constEnd(); ++it)
+            {
+                ubox.box = grid.rangeBox(k, it.value());
+                ubox.box.left += inset;
+                ubox.box.right -= inset;
+                ubox.box.bottom += inset;
+                ubox.box.top -= inset;
+                uboxes.append(ubox);
+            }
+
+            open = next;
+        }
+    }
+
+    st.regions = uboxes.size();
+    if(stats)
+        *stats = st;
+
+    return uboxes;
+}
+
+//----------------------------------------------
+QString FootprintRaster::report(const FootprintStats& st)
+{
+    QString sretval = "Footprint: " + QString::number(st.tiles) + " tiles in " + QString::number(st.regions) + " regions";
+    if(st.boundstiles > 0)
+        sretval += " (" + QString::number(100.0 * st.tiles / st.boundstiles, 'f', 1) + "% of its bounding box)";
+
+    return sretval;
+}
@@ -0,0 +1,74 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by Саша Миленковић                                 *
+ *   sasa.milenkovic.xyz@gmail.com                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *   ( http://www.gnu.org/licenses/gpl-3.0.en.html )                       *
+ *									   *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef FOOTPRINT_H
+#define FOOTPRINT_H
+
+#include <QList>
+#include <QVector>
+#include <QPointF>
+#include <QString>
+
+#include "tilegrid.h"
+
+//----------------------------------------------
+// A polygonal area to seed instead of the whole BBOX: the rings of one or
+// more polygons in the SRS of the job, filled by the even-odd rule (so the
+// holes and the separate parts need no distinction).
+struct Footprint
+{
+    QList<QVector<QPointF> > rings;
+
+    bool isEmpty() const { return rings.isEmpty(); }
+    BBox bounds() const;
+};
+
+//----------------------------------------------
+struct FootprintStats
+{
+    FootprintStats() : tiles(0), boundstiles(0), regions(0) {}
+
+    qint64 tiles;       // the tiles of all levels the footprint touches
+    qint64 boundstiles; // ... and its bounding box
+    int regions;
+};
+
+namespace FootprintIO
+{
+    // WKT (POLYGON, MULTIPOLYGON) or GeoJSON (a geometry, a Feature or a
+    // FeatureCollection of polygons); returns the error, empty - OK
+    QString parse(const QByteArray& text, Footprint& footprint);
+    QString load(const QString& path, Footprint& footprint);
+}
+
+namespace FootprintRaster
+{
+    // the tiles of the level k which the footprint touches, grown by 'buffer'
+    // tiles: per row (from the level's r0) the sorted, disjoint column runs
+    QVector<QVector<TileRange> > rasterize(const Footprint& footprint, const TileGrid& grid, int k, int buffer);
+
+    // the tiles of all levels as single-level update regions: the runs of
+    // consecutive rows with the same columns become one rectangle
+    QList<UBox> regions(const Footprint& footprint, const TileGrid& grid, int buffer, FootprintStats* stats = 0);
+
+    QString report(const FootprintStats&);
+}
+
+#endif // FOOTPRINT_H
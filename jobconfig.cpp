@@ -0,0 +1,455 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by Саша Миленковић                                 *
+ *   sasa.milenkovic.xyz@gmail.com                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *   ( http://www.gnu.org/licenses/gpl-3.0.en.html )                       *
+ *									   *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <QTextStream>
+
+#include "jobconfig.h"
+
+//----------------------------------------------
+JobConfig::JobConfig() :
+    srs("EPSG:3857"),
+    threads(1), quality(90),
+    tilesize(DEFAULTTILESIZE),
+    noopt(false), skipdirs(false), verbose(true),
+    background("white"), exceptions("tolerant"), format("jpeg"),
+    updates(false),
+    footprintbuffer(0)
+{
+}
+
+//----------------------------------------------
+QString JobIO::validateBBOX(const QString& bboxtext, BBox& bbox)
+{
+    QString sbbox = bboxtext.simplified();
+    if(sbbox.isEmpty())
+        return "The caching cannot start if the bounding box (BBOX) is not set.\n\nEnter the BBOX, please.";
+
+    QStringList strlist = sbbox.split(",");
+    if(strlist.size()!=4)
+        return "The bounding box (BBOX) is not valid.\nIt should have 4 parameters (left, bottom, right, top), but it is not so?!\n\nCorrect the data, please.";
+
+    bool bretval;
+
+    bbox.left = strlist[0].trimmed().toDouble(&bretval);
+    if(!bretval)
+        return "The caching will not start because\nthe BBOX.left is not valid.\n\nCorrect the data, please.";
+
+    bbox.bottom = strlist[1].trimmed().toDouble(&bretval);
+    if(!bretval)
+        return "The caching will not start because\nthe BBOX.bottom is not valid.\n\nCorrect the data, please.";
+
+    bbox.right = strlist[2].trimmed().toDouble(&bretval);
+    if(!bretval)
+        return "The caching will not start because\nthe BBOX.right is not valid.\n\nCorrect the data, please.";
+
+    bbox.top = strlist[3].trimmed().toDouble(&bretval);
+    if(!bretval)
+        return "The caching will not start because\nthe BBOX.top is not valid.\n\nCorrect the data, please.";
+
+    if(bbox.left >= bbox.right)
+        return "The caching will not start because\nBBOX.left should be less than BBOX.right, but it is not so?!\n\nCorrect the data, please.";
+
+    if(bbox.bottom >= bbox.top)
+        return "The caching will not start because\nBBOX.bottom should be less than BBOX.top, but it is not so?!\n\nCorrect the data, please.";
+
+    return QString();
+}
+
+//----------------------------------------------
+// 'lres' is the lowest sensible resolution for the BBOX (two tiles along its shorter side)
+QString JobIO::validateResolution(const QString& restext, const BBox& bbox, double& hres, double& lres,
+                                  int tilesize)
+{
+    QString sres = restext.simplified();
+    if(sres.isEmpty())
+        return "The caching cannot start if the resolution is not set.\n\nEnter the resolution, please.";
+
+    bool bretval;
+    hres = sres.toDouble(&bretval);
+
+    double hspan = bbox.right - bbox.left;
+    double wspan = bbox.top - bbox.bottom;
+    double minspan = hspan < wspan ? hspan : wspan;
+
+    lres = minspan * 2.0 / tilesize;
+
+    if(!bretval)
+        return "The caching will not start because\nthe resolution is not valid.\n\nCorrect the data, please.";
+
+    return QString();
+}
+
+//----------------------------------------------
+QString JobIO::formatUBox(const UBox& ubox)
+{
+    // thus, the values may be a bit more formatted
+    QString sretval = QString::number(ubox.box.left,'g',8) + "," +
+                      QString::number(ubox.box.bottom,'g',8) + "," +
+                      QString::number(ubox.box.right,'g',8) + "," +
+                      QString::number(ubox.box.top,'g',8);
+
+    if(ubox.hres > 0.0)
+        sretval += "," + QString::number(ubox.hres);
+
+    if(ubox.lres > 0.0)
+        sretval += "," + QString::number(ubox.lres,'g',8);
+
+    if(ubox.fitres > 0.0)
+        sretval += "," + QString::number(ubox.fitres,'g',8);
+
+    return sretval;
+}
+
+//----------------------------------------------------------
+QString JobIO::validateUpdateRow(int row, const QStringList& cells,
+                                 const BBox& bbox, double minres, double maxres,
+                                 int* errcolumn, UBox* ubox)
+{
+    static const char* const names[UBOXCOLUMNS] = { "left", "bottom", "right", "top", "high resolution", "low resolution", "fitting resolution" };
+
+    QString s[UBOXCOLUMNS];
+    for(int col=0; col<UBOXCOLUMNS && col<cells.size(); col++)
+        s[col] = cells[col].simplified();
+
+    int errcol = -1;
+    if(!errcolumn)
+        errcolumn = &errcol;
+    *errcolumn = -1;
+
+    QString srow = QString::number(row);
+
+    bool bEmptyRegion = s[0].isEmpty() && s[1].isEmpty() && s[2].isEmpty() && s[3].isEmpty();
+    bool bEmptyRow = bEmptyRegion && s[4].isEmpty() && s[5].isEmpty() && s[6].isEmpty();
+
+    if(bEmptyRow)
+        return "empty";
+    else if(bEmptyRegion)
+        return "Error at UBOX " + srow + ": Not all the mandatory values (left,bottom,right,top) have been set?!";
+
+    // tho following is for - no bEmptyRow and no bEmptyRegion
+
+    //------ left, bottom, right, top ------------
+    bool bOK;
+    double d[4];
+    for(int col=0; col<4; col++)
+    {
+        *errcolumn = col;
+
+        if(s[col].isEmpty())
+            return "Error at UBOX " + srow + ":  there is no '" + names[col] + "' parameter?!";
+
+        d[col] = s[col].toDouble(&bOK);
+        if(!bOK)
+            return "Error at UBOX " + srow + ":  the '" + names[col] + "' parameter is not valid?!";
+    }
+
+    UBox result;
+    result.box = BBox(d[0], d[1], d[2], d[3]);
+
+    //------ logical inconsistencies ------------
+    *errcolumn = 2;
+    if(d[0] >= d[2])
+        return "Error at UBOX " + srow + ":  the 'left' parameter is bigger than the 'right' parameter?!";
+    *errcolumn = 3;
+    if(d[1] >= d[3])
+        return "Error at UBOX " + srow + ":  the 'bottom' parameter is bigger than the 'top' parameter?!";
+
+    *errcolumn = 0;
+    if(d[0] < bbox.left)
+        return "Error at UBOX " + srow + ":  the 'left' parameter is less than the BBOX.left parameter?!";
+    *errcolumn = 1;
+    if(d[1] < bbox.bottom)
+        return "Error at UBOX " + srow + ":  the 'bottom' parameter is less than the BBOX.bottom parameter?!";
+    *errcolumn = 2;
+    if(d[2] > bbox.right)
+        return "Error at UBOX " + srow + ":  the 'right' parameter is bigger than the BBOX.right parameter?!";
+    *errcolumn = 3;
+    if(d[3] > bbox.top)
+        return "Error at UBOX " + srow + ":  the 'top' parameter is bigger than the BBOX.top parameter?!";
+
+    // resolutions
+
+    bool bhres = !s[4].isEmpty();
+    if(bhres)
+    {
+        *errcolumn = 4;
+
+        result.hres = s[4].toDouble(&bOK);
+        if(!bOK)
+            return "Error at UBOX " + srow + ":  the 'high resolution' parameter is not valid?!";
+
+        if(result.hres < minres)
+            return "Error at UBOX " + srow + ":  the 'high resolution' parameter is better than general resolution?!";
+
+        if(result.hres > maxres)
+            return "Error at UBOX " + srow + ":  the 'high resolution' parameter is too low?!";
+    }
+
+    bool blres = !s[5].isEmpty();
+    if(blres)
+    {
+        *errcolumn = 4;
+        if(!bhres)
+            return "Error at UBOX " + srow + ":  there is 'low resolution' but there is no 'high resolution'?!";
+
+        *errcolumn = 5;
+
+        result.lres = s[5].toDouble(&bOK);
+        if(!bOK)
+            return "Error at UBOX " + srow + ":  the 'low resolution' parameter is not valid?!";
+
+        if(result.lres < result.hres)
+            return "Error at UBOX " + srow + ":  the 'low resolution' is better than 'the high' resolution?!";
+
+        if(result.lres > maxres)
+            return "Error at UBOX " + srow + ":  the 'low resolution' parameter is too low?!";
+    }
+
+    bool bfitres = !s[6].isEmpty();
+    if(bfitres)
+    {
+        *errcolumn = 5;
+        if(!blres)
+            return "Error at UBOX " + srow + ":  there is 'fitting resolution' but there is no 'low resolution'?!";
+
+        *errcolumn = 6;
+
+        result.fitres = s[6].toDouble(&bOK);
+        if(!bOK)
+            return "Error at UBOX " + srow + ":  the 'fitting resolution' parameter is not valid?!";
+
+        if(result.fitres < result.hres || result.fitres > result.lres)
+            return "Error at UBOX " + srow + ":  the 'fitting resolution' parameter is not between 'high resolution' and 'low resolution'?!";
+    }
+
+    *errcolumn = -1;
+    if(ubox)
+        *ubox = result;
+
+    return formatUBox(result);
+}
+
+//----------------------------------------------
+// one line of an update regions list; false if it has not 4..7 values
+static bool splitUpdateRow(const QString& line, QStringList& cells)
+{
+    cells = line.split(",");
+    if(cells.size()<4 || cells.size()>UBOXCOLUMNS)
+        return false;
+
+    for(int i=0; i<cells.size(); i++)
+        cells[i] = cells[i].simplified();
+
+    while(cells.size() < UBOXCOLUMNS)
+        cells.append(QString());
+
+    return true;
+}
+
+//----------------------------------------------
+bool JobIO::readTip(QTextStream& in, JobConfig& cfg)
+{
+    bool bOK;
+
+    // edits
+    QString line = in.readLine();
+    if(line.isNull() || !line.startsWith("url:")) return false;
+    cfg.url = line.right(line.length()-4);
+
+    line = in.readLine();
+    if(line.isNull() || !line.startsWith("layer:")) return false;
+    cfg.layer = line.right(line.length()-6);
+
+    line = in.readLine();
+    if(line.isNull() || !line.startsWith("bbox:")) return false;
+    cfg.bbox = line.right(line.length()-5);
+
+    line = in.readLine();
+    if(line.isNull() || !line.startsWith("res:")) return false;
+    cfg.res = line.right(line.length()-4);
+
+    line = in.readLine();
+    if(line.isNull() || !line.startsWith("srs:")) return false;
+    cfg.srs = line.right(line.length()-4);
+
+    // spins
+    line = in.readLine();
+    if(line.isNull() || !line.startsWith("threads:")) return false;
+    cfg.threads = line.right(line.length()-8).simplified().toInt(&bOK);
+    if(!bOK) return false;
+
+    line = in.readLine();
+    if(line.isNull() || !line.startsWith("quality:")) return false;
+    cfg.quality = line.right(line.length()-8).simplified().toInt(&bOK);
+    if(!bOK) return false;
+
+    // checks
+    line = in.readLine();
+    if(line.isNull() || !line.startsWith("noopt:")) return false;
+    cfg.noopt = line.right(line.length()-6).simplified().toInt(&bOK) != 0;
+    if(!bOK) return false;
+
+    line = in.readLine();
+    if(line.isNull() || !line.startsWith("skipdirs:")) return false;
+    cfg.skipdirs = line.right(line.length()-9).simplified().toInt(&bOK) != 0;
+    if(!bOK) return false;
+
+    line = in.readLine();
+    if(line.isNull() || !line.startsWith("verbose:")) return false;
+    cfg.verbose = line.right(line.length()-8).simplified().toInt(&bOK) != 0;
+    if(!bOK) return false;
+
+    line = in.readLine();
+    if(line.isNull() || !line.startsWith("background:")) return false;
+    cfg.background = line.right(line.length()-11).simplified();
+    if(cfg.background != "white" && cfg.background != "black" && cfg.background != "transparent")
+        return false;
+
+    line = in.readLine();
+    if(line.isNull() || !line.startsWith("exceptions:")) return false;
+    cfg.exceptions = line.right(line.length()-11).simplified();
+    if(cfg.exceptions != "tolerant" && cfg.exceptions != "moderate" && cfg.exceptions != "strict")
+        return false;
+
+    line = in.readLine();
+    if(line.isNull() || !line.startsWith("format:")) return false;
+    cfg.format = line.right(line.length()-7).simplified();
+    if(cfg.format != "jpeg" && cfg.format != "png" && cfg.format != "gif")
+        return false;
+
+    // optional, older files have no tile size
+    line = in.readLine();
+    cfg.tilesize = DEFAULTTILESIZE;
+    if(!line.isNull() && line.startsWith("tilesize:"))
+    {
+        cfg.tilesize = line.right(line.length()-9).simplified().toInt(&bOK);
+        if(!bOK || (cfg.tilesize != 256 && cfg.tilesize != 512 && cfg.tilesize != 1024))
+            return false;
+
+        line = in.readLine();
+    }
+
+    // optional: "footprint:<buffer>,<path>"
+    cfg.footprint.clear();
+    cfg.footprintbuffer = 0;
+    if(!line.isNull() && line.startsWith("footprint:"))
+    {
+        QString value = line.right(line.length()-10);
+        int comma = value.indexOf(',');
+        if(comma < 0) return false;
+
+        cfg.footprintbuffer = value.left(comma).simplified().toInt(&bOK);
+        if(!bOK || cfg.footprintbuffer < 0) return false;
+        cfg.footprint = value.mid(comma + 1).trimmed();
+
+        line = in.readLine();
+    }
+
+    // updates
+    if(line.isNull() || !line.startsWith("updates:")) return false;
+    cfg.updates = line.right(line.length()-8).simplified().toInt(&bOK) != 0;
+    if(!bOK) return false;
+
+    cfg.updaterows.clear();
+
+    QStringList cells;
+    while (!in.atEnd())
+    {
+        line = in.readLine();
+        if(line.simplified().isEmpty())
+            continue;
+
+        if(!splitUpdateRow(line, cells))
+            return false;
+
+        cfg.updaterows.append(cells);
+    }
+
+    return true;
+}
+
+//----------------------------------------------
+void JobIO::writeTip(QTextStream& out, const JobConfig& cfg)
+{
+    out << "url:" << cfg.url << "\n";
+    out << "layer:" << cfg.layer << "\n";
+    out << "bbox:" << cfg.bbox << "\n";
+    out << "res:" << cfg.res << "\n";
+    out << "srs:" << cfg.srs << "\n";
+
+    out << "threads:" << cfg.threads << "\n";
+    out << "quality:" << cfg.quality << "\n";
+
+    out << "noopt:" << int(cfg.noopt) << "\n";
+    out << "skipdirs:" << int(cfg.skipdirs) << "\n";
+    out << "verbose:" << int(cfg.verbose) << "\n";
+
+    out << "background:" << cfg.background << "\n";
+    out << "exceptions:" << cfg.exceptions << "\n";
+    out << "format:" << cfg.format << "\n";
+    if(cfg.tilesize != DEFAULTTILESIZE)
+        out << "tilesize:" << cfg.tilesize << "\n";
+    if(!cfg.footprint.isEmpty())
+        out << "footprint:" << cfg.footprintbuffer << "," << cfg.footprint << "\n";
+
+    out << "updates:" << int(cfg.updates) << "\n";
+
+    // no endl here - flushing every line makes big lists very slow
+    for(int row = 0; row<cfg.updaterows.size(); row++)
+    {
+        const QStringList& cells = cfg.updaterows[row];
+        for(int col = 0; col<UBOXCOLUMNS; col++)
+        {
+            if(col > 0)
+                out << ",";
+            if(col < cells.size())
+                out << cells[col];
+        }
+        out << "\n";
+    }
+
+    out.flush();
+}
+
+//----------------------------------------------
+bool JobIO::readUpdateRows(QTextStream& in, QList<QStringList>& rows, QString* error)
+{
+    rows.clear();
+
+    QStringList cells;
+    while (!in.atEnd())
+    {
+        QString line = in.readLine();
+        if(line.simplified().isEmpty())
+            continue;
+
+        if(!splitUpdateRow(line, cells))
+        {
+            if(error)
+                *error = "Irregular number of parameters of ubox No. " + QString::number(rows.size()+1) + ".\n\nData will not be loaded.";
+            rows.clear();
+            return false;
+        }
+
+        rows.append(cells);
+    }
+
+    return true;
+}
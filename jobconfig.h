@@ -0,0 +1,97 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by Саша Миленковић                                 *
+ *   sasa.milenkovic.xyz@gmail.com                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *   ( http://www.gnu.org/licenses/gpl-3.0.en.html )                       *
+ *									   *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef JOBCONFIG_H
+#define JOBCONFIG_H
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+
+class QTextStream;
+
+// Widget-free part of the dialog: parsing and validation of the job
+// parameters and the *.tip / update-regions file formats.
+
+const int UBOXCOLUMNS = 7; // left, bottom, right, top, high res., low res., fitting res.
+const int DEFAULTTILESIZE = 512; // the tilemaker's own; 256 and 1024 are passed with --tilesize
+
+//----------------------------------------------
+struct BBox
+{
+    BBox() : left(-180.0), bottom(-90.0), right(180.0), top(90.0) {}
+    BBox(double l, double b, double r, double t) : left(l), bottom(b), right(r), top(t) {}
+
+    double left, bottom, right, top;
+};
+
+//----------------------------------------------
+// one validated update region; a resolution which is not set is 0
+struct UBox
+{
+    UBox() : hres(0.0), lres(0.0), fitres(0.0) {}
+
+    BBox box;
+    double hres, lres, fitres;
+};
+
+//----------------------------------------------
+// contents of a *.tip file, the fields are kept as they have been typed
+struct JobConfig
+{
+    JobConfig();
+
+    QString url, layer, bbox, res, srs;
+    int threads, quality;
+    int tilesize;
+    bool noopt, skipdirs, verbose;
+    QString background;     // white, black, transparent
+    QString exceptions;     // tolerant, moderate, strict
+    QString format;         // jpeg, png, gif
+    bool updates;
+    QList<QStringList> updaterows; // UBOXCOLUMNS cells per row, may be empty
+    QString footprint;      // WKT/GeoJSON polygon file of further update regions (optional)
+    int footprintbuffer;    // tiles around the footprint
+};
+
+namespace JobIO
+{
+    // 'error' gets the message for the user; empty return means OK
+    QString validateBBOX(const QString& sbbox, BBox& bbox);
+    QString validateResolution(const QString& sres, const BBox& bbox, double& hres, double& lres,
+                               int tilesize = DEFAULTTILESIZE);
+
+    // returns "empty", "Error at UBOX ..." or the normalized line for the tilemaker;
+    // 'errcolumn' is the column to focus (-1 - the whole row)
+    QString validateUpdateRow(int row, const QStringList& cells,
+                              const BBox& bbox, double minres, double maxres,
+                              int* errcolumn = 0, UBox* ubox = 0);
+
+    // the same line format which the tilemaker reads with --file
+    QString formatUBox(const UBox&);
+
+    bool readTip(QTextStream& in, JobConfig& cfg);
+    void writeTip(QTextStream& out, const JobConfig& cfg);
+
+    // update regions file (4..7 comma separated values per line)
+    bool readUpdateRows(QTextStream& in, QList<QStringList>& rows, QString* error);
+}
+
+#endif // JOBCONFIG_H
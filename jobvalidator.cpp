@@ -0,0 +1,303 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by Саша Миленковић                                 *
+ *   sasa.milenkovic.xyz@gmail.com                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *   ( http://www.gnu.org/licenses/gpl-3.0.en.html )                       *
+ *									   *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <QtConcurrentRun>
+
+#include <algorithm>
+
+#include "jobvalidator.h"
+#include "tracer.h"
+
+//----------------------------------------------
+// all cells empty - no cells
+static QStringList normalized(const QStringList& cells)
+{
+    QStringList result;
+    bool bempty = true;
+    for(int i=0; i<cells.size(); i++)
+    {
+        result << cells[i].simplified();
+        bempty = bempty && result.last().isEmpty();
+    }
+
+    return bempty ? QStringList() : result;
+}
+
+//----------------------------------------------
+// a single word, as the tilemaker takes it
+static QString checkWord(const QString& text, const QString& name, bool bmandatory)
+{
+    QString s = text.simplified();
+    if(s.isEmpty() && bmandatory)
+        return "The " + name + " is not set.";
+
+    if(s.contains(" "))
+        return "The " + name + " is not valid (two strings instead of just one).";
+
+    return QString();
+}
+
+//----------------------------------------------
+JobValidator::JobValidator(QObject *parent) :
+    QObject(parent),
+    hres(0.0),
+    lres(0.0),
+    tilesize(DEFAULTTILESIZE),
+    bcontext(false),
+    stamp(1),
+    batchhres(0.0),
+    batchlres(0.0)
+{
+    connect(&watcher, SIGNAL(finished()), this, SLOT(checked()));
+}
+
+//----------------------------------------------
+JobValidator::~JobValidator()
+{
+    watcher.waitForFinished();
+}
+
+//----------------------------------------------
+void JobValidator::setFields(const QString& url, const QString& layer, const QString& sbbox,
+                             const QString& sres, const QString& srs, int size)
+{
+    fielderrors[FieldUrl] = checkWord(url, "URL of the WMS server", true);
+    fielderrors[FieldLayer] = checkWord(layer, "WMS layer", true);
+    fielderrors[FieldSRS] = checkWord(srs, "SRS", false);
+
+    BBox box;
+    double h = 0.0, l = 0.0;
+    fielderrors[FieldBBOX] = JobIO::validateBBOX(sbbox, box);
+    fielderrors[FieldRes] = fielderrors[FieldBBOX].isEmpty() ?
+                            JobIO::validateResolution(sres, box, h, l, size) : QString();
+
+    bool bvalid = fielderrors[FieldBBOX].isEmpty() && fielderrors[FieldRes].isEmpty();
+    bool bsame = bvalid == bcontext && box.left == bbox.left && box.bottom == bbox.bottom &&
+                 box.right == bbox.right && box.top == bbox.top && h == hres && l == lres && tilesize == size;
+
+    // the rows depend on the BBOX and the resolution
+    if(!bsame)
+    {
+        bbox = box;
+        hres = h;
+        lres = l;
+        tilesize = size;
+        bcontext = bvalid;
+        stamp++;
+
+        for(int row=0; row<rows.size(); row++)
+            if(!rows[row].cells.isEmpty())
+                dirty.insert(row);
+    }
+
+    emit fieldsChecked();
+    schedule();
+}
+
+//----------------------------------------------
+void JobValidator::setRowCount(int count)
+{
+    int old = rows.size();
+    rows.resize(count);
+    for(int row=old; row<count; row++)
+        rows[row].row = row;
+
+    QList<int> gone = dirty.toList();
+    for(int i=0; i<gone.size(); i++)
+        if(gone[i] >= count)
+            dirty.remove(gone[i]);
+}
+
+//----------------------------------------------
+void JobValidator::setRow(int row, const QStringList& cells)
+{
+    if(row < 0 || row >= rows.size())
+        return;
+
+    QStringList normal = normalized(cells);
+    if(normal == rows[row].cells && (normal.isEmpty() || rows[row].stamp == stamp))
+        return;
+
+    // an empty row is valid in any context
+    if(normal.isEmpty())
+    {
+        dirty.remove(row);
+        rows[row] = RowCheck();
+        rows[row].row = row;
+        emit rowsChecked(QList<int>() << row);
+        return;
+    }
+
+    // until it is checked
+    rows[row].cells = normal;
+    rows[row].stamp = 0;
+    dirty.insert(row);
+    schedule();
+}
+
+//----------------------------------------------
+bool JobValidator::isBusy() const
+{
+    return watcher.isRunning() || !batch.isEmpty() || (bcontext && !dirty.isEmpty());
+}
+
+//----------------------------------------------
+void JobValidator::waitForFinished()
+{
+    watcher.waitForFinished();
+    apply();
+
+    if(bcontext && !dirty.isEmpty())
+    {
+        take();
+        checkBatch();
+        apply();
+    }
+}
+
+//----------------------------------------------
+int JobValidator::rowErrors() const
+{
+    int errors = 0;
+    for(int row=0; row<rows.size(); row++)
+        if(!rows[row].error.isEmpty())
+            errors++;
+
+    return errors;
+}
+
+//----------------------------------------------
+int JobValidator::firstErrorRow() const
+{
+    for(int row=0; row<rows.size(); row++)
+        if(!rows[row].error.isEmpty())
+            return row;
+
+    return -1;
+}
+
+//----------------------------------------------
+QList<UBox> JobValidator::uboxes() const
+{
+    QList<UBox> result;
+    for(int row=0; row<rows.size(); row++)
+        if(!rows[row].bempty && rows[row].error.isEmpty())
+            result.append(rows[row].ubox);
+
+    return result;
+}
+
+//----------------------------------------------
+QString JobValidator::summary() const
+{
+    int fields = 0;
+    for(int f=0; f<Fields; f++)
+        if(!fielderrors[f].isEmpty())
+            fields++;
+
+    int errors = rowErrors();
+    if(fields == 0 && errors == 0)
+        return isBusy() ? "Checking the update regions ..." : QString();
+
+    QString sretval;
+    if(fields > 0)
+        sretval = QString::number(fields) + (fields == 1 ? " field" : " fields");
+    if(errors > 0)
+        sretval += (sretval.isEmpty() ? "" : ", ") + QString::number(errors) + (errors == 1 ? " UBOX" : " UBOXes");
+
+    return sretval + " to correct";
+}
+
+//----------------------------------------------
+void JobValidator::schedule()
+{
+    if(watcher.isRunning() || !batch.isEmpty() || !bcontext || dirty.isEmpty())
+        return;
+
+    take();
+    watcher.setFuture(QtConcurrent::run(this, &JobValidator::checkBatch));
+}
+
+//----------------------------------------------
+// the dirty rows and the context into the batch
+void JobValidator::take()
+{
+    QList<int> pending = dirty.toList();
+    std::sort(pending.begin(), pending.end());
+    dirty.clear();
+
+    batch.clear();
+    batch.reserve(pending.size());
+    for(int i=0; i<pending.size(); i++)
+    {
+        RowCheck check;
+        check.row = pending[i];
+        check.cells = rows[pending[i]].cells;
+        check.stamp = stamp;
+        batch.append(check);
+    }
+
+    batchbox = bbox;
+    batchhres = hres;
+    batchlres = lres;
+}
+
+//----------------------------------------------
+// in a pool thread, only the batch is touched
+void JobValidator::checkBatch()
+{
+    TraceSpan span("validate rows", "validate", batch.size());
+
+    for(int i=0; i<batch.size(); i++)
+    {
+        RowCheck& check = batch[i];
+        QString verdict = JobIO::validateUpdateRow(check.row, check.cells, batchbox, batchhres, batchlres,
+                                                   &check.errcolumn, &check.ubox);
+        check.bempty = verdict == "empty";
+        check.error = verdict.startsWith("Error") ? verdict : QString();
+    }
+}
+
+//----------------------------------------------
+void JobValidator::checked()
+{
+    apply();
+    schedule();
+}
+
+//----------------------------------------------
+// the verdicts of the rows which have not changed since
+void JobValidator::apply()
+{
+    QList<int> changed;
+    for(int i=0; i<batch.size(); i++)
+    {
+        const RowCheck& check = batch[i];
+        if(check.row >= rows.size() || check.stamp != stamp || rows[check.row].cells != check.cells)
+            continue;
+
+        rows[check.row] = check;
+        changed.append(check.row);
+    }
+    batch.clear();
+
+    if(!changed.isEmpty())
+        emit rowsChecked(changed);
+}
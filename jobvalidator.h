@@ -0,0 +1,117 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by Саша Миленковић                                 *
+ *   sasa.milenkovic.xyz@gmail.com                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *   ( http://www.gnu.org/licenses/gpl-3.0.en.html )                       *
+ *									   *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef JOBVALIDATOR_H
+#define JOBVALIDATOR_H
+
+#include <QObject>
+#include <QVector>
+#include <QSet>
+#include <QStringList>
+#include <QFutureWatcher>
+
+#include "jobconfig.h"
+#include "tilegrid.h"
+
+//----------------------------------------------
+// the verdict on one row of the update regions table
+struct RowCheck
+{
+    RowCheck() : row(0), bempty(true), errcolumn(-1), stamp(0) {}
+
+    int row;
+    QStringList cells;  // as checked, none - an empty row
+    bool bempty;
+    QString error;      // empty - OK
+    int errcolumn;      // -1 - the whole row
+    UBox ubox;          // the parsed values of a valid row
+    quint64 stamp;      // of the BBOX and resolution it has been checked against
+};
+
+//----------------------------------------------
+// Validates the job definition while it is being edited. The fields are
+// checked at once; the rows of the update regions in a pool thread, only
+// the edited ones, or all of them when the BBOX or the resolution change.
+// The verdicts and the parsed values of the rows are kept, so a job which
+// has been edited into a valid state starts without validating it again.
+class JobValidator : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Field { FieldUrl, FieldLayer, FieldBBOX, FieldRes, FieldSRS, Fields };
+
+    explicit JobValidator(QObject *parent = 0);
+    ~JobValidator();
+
+    void setFields(const QString& url, const QString& layer, const QString& bbox, const QString& res,
+                   const QString& srs, int tilesize);
+    void setRowCount(int count);
+    void setRow(int row, const QStringList& cells);
+
+    // rows waiting or being checked; the wait checks the rest in this thread
+    bool isBusy() const;
+    void waitForFinished();
+
+    QString fieldError(int field) const { return fielderrors[field]; }
+
+    // of the valid BBOX and resolution
+    TileGrid grid() const { return TileGrid(bbox, hres, lres, tilesize); }
+    int rowCount() const { return rows.size(); }
+    const RowCheck& row(int row) const { return rows[row]; }
+    int rowErrors() const;
+    int firstErrorRow() const;      // -1 - none
+
+    // the regions of the non-empty rows, in their order
+    QList<UBox> uboxes() const;
+
+    QString summary() const;
+
+signals:
+    void fieldsChecked();
+    void rowsChecked(const QList<int>& rows);
+
+private slots:
+    void checked();
+
+private:
+    QString fielderrors[Fields];
+    BBox bbox;
+    double hres, lres;
+    int tilesize;
+    bool bcontext;          // the BBOX and the resolution are valid
+    quint64 stamp;
+
+    QVector<RowCheck> rows;
+    QSet<int> dirty;        // to be checked
+
+    QVector<RowCheck> batch;    // being checked, with its context
+    BBox batchbox;
+    double batchhres, batchlres;
+
+    QFutureWatcher<void> watcher;
+
+    void schedule();
+    void take();
+    void checkBatch();
+    void apply();
+};
+
+#endif // JOBVALIDATOR_H
@@ -0,0 +1,484 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by Саша Миленковић                                 *
+ *   sasa.milenkovic.xyz@gmail.com                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *   ( http://www.gnu.org/licenses/gpl-3.0.en.html )                       *
+ *									   *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <QDir>
+#include <QSet>
+#include <QMap>
+#include <QProcess>
+#include <QImage>
+#include <QImageWriter>
+#include <QPainter>
+#include <QSaveFile>
+#include <QBuffer>
+#include <QThreadPool>
+#include <QScopedPointer>
+#include <QtConcurrentRun>
+#include <QtConcurrentMap>
+
+#include "layerset.h"
+#include "tracer.h"
+#include "bufferarena.h"
+
+//----------------------------------------------
+QStringList LayerSet::parse(const QString& text)
+{
+    QStringList layers;
+    QStringList parts = text.split(';', QString::SkipEmptyParts);
+    for(int i=0; i<parts.size(); i++)
+    {
+        QString layer = parts[i].simplified();
+        if(!layer.isEmpty() && !layers.contains(layer))
+            layers << layer;
+    }
+
+    return layers;
+}
+
+//----------------------------------------------
+QString LayerSet::directoryName(const QString& layer)
+{
+    QString name = layer;
+    for(int i=0; i<name.size(); i++)
+        if(!name[i].isLetterOrNumber() && name[i] != '-' && name[i] != '.')
+            name[i] = '_';
+
+    return name;
+}
+
+//----------------------------------------------
+int LayerSet::createDirectories(const QStringList& roots, const TileGrid& grid, const QList<UBox>& regions, bool bupdates)
+{
+    TraceSpan span("create directories", "layers");
+
+    QList<UBox> boxes = regions;
+    if(!bupdates)
+    {
+        UBox whole;
+        whole.box = grid.extent();
+        boxes.clear();
+        boxes.append(whole);
+    }
+
+    // the columns of all regions, each once
+    QSet<qint64> columns;
+    for(int i=0; i<boxes.size(); i++)
+    {
+        int kmin, kmax;
+        grid.levelRange(boxes[i], kmin, kmax);
+
+        for(int k=kmin; k<=kmax; k++)
+        {
+            TileRange range = grid.range(boxes[i], k);
+            for(qint64 c=range.c0; c<=range.c1; c++)
+                columns.insert((qint64(grid.zoom(k)) << 40) | c);
+        }
+    }
+
+    int created = 0;
+    QDir dir;
+    for(QSet<qint64>::const_iterator it=columns.constBegin(); it!=columns.constEnd(); ++it)
+    {
+        QString path = "/" + QString::number(*it >> 40) + "/" + QString::number(*it & ((qint64(1) << 40) - 1));
+        for(int i=0; i<roots.size(); i++)
+            if(dir.mkpath(roots[i] + path))
+                created++;
+    }
+
+    return created;
+}
+
+//==============================================
+// the run
+
+//----------------------------------------------
+LayerRun::LayerRun(QObject *parent) :
+    QObject(parent),
+    threads(1),
+    running(0),
+    failed(0),
+    bstopped(false)
+{
+    connect(&dirwatcher, SIGNAL(finished()), this, SLOT(directoriesCreated()));
+}
+
+//----------------------------------------------
+LayerRun::~LayerRun()
+{
+    stop();
+    dirwatcher.waitForFinished();
+}
+
+//----------------------------------------------
+void LayerRun::start(const QString& cmd, const QStringList& arguments, const QStringList& names,
+                     const QString& base, int threadcount, const TileGrid& grid,
+                     const QList<UBox>& regions, bool bupdates)
+{
+    command = cmd;
+    args = arguments;
+    layers = names;
+    threads = qMax(1, threadcount / qMax(1, layers.size()));
+    running = 0;
+    failed = 0;
+    bstopped = false;
+    timer.start();
+
+    layerroots.clear();
+    for(int i=0; i<layers.size(); i++)
+        layerroots << base + "/" + LayerSet::directoryName(layers[i]);
+
+    emit message("Creating the directories of " + QString::number(layers.size()) + " layers ...");
+    dirwatcher.setFuture(QtConcurrent::run(LayerSet::createDirectories, layerroots, grid, regions, bupdates));
+}
+
+//----------------------------------------------
+void LayerRun::stop()
+{
+    bstopped = true;
+    for(int i=0; i<processes.size(); i++)
+        processes[i]->kill();
+}
+
+//----------------------------------------------
+bool LayerRun::isRunning() const
+{
+    return dirwatcher.isRunning() || running > 0;
+}
+
+//----------------------------------------------
+void LayerRun::directoriesCreated()
+{
+    if(bstopped)
+    {
+        emit finished(layers.size());
+        return;
+    }
+
+    emit message(QString::number(dirwatcher.result()) + " directories created; " +
+                 QString::number(layers.size()) + " tilemakers with " + QString::number(threads) + " threads each.");
+
+    qDeleteAll(processes);
+    processes.clear();
+
+    for(int i=0; i<layers.size(); i++)
+    {
+        QStringList a = args;
+
+        int j = a.indexOf("--layer");
+        if(j >= 0 && j+1 < a.size())
+            a[j+1] = layers[i];
+
+        j = a.indexOf("--threads");
+        if(j >= 0 && j+1 < a.size())
+        {
+            a.removeAt(j);
+            a.removeAt(j);
+        }
+        if(threads != 1)
+            a << "--threads" << QString::number(threads);
+
+        if(!a.contains("--skipdirs"))
+            a << "--skipdirs";
+
+        QProcess* process = new QProcess(this);
+        process->setObjectName(layers[i]);
+        process->setProcessChannelMode(QProcess::MergedChannels);
+        process->setWorkingDirectory(layerroots[i]);
+        connect(process, SIGNAL(readyReadStandardOutput()), this, SLOT(processOutput()));
+        connect(process, SIGNAL(finished(int)), this, SLOT(processFinished(int)));
+        processes.append(process);
+
+        running++;
+        process->start(command, a);
+        if(!process->waitForStarted())
+        {
+            emit output(layers[i], "The tilemaker cannot be started.");
+            running--;
+            failed++;
+        }
+    }
+
+    if(running == 0)
+        emit finished(failed);
+}
+
+//----------------------------------------------
+void LayerRun::processOutput()
+{
+    QProcess* process = qobject_cast<QProcess*>(sender());
+    if(process)
+        emit output(process->objectName(), process->readAllStandardOutput());
+}
+
+//----------------------------------------------
+void LayerRun::processFinished(int exitcode)
+{
+    QProcess* process = qobject_cast<QProcess*>(sender());
+    if(!process)
+        return;
+
+    if(exitcode != 0 || process->exitStatus() == QProcess::CrashExit)
+        failed++;
+
+    if(--running > 0)
+        return;
+
+    emit message(QString::number(layers.size()) + " layers done in " +
+                 QString::number(timer.elapsed() / 1000.0, 'f', 1) + " s" +
+                 (failed > 0 ? ", " + QString::number(failed) + " failed." : "."));
+    emit finished(failed);
+}
+
+//==============================================
+// the composite
+
+//----------------------------------------------
+// runs in the pool threads
+struct ComposeJob
+{
+    ComposeJob(const LayerCompositor* p) : compositor(p) {}
+
+    void operator()(CompositeColumn& column) const
+    {
+        compositor->composeColumn(column);
+    }
+
+    const LayerCompositor* compositor;
+};
+
+//----------------------------------------------
+LayerCompositor::LayerCompositor(QObject *parent) :
+    QObject(parent),
+    bjpeg(true),
+    quality(90),
+    background(0),
+    bcancelled(false)
+{
+    connect(&scanwatcher, SIGNAL(finished()), this, SLOT(scanned()));
+    connect(&columnwatcher, SIGNAL(progressValueChanged(int)), this, SLOT(columnProgress(int)));
+    connect(&columnwatcher, SIGNAL(finished()), this, SIGNAL(finished()));
+}
+
+//----------------------------------------------
+LayerCompositor::~LayerCompositor()
+{
+    cancel();
+    scanwatcher.waitForFinished();
+    columnwatcher.waitForFinished();
+}
+
+//----------------------------------------------
+void LayerCompositor::start(const QStringList& layerroots, const QString& out, const TileGrid& grid,
+                            bool bj, int q, QRgb color)
+{
+    roots = layerroots;
+    output = out;
+    bjpeg = bj;
+    quality = q;
+    background = color;
+    BufferArena::configure(QThreadPool::globalInstance()->maxThreadCount(), grid.tileSize());
+
+    columns.clear();
+    bcancel.store(0);
+    bcancelled = false;
+    timer.start();
+
+    scanwatcher.setFuture(QtConcurrent::run(this, &LayerCompositor::scan));
+}
+
+//----------------------------------------------
+void LayerCompositor::cancel()
+{
+    bcancel.store(1);
+    bcancelled = true;
+    columnwatcher.cancel();
+}
+
+//----------------------------------------------
+bool LayerCompositor::isRunning() const
+{
+    return scanwatcher.isRunning() || columnwatcher.isRunning();
+}
+
+//----------------------------------------------
+// the <z>/<x> directories of any layer (in a pool thread)
+void LayerCompositor::scan()
+{
+    QSet<qint64> seen;
+    for(int i=0; i<roots.size() && !bcancel.load(); i++)
+    {
+        QDir root(roots[i]);
+        QStringList zdirs = root.entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+        for(int j=0; j<zdirs.size(); j++)
+        {
+            bool bz;
+            int z = zdirs[j].toInt(&bz);
+            if(!bz || z < 0)
+                continue;
+
+            QStringList xdirs = QDir(root.filePath(zdirs[j])).entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+            for(int n=0; n<xdirs.size(); n++)
+            {
+                bool bx;
+                int x = xdirs[n].toInt(&bx);
+                qint64 key = (qint64(z) << 32) | quint32(x);
+                if(!bx || x < 0 || seen.contains(key))
+                    continue;
+
+                seen.insert(key);
+
+                CompositeColumn column;
+                column.z = z;
+                column.x = x;
+                columns.append(column);
+            }
+        }
+    }
+}
+
+//----------------------------------------------
+void LayerCompositor::scanned()
+{
+    if(bcancelled || columns.isEmpty())
+    {
+        emit finished();
+        return;
+    }
+
+    emit progress(0, columns.size());
+    columnwatcher.setFuture(QtConcurrent::map(columns, ComposeJob(this)));
+}
+
+//----------------------------------------------
+void LayerCompositor::columnProgress(int done)
+{
+    emit progress(done, columns.size());
+}
+
+//----------------------------------------------
+void LayerCompositor::composeColumn(CompositeColumn& column) const
+{
+    TraceSpan span("column", "composite", column.x);
+
+    const QString sub = "/" + QString::number(column.z) + "/" + QString::number(column.x);
+    const QStringList filters = QStringList() << "*.jpg" << "*.jpeg" << "*.png" << "*.gif";
+
+    // the tiles of the column: y -> the file of every layer (empty - none)
+    QMap<int, QStringList> tiles;
+    for(int i=0; i<roots.size(); i++)
+    {
+        QDir dir(roots[i] + sub);
+        QStringList names = dir.entryList(filters, QDir::Files);
+        for(int n=0; n<names.size(); n++)
+        {
+            bool by;
+            int y = names[n].left(names[n].indexOf('.')).toInt(&by);
+            if(!by)
+                continue;
+
+            QStringList& files = tiles[y];
+            while(files.size() < roots.size())
+                files << QString();
+            files[i] = dir.filePath(names[n]);
+        }
+    }
+
+    if(tiles.isEmpty())
+        return;
+
+    QDir().mkpath(output + sub);
+
+    for(QMap<int, QStringList>::const_iterator it=tiles.constBegin(); it!=tiles.constEnd() && !bcancel.load(); ++it)
+    {
+        QScopedPointer<ArenaBuffer> raster;
+        QImage result;
+        QPainter painter;
+
+        for(int i=0; i<it.value().size(); i++)
+        {
+            if(it.value()[i].isEmpty())
+                continue;
+
+            QImage layer;
+            {
+                TraceSpan decode(TraceName::Decode, "composite", it.key());
+                layer.load(it.value()[i]);
+            }
+            if(layer.isNull())
+                continue;
+
+            if(result.isNull())
+            {
+                raster.reset(new ArenaBuffer(qint64(layer.width()) * layer.height() * 4));
+                result = raster->image(layer.width(), layer.height(),
+                                       bjpeg ? QImage::Format_RGB32 : QImage::Format_ARGB32_Premultiplied);
+                result.fill(bjpeg ? background : 0);
+                painter.begin(&result);
+            }
+
+            painter.drawImage(0, 0, layer);
+        }
+
+        if(result.isNull())
+        {
+            column.failed++;
+            continue;
+        }
+        painter.end();
+
+        QByteArray encoded;
+        {
+            TraceSpan encode(TraceName::Encode, "composite", it.key());
+            QBuffer buffer(&encoded);
+            buffer.open(QIODevice::WriteOnly);
+            QImageWriter writer(&buffer, bjpeg ? "jpg" : "png");
+            if(bjpeg)
+                writer.setQuality(quality);
+            if(!writer.write(result))
+                encoded.clear();
+        }
+
+        TraceSpan write(TraceName::Write, "composite", it.key());
+        QSaveFile file(output + sub + "/" + QString::number(it.key()) + (bjpeg ? ".jpg" : ".png"));
+        if(!encoded.isEmpty() && file.open(QIODevice::WriteOnly) && file.write(encoded) == encoded.size() && file.commit())
+            column.written++;
+        else
+            column.failed++;
+    }
+}
+
+//----------------------------------------------
+QString LayerCompositor::report() const
+{
+    int written = 0, failed = 0;
+    for(int i=0; i<columns.size(); i++)
+    {
+        written += columns[i].written;
+        failed += columns[i].failed;
+    }
+
+    QString sretval = "Composited " + QString::number(written) + " tiles of " + QString::number(roots.size()) +
+                      " layers into " + output + " in " + QString::number(timer.elapsed() / 1000.0, 'f', 1) + " s" +
+                      (bcancelled ? " (cancelled)" : "");
+
+    if(failed > 0)
+        sretval += "\n" + QString::number(failed) + " tiles could not be read or written";
+
+    return sretval;
+}
@@ -0,0 +1,156 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by Саша Миленковић                                 *
+ *   sasa.milenkovic.xyz@gmail.com                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *   ( http://www.gnu.org/licenses/gpl-3.0.en.html )                       *
+ *									   *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef LAYERSET_H
+#define LAYERSET_H
+
+#include <QObject>
+#include <QStringList>
+#include <QVector>
+#include <QFutureWatcher>
+#include <QElapsedTimer>
+#include <QAtomicInt>
+#include <QRgb>
+
+#include "tilegrid.h"
+
+class QProcess;
+
+// Several WMS layers over the same BBOX in one job ("roads;rivers;labels"
+// in the layer field). The plan is validated and the update regions are
+// optimized once; the directory tree is created once for all layers and
+// one tilemaker per layer runs with --skipdirs in <base>/<layer>/, all at
+// the same time, so the requests of the layers interleave.
+namespace LayerSet
+{
+    // in the stacking order (the first one at the bottom)
+    QStringList parse(const QString& layers);
+
+    // the directory of the layer's pyramid
+    QString directoryName(const QString& layer);
+
+    // the <z>/<x> directories which the plan writes, under every root
+    int createDirectories(const QStringList& roots, const TileGrid& grid, const QList<UBox>& regions, bool bupdates);
+}
+
+//----------------------------------------------
+class LayerRun : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit LayerRun(QObject *parent = 0);
+    ~LayerRun();
+
+    // 'args' - the arguments of the tilemaker for the first layer; the layer,
+    // the threads (split among the layers) and --skipdirs are set per process
+    void start(const QString& command, const QStringList& args, const QStringList& layers,
+               const QString& base, int threads, const TileGrid& grid,
+               const QList<UBox>& regions, bool bupdates);
+    void stop();
+    bool isRunning() const;
+
+    QStringList roots() const { return layerroots; }
+
+signals:
+    void message(const QString&);
+    void output(const QString& layer, const QByteArray& data);
+    void finished(int failed);
+
+private slots:
+    void directoriesCreated();
+    void processOutput();
+    void processFinished(int);
+
+private:
+    QString command;
+    QStringList args;
+    QStringList layers;
+    QStringList layerroots;
+    int threads;
+    QList<QProcess*> processes;
+    int running;
+    int failed;
+    bool bstopped;
+    QElapsedTimer timer;
+    QFutureWatcher<int> dirwatcher;
+};
+
+//----------------------------------------------
+// one column directory of the composite pyramid
+struct CompositeColumn
+{
+    CompositeColumn() : z(0), x(0), written(0), failed(0) {}
+
+    int z, x;
+    int written;
+    int failed;
+};
+
+//----------------------------------------------
+// Stacks the pyramids of the layers (source over, in the layer order)
+// into <base>/composite, in parallel (QtConcurrent). Only the upper
+// layers with transparency let the lower ones through.
+class LayerCompositor : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit LayerCompositor(QObject *parent = 0);
+    ~LayerCompositor();
+
+    // 'bjpeg' - the composite is JPEG over the background, otherwise PNG
+    void start(const QStringList& roots, const QString& output, const TileGrid& grid,
+               bool bjpeg, int quality, QRgb background);
+    void cancel();
+    bool isRunning() const;
+
+    QString report() const;
+
+    // runs in the pool threads
+    void composeColumn(CompositeColumn& column) const;
+
+signals:
+    void progress(int done, int total);
+    void finished();
+
+private slots:
+    void scanned();
+    void columnProgress(int);
+
+private:
+    QStringList roots;
+    QString output;
+    bool bjpeg;
+    int quality;
+    QRgb background;
+
+    QVector<CompositeColumn> columns;
+    QAtomicInt bcancel;
+    bool bcancelled;
+    QElapsedTimer timer;
+
+    QFutureWatcher<void> scanwatcher;
+    QFutureWatcher<void> columnwatcher;
+
+    void scan();
+};
+
+#endif // LAYERSET_H
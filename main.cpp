@@ -19,10 +19,246 @@
  ***************************************************************************/
 
 #include "dialog.h"
+#include "cluster.h"
+#include "requestplan.h"
+#include "tileoptimizer.h"
+#include "bufferarena.h"
+#include "changemanifest.h"
 #include <QApplication>
+#include <QTextStream>
+#include <QFile>
+#include <QDir>
+
+//----------------------------------------------
+// tilemaker_wms_gui --worker host[:port] [--slots n] [--token t]
+// runs a headless worker agent of a distributed job; the token of the
+// coordinator comes from --token or $TILEMAKER_CLUSTER_TOKEN
+static int runWorker(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QStringList args = a.arguments();
+    int i = args.indexOf("--worker");
+
+    QString host = i+1 < args.size() ? args[i+1] : QString();
+    quint16 port = CLUSTERPORT;
+
+    int colon = host.lastIndexOf(':');
+    if(colon > 0)
+    {
+        port = host.mid(colon+1).toUShort();
+        host = host.left(colon);
+    }
+
+    int slotcount = 1;
+    int j = args.indexOf("--slots");
+    if(j > 0 && j+1 < args.size())
+        slotcount = args[j+1].toInt();
+
+    QByteArray token = qgetenv(ClusterPlan::TOKENVARIABLE);
+    int t = args.indexOf("--token");
+    if(t > 0 && t+1 < args.size())
+        token = args[t+1].toUtf8();
+
+    if(host.isEmpty() || port == 0 || slotcount < 1 || token.isEmpty())
+    {
+        QTextStream(stderr) << "usage: " << args[0] << " --worker host[:port] [--slots n] [--token t]\n"
+                            << "(the token may be set in $" << ClusterPlan::TOKENVARIABLE << " instead)\n";
+        return 1;
+    }
+
+    ClusterWorkerAgent agent(host, port, slotcount, token);
+    QObject::connect(&agent, SIGNAL(finished()), &a, SLOT(quit()));
+    agent.start();
+
+    return a.exec();
+}
+
+//----------------------------------------------
+// tilemaker_wms_gui --plan job.tip [--count] [--no-merge]
+// writes the GetMap requests of a saved job to stdout, the summary to stderr
+static int runPlan(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QStringList args = a.arguments();
+    int i = args.indexOf("--plan");
+
+    QFile file(i+1 < args.size() ? args[i+1] : QString());
+    if(!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        QTextStream(stderr) << "usage: " << args[0] << " --plan job.tip [--count] [--no-merge]\n";
+        return 1;
+    }
+
+    QTextStream in(&file);
+    JobConfig cfg;
+    if(!JobIO::readTip(in, cfg))
+    {
+        QTextStream(stderr) << file.fileName() << " is not a valid *.tip file.\n";
+        return 1;
+    }
+
+    RequestPlan::Job job;
+    QString error = RequestPlan::fromConfig(cfg, !args.contains("--no-merge"), job);
+    if(!error.isEmpty())
+    {
+        QTextStream(stderr) << error << "\n";
+        return 1;
+    }
+
+    QFile out;
+    bool bcount = args.contains("--count");
+    if(!bcount)
+        out.open(stdout, QIODevice::WriteOnly);
+
+    RequestPlan::Summary summary = RequestPlan::write(job, bcount ? 0 : &out);
+    QTextStream(stderr) << RequestPlan::report(summary) << "\n";
+
+    return 0;
+}
+
+//----------------------------------------------
+// tilemaker_wms_gui --optimize dir [--quality q] [--budget kb] [--level-budgets z:kb,...] [--ssim s]
+//                   [--from-level z] [--tilesize n] [--no-png] [--no-jpeg]
+// recompresses a tile tree without the GUI
+static int runOptimize(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QStringList args = a.arguments();
+    int i = args.indexOf("--optimize");
+
+    QString root = i+1 < args.size() ? args[i+1] : QString();
+    if(root.isEmpty() || !QDir(root).exists())
+    {
+        QTextStream(stderr) << "usage: " << args[0] << " --optimize dir [--quality q] [--budget kb]"
+                               " [--level-budgets z:kb,...] [--ssim s] [--from-level z] [--tilesize n] [--no-png] [--no-jpeg]\n";
+        return 1;
+    }
+
+    OptimizeOptions options;
+    options.bpng = !args.contains("--no-png");
+    options.bjpeg = !args.contains("--no-jpeg");
+
+    int j = args.indexOf("--quality");
+    if(j > 0 && j+1 < args.size())
+        options.quality = qBound(0, args[j+1].toInt(), 100);
+
+    j = args.indexOf("--budget");
+    if(j > 0 && j+1 < args.size())
+        options.budget = qMax(0, args[j+1].toInt()) * 1024;
+
+    j = args.indexOf("--level-budgets");
+    if(j > 0 && j+1 < args.size() && !options.setLevelBudgets(args[j+1]))
+    {
+        QTextStream(stderr) << "--level-budgets expects z:kb,... (e.g. 14:24,16:16)\n";
+        return 1;
+    }
+
+    j = args.indexOf("--ssim");
+    if(j > 0 && j+1 < args.size())
+        options.ssim = qBound(0.0, args[j+1].toDouble(), 0.999);
+
+    j = args.indexOf("--from-level");
+    if(j > 0 && j+1 < args.size())
+        options.fromlevel = qMax(0, args[j+1].toInt());
+
+    // only the tile size of the grid matters for the buffers
+    int tilesize = DEFAULTTILESIZE;
+    j = args.indexOf("--tilesize");
+    if(j > 0 && j+1 < args.size())
+        tilesize = args[j+1].toInt();
+
+    if(!TileGrid::isValidTileSize(tilesize))
+    {
+        QTextStream(stderr) << "--tilesize expects 256, 512 or 1024\n";
+        return 1;
+    }
+
+    TileOptimizer optimizer;
+    QObject::connect(&optimizer, SIGNAL(finished()), &a, SLOT(quit()));
+    optimizer.start(root, TileGrid(BBox(), 0.0, 0.0, tilesize), options);
+
+    int exitcode = a.exec();
+    QTextStream(stderr) << optimizer.report() << "\n" << BufferArena::report() << "\n";
+
+    return exitcode;
+}
+
+//----------------------------------------------
+// tilemaker_wms_gui --delta dir [--run n | --since n]
+// writes the tiles created or replaced by the recorded run(s) (the last one
+// by default) to stdout as a tar stream, the summary to stderr
+static int runDelta(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QStringList args = a.arguments();
+    int i = args.indexOf("--delta");
+
+    QString root = i+1 < args.size() ? args[i+1] : QString();
+    QString path = ChangeManifest::fileName(root);
+
+    QHash<qint64, TileChange> tiles;
+    int runs = root.isEmpty() ? 0 : ChangeManifest::latest(path, tiles, 1, 0);
+    if(runs <= 0)
+    {
+        QTextStream(stderr) << "usage: " << args[0] << " --delta dir [--run n | --since n]\n";
+        if(runs < 0)
+            QTextStream(stderr) << path << " is not a change manifest.\n";
+        return 1;
+    }
+
+    int from = runs, to = runs;
+    int j = args.indexOf("--run");
+    if(j > 0 && j+1 < args.size())
+        from = to = args[j+1].toInt();
+
+    j = args.indexOf("--since");
+    if(j > 0 && j+1 < args.size())
+        from = args[j+1].toInt();
+
+    if(from < 1 || from > to || to > runs)
+    {
+        QTextStream(stderr) << path << " has the runs 1 - " << runs << ".\n";
+        return 1;
+    }
+
+    ChangeManifest::latest(path, tiles, from, to);
+
+    QFile out;
+    out.open(stdout, QIODevice::WriteOnly);
+
+    int missing = 0;
+    int exported = ChangeManifest::exportTar(root, tiles, &out, &missing);
+    if(exported < 0)
+    {
+        QTextStream(stderr) << "The tar stream can't be written.\n";
+        return 1;
+    }
+
+    QTextStream(stderr) << "Runs " << from << " - " << to << ": " << exported << " tiles exported, "
+                        << tiles.size() - exported - missing << " unchanged, " << missing
+                        << " gone from the cache\n";
+
+    return 0;
+}
 
 int main(int argc, char *argv[])
 {
+    for(int i=1; i<argc; i++)
+    {
+        if(QString(argv[i]) == "--worker")
+            return runWorker(argc, argv);
+        if(QString(argv[i]) == "--plan")
+            return runPlan(argc, argv);
+        if(QString(argv[i]) == "--optimize")
+            return runOptimize(argc, argv);
+        if(QString(argv[i]) == "--delta")
+            return runDelta(argc, argv);
+    }
+
     QApplication a(argc, argv);
     Dialog w;
     w.show();
@@ -0,0 +1,381 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by Саша Миленковић                                 *
+ *   sasa.milenkovic.xyz@gmail.com                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *   ( http://www.gnu.org/licenses/gpl-3.0.en.html )                       *
+ *									   *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <QFile>
+#include <QDir>
+#include <QStringList>
+
+#include "procmonitor.h"
+
+#ifdef Q_OS_LINUX
+#include <unistd.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#endif
+
+const int THROTTLEPERIOD = 200; // msecs, one SIGSTOP/SIGCONT duty cycle
+
+//----------------------------------------------
+// reads the whole (zero-sized) /proc file
+static QByteArray readProcFile(const QString& path)
+{
+    QFile file(path);
+    if(!file.open(QIODevice::ReadOnly))
+        return QByteArray();
+
+    return file.readAll();
+}
+
+//----------------------------------------------
+// utime+stime (and num_threads) out of /proc/<pid>/stat or /proc/<pid>/task/<tid>/stat
+static bool readStatTicks(const QString& path, qint64& ticks, int* threads = 0)
+{
+    QByteArray data = readProcFile(path);
+
+    // the command name is in parentheses and it may contain spaces
+    int paren = data.lastIndexOf(')');
+    if(paren < 0)
+        return false;
+
+    // fields[0] is 'state' i.e. field 3 of proc(5), so field N is fields[N-3]
+    QList<QByteArray> fields = data.mid(paren+2).split(' ');
+    if(fields.size() < 18)
+        return false;
+
+    ticks = fields[11].toLongLong() + fields[12].toLongLong();
+    if(threads)
+        *threads = fields[17].toInt();
+
+    return true;
+}
+
+//----------------------------------------------
+// value of a 'key: value' line (/proc/<pid>/status, /proc/<pid>/io)
+static qint64 procValue(const QByteArray& data, const QByteArray& key)
+{
+    int pos = data.indexOf("\n" + key);
+    if(pos < 0)
+    {
+        if(!data.startsWith(key))
+            return -1;
+    }
+    else
+        pos += 1;
+
+    int end = data.indexOf('\n', pos);
+    QByteArray line = data.mid(pos + key.length(), end < 0 ? -1 : end - pos - key.length());
+    line = line.replace("kB", "").trimmed();
+
+    return line.toLongLong();
+}
+
+//----------------------------------------------
+ProcMonitor::ProcMonitor(QObject *parent) :
+    QObject(parent),
+    processid(0),
+    lastmsecs(0), lastticks(0), lastread(0), lastwrite(0),
+    stopfraction(0.0), bstopped(false), stoppedmsecs(0), stopstarted(0),
+    brsswarned(false), peakrss(0)
+{
+    sampletimer.setInterval(1000);
+    throttletimer.setSingleShot(true);
+
+    connect(&sampletimer, SIGNAL(timeout()), this, SLOT(sample()));
+    connect(&throttletimer, SIGNAL(timeout()), this, SLOT(throttle()));
+}
+
+//----------------------------------------------
+ProcMonitor::~ProcMonitor()
+{
+    stop();
+}
+
+//----------------------------------------------
+void ProcMonitor::setInterval(int msecs)
+{
+    sampletimer.setInterval(msecs < 100 ? 100 : msecs);
+}
+
+//----------------------------------------------
+void ProcMonitor::setBudget(const ProcBudget& b)
+{
+    procbudget = b;
+    if(procbudget.cgroup == badcgroup)
+        procbudget.cgroup.clear();
+
+    if(isRunning())
+    {
+        governedthreads.clear();
+        applyToThreads();
+        applyCgroup();
+    }
+}
+
+//----------------------------------------------
+void ProcMonitor::start(qint64 pid)
+{
+    stop();
+
+#ifdef Q_OS_LINUX
+    processid = pid;
+
+    clock.start();
+    lastmsecs = 0;
+    lastticks = 0;
+    lastread = lastwrite = 0;
+    lastthreadticks.clear();
+    governedthreads.clear();
+
+    stopfraction = 0.0;
+    bstopped = false;
+    stoppedmsecs = 0;
+    brsswarned = false;
+    peakrss = 0;
+
+    applyCgroup();
+    applyToThreads();
+
+    sampletimer.start();
+#else
+    Q_UNUSED(pid)
+#endif
+}
+
+//----------------------------------------------
+void ProcMonitor::stop(bool bexited)
+{
+    sampletimer.stop();
+    throttletimer.stop();
+
+    // no SIGCONT to a process which is gone
+    if(bexited)
+        processid = 0;
+
+    resume();
+    processid = 0;
+}
+
+//----------------------------------------------
+// SIGCONT if the governor holds the process stopped just now
+void ProcMonitor::resume()
+{
+#ifdef Q_OS_LINUX
+    if(bstopped && processid > 0)
+    {
+        ::kill(pid_t(processid), SIGCONT);
+        stoppedmsecs += clock.elapsed() - stopstarted;
+    }
+#endif
+    bstopped = false;
+}
+
+//----------------------------------------------
+// renice/ionice every thread which has not been treated yet (on Linux
+// both priorities are per thread, and the tilemaker starts its workers lazily)
+void ProcMonitor::applyToThreads()
+{
+#ifdef Q_OS_LINUX
+    if(procbudget.nice <= 0 && !procbudget.idleio)
+        return;
+
+    QDir taskdir(QString("/proc/%1/task").arg(processid));
+    foreach(const QString& stid, taskdir.entryList(QDir::Dirs | QDir::NoDotAndDotDot))
+    {
+        int tid = stid.toInt();
+        if(governedthreads.contains(tid))
+            continue;
+
+        if(procbudget.nice > 0)
+            setpriority(PRIO_PROCESS, id_t(tid), procbudget.nice > 19 ? 19 : procbudget.nice);
+
+        // IOPRIO_WHO_PROCESS = 1, IOPRIO_CLASS_IDLE = 3 << IOPRIO_CLASS_SHIFT(13)
+        if(procbudget.idleio)
+            syscall(SYS_ioprio_set, 1, tid, 3 << 13);
+
+        governedthreads.insert(tid, true);
+    }
+#endif
+}
+
+//----------------------------------------------
+// moves the process into the given cgroup (v2) and sets cpu.max and memory.max
+void ProcMonitor::applyCgroup()
+{
+#ifdef Q_OS_LINUX
+    if(procbudget.cgroup.isEmpty() || processid <= 0)
+        return;
+
+    QDir cgdir(procbudget.cgroup);
+    QFile procs(cgdir.filePath("cgroup.procs"));
+    if(!procs.open(QIODevice::WriteOnly) || procs.write(QByteArray::number(processid)) < 0)
+    {
+        emit governorMessage("Cannot move the process into the cgroup " + procbudget.cgroup + " (no permission?). SIGSTOP/SIGCONT throttling will be used instead.");
+        badcgroup = procbudget.cgroup;
+        procbudget.cgroup.clear();
+        return;
+    }
+    procs.close();
+
+    QFile cpumax(cgdir.filePath("cpu.max"));
+    if(cpumax.open(QIODevice::WriteOnly))
+        cpumax.write(procbudget.cpulimit > 0 ? QByteArray::number(procbudget.cpulimit * 1000) + " 100000" : QByteArray("max 100000"));
+
+    QFile memmax(cgdir.filePath("memory.max"));
+    if(memmax.open(QIODevice::WriteOnly))
+        memmax.write(procbudget.rsslimit > 0 ? QByteArray::number(procbudget.rsslimit) : QByteArray("max"));
+#endif
+}
+
+//----------------------------------------------
+void ProcMonitor::sample()
+{
+#ifdef Q_OS_LINUX
+    QString procdir = QString("/proc/%1/").arg(processid);
+
+    qint64 ticks;
+    int threads;
+    if(!readStatTicks(procdir + "stat", ticks, &threads))
+    {
+        stop(true); // the process is gone
+        return;
+    }
+
+    static const double clktck = double(sysconf(_SC_CLK_TCK));
+
+    ProcSample s;
+    s.msecs = clock.elapsed();
+    s.threads = threads;
+
+    double seconds = (s.msecs - lastmsecs) / 1000.0;
+    if(seconds <= 0.0)
+        return;
+
+    s.cpu = lastmsecs > 0 ? 100.0 * (ticks - lastticks) / clktck / seconds : 0.0;
+
+    // the busiest thread
+    s.busiestcpu = 0.0;
+    QHash<int, qint64> threadticks;
+    QDir taskdir(procdir + "task");
+    foreach(const QString& stid, taskdir.entryList(QDir::Dirs | QDir::NoDotAndDotDot))
+    {
+        qint64 tticks;
+        if(!readStatTicks(taskdir.filePath(stid) + "/stat", tticks))
+            continue;
+
+        int tid = stid.toInt();
+        threadticks.insert(tid, tticks);
+
+        if(lastthreadticks.contains(tid))
+        {
+            double tcpu = 100.0 * (tticks - lastthreadticks.value(tid)) / clktck / seconds;
+            if(tcpu > s.busiestcpu)
+                s.busiestcpu = tcpu;
+        }
+    }
+    lastthreadticks = threadticks;
+
+    QByteArray status = readProcFile(procdir + "status");
+    s.rss = qMax(qint64(0), procValue(status, "VmRSS:")) * 1024;
+    if(s.rss > peakrss)
+        peakrss = s.rss;
+
+    // /proc/<pid>/io is readable only by the owner of the process
+    QByteArray io = readProcFile(procdir + "io");
+    s.readtotal = qMax(qint64(0), procValue(io, "read_bytes:"));
+    s.writetotal = qMax(qint64(0), procValue(io, "write_bytes:"));
+    s.readrate = lastmsecs > 0 ? qint64((s.readtotal - lastread) / seconds) : 0;
+    s.writerate = lastmsecs > 0 ? qint64((s.writetotal - lastwrite) / seconds) : 0;
+
+    if(bstopped)
+    {
+        stoppedmsecs += s.msecs - stopstarted;
+        stopstarted = s.msecs;
+    }
+    s.stopped = qMin(1.0, stoppedmsecs / 1000.0 / seconds);
+    stoppedmsecs = 0;
+
+    lastmsecs = s.msecs;
+    lastticks = ticks;
+    lastread = s.readtotal;
+    lastwrite = s.writetotal;
+
+    //------ governor ------------
+    applyToThreads();
+
+    if(procbudget.rsslimit > 0 && s.rss > procbudget.rsslimit && procbudget.cgroup.isEmpty() && !brsswarned)
+    {
+        brsswarned = true;
+        emit governorMessage(QString("The tilemaker RSS (%1 MB) is over the budget (%2 MB). Only a cgroup can enforce the memory limit.")
+                             .arg(s.rss >> 20).arg(procbudget.rsslimit >> 20));
+    }
+
+    // The measured rates already include the stopped time; the rate while
+    // running is rate/(1-stopped) and the wanted stopped fraction is 1-limit/runrate.
+    double fwanted = 0.0;
+    double running = 1.0 - s.stopped;
+    if(running < 0.05)
+        running = 0.05;
+
+    if(procbudget.cpulimit > 0 && procbudget.cgroup.isEmpty() && s.cpu > 0.0)
+        fwanted = qMax(fwanted, 1.0 - procbudget.cpulimit / (s.cpu / running));
+
+    if(procbudget.iolimit > 0 && (s.readrate + s.writerate) > 0)
+        fwanted = qMax(fwanted, 1.0 - procbudget.iolimit / ((s.readrate + s.writerate) / running));
+
+    stopfraction = qBound(0.0, 0.5 * stopfraction + 0.5 * fwanted, 0.9);
+
+    if(stopfraction > 0.02)
+    {
+        if(!throttletimer.isActive())
+            throttletimer.start(0);
+    }
+    else
+    {
+        throttletimer.stop();
+        resume();
+    }
+
+    emit sampled(s);
+#endif
+}
+
+//----------------------------------------------
+// one half of the SIGSTOP/SIGCONT duty cycle
+void ProcMonitor::throttle()
+{
+#ifdef Q_OS_LINUX
+    if(processid <= 0)
+        return;
+
+    if(bstopped)
+    {
+        resume();
+        throttletimer.start(int(THROTTLEPERIOD * (1.0 - stopfraction)));
+    }
+    else
+    {
+        ::kill(pid_t(processid), SIGSTOP);
+        bstopped = true;
+        stopstarted = clock.elapsed();
+        throttletimer.start(int(THROTTLEPERIOD * stopfraction));
+    }
+#endif
+}
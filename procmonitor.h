@@ -0,0 +1,123 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by Саша Миленковић                                 *
+ *   sasa.milenkovic.xyz@gmail.com                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *   ( http://www.gnu.org/licenses/gpl-3.0.en.html )                       *
+ *									   *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef PROCMONITOR_H
+#define PROCMONITOR_H
+
+#include <QObject>
+#include <QString>
+#include <QHash>
+#include <QTimer>
+#include <QElapsedTimer>
+
+//----------------------------------------------
+// one sample of the tilemaker process resource usage
+struct ProcSample
+{
+    qint64 msecs;       // since the monitoring has started
+    double cpu;         // percent of one core, all threads together
+    double busiestcpu;  // percent of one core, the busiest thread
+    int    threads;
+    qint64 rss;         // bytes
+    qint64 readrate;    // bytes per second (storage layer)
+    qint64 writerate;   // bytes per second (storage layer)
+    qint64 readtotal;
+    qint64 writetotal;
+    double stopped;     // fraction of time the process has been held stopped by the governor
+};
+
+//----------------------------------------------
+// resource budget which the governor enforces; zero means 'unlimited'
+struct ProcBudget
+{
+    ProcBudget() : nice(0), idleio(false), cpulimit(0), rsslimit(0), iolimit(0) {}
+
+    int     nice;       // 0..19, applied to every thread (renice)
+    bool    idleio;     // idle I/O scheduling class (ionice -c3)
+    int     cpulimit;   // percent of one core (SIGSTOP/SIGCONT throttling or cgroup cpu.max)
+    qint64  rsslimit;   // bytes (cgroup memory.max, otherwise only reported)
+    qint64  iolimit;    // bytes per second, read+write (SIGSTOP/SIGCONT throttling)
+    QString cgroup;     // writable cgroup v2 directory; empty - no cgroup is used
+};
+
+//----------------------------------------------
+// Samples /proc/<pid>/{stat,status,io} and /proc/<pid>/task/*/stat of
+// the tilemaker process at a fixed interval and optionally governs it.
+// Everything here is Linux specific; elsewhere the monitor does nothing.
+class ProcMonitor : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ProcMonitor(QObject *parent = 0);
+    ~ProcMonitor();
+
+    void setInterval(int msecs);
+    int interval() const { return sampletimer.interval(); }
+
+    void setBudget(const ProcBudget&);
+    const ProcBudget& budget() const { return procbudget; }
+
+    void start(qint64 pid);
+    void stop(bool bexited = false);   // 'bexited' - reaped, its pid may belong to another process
+    bool isRunning() const { return processid > 0; }
+
+    qint64 peakRss() const { return peakrss; }
+
+    // bytes written to the storage up to the last sample
+    qint64 writeTotal() const { return lastwrite; }
+
+signals:
+    void sampled(const ProcSample&);
+    void governorMessage(const QString&);
+
+private slots:
+    void sample();
+    void throttle();
+
+private:
+    QTimer sampletimer;
+    QTimer throttletimer;
+    QElapsedTimer clock;
+
+    qint64 processid;
+    ProcBudget procbudget;
+    QString badcgroup;      // the process could not be moved into it, not tried again
+
+    qint64 lastmsecs;
+    qint64 lastticks;
+    qint64 lastread;
+    qint64 lastwrite;
+    QHash<int, qint64> lastthreadticks;
+    QHash<int, bool> governedthreads;
+
+    double stopfraction;    // duty cycle of the SIGSTOP/SIGCONT throttling
+    bool   bstopped;
+    qint64 stoppedmsecs;    // accumulated since the last sample
+    qint64 stopstarted;
+    bool   brsswarned;
+    qint64 peakrss;
+
+    void applyToThreads();
+    void applyCgroup();
+    void resume();
+};
+
+#endif // PROCMONITOR_H
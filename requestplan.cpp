@@ -0,0 +1,310 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by Саша Миленковић                                 *
+ *   sasa.milenkovic.xyz@gmail.com                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *   ( http://www.gnu.org/licenses/gpl-3.0.en.html )                       *
+ *									   *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <QIODevice>
+#include <QElapsedTimer>
+#include <QUrl>
+
+#include "requestplan.h"
+#include "uboxindex.h"
+#include "footprint.h"
+
+const int PLANBUFFER = 4 << 20;     // bytes of the plan written at once
+
+//----------------------------------------------
+QString RequestPlan::fromConfig(const JobConfig& cfg, bool boptimize, Job& job)
+{
+    job.url = cfg.url.simplified();
+    job.layer = cfg.layer.simplified();
+    job.srs = cfg.srs.simplified();
+    job.format = cfg.format;
+    job.background = cfg.background;
+
+    if(job.url.isEmpty() || job.url.contains(" "))
+        return "The URL of WMS server is not valid.";
+
+    if(job.layer.isEmpty())
+        return "The layer is not set.";
+
+    BBox bbox;
+    QString error = JobIO::validateBBOX(cfg.bbox, bbox);
+    if(!error.isEmpty())
+        return error;
+
+    double hres, lres;
+    error = JobIO::validateResolution(cfg.res, bbox, hres, lres, cfg.tilesize);
+    if(!error.isEmpty())
+        return error;
+
+    job.grid = TileGrid(bbox, hres, lres, cfg.tilesize);
+
+    job.updates = cfg.updates;
+    job.regions.clear();
+    if(!cfg.updates)
+        return QString();
+
+    for(int row=0; row<cfg.updaterows.size(); row++)
+    {
+        UBox ubox;
+        QString sres = JobIO::validateUpdateRow(row, cfg.updaterows[row], bbox, hres, lres, 0, &ubox);
+
+        if(sres == "empty")
+            continue;
+
+        if(sres.startsWith("Error"))
+            return sres;
+
+        job.regions.append(ubox);
+    }
+
+    if(!cfg.footprint.isEmpty())
+    {
+        Footprint footprint;
+        error = FootprintIO::load(cfg.footprint, footprint);
+        if(!error.isEmpty())
+            return error;
+
+        job.regions += FootprintRaster::regions(footprint, job.grid, cfg.footprintbuffer);
+    }
+
+    if(boptimize)
+        UBoxOptimizer::optimize(job.regions, job.grid);
+
+    return QString();
+}
+
+//----------------------------------------------
+// everything of the GetMap URL but the BBOX values (WMS 1.1.1)
+static QByteArray urlPrefix(const RequestPlan::Job& job)
+{
+    QByteArray url = job.url.toUtf8();
+    if(!url.contains('?'))
+        url += '?';
+    else if(!url.endsWith('?') && !url.endsWith('&'))
+        url += '&';
+
+    url += "SERVICE=WMS&VERSION=1.1.1&REQUEST=GetMap&LAYERS=" + QUrl::toPercentEncoding(job.layer) + "&STYLES=";
+
+    if(!job.srs.isEmpty())
+        url += "&SRS=" + QUrl::toPercentEncoding(job.srs);
+
+    url += "&FORMAT=image/" + (job.format.isEmpty() ? QByteArray("jpeg") : job.format.toLatin1());
+
+    if(job.background == "transparent")
+        url += "&TRANSPARENT=TRUE";
+    else
+        url += job.background == "black" ? "&BGCOLOR=0x000000" : "&BGCOLOR=0xFFFFFF";
+
+    const QByteArray size = QByteArray::number(job.grid.tileSize());
+    url += "&WIDTH=" + size + "&HEIGHT=" + size + "&BBOX=";
+
+    return url;
+}
+
+//----------------------------------------------
+RequestPlan::Summary RequestPlan::write(const Job& job, QIODevice* out, const QAtomicInt* cancel)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    Summary summary;
+    const TileGrid& grid = job.grid;
+    summary.tilesize = grid.tileSize();
+    summary.perlevel.fill(0, grid.levels());
+
+    QList<UBox> regions = job.regions;
+    if(!job.updates)
+    {
+        UBox whole;
+        whole.box = job.grid.extent();
+        regions.append(whole);
+    }
+    summary.regions = regions.size();
+
+    const QByteArray prefix = urlPrefix(job);
+    const QByteArray size = "\t" + QByteArray::number(grid.tileSize()) + "\t" + QByteArray::number(grid.tileSize()) + "\t";
+
+    QByteArray buffer;
+    if(out)
+    {
+        buffer.reserve(PLANBUFFER + 4096);
+        buffer += "# z\tx\ty\twidth\theight\tGetMap\n";
+    }
+
+    // the edge coordinates and the indices of the current region and level
+    QVector<QByteArray> xs, ys, xi;
+
+    for(int i=0; i<regions.size() && !summary.bcancelled; i++)
+    {
+        int kmin, kmax;
+        grid.levelRange(regions[i], kmin, kmax);
+
+        for(int k=kmax; k>=kmin && !summary.bcancelled; k--)
+        {
+            TileRange range = grid.range(regions[i], k);
+            if(range.isEmpty())
+                continue;
+
+            const qint64 c0 = range.c0, c1 = range.c1, r0 = range.r0, r1 = range.r1;
+            int z = grid.zoom(k);
+            qint64 count = range.count();
+            summary.perlevel[z] += count;
+            summary.requests += count;
+
+            if(!out)
+                continue;
+
+            double span = grid.span(k);
+            const QByteArray zs = QByteArray::number(z) + "\t";
+
+            xs.resize(int(c1 - c0 + 2));
+            xi.resize(int(c1 - c0 + 1));
+            for(qint64 c=c0; c<=c1+1; c++)
+            {
+                xs[int(c - c0)] = QByteArray::number(grid.extent().left + c * span, 'g', 17);
+                if(c <= c1)
+                    xi[int(c - c0)] = QByteArray::number(c) + "\t";
+            }
+
+            ys.resize(2);
+            for(qint64 r=r0; r<=r1; r++)
+            {
+                if(cancel && cancel->load())
+                {
+                    summary.bcancelled = true;
+                    break;
+                }
+
+                ys[0] = QByteArray::number(grid.extent().bottom + r * span, 'g', 17);
+                ys[1] = QByteArray::number(grid.extent().bottom + (r + 1) * span, 'g', 17);
+                const QByteArray rs = QByteArray::number(r);
+
+                for(int c=0; c<xi.size(); c++)
+                {
+                    buffer += zs;
+                    buffer += xi[c];
+                    buffer += rs;
+                    buffer += size;
+                    buffer += prefix;
+                    buffer += xs[c];
+                    buffer += ',';
+                    buffer += ys[0];
+                    buffer += ',';
+                    buffer += xs[c+1];
+                    buffer += ',';
+                    buffer += ys[1];
+                    buffer += '\n';
+                }
+
+                if(buffer.size() >= PLANBUFFER)
+                {
+                    summary.bytes += out->write(buffer);
+                    buffer.resize(0);
+                }
+            }
+        }
+    }
+
+    if(out && !buffer.isEmpty())
+        summary.bytes += out->write(buffer);
+
+    summary.msecs = timer.elapsed();
+    return summary;
+}
+
+//----------------------------------------------
+QStringList RequestPlan::sample(const Job& job, int count)
+{
+    QStringList list;
+    if(count <= 0)
+        return list;
+
+    QList<UBox> regions = job.regions;
+    if(!job.updates)
+    {
+        UBox whole;
+        whole.box = job.grid.extent();
+        regions.append(whole);
+    }
+
+    qint64 total = write(job, 0).requests;
+    if(total <= 0)
+        return list;
+
+    const QByteArray prefix = urlPrefix(job);
+    double stride = qMax(1.0, double(total) / count);
+    double next = 0.0;      // index of the next sampled request in the whole plan
+    qint64 first = 0;       // index of the first request of the current region and level
+
+    for(int i=0; i<regions.size() && list.size()<count; i++)
+    {
+        int kmin, kmax;
+        job.grid.levelRange(regions[i], kmin, kmax);
+
+        for(int k=kmax; k>=kmin && list.size()<count; k--)
+        {
+            TileRange range = job.grid.range(regions[i], k);
+            if(range.isEmpty())
+                continue;
+
+            qint64 width = range.columns();
+            qint64 size = range.count();
+
+            for(; qint64(next) < first + size && list.size()<count; next += stride)
+            {
+                qint64 n = qint64(next) - first;
+                BBox tile = job.grid.tileBox(k, range.c0 + n % width, range.r0 + n / width);
+
+                list << QString::fromLatin1(prefix +
+                                            QByteArray::number(tile.left, 'g', 17) + ',' +
+                                            QByteArray::number(tile.bottom, 'g', 17) + ',' +
+                                            QByteArray::number(tile.right, 'g', 17) + ',' +
+                                            QByteArray::number(tile.top, 'g', 17));
+            }
+
+            first += size;
+        }
+    }
+
+    return list;
+}
+
+//----------------------------------------------
+QString RequestPlan::report(const Summary& summary)
+{
+    QString sretval = "Request plan: " + QString::number(summary.requests) + " GetMap requests (" +
+                      QString::number(summary.tilesize) + "x" + QString::number(summary.tilesize) + " px, " +
+                      QString::number(double(summary.requests) * summary.tilesize * summary.tilesize / 1e6, 'f', 0) + " Mpx), " +
+                      QString::number(summary.regions) + " regions";
+
+    if(summary.bytes > 0)
+        sretval += ", " + QString::number(summary.bytes >> 20) + " MB written";
+
+    sretval += ", " + QString::number(summary.msecs / 1000.0, 'f', 1) + " s";
+
+    if(summary.bcancelled)
+        sretval += " (cancelled)";
+
+    for(int z=0; z<summary.perlevel.size(); z++)
+        if(summary.perlevel[z] > 0)
+            sretval += "\n  level " + QString::number(z) + ": " + QString::number(summary.perlevel[z]);
+
+    return sretval;
+}
@@ -0,0 +1,80 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by Саша Миленковић                                 *
+ *   sasa.milenkovic.xyz@gmail.com                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *   ( http://www.gnu.org/licenses/gpl-3.0.en.html )                       *
+ *									   *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef REQUESTPLAN_H
+#define REQUESTPLAN_H
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QVector>
+#include <QAtomicInt>
+
+#include "tilegrid.h"
+
+class QIODevice;
+
+// Dry run: the GetMap requests which a job sends, without sending them.
+// The plan is generated level by level and tile row by tile row into a
+// fixed buffer, so the memory doesn't grow with the plan; only the edge
+// coordinates of the current region and level are kept. Counting alone
+// is computed per region and level, without walking the tiles.
+//
+// One line per request (tab separated):  z  x  y  width  height  GetMap-URL
+// with z, x, y as in the TMS tree (0 - the coarsest level, y from the bottom).
+
+namespace RequestPlan
+{
+    struct Job
+    {
+        QString url, layer, srs;
+        QString format;         // jpeg, png, gif
+        QString background;     // white, black, transparent
+        TileGrid grid;
+        bool updates;           // only the regions, otherwise the whole BBOX
+        QList<UBox> regions;
+    };
+
+    struct Summary
+    {
+        Summary() : requests(0), regions(0), bytes(0), msecs(0), bcancelled(false), tilesize(DEFAULTTILESIZE) {}
+
+        qint64 requests;
+        QVector<qint64> perlevel;   // by z
+        int regions;
+        qint64 bytes;               // of the written plan
+        qint64 msecs;
+        bool bcancelled;
+        int tilesize;
+    };
+
+    // validates a *.tip job as the dialog does; empty return means OK
+    QString fromConfig(const JobConfig& cfg, bool boptimize, Job& job);
+
+    // 'out' == 0 - counts only
+    Summary write(const Job& job, QIODevice* out, const QAtomicInt* cancel = 0);
+
+    QString report(const Summary&);
+
+    // GetMap URLs of at most 'count' tiles spread evenly over the plan
+    QStringList sample(const Job& job, int count);
+}
+
+#endif // REQUESTPLAN_H
@@ -0,0 +1,148 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by Саша Миленковић                                 *
+ *   sasa.milenkovic.xyz@gmail.com                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *   ( http://www.gnu.org/licenses/gpl-3.0.en.html )                       *
+ *									   *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <QPainter>
+#include <QPainterPath>
+#include <QStringList>
+
+#include "resourcegraph.h"
+
+//----------------------------------------------
+static QString humanBytes(double bytes)
+{
+    if(bytes >= 1024.0*1024.0*1024.0)
+        return QString::number(bytes/1024.0/1024.0/1024.0, 'f', 2) + " GB";
+    if(bytes >= 1024.0*1024.0)
+        return QString::number(bytes/1024.0/1024.0, 'f', 1) + " MB";
+    return QString::number(bytes/1024.0, 'f', 0) + " kB";
+}
+
+//----------------------------------------------
+ResourceGraph::ResourceGraph(QWidget *parent) :
+    QWidget(parent),
+    capacity(600)
+{
+    setMinimumHeight(120);
+    setAutoFillBackground(true);
+    setBackgroundRole(QPalette::Base);
+}
+
+//----------------------------------------------
+void ResourceGraph::addSample(const ProcSample& s)
+{
+    if(samples.size() >= capacity)
+        samples.remove(0, samples.size() - capacity + 1);
+
+    samples.append(s);
+    update();
+}
+
+//----------------------------------------------
+void ResourceGraph::clear()
+{
+    samples.clear();
+    update();
+}
+
+//----------------------------------------------
+void ResourceGraph::paintEvent(QPaintEvent*)
+{
+    QPainter painter(this);
+    painter.setRenderHint(QPainter::Antialiasing);
+
+    const int legendheight = fontMetrics().height() + 4;
+    QRect area = rect().adjusted(2, legendheight, -2, -2);
+
+    painter.setPen(Qt::lightGray);
+    painter.drawRect(area);
+
+    if(samples.size() < 2)
+        return;
+
+    double maxcpu = 100.0, maxrss = 1.0, maxrate = 1.0;
+    for(int i=0; i<samples.size(); i++)
+    {
+        maxcpu = qMax(maxcpu, samples[i].cpu);
+        maxrss = qMax(maxrss, double(samples[i].rss));
+        maxrate = qMax(maxrate, double(qMax(samples[i].readrate, samples[i].writerate)));
+    }
+
+    const double dx = double(area.width()) / (capacity - 1);
+    const double x0 = area.right() - dx * (samples.size() - 1);
+
+    QPainterPath pcpu, prss, pread, pwrite;
+    for(int i=0; i<samples.size(); i++)
+    {
+        const ProcSample& s = samples[i];
+        double x = x0 + i*dx;
+
+        QPointF ptcpu(x, area.bottom() - area.height() * s.cpu / maxcpu);
+        QPointF ptrss(x, area.bottom() - area.height() * s.rss / maxrss);
+        QPointF ptread(x, area.bottom() - area.height() * s.readrate / maxrate);
+        QPointF ptwrite(x, area.bottom() - area.height() * s.writerate / maxrate);
+
+        if(i == 0)
+        {
+            pcpu.moveTo(ptcpu);
+            prss.moveTo(ptrss);
+            pread.moveTo(ptread);
+            pwrite.moveTo(ptwrite);
+        }
+        else
+        {
+            pcpu.lineTo(ptcpu);
+            prss.lineTo(ptrss);
+            pread.lineTo(ptread);
+            pwrite.lineTo(ptwrite);
+        }
+    }
+
+    painter.setPen(QPen(Qt::red, 1.5));
+    painter.drawPath(pcpu);
+    painter.setPen(QPen(Qt::blue, 1.5));
+    painter.drawPath(prss);
+    painter.setPen(QPen(Qt::darkGreen, 1.5));
+    painter.drawPath(pread);
+    painter.setPen(QPen(Qt::darkMagenta, 1.5));
+    painter.drawPath(pwrite);
+
+    // legend with the current values
+    const ProcSample& last = samples.last();
+    QStringList legend;
+    legend << QString("CPU %1% (%2 thr.)").arg(last.cpu, 0, 'f', 0).arg(last.threads)
+           << "RSS " + humanBytes(last.rss)
+           << "read " + humanBytes(last.readrate) + "/s"
+           << "write " + humanBytes(last.writerate) + "/s";
+    QColor colors[] = { Qt::red, Qt::blue, Qt::darkGreen, Qt::darkMagenta };
+
+    int x = area.left();
+    for(int i=0; i<legend.size(); i++)
+    {
+        painter.setPen(colors[i]);
+        painter.drawText(x, fontMetrics().ascent() + 1, legend[i]);
+        x += fontMetrics().width(legend[i]) + 12;
+    }
+
+    if(last.stopped > 0.0)
+    {
+        painter.setPen(Qt::darkGray);
+        painter.drawText(x, fontMetrics().ascent() + 1, QString("throttled %1%").arg(int(last.stopped*100)));
+    }
+}
@@ -0,0 +1,53 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by Саша Миленковић                                 *
+ *   sasa.milenkovic.xyz@gmail.com                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *   ( http://www.gnu.org/licenses/gpl-3.0.en.html )                       *
+ *									   *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef RESOURCEGRAPH_H
+#define RESOURCEGRAPH_H
+
+#include <QWidget>
+#include <QVector>
+
+#include "procmonitor.h"
+
+//----------------------------------------------
+// Rolling graph of the last samples of the tilemaker process: CPU, RSS
+// and read/write rates. Every series is scaled to its own maximum.
+class ResourceGraph : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit ResourceGraph(QWidget *parent = 0);
+
+    void setCapacity(int samples) { capacity = samples; }
+
+public slots:
+    void addSample(const ProcSample&);
+    void clear();
+
+protected:
+    void paintEvent(QPaintEvent*);
+
+private:
+    int capacity;
+    QVector<ProcSample> samples;
+};
+
+#endif // RESOURCEGRAPH_H
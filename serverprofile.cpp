@@ -0,0 +1,458 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by Саша Миленковић                                 *
+ *   sasa.milenkovic.xyz@gmail.com                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *   ( http://www.gnu.org/licenses/gpl-3.0.en.html )                       *
+ *									   *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <QSettings>
+#include <QDateTime>
+#include <QUrl>
+#include <QNetworkAccessManager>
+#include <QNetworkRequest>
+#include <QNetworkReply>
+#include <QBuffer>
+#include <QImage>
+#include <QImageWriter>
+
+#include <algorithm>
+#include <cmath>
+
+#include "serverprofile.h"
+#include "tracer.h"
+
+const double MAXERRORRATE = 0.02;       // a concurrency with more errors is not recommended
+const double GIVEUPERRORRATE = 0.2;     // the sweep stops
+const double KNEE = 1.25;               // bytes growth per 5 quality points which is still worth it
+const int PROBEIMAGES = 4;
+const int PROBETIMEOUT = 30000;         // msecs without any response
+
+//----------------------------------------------
+int ServerProfile::recommendedThreads() const
+{
+    double best = 0.0;
+    for(QMap<int, ProfilePoint>::const_iterator it=points.constBegin(); it!=points.constEnd(); ++it)
+        if(it.value().errorrate <= MAXERRORRATE && it.value().throughput > best)
+            best = it.value().throughput;
+
+    if(best <= 0.0)
+        return 0;
+
+    // the least concurrency which gives nearly the best throughput
+    for(QMap<int, ProfilePoint>::const_iterator it=points.constBegin(); it!=points.constEnd(); ++it)
+        if(it.value().errorrate <= MAXERRORRATE && it.value().throughput >= 0.9 * best)
+            return it.key();
+
+    return 0;
+}
+
+//----------------------------------------------
+// the highest concurrency below the first one with errors
+int ServerProfile::concurrencyLimit() const
+{
+    int limit = 0;
+    for(QMap<int, ProfilePoint>::const_iterator it=points.constBegin(); it!=points.constEnd(); ++it)
+    {
+        if(it.value().errorrate > MAXERRORRATE)
+            break;
+        limit = it.key();
+    }
+
+    return limit;
+}
+
+//----------------------------------------------
+// the knee of the size/quality curve: higher qualities cost too many bytes
+int ServerProfile::recommendedQuality() const
+{
+    if(bytespertile.size() < 2)
+        return 0;
+
+    QMap<int, double>::const_iterator it = bytespertile.constBegin();
+    int quality = it.key();
+    double bytes = it.value();
+
+    for(++it; it!=bytespertile.constEnd(); ++it)
+    {
+        double allowed = bytes * std::pow(KNEE, (it.key() - quality) / 5.0);
+        if(it.value() > allowed)
+            break;
+
+        quality = it.key();
+        bytes = it.value();
+    }
+
+    return quality;
+}
+
+//----------------------------------------------
+QString ServerProfile::describe() const
+{
+    QString sretval = key + ": " + QString::number(runs) + " runs";
+    if(!updated.isEmpty())
+        sretval += ", updated " + updated;
+
+    if(recommendedThreads() > 0)
+        sretval += "\n  threads " + QString::number(recommendedThreads()) +
+                   " (no errors up to " + QString::number(concurrencyLimit()) + ")";
+
+    if(recommendedQuality() > 0)
+        sretval += "\n  quality " + QString::number(recommendedQuality());
+
+    for(QMap<int, ProfilePoint>::const_iterator it=points.constBegin(); it!=points.constEnd(); ++it)
+        sretval += "\n  " + QString::number(it.key()) + " threads: " +
+                   QString::number(it.value().throughput, 'f', 1) + " tiles/s, " +
+                   QString::number(it.value().latency, 'f', 0) + " ms, " +
+                   QString::number(it.value().errorrate * 100.0, 'f', 1) + "% errors";
+
+    for(QMap<int, double>::const_iterator it=bytespertile.constBegin(); it!=bytespertile.constEnd(); ++it)
+        sretval += "\n  quality " + QString::number(it.key()) + ": " + QString::number(it.value() / 1024.0, 'f', 1) + " KB/tile";
+
+    return sretval;
+}
+
+//==============================================
+// the store
+
+//----------------------------------------------
+QString ProfileStore::key(const QString& url, const QString& layer)
+{
+    QUrl u(url.simplified());
+    QString host = u.host().toLower();
+    if(u.port() > 0)
+        host += ":" + QString::number(u.port());
+
+    return host + "|" + layer.simplified();
+}
+
+//----------------------------------------------
+static QString settingsGroup(const QString& key)
+{
+    QString group = key;
+    return group.replace('/', '_').replace('\\', '_');
+}
+
+//----------------------------------------------
+bool ProfileStore::load(const QString& key, ServerProfile& profile)
+{
+    QSettings settings(QSettings::IniFormat, QSettings::UserScope, "tilemaker_wms_gui", "profiles");
+
+    profile = ServerProfile();
+    profile.key = key;
+
+    if(!settings.childGroups().contains(settingsGroup(key)))
+        return false;
+
+    settings.beginGroup(settingsGroup(key));
+
+    profile.runs = settings.value("runs", 0).toInt();
+    profile.updated = settings.value("updated").toString();
+
+    QStringList list = settings.value("points").toStringList();
+    for(int i=0; i<list.size(); i++)
+    {
+        QStringList v = list[i].split(";");
+        if(v.size() != 4)
+            continue;
+
+        ProfilePoint point;
+        point.concurrency = v[0].toInt();
+        point.latency = v[1].toDouble();
+        point.throughput = v[2].toDouble();
+        point.errorrate = v[3].toDouble();
+        if(point.concurrency > 0)
+            profile.points.insert(point.concurrency, point);
+    }
+
+    list = settings.value("bytes").toStringList();
+    for(int i=0; i<list.size(); i++)
+    {
+        QStringList v = list[i].split(";");
+        if(v.size() == 2 && v[0].toInt() > 0)
+            profile.bytespertile.insert(v[0].toInt(), v[1].toDouble());
+    }
+
+    settings.endGroup();
+    return true;
+}
+
+//----------------------------------------------
+void ProfileStore::save(const ServerProfile& profile)
+{
+    QSettings settings(QSettings::IniFormat, QSettings::UserScope, "tilemaker_wms_gui", "profiles");
+    settings.beginGroup(settingsGroup(profile.key));
+
+    settings.setValue("runs", profile.runs);
+    settings.setValue("updated", QDateTime::currentDateTime().toString(Qt::ISODate));
+
+    QStringList list;
+    for(QMap<int, ProfilePoint>::const_iterator it=profile.points.constBegin(); it!=profile.points.constEnd(); ++it)
+        list << QString::number(it.key()) + ";" + QString::number(it.value().latency) + ";" +
+                QString::number(it.value().throughput) + ";" + QString::number(it.value().errorrate);
+    settings.setValue("points", list);
+
+    list.clear();
+    for(QMap<int, double>::const_iterator it=profile.bytespertile.constBegin(); it!=profile.bytespertile.constEnd(); ++it)
+        list << QString::number(it.key()) + ";" + QString::number(it.value());
+    settings.setValue("bytes", list);
+
+    settings.endGroup();
+}
+
+//----------------------------------------------
+void ProfileStore::recordRun(const QString& key, int threads, int quality, qint64 tiles,
+                             qint64 msecs, qint64 bytes, int errors)
+{
+    if(tiles <= 0 || msecs <= 0)
+        return;
+
+    ServerProfile profile;
+    load(key, profile);
+
+    ProfilePoint point;
+    point.concurrency = threads;
+    point.throughput = tiles * 1000.0 / msecs;
+    point.latency = threads * 1000.0 / point.throughput;
+    point.errorrate = qMin(1.0, double(errors) / tiles);
+    profile.points.insert(threads, point);
+
+    if(bytes > 0)
+        profile.bytespertile.insert(quality, double(bytes) / tiles);
+
+    profile.runs++;
+    save(profile);
+}
+
+//==============================================
+// the probe
+
+//----------------------------------------------
+ServerProbe::ServerProbe(QObject *parent) :
+    QObject(parent),
+    maxconcurrency(1),
+    concurrency(0),
+    nexturl(0),
+    issued(0),
+    target(0),
+    inflight(0),
+    stepstarted(0),
+    errors(0),
+    best(0.0)
+{
+    watchdog.setSingleShot(true);
+    watchdog.setInterval(PROBETIMEOUT);
+    connect(&watchdog, SIGNAL(timeout()), this, SLOT(timeout()));
+}
+
+//----------------------------------------------
+ServerProbe::~ServerProbe()
+{
+    cancel();
+}
+
+//----------------------------------------------
+void ServerProbe::start(const QString& key, const QStringList& sample, int maxc)
+{
+    cancel();
+
+    ProfileStore::load(key, result);
+
+    urls = sample;
+    maxconcurrency = qMax(1, maxc);
+    nexturl = 0;
+    images.clear();
+    best = 0.0;
+    clock.start();
+
+    if(urls.isEmpty())
+    {
+        finish(false);
+        return;
+    }
+
+    startStep(1);
+}
+
+//----------------------------------------------
+void ServerProbe::cancel()
+{
+    concurrency = 0;
+    watchdog.stop();
+
+    QList<QNetworkReply*> replies = started.keys();
+    started.clear();
+    for(int i=0; i<replies.size(); i++)
+    {
+        replies[i]->disconnect(this);
+        replies[i]->abort();
+        replies[i]->deleteLater();
+    }
+    inflight = 0;
+}
+
+//----------------------------------------------
+void ServerProbe::startStep(int c)
+{
+    concurrency = c;
+    issued = 0;
+    inflight = 0;
+    errors = 0;
+    target = qMax(8, 3 * c);
+    latencies.clear();
+
+    // one connection per request in flight (a manager opens at most 6 per host)
+    while(managers.size() < c)
+        managers.append(new QNetworkAccessManager(this));
+
+    stepstarted = clock.elapsed();
+    watchdog.start();
+
+    while(inflight < concurrency && issued < target)
+        issue();
+}
+
+//----------------------------------------------
+void ServerProbe::issue()
+{
+    QNetworkRequest request(QUrl(urls[nexturl++ % urls.size()]));
+    QNetworkReply* reply = managers[issued % concurrency]->get(request);
+    connect(reply, SIGNAL(finished()), this, SLOT(replyFinished()));
+
+    started.insert(reply, clock.elapsed());
+    issued++;
+    inflight++;
+}
+
+//----------------------------------------------
+void ServerProbe::replyFinished()
+{
+    QNetworkReply* reply = qobject_cast<QNetworkReply*>(sender());
+    if(!reply || !started.contains(reply))
+        return;
+
+    qint64 latency = clock.elapsed() - started.take(reply);
+    latencies.append(latency);
+    inflight--;
+
+    int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    Tracer::complete(TraceName::Request, "probe", Tracer::now() - latency * 1000, latency * 1000, status);
+    QString type = reply->header(QNetworkRequest::ContentTypeHeader).toString();
+    QByteArray data = reply->readAll();
+    reply->deleteLater();
+
+    // a ServiceException comes as XML, mostly with the status 200
+    if(reply->error() != QNetworkReply::NoError || status != 200 || !type.startsWith("image/"))
+        errors++;
+    else if(images.size() < PROBEIMAGES)
+        images.append(data);
+
+    watchdog.start();
+
+    if(issued < target)
+        issue();
+    else if(inflight == 0)
+        finishStep();
+}
+
+//----------------------------------------------
+// the server doesn't respond at all - the requests in flight count as errors
+void ServerProbe::timeout()
+{
+    QList<QNetworkReply*> replies = started.keys();
+    for(int i=0; i<replies.size(); i++)
+        replies[i]->abort();
+}
+
+//----------------------------------------------
+void ServerProbe::finishStep()
+{
+    qint64 msecs = qMax(qint64(1), clock.elapsed() - stepstarted);
+
+    ProfilePoint point;
+    point.concurrency = concurrency;
+    point.throughput = target * 1000.0 / msecs;
+    point.errorrate = double(errors) / target;
+
+    std::nth_element(latencies.begin(), latencies.begin() + latencies.size()/2, latencies.end());
+    point.latency = latencies[latencies.size()/2];
+
+    result.points.insert(concurrency, point);
+
+    emit message("Probe: " + QString::number(concurrency) + " in flight - " +
+                 QString::number(point.throughput, 'f', 1) + " requests/s, median " +
+                 QString::number(point.latency, 'f', 0) + " ms, " +
+                 QString::number(errors) + " errors of " + QString::number(target));
+
+    // against the previous steps of this sweep only, not the stored ones
+    bool bsaturated = concurrency > 1 && point.throughput < best * 1.05;
+    best = qMax(best, point.throughput);
+    int next = concurrency < 4 ? concurrency * 2 : concurrency + 4;
+
+    if(point.errorrate > GIVEUPERRORRATE || bsaturated || concurrency >= maxconcurrency)
+    {
+        measureQualities();
+        finish(true);
+        return;
+    }
+
+    startStep(qMin(next, maxconcurrency));
+}
+
+//----------------------------------------------
+// bytes of a tile per JPEG quality, from the fetched images
+void ServerProbe::measureQualities()
+{
+    QList<QImage> decoded;
+    for(int i=0; i<images.size(); i++)
+    {
+        QImage image;
+        if(image.loadFromData(images[i]))
+            decoded.append(image);
+    }
+
+    if(decoded.isEmpty())
+        return;
+
+    for(int quality=50; quality<=95; quality+=5)
+    {
+        qint64 total = 0;
+        for(int i=0; i<decoded.size(); i++)
+        {
+            QBuffer buffer;
+            buffer.open(QIODevice::WriteOnly);
+
+            QImageWriter writer(&buffer, "jpg");
+            writer.setQuality(quality);
+            writer.write(decoded[i]);
+
+            total += buffer.size();
+        }
+
+        result.bytespertile.insert(quality, double(total) / decoded.size());
+    }
+}
+
+//----------------------------------------------
+void ServerProbe::finish(bool bOK)
+{
+    concurrency = 0;
+    watchdog.stop();
+
+    if(bOK)
+        ProfileStore::save(result);
+
+    emit finished(bOK);
+}
@@ -0,0 +1,131 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by Саша Миленковић                                 *
+ *   sasa.milenkovic.xyz@gmail.com                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *   ( http://www.gnu.org/licenses/gpl-3.0.en.html )                       *
+ *									   *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef SERVERPROFILE_H
+#define SERVERPROFILE_H
+
+#include <QObject>
+#include <QStringList>
+#include <QMap>
+#include <QHash>
+#include <QVector>
+#include <QTimer>
+#include <QElapsedTimer>
+
+class QNetworkAccessManager;
+class QNetworkReply;
+
+//----------------------------------------------
+// throughput of a WMS at one concurrency (a probe step or a finished run)
+struct ProfilePoint
+{
+    ProfilePoint() : concurrency(0), latency(0.0), throughput(0.0), errorrate(0.0) {}
+
+    int concurrency;
+    double latency;     // msecs, median
+    double throughput;  // requests (tiles) per second
+    double errorrate;   // 0..1
+};
+
+//----------------------------------------------
+// what has been learnt about one WMS host and layer; kept in a QSettings
+// INI file of the user (tilemaker_wms_gui/profiles.ini)
+struct ServerProfile
+{
+    ServerProfile() : runs(0) {}
+
+    QString key;
+    QMap<int, ProfilePoint> points;     // by concurrency, the newest measurement wins
+    QMap<int, double> bytespertile;     // by JPEG quality
+    int runs;
+    QString updated;
+
+    // 0 - nothing is known yet
+    int recommendedThreads() const;
+    int concurrencyLimit() const;
+    int recommendedQuality() const;
+
+    QString describe() const;
+};
+
+namespace ProfileStore
+{
+    QString key(const QString& url, const QString& layer);
+
+    bool load(const QString& key, ServerProfile& profile);
+    void save(const ServerProfile& profile);
+
+    // statistics of a finished tilemaker run
+    void recordRun(const QString& key, int threads, int quality, qint64 tiles,
+                   qint64 msecs, qint64 bytes, int errors);
+}
+
+//----------------------------------------------
+// Calibration sweep: sample GetMap requests of the job are sent at rising
+// concurrency (1, 2, 4, ... up to the thread limit) until the throughput
+// stops growing or the errors rise; a few of the fetched images are then
+// encoded at several JPEG qualities for the size/quality curve.
+class ServerProbe : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ServerProbe(QObject *parent = 0);
+    ~ServerProbe();
+
+    void start(const QString& key, const QStringList& urls, int maxconcurrency);
+    void cancel();
+    bool isRunning() const { return concurrency > 0; }
+
+    const ServerProfile& profile() const { return result; }
+
+signals:
+    void message(const QString&);
+    void finished(bool bOK);
+
+private slots:
+    void replyFinished();
+    void timeout();
+
+private:
+    QList<QNetworkAccessManager*> managers;
+    QStringList urls;
+    int maxconcurrency;
+    int concurrency;        // of the current step, 0 - not running
+    int nexturl;
+    int issued, target, inflight;
+    QHash<QNetworkReply*, qint64> started;
+    QElapsedTimer clock;
+    qint64 stepstarted;
+    QVector<double> latencies;
+    int errors;
+    QList<QByteArray> images;   // for the quality curve
+    double best;            // throughput of this probe's steps; 'result' holds older points too
+    QTimer watchdog;
+    ServerProfile result;
+
+    void startStep(int c);
+    void issue();
+    void finishStep();
+    void measureQualities();
+    void finish(bool bOK);
+};
+
+#endif // SERVERPROFILE_H
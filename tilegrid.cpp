@@ -0,0 +1,171 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by Саша Миленковић                                 *
+ *   sasa.milenkovic.xyz@gmail.com                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *   ( http://www.gnu.org/licenses/gpl-3.0.en.html )                       *
+ *									   *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "tilegrid.h"
+
+const double EPS = 1e-9;    // in tiles - an edge this close to a tile border is on it
+
+//----------------------------------------------
+TileGrid::TileGrid() :
+    hres(0.0),
+    lres(0.0),
+    tilesize(DEFAULTTILESIZE),
+    levelcount(1)
+{
+}
+
+//----------------------------------------------
+TileGrid::TileGrid(const BBox& extent, double high, double low, int size) :
+    bbox(extent),
+    hres(high),
+    lres(low),
+    tilesize(isValidTileSize(size) ? size : DEFAULTTILESIZE),
+    levelcount(1)
+{
+    if(hres <= 0.0)
+        return;
+
+    for(double res = hres * 2.0; res <= lres * (1.0 + EPS) && levelcount < 62; res *= 2.0)
+        levelcount++;
+
+    base = baseRange(bbox);
+    base.c0 = base.r0 = 0;
+}
+
+//----------------------------------------------
+bool TileGrid::isValidTileSize(int size)
+{
+    return size == 256 || size == 512 || size == 1024;
+}
+
+//----------------------------------------------
+// the level 0 indices of the tiles which the box touches (not clipped)
+TileRange TileGrid::baseRange(const BBox& box) const
+{
+    if(hres <= 0.0)
+        return TileRange();
+
+    double s = span(0);
+    return TileRange(qint64(std::floor((box.left - bbox.left) / s + EPS)),
+                     qint64(std::ceil((box.right - bbox.left) / s - EPS)) - 1,
+                     qint64(std::floor((box.bottom - bbox.bottom) / s + EPS)),
+                     qint64(std::ceil((box.top - bbox.bottom) / s - EPS)) - 1);
+}
+
+//----------------------------------------------
+// with a fitting resolution the region grows to the whole tiles of that level
+TileRange TileGrid::baseRange(const UBox& ubox) const
+{
+    TileRange range = baseRange(ubox.box);
+    if(ubox.fitres <= 0.0 || hres <= 0.0 || range.isEmpty())
+        return range;
+
+    int kf = qBound(0, int(qRound(std::log(ubox.fitres / hres) / std::log(2.0))), levelcount - 1);
+    qint64 n = qint64(1) << kf;
+
+    TileRange fitted = coarsen(range, kf);
+    return TileRange(fitted.c0 * n, (fitted.c1 + 1) * n - 1, fitted.r0 * n, (fitted.r1 + 1) * n - 1);
+}
+
+//----------------------------------------------
+// the same tiles k levels up: floor(i / 2^k) (an arithmetic shift, also
+// for the negative indices left or below the origin)
+TileRange TileGrid::coarsen(const TileRange& range, int k)
+{
+    return TileRange(range.c0 >> k, range.c1 >> k, range.r0 >> k, range.r1 >> k);
+}
+
+//----------------------------------------------
+TileRange TileGrid::clip(const TileRange& range, int k) const
+{
+    TileRange all = coarsen(base, k);
+    return TileRange(qMax(range.c0, all.c0), qMin(range.c1, all.c1),
+                     qMax(range.r0, all.r0), qMin(range.r1, all.r1));
+}
+
+//----------------------------------------------
+TileRange TileGrid::levelTiles(int k) const
+{
+    return coarsen(base, k);
+}
+
+//----------------------------------------------
+TileRange TileGrid::range(const BBox& box, int k) const
+{
+    return clip(coarsen(baseRange(box), k), k);
+}
+
+//----------------------------------------------
+TileRange TileGrid::range(const UBox& ubox, int k) const
+{
+    return clip(coarsen(baseRange(ubox), k), k);
+}
+
+//----------------------------------------------
+void TileGrid::levelRange(const UBox& ubox, int& kmin, int& kmax) const
+{
+    kmin = 0;
+    kmax = levelcount - 1;
+
+    if(ubox.hres > 0.0 && hres > 0.0)
+        kmin = qMax(0, int(std::ceil(std::log(ubox.hres / hres) / std::log(2.0) - EPS)));
+
+    if(ubox.lres > 0.0 && hres > 0.0)
+        kmax = qMin(levelcount - 1, int(std::floor(std::log(ubox.lres / hres) / std::log(2.0) + EPS)));
+}
+
+//----------------------------------------------
+qint64 TileGrid::countTiles(const UBox& ubox) const
+{
+    int kmin, kmax;
+    levelRange(ubox, kmin, kmax);
+
+    // integer only after the level 0 indices
+    TileRange b = baseRange(ubox);
+    qint64 total = 0;
+    for(int k=kmin; k<=kmax; k++)
+        total += clip(coarsen(b, k), k).count();
+
+    return total;
+}
+
+//----------------------------------------------
+qint64 TileGrid::countTiles(const QList<UBox>& uboxes) const
+{
+    qint64 total = 0;
+    for(int i=0; i<uboxes.size(); i++)
+        total += countTiles(uboxes[i]);
+
+    return total;
+}
+
+//----------------------------------------------
+BBox TileGrid::tileBox(int k, qint64 c, qint64 r) const
+{
+    return rangeBox(k, TileRange(c, c, r, r));
+}
+
+//----------------------------------------------
+BBox TileGrid::rangeBox(int k, const TileRange& range) const
+{
+    double s = span(k);
+    return BBox(bbox.left + range.c0 * s, bbox.bottom + range.r0 * s,
+                bbox.left + (range.c1 + 1) * s, bbox.bottom + (range.r1 + 1) * s);
+}
@@ -0,0 +1,109 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by Саша Миленковић                                 *
+ *   sasa.milenkovic.xyz@gmail.com                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *   ( http://www.gnu.org/licenses/gpl-3.0.en.html )                       *
+ *									   *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef TILEGRID_H
+#define TILEGRID_H
+
+#include <QList>
+
+#include <cmath>
+
+#include "jobconfig.h"
+
+//----------------------------------------------
+// tiles [c0,c1] x [r0,r1] of one level, inclusive; columns count from
+// the left and rows from the bottom of the grid origin
+struct TileRange
+{
+    TileRange() : c0(0), c1(-1), r0(0), r1(-1) {}
+    TileRange(qint64 col0, qint64 col1, qint64 row0, qint64 row1) : c0(col0), c1(col1), r0(row0), r1(row1) {}
+
+    qint64 c0, c1, r0, r1;
+
+    bool isEmpty() const { return c1 < c0 || r1 < r0; }
+    qint64 columns() const { return isEmpty() ? 0 : c1 - c0 + 1; }
+    qint64 rows() const { return isEmpty() ? 0 : r1 - r0 + 1; }
+    qint64 count() const { return columns() * rows(); }
+};
+
+//----------------------------------------------
+// The tile pyramid of a job. The origin is the BBOX left/bottom corner;
+// the level k has the resolution hres * 2^k (k = 0 - the high resolution)
+// while it is not coarser than lres. TMS numbers the levels the other way:
+// z = levels - 1 - k, z = 0 is the coarsest one.
+//
+// A box is turned into tile indices once, at the level 0, with floating
+// point; the indices of the coarser levels follow from them by shifts, so
+// every level agrees exactly with the others and with the tile edges.
+//
+// Only this grid is supported: no other origin and no resolution list
+// which is not hres * 2^k. It is the one the tilemaker renders, and the
+// exact shifts between the levels hold for it alone.
+class TileGrid
+{
+public:
+    TileGrid();
+    TileGrid(const BBox& extent, double hres, double lres, int tilesize = DEFAULTTILESIZE);
+
+    // 256, 512 or 1024
+    static bool isValidTileSize(int size);
+
+    const BBox& extent() const { return bbox; }
+    double highResolution() const { return hres; }
+    double lowResolution() const { return lres; }
+    int tileSize() const { return tilesize; }
+    int levels() const { return levelcount; }
+
+    double resolution(int k) const { return std::ldexp(hres, k); }
+    double span(int k) const { return tilesize * resolution(k); }
+    int zoom(int k) const { return levelcount - 1 - k; }
+    int level(int z) const { return levelcount - 1 - z; }
+
+    // all tiles of the level
+    TileRange levelTiles(int k) const;
+
+    // the tiles of the level k which the box touches
+    TileRange range(const BBox& box, int k) const;
+
+    // as the tilemaker renders an update region: its levels (kmax < kmin - none)
+    // and its box, grown to the tiles of the fitting resolution if it is set
+    void levelRange(const UBox& ubox, int& kmin, int& kmax) const;
+    TileRange range(const UBox& ubox, int k) const;
+
+    qint64 countTiles(const UBox& ubox) const;
+    qint64 countTiles(const QList<UBox>& uboxes) const;
+
+    BBox tileBox(int k, qint64 c, qint64 r) const;
+    BBox rangeBox(int k, const TileRange& range) const;
+
+private:
+    BBox bbox;
+    double hres, lres;
+    int tilesize;
+    int levelcount;
+    TileRange base;     // all tiles of the level 0
+
+    TileRange baseRange(const BBox& box) const;
+    TileRange baseRange(const UBox& ubox) const;
+    static TileRange coarsen(const TileRange& range, int k);
+    TileRange clip(const TileRange& range, int k) const;
+};
+
+#endif // TILEGRID_H
@@ -4,18 +4,62 @@
 #
 #-------------------------------------------------
 
-QT       += core gui
+QT       += core gui network concurrent
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
 TARGET = tilemaker_wms_gui
 TEMPLATE = app
 
+CONFIG += c++11
+
+LIBS += -lz
+
 
 SOURCES += main.cpp\
-        dialog.cpp
+        dialog.cpp \
+        procmonitor.cpp \
+        resourcegraph.cpp \
+        tracer.cpp \
+        jobconfig.cpp \
+        uboxindex.cpp \
+        tilegrid.cpp \
+        cluster.cpp \
+        tileverifier.cpp \
+        tileoptimizer.cpp \
+        tilewarper.cpp \
+        requestplan.cpp \
+        serverprofile.cpp \
+        layerset.cpp \
+        bufferarena.cpp \
+        tilepreview.cpp \
+        footprint.cpp \
+        accesslog.cpp \
+        changemanifest.cpp \
+        tilestager.cpp \
+        jobvalidator.cpp
 
-HEADERS  += dialog.h
+HEADERS  += dialog.h \
+        procmonitor.h \
+        resourcegraph.h \
+        tracer.h \
+        jobconfig.h \
+        uboxindex.h \
+        tilegrid.h \
+        cluster.h \
+        tileverifier.h \
+        tileoptimizer.h \
+        tilewarper.h \
+        requestplan.h \
+        serverprofile.h \
+        layerset.h \
+        bufferarena.h \
+        tilepreview.h \
+        footprint.h \
+        accesslog.h \
+        changemanifest.h \
+        tilestager.h \
+        jobvalidator.h
 
 FORMS    += dialog.ui
 
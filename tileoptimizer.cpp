@@ -0,0 +1,772 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by Саша Миленковић                                 *
+ *   sasa.milenkovic.xyz@gmail.com                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *   ( http://www.gnu.org/licenses/gpl-3.0.en.html )                       *
+ *									   *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <QDir>
+#include <QSaveFile>
+#include <QTextStream>
+#include <QBuffer>
+#include <QImage>
+#include <QImageWriter>
+#include <QProcess>
+#include <QStandardPaths>
+#include <QHash>
+#include <QSet>
+#include <QThreadPool>
+#include <QtConcurrentRun>
+#include <QtConcurrentMap>
+
+#include "tileoptimizer.h"
+#include "tracer.h"
+#include "bufferarena.h"
+#include "jobconfig.h"
+
+const int MINQUALITY = 30;          // the size budget never lowers the quality below this
+const int JPEGTRANTIMEOUT = 30000;  // msecs per tile
+static const char* const JOURNAL = ".tileoptimizer";
+
+//----------------------------------------------
+bool OptimizeOptions::setLevelBudgets(const QString& text)
+{
+    QMap<int, int> budgets;
+    QStringList items = text.split(',', QString::SkipEmptyParts);
+    for(int i=0; i<items.size(); i++)
+    {
+        QStringList parts = items[i].split(':');
+        bool bz = false, bkb = false;
+        int z = parts.size() == 2 ? parts[0].trimmed().toInt(&bz) : -1;
+        int kb = parts.size() == 2 ? parts[1].trimmed().toInt(&bkb) : -1;
+        if(!bz || !bkb || z < 0 || kb < 0)
+            return false;
+
+        budgets[z] = kb * 1024;
+    }
+
+    levelbudgets = budgets;
+    return true;
+}
+
+//----------------------------------------------
+// the adaptive options only if they are set, so the older journals still resume
+QString OptimizeOptions::describe() const
+{
+    QString sretval = QString("png=%1 jpeg=%2 quality=%3 budget=%4 fromlevel=%5")
+                      .arg(bpng).arg(bjpeg).arg(quality).arg(budget).arg(fromlevel);
+
+    if(ssim > 0.0)
+        sretval += " ssim=" + QString::number(ssim);
+
+    QList<int> levels = levelbudgets.keys();
+    for(int i=0; i<levels.size(); i++)
+        sretval += (i == 0 ? " levelbudgets=" : ",") + QString::number(levels[i]) + ":" +
+                   QString::number(levelbudgets.value(levels[i]));
+
+    return sretval;
+}
+
+//==============================================
+// the adaptive JPEG quality
+
+//----------------------------------------------
+QualityModel::QualityModel() :
+    ntiles(0),
+    nencodes(0),
+    qualitysum(0)
+{
+}
+
+//----------------------------------------------
+void QualityModel::clear()
+{
+    QMutexLocker locker(&mutex);
+    sums.clear();
+    counts.clear();
+    ntiles = nencodes = qualitysum = 0;
+}
+
+//----------------------------------------------
+int QualityModel::predict(int z, int bucket, int fallback) const
+{
+    QMutexLocker locker(&mutex);
+    qint64 count = counts.contains(z) ? counts.value(z)[bucket] : 0;
+    if(count == 0)
+        return fallback;
+
+    return int((sums.value(z)[bucket] + count / 2) / count);
+}
+
+//----------------------------------------------
+void QualityModel::add(int z, int bucket, int quality, int encodes)
+{
+    QMutexLocker locker(&mutex);
+    if(!counts.contains(z))
+    {
+        sums[z] = QVector<qint64>(BUCKETS, 0);
+        counts[z] = QVector<qint64>(BUCKETS, 0);
+    }
+
+    sums[z][bucket] += quality;
+    counts[z][bucket]++;
+
+    ntiles++;
+    nencodes += encodes;
+    qualitysum += quality;
+}
+
+//----------------------------------------------
+qint64 QualityModel::tiles() const
+{
+    QMutexLocker locker(&mutex);
+    return ntiles;
+}
+
+//----------------------------------------------
+QString QualityModel::report() const
+{
+    QMutexLocker locker(&mutex);
+    if(ntiles == 0)
+        return QString();
+
+    QString sretval = "Adaptive JPEG quality of " + QString::number(ntiles) + " tiles: mean " +
+                      QString::number(double(qualitysum) / ntiles, 'f', 1) + ", " +
+                      QString::number(double(nencodes) / ntiles, 'f', 1) + " encodes per tile";
+
+    QList<int> levels = counts.keys();
+    for(int i=0; i<levels.size(); i++)
+    {
+        qint64 sum = 0, count = 0;
+        for(int b=0; b<BUCKETS; b++)
+        {
+            sum += sums.value(levels[i])[b];
+            count += counts.value(levels[i])[b];
+        }
+        sretval += "\n  level " + QString::number(levels[i]) + ": mean quality " +
+                   QString::number(double(sum) / qMax(qint64(1), count), 'f', 1);
+    }
+
+    return sretval;
+}
+
+//----------------------------------------------
+static QVector<float> luminance(const QImage& image)
+{
+    QVector<float> luma(image.width() * image.height());
+    for(int y=0; y<image.height(); y++)
+    {
+        const QRgb* line = (const QRgb*)image.constScanLine(y);
+        float* out = luma.data() + y * image.width();
+        for(int x=0; x<image.width(); x++)
+            out[x] = 0.299f * qRed(line[x]) + 0.587f * qGreen(line[x]) + 0.114f * qBlue(line[x]);
+    }
+
+    return luma;
+}
+
+//----------------------------------------------
+static bool encodeJpeg(const QImage& image, int quality, QByteArray& out)
+{
+    out.clear();
+    QBuffer buffer(&out);
+    buffer.open(QIODevice::WriteOnly);
+
+    QImageWriter writer(&buffer, "jpg");
+    writer.setQuality(quality);
+    return writer.write(image);
+}
+
+//----------------------------------------------
+// The encodings of one tile at the qualities a search has tried. Both the
+// size and the SSIM grow with the quality, so the search for the edge of
+// a condition starts at the predicted quality, steps away from it by 1, 2,
+// 4, ... until the condition flips and bisects the last step.
+class QualitySearch
+{
+public:
+    enum Test { Keeps, Exceeds };   // SSIM >= the target, size > the budget
+
+    explicit QualitySearch(const QImage& image);
+
+    int bucket() const;
+    const QByteArray& encoded(int quality);
+    int encodes() const { return cache.size(); }
+
+    // the lowest quality of [lo, hi] which passes the test, hi + 1 - none
+    int lowest(Test test, double limit, int lo, int hi, int start);
+
+private:
+    QImage image;
+    QVector<float> luma;
+    QHash<int, QByteArray> cache;
+    QHash<int, double> ssims;
+
+    bool passes(Test test, double limit, int quality);
+    double ssim(int quality);
+};
+
+//----------------------------------------------
+QualitySearch::QualitySearch(const QImage& source) :
+    image(source.convertToFormat(QImage::Format_RGB32))
+{
+    luma = luminance(image);
+}
+
+//----------------------------------------------
+// the mean luminance gradient, in the buckets of the model
+int QualitySearch::bucket() const
+{
+    const int w = image.width(), h = image.height();
+    double activity = 0.0;
+    for(int y=0; y+1<h; y++)
+    {
+        const float* line = luma.constData() + y * w;
+        for(int x=0; x+1<w; x++)
+            activity += qAbs(line[x+1] - line[x]) + qAbs(line[x+w] - line[x]);
+    }
+
+    activity /= qMax(1, (w - 1) * (h - 1));
+    return qMin(int(QualityModel::BUCKETS) - 1, int(activity / QualityModel::BUCKETWIDTH));
+}
+
+//----------------------------------------------
+const QByteArray& QualitySearch::encoded(int quality)
+{
+    QHash<int, QByteArray>::iterator it = cache.find(quality);
+    if(it == cache.end())
+    {
+        QByteArray out;
+        if(!encodeJpeg(image, quality, out))
+            out.clear();
+        it = cache.insert(quality, out);
+    }
+
+    return *it;
+}
+
+//----------------------------------------------
+// the mean SSIM of the luminance in 8x8 windows
+double QualitySearch::ssim(int quality)
+{
+    QHash<int, double>::const_iterator it = ssims.constFind(quality);
+    if(it != ssims.constEnd())
+        return *it;
+
+    QImage decoded;
+    double sretval = 0.0;
+    if(decoded.loadFromData(encoded(quality), "JPEG") && decoded.size() == image.size())
+    {
+        QVector<float> other = luminance(decoded.convertToFormat(QImage::Format_RGB32));
+
+        const double C1 = 6.5025, C2 = 58.5225;     // (0.01 * 255)^2, (0.03 * 255)^2
+        const int w = image.width(), h = image.height();
+        int windows = 0;
+        for(int y0=0; y0+8<=h; y0+=8)
+            for(int x0=0; x0+8<=w; x0+=8)
+            {
+                double sa = 0, sb = 0, saa = 0, sbb = 0, sab = 0;
+                for(int y=y0; y<y0+8; y++)
+                    for(int x=x0; x<x0+8; x++)
+                    {
+                        double a = luma[y * w + x], b = other[y * w + x];
+                        sa += a;
+                        sb += b;
+                        saa += a * a;
+                        sbb += b * b;
+                        sab += a * b;
+                    }
+
+                double ma = sa / 64, mb = sb / 64;
+                double va = saa / 64 - ma * ma, vb = sbb / 64 - mb * mb, cov = sab / 64 - ma * mb;
+                sretval += ((2 * ma * mb + C1) * (2 * cov + C2)) / ((ma * ma + mb * mb + C1) * (va + vb + C2));
+                windows++;
+            }
+
+        sretval /= qMax(1, windows);
+    }
+
+    ssims.insert(quality, sretval);
+    return sretval;
+}
+
+//----------------------------------------------
+bool QualitySearch::passes(Test test, double limit, int quality)
+{
+    if(test == Keeps)
+        return ssim(quality) >= limit;
+
+    return encoded(quality).size() > limit;
+}
+
+//----------------------------------------------
+int QualitySearch::lowest(Test test, double limit, int lo, int hi, int start)
+{
+    // fails at 'below', passes at 'above'
+    int below = lo - 1, above = hi + 1;
+    start = qBound(lo, start, hi);
+
+    if(passes(test, limit, start))
+    {
+        above = start;
+        for(int step=1; above-1 > below; step*=2)
+        {
+            int q = qMax(lo, above - step);
+            if(!passes(test, limit, q))
+            {
+                below = q;
+                break;
+            }
+            above = q;
+        }
+    }
+    else
+    {
+        below = start;
+        for(int step=1; below+1 < above; step*=2)
+        {
+            int q = qMin(hi, below + step);
+            if(passes(test, limit, q))
+            {
+                above = q;
+                break;
+            }
+            below = q;
+        }
+    }
+
+    while(above - below > 1)
+    {
+        int q = (below + above) / 2;
+        if(passes(test, limit, q))
+            above = q;
+        else
+            below = q;
+    }
+
+    return above;
+}
+
+//----------------------------------------------
+// runs in the pool threads
+struct OptimizeJob
+{
+    OptimizeJob(TileOptimizer* p) : optimizer(p) {}
+
+    void operator()(OptimizeColumn& column) const
+    {
+        optimizer->optimizeColumn(column);
+    }
+
+    TileOptimizer* optimizer;
+};
+
+//----------------------------------------------
+TileOptimizer::TileOptimizer(QObject *parent) :
+    QObject(parent),
+    bcancelled(false)
+{
+    connect(&scanwatcher, SIGNAL(finished()), this, SLOT(scanned()));
+    connect(&columnwatcher, SIGNAL(progressValueChanged(int)), this, SLOT(columnProgress(int)));
+    connect(&columnwatcher, SIGNAL(finished()), this, SLOT(optimized()));
+}
+
+//----------------------------------------------
+TileOptimizer::~TileOptimizer()
+{
+    cancel();
+    scanwatcher.waitForFinished();
+    columnwatcher.waitForFinished();
+}
+
+//----------------------------------------------
+void TileOptimizer::start(const QString& dir, const TileGrid& grid, const OptimizeOptions& opts)
+{
+    root = dir;
+    options = opts;
+    jpegtran = options.bjpeg ? QStandardPaths::findExecutable("jpegtran") : QString();
+    BufferArena::configure(QThreadPool::globalInstance()->maxThreadCount(), grid.tileSize());
+
+    columns.clear();
+    resumed.clear();
+    model.clear();
+    bcancel.store(0);
+    bcancelled = false;
+    timer.start();
+
+    scanwatcher.setFuture(QtConcurrent::run(this, &TileOptimizer::scan));
+}
+
+//----------------------------------------------
+void TileOptimizer::cancel()
+{
+    bcancel.store(1);
+    bcancelled = true;
+    columnwatcher.cancel();
+}
+
+//----------------------------------------------
+bool TileOptimizer::isRunning() const
+{
+    return scanwatcher.isRunning() || columnwatcher.isRunning();
+}
+
+//----------------------------------------------
+// reads the journal and collects the columns still to do (in a pool thread)
+void TileOptimizer::scan()
+{
+    TraceSpan span("scan", "optimize");
+
+    const QString header = "# tileoptimizer " + options.describe();
+
+    // the columns of a previous run with the same options are done
+    QSet<qint64> done;
+
+    journal.close();
+    journal.setFileName(root + "/" + JOURNAL);
+    if(journal.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        QTextStream in(&journal);
+        if(in.readLine() == header)
+        {
+            while(!in.atEnd())
+            {
+                QStringList v = in.readLine().split(' ', QString::SkipEmptyParts);
+                if(v.size() != 7)
+                    continue;
+
+                OptimizeColumn column;
+                column.z = v[0].toInt();
+                column.x = v[1].toInt();
+                column.files = v[2].toInt();
+                column.optimized = v[3].toInt();
+                column.failed = v[4].toInt();
+                column.before = v[5].toLongLong();
+                column.after = v[6].toLongLong();
+
+                resumed.append(column);
+                done.insert((qint64(column.z) << 32) | quint32(column.x));
+            }
+        }
+        journal.close();
+    }
+
+    if(resumed.isEmpty())
+    {
+        if(journal.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+            journal.write(header.toUtf8() + "\n");
+    }
+    else
+        journal.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text);
+
+    QDir rootdir(root);
+    QStringList zdirs = rootdir.entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+    for(int i=0; i<zdirs.size() && !bcancel.load(); i++)
+    {
+        bool bz;
+        int z = zdirs[i].toInt(&bz);
+        if(!bz || z < 0)
+            continue;
+
+        QStringList xdirs = QDir(rootdir.filePath(zdirs[i])).entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+        for(int j=0; j<xdirs.size(); j++)
+        {
+            bool bx;
+            int x = xdirs[j].toInt(&bx);
+            if(!bx || x < 0 || done.contains((qint64(z) << 32) | quint32(x)))
+                continue;
+
+            OptimizeColumn column;
+            column.z = z;
+            column.x = x;
+            columns.append(column);
+        }
+    }
+}
+
+//----------------------------------------------
+void TileOptimizer::scanned()
+{
+    if(bcancelled || columns.isEmpty())
+    {
+        journal.close();
+        emit finished();
+        return;
+    }
+
+    emit progress(0, columns.size());
+    columnwatcher.setFuture(QtConcurrent::map(columns, OptimizeJob(this)));
+}
+
+//----------------------------------------------
+void TileOptimizer::columnProgress(int done)
+{
+    emit progress(done, columns.size());
+}
+
+//----------------------------------------------
+void TileOptimizer::optimized()
+{
+    journal.close();
+    emit finished();
+}
+
+//----------------------------------------------
+// a cancelled column isn't journaled, the next run does it again
+void TileOptimizer::optimizeColumn(OptimizeColumn& column)
+{
+    TraceSpan span("column", "optimize", column.x);
+
+    QDir dir(root + "/" + QString::number(column.z) + "/" + QString::number(column.x));
+    QStringList names = dir.entryList(QStringList() << "*.png" << "*.jpg" << "*.jpeg", QDir::Files);
+
+    for(int i=0; i<names.size(); i++)
+    {
+        if(bcancel.load())
+            return;
+
+        optimizeTile(dir.filePath(names[i]), column.z, column);
+    }
+
+    QMutexLocker locker(&journalmutex);
+    QTextStream(&journal) << column.z << " " << column.x << " " << column.files << " "
+                          << column.optimized << " " << column.failed << " "
+                          << column.before << " " << column.after << "\n";
+    journal.flush();
+}
+
+//----------------------------------------------
+void TileOptimizer::optimizeTile(const QString& path, int z, OptimizeColumn& column)
+{
+    column.files++;
+
+    QFile file(path);
+    if(!file.open(QIODevice::ReadOnly))
+    {
+        column.failed++;
+        return;
+    }
+
+    // the tile in an arena buffer; the QByteArray only refers to it
+    ArenaBuffer raw(file.size());
+    qint64 length = file.read((char*)raw.data(), raw.size());
+    file.close();
+
+    if(length < 0)
+    {
+        column.failed++;
+        return;
+    }
+
+    QByteArray data = QByteArray::fromRawData((const char*)raw.data(), int(length));
+
+    column.before += data.size();
+
+    QByteArray out;
+    bool bOK = false;
+    if(data.startsWith("\x89PNG\r\n\x1a\n"))
+        bOK = options.bpng && optimizePng(data, out);
+    else if(data.size() >= 3 && (uchar)data[0] == 0xFF && (uchar)data[1] == 0xD8 && (uchar)data[2] == 0xFF)
+        bOK = optimizeJpeg(data, z, out);
+
+    if(!bOK || out.isEmpty() || out.size() >= data.size())
+    {
+        column.after += data.size();
+        return;
+    }
+
+    // written to a temporary file and renamed over the tile
+    TraceSpan write(TraceName::Write, "optimize", z);
+    QSaveFile save(path);
+    if(save.open(QIODevice::WriteOnly) && save.write(out) == out.size() && save.commit())
+    {
+        column.optimized++;
+        column.after += out.size();
+    }
+    else
+    {
+        column.failed++;
+        column.after += data.size();
+    }
+}
+
+//----------------------------------------------
+// lossless: a palette when the tile has at most 256 colors (alpha included),
+// the maximal deflate level
+bool TileOptimizer::optimizePng(const QByteArray& data, QByteArray& out) const
+{
+    // QImage has 8 bits per channel - 16 bit PNGs would lose precision
+    if(data.size() < 25 || data[24] == 16)
+        return false;
+
+    QImage image;
+    if(!image.loadFromData(data, "PNG"))
+        return false;
+
+    QImage argb = image.convertToFormat(image.hasAlphaChannel() ? QImage::Format_ARGB32 : QImage::Format_RGB32);
+
+    QVector<QRgb> palette;
+    QHash<QRgb, int> seen;
+    for(int y=0; y<argb.height() && palette.size()<=256; y++)
+    {
+        const QRgb* line = (const QRgb*)argb.constScanLine(y);
+        for(int x=0; x<argb.width() && palette.size()<=256; x++)
+        {
+            if(!seen.contains(line[x]))
+            {
+                seen.insert(line[x], palette.size());
+                palette.append(line[x]);
+            }
+        }
+    }
+
+    // every color is in the palette, so the nearest one is exact
+    if(palette.size() <= 256)
+        image = argb.convertToFormat(QImage::Format_Indexed8, palette, Qt::ThresholdDither | Qt::AvoidDither);
+
+    QBuffer buffer(&out);
+    buffer.open(QIODevice::WriteOnly);
+
+    // for PNG the quality is the inverse of the deflate level: 0 - level 9
+    QImageWriter writer(&buffer, "png");
+    writer.setQuality(0);
+    return writer.write(image);
+}
+
+//----------------------------------------------
+bool TileOptimizer::optimizeJpeg(const QByteArray& data, int z, QByteArray& out)
+{
+    out = data;
+    bool bchanged = false;
+
+    if(options.quality > 0 && z >= options.fromlevel)
+    {
+        QImage image;
+        if(image.loadFromData(data, "JPEG"))
+        {
+            QByteArray encoded;
+            if(options.isAdaptive() ? !adaptiveJpeg(image, z, encoded) : !encodeJpeg(image, options.quality, encoded))
+                return false;
+
+            out = encoded;
+            bchanged = true;
+        }
+    }
+
+    if(options.bjpeg && !jpegtran.isEmpty())
+    {
+        QByteArray optimized;
+        if(runJpegtran(out, optimized))
+        {
+            out = optimized;
+            bchanged = true;
+        }
+    }
+
+    return bchanged;
+}
+
+//----------------------------------------------
+// The quality of the tile: the lowest one which keeps the SSIM target (or
+// the options' quality without one), then lowered until the tile fits the
+// budget of its level, not below MINQUALITY.
+bool TileOptimizer::adaptiveJpeg(const QImage& image, int z, QByteArray& out)
+{
+    TraceSpan span("adaptive", "optimize", z);
+
+    QualitySearch search(image);
+    int bucket = search.bucket();
+    int quality = options.quality;
+    int predicted = model.predict(z, bucket, quality);
+
+    if(options.ssim > 0.0)
+        quality = qMin(quality, search.lowest(QualitySearch::Keeps, options.ssim, MINQUALITY, quality, predicted));
+
+    int budget = options.budgetOf(z);
+    if(budget > 0 && search.encoded(quality).size() > budget)
+        quality = qMax(MINQUALITY, search.lowest(QualitySearch::Exceeds, budget, MINQUALITY, quality,
+                                                 qMin(quality, predicted + 1)) - 1);
+
+    out = search.encoded(quality);
+    if(out.isEmpty())
+        return false;
+
+    model.add(z, bucket, quality, search.encodes());
+    return true;
+}
+
+//----------------------------------------------
+// optimal Huffman tables, the coefficients stay as they are (stdin -> stdout)
+bool TileOptimizer::runJpegtran(const QByteArray& data, QByteArray& out) const
+{
+    QProcess process;
+    process.start(jpegtran, QStringList() << "-copy" << "none" << "-optimize");
+    if(!process.waitForStarted())
+        return false;
+
+    process.write(data);
+    process.closeWriteChannel();
+
+    if(!process.waitForFinished(JPEGTRANTIMEOUT) ||
+       process.exitStatus() != QProcess::NormalExit || process.exitCode() != 0)
+    {
+        process.kill();
+        return false;
+    }
+
+    out = process.readAllStandardOutput();
+    return !out.isEmpty();
+}
+
+//----------------------------------------------
+QString TileOptimizer::report() const
+{
+    qint64 files = 0, optimizedtiles = 0, failed = 0, before = 0, after = 0;
+
+    QVector<OptimizeColumn> all = resumed;
+    all += columns;
+    for(int i=0; i<all.size(); i++)
+    {
+        files += all[i].files;
+        optimizedtiles += all[i].optimized;
+        failed += all[i].failed;
+        before += all[i].before;
+        after += all[i].after;
+    }
+
+    qint64 saved = before - after;
+
+    QString sretval = "Optimized " + QString::number(optimizedtiles) + " of " + QString::number(files) +
+                      " tiles in " + QString::number(timer.elapsed() / 1000.0, 'f', 1) + " s" +
+                      (bcancelled ? " (cancelled)" : "") + ": " +
+                      QString::number(saved >> 20) + " MB saved (" +
+                      QString::number(before > 0 ? saved * 100.0 / before : 0.0, 'f', 1) + "%)";
+
+    if(!resumed.isEmpty())
+        sretval += "\n" + QString::number(resumed.size()) + " columns done by a previous run";
+
+    if(failed > 0)
+        sretval += "\n" + QString::number(failed) + " tiles could not be read or written";
+
+    if(options.bjpeg && jpegtran.isEmpty())
+        sretval += "\njpegtran has not been found - the JPEG Huffman tables are left as they are";
+
+    QString adaptive = model.report();
+    if(!adaptive.isEmpty())
+        sretval += "\n" + adaptive;
+
+    return sretval;
+}
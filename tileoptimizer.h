@@ -0,0 +1,157 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by Саша Миленковић                                 *
+ *   sasa.milenkovic.xyz@gmail.com                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *   ( http://www.gnu.org/licenses/gpl-3.0.en.html )                       *
+ *									   *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef TILEOPTIMIZER_H
+#define TILEOPTIMIZER_H
+
+#include <QObject>
+#include <QVector>
+#include <QFutureWatcher>
+#include <QElapsedTimer>
+#include <QAtomicInt>
+#include <QMutex>
+#include <QFile>
+#include <QMap>
+
+#include "tilegrid.h"
+
+class QImage;
+
+//----------------------------------------------
+struct OptimizeOptions
+{
+    OptimizeOptions() : bpng(true), bjpeg(true), quality(0), budget(0), fromlevel(0), ssim(0.0) {}
+
+    bool bpng;          // lossless: palette reduction, maximal deflate
+    bool bjpeg;         // lossless: optimized Huffman tables (jpegtran)
+    int quality;        // 0 - no transcoding, otherwise JPEG tiles are re-encoded with it ...
+    int budget;         // ... and lower (down to MINQUALITY) until a tile has at most this many bytes (0 - any size)
+    int fromlevel;      // the transcoding applies to this and the finer levels only
+    QMap<int, int> levelbudgets;    // bytes per tile of a level (z), instead of 'budget'
+    double ssim;        // > 0 - the lowest quality per tile which keeps this SSIM (within the budget)
+
+    int budgetOf(int z) const { return levelbudgets.value(z, budget); }
+    bool isAdaptive() const { return ssim > 0.0 || budget > 0 || !levelbudgets.isEmpty(); }
+
+    // "z:KB, z:KB, ..." - false if the text is not such a list
+    bool setLevelBudgets(const QString& text);
+
+    QString describe() const;
+};
+
+//----------------------------------------------
+// The qualities the adaptive JPEG search has found, per level and tile
+// complexity (the mean luminance gradient, in buckets). A new tile starts
+// its search at the average of its bucket, which is mostly right within
+// a step or two, instead of bisecting the whole quality range.
+class QualityModel
+{
+public:
+    enum { BUCKETS = 16, BUCKETWIDTH = 4 };
+
+    QualityModel();
+
+    void clear();
+    int predict(int z, int bucket, int fallback) const;
+    void add(int z, int bucket, int quality, int encodes);
+
+    qint64 tiles() const;
+    QString report() const;
+
+private:
+    mutable QMutex mutex;
+    QMap<int, QVector<qint64> > sums, counts;   // by level, per bucket
+    qint64 ntiles, nencodes, qualitysum;
+};
+
+//----------------------------------------------
+// one column directory of the tile tree (<root>/<z>/<x>/), the unit of
+// the work and of the resume journal
+struct OptimizeColumn
+{
+    OptimizeColumn() : z(0), x(0), files(0), optimized(0), failed(0), before(0), after(0) {}
+
+    int z, x;
+    int files;
+    int optimized;      // rewritten smaller
+    int failed;         // unreadable or not writable
+    qint64 before, after;
+};
+
+//----------------------------------------------
+// Recompresses an existing tile tree in place, in parallel (QtConcurrent,
+// all cores). A tile is replaced only when the result is smaller, through
+// QSaveFile, so an interrupted run never leaves a partial tile. Finished
+// columns are appended to the journal <root>/.tileoptimizer; a new run with
+// the same options skips them.
+class TileOptimizer : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit TileOptimizer(QObject *parent = 0);
+    ~TileOptimizer();
+
+    void start(const QString& root, const TileGrid& grid, const OptimizeOptions& options);
+    void cancel();
+    bool isRunning() const;
+
+    QString report() const;
+
+    // the column jobs, public for the pool functor
+    void optimizeColumn(OptimizeColumn& column);
+
+signals:
+    void progress(int done, int total);
+    void finished();
+
+private slots:
+    void scanned();
+    void columnProgress(int);
+    void optimized();
+
+private:
+    QString root;
+    OptimizeOptions options;
+    QString jpegtran;       // empty - not installed, no lossless JPEG pass
+
+    QVector<OptimizeColumn> columns;
+    QVector<OptimizeColumn> resumed;    // from the journal
+    QAtomicInt bcancel;
+    bool bcancelled;
+    QElapsedTimer timer;
+
+    QMutex journalmutex;
+    QFile journal;
+
+    QualityModel model;
+
+    QFutureWatcher<void> scanwatcher;
+    QFutureWatcher<void> columnwatcher;
+
+    void scan();
+    void optimizeTile(const QString& path, int z, OptimizeColumn& column);
+    bool optimizePng(const QByteArray& data, QByteArray& out) const;
+    bool optimizeJpeg(const QByteArray& data, int z, QByteArray& out);
+    bool adaptiveJpeg(const QImage& image, int z, QByteArray& out);
+    bool runJpegtran(const QByteArray& data, QByteArray& out) const;
+};
+
+#endif // TILEOPTIMIZER_H
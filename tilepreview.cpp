@@ -0,0 +1,430 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by Саша Миленковић                                 *
+ *   sasa.milenkovic.xyz@gmail.com                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *   ( http://www.gnu.org/licenses/gpl-3.0.en.html )                       *
+ *									   *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <QPainter>
+#include <QMouseEvent>
+#include <QWheelEvent>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QtConcurrentRun>
+
+#include <algorithm>
+#include <cmath>
+
+#include "tilepreview.h"
+#include "tracer.h"
+
+const int LOADERS = 4;
+const qint64 RETRYMS = 3000;    // a missing tile is tried again after this
+const qint64 SETTLEDSECS = 5;   // a file not modified for so long is mapped, newer ones are read
+
+//----------------------------------------------
+// '<base>.<ext>' of any tile format (in a pool thread); a null image - none
+static QImage loadTile(const QString& base)
+{
+    TraceSpan span(TraceName::Decode, "preview");
+
+    static const char* const extensions[] = { "jpg", "png", "jpeg", "gif" };
+    for(int i=0; i<4; i++)
+    {
+        QFile file(base + "." + extensions[i]);
+        if(!file.open(QIODevice::ReadOnly))
+            continue;
+
+        // a file which may still be written is read, not mapped (it could shrink under the map)
+        QImage image;
+        QFileInfo info(file);
+        uchar* data = 0;
+        if(info.lastModified().secsTo(QDateTime::currentDateTime()) >= SETTLEDSECS)
+            data = file.map(0, file.size());
+
+        if(data)
+        {
+            image.loadFromData(data, int(file.size()));
+            file.unmap(data);
+        }
+        else
+            image.loadFromData(file.readAll());
+
+        if(image.isNull())
+            return image;
+
+        // the fastest one to draw
+        return image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    }
+
+    return QImage();
+}
+
+//----------------------------------------------
+TilePreview::TilePreview(QWidget *parent) :
+    QWidget(parent),
+    cx(0.0), cy(0.0),
+    viewres(1.0),
+    bdragging(false),
+    generation(0)
+{
+    setMinimumHeight(200);
+    setMouseTracking(true);
+    setAutoFillBackground(true);
+    setBackgroundRole(QPalette::Base);
+
+    setCacheSize(256);
+    pool.setMaxThreadCount(LOADERS);
+    clock.start();
+}
+
+//----------------------------------------------
+TilePreview::~TilePreview()
+{
+    pool.waitForDone();
+}
+
+//----------------------------------------------
+void TilePreview::setPyramid(const QString& dir, const TileGrid& g)
+{
+    root = dir;
+    grid = g;
+    reload();
+    zoomToExtent();
+}
+
+//----------------------------------------------
+void TilePreview::setCacheSize(int megabytes)
+{
+    cache.setMaxCost(megabytes * 1024);
+}
+
+//----------------------------------------------
+void TilePreview::reload()
+{
+    generation++;
+    cache.clear();
+    missing.clear();
+    queue.clear();
+    inflight.clear();
+    update();
+}
+
+//----------------------------------------------
+void TilePreview::zoomToExtent()
+{
+    if(!hasPyramid())
+        return;
+
+    const BBox& e = grid.extent();
+    cx = (e.left + e.right) / 2;
+    cy = (e.bottom + e.top) / 2;
+    viewres = qMax((e.right - e.left) / qMax(1, width()), (e.top - e.bottom) / qMax(1, height()));
+    update();
+}
+
+//----------------------------------------------
+qint64 TilePreview::key(int k, qint64 c, qint64 r)
+{
+    return (qint64(k) << 56) | (c << 28) | r;
+}
+
+//----------------------------------------------
+// the finest level whose pixels are not smaller than the screen ones
+int TilePreview::viewLevel() const
+{
+    int k = int(std::floor(std::log(viewres / grid.highResolution()) / std::log(2.0) + 1e-9));
+    return qBound(0, k, grid.levels() - 1);
+}
+
+//----------------------------------------------
+BBox TilePreview::viewBox() const
+{
+    double hw = width() * viewres / 2, hh = height() * viewres / 2;
+    return BBox(cx - hw, cy - hh, cx + hw, cy + hh);
+}
+
+//----------------------------------------------
+QRectF TilePreview::mapRect(const BBox& box) const
+{
+    double x = width() / 2.0 + (box.left - cx) / viewres;
+    double y = height() / 2.0 - (box.top - cy) / viewres;
+    return QRectF(x, y, (box.right - box.left) / viewres, (box.top - box.bottom) / viewres);
+}
+
+//----------------------------------------------
+QString TilePreview::tilePath(qint64 tilekey) const
+{
+    int k = int(tilekey >> 56);
+    qint64 c = (tilekey >> 28) & 0xFFFFFFF;
+    qint64 r = tilekey & 0xFFFFFFF;
+
+    return root + "/" + QString::number(grid.zoom(k)) + "/" + QString::number(c) + "/" + QString::number(r);
+}
+
+//----------------------------------------------
+void TilePreview::paintEvent(QPaintEvent*)
+{
+    QPainter painter(this);
+    if(!hasPyramid())
+    {
+        painter.setPen(Qt::gray);
+        painter.drawText(rect(), Qt::AlignCenter, "No tile cache to show");
+        return;
+    }
+
+    // smooth only while it stands still
+    painter.setRenderHint(QPainter::SmoothPixmapTransform, !bdragging);
+
+    const BBox view = viewBox();
+    const int k = viewLevel();
+    const TileRange range = grid.range(view, k);
+
+    painter.setPen(Qt::lightGray);
+    painter.drawRect(mapRect(grid.extent()));
+
+    // the visible tiles, from the centre out
+    QList<QPair<double, qint64> > visible;
+    const double span = grid.span(k);
+    for(qint64 r=range.r0; r<=range.r1; r++)
+    {
+        for(qint64 c=range.c0; c<=range.c1; c++)
+        {
+            const BBox box = grid.tileBox(k, c, r);
+            const QRectF target = mapRect(box);
+            const qint64 tilekey = key(k, c, r);
+
+            QImage* image = cache.object(tilekey);
+            if(image)
+            {
+                painter.drawImage(target, *image);
+                continue;
+            }
+
+            drawAncestor(painter, k, c, r, target);
+
+            double dx = ((box.left + box.right) / 2 - cx) / span, dy = ((box.bottom + box.top) / 2 - cy) / span;
+            visible.append(qMakePair(dx*dx + dy*dy, tilekey));
+        }
+    }
+
+    std::sort(visible.begin(), visible.end());
+
+    QList<qint64> wanted;
+    for(int i=0; i<visible.size(); i++)
+        wanted << visible[i].second;
+
+    // the neighbours, then the next coarser level
+    if(range.isEmpty())
+        return;
+
+    TileRange all = grid.levelTiles(k);
+    for(qint64 r=qMax(all.r0, range.r0-1); r<=qMin(all.r1, range.r1+1); r++)
+        for(qint64 c=qMax(all.c0, range.c0-1); c<=qMin(all.c1, range.c1+1); c++)
+            if(r < range.r0 || r > range.r1 || c < range.c0 || c > range.c1)
+                wanted << key(k, c, r);
+
+    if(k+1 < grid.levels())
+    {
+        TileRange coarse = grid.range(view, k+1);
+        for(qint64 r=coarse.r0; r<=coarse.r1; r++)
+            for(qint64 c=coarse.c0; c<=coarse.c1; c++)
+                wanted << key(k+1, c, r);
+    }
+
+    request(wanted);
+}
+
+//----------------------------------------------
+// the nearest decoded ancestor's part of the tile, scaled up
+bool TilePreview::drawAncestor(QPainter& painter, int k, qint64 c, qint64 r, const QRectF& target)
+{
+    const BBox box = grid.tileBox(k, c, r);
+    for(int j=1; k+j<grid.levels(); j++)
+    {
+        QImage* image = cache.object(key(k+j, c >> j, r >> j));
+        if(!image)
+            continue;
+
+        const BBox pbox = grid.tileBox(k+j, c >> j, r >> j);
+        const double scale = image->width() / (pbox.right - pbox.left);
+        QRectF source((box.left - pbox.left) * scale, (pbox.top - box.top) * scale,
+                      (box.right - box.left) * scale, (box.top - box.bottom) * scale);
+        painter.drawImage(target, *image, source);
+        return true;
+    }
+
+    return false;
+}
+
+//----------------------------------------------
+// the queue is replaced: what has scrolled away is not loaded any more
+void TilePreview::request(const QList<qint64>& wanted)
+{
+    const qint64 now = clock.elapsed();
+
+    queue.clear();
+    for(int i=0; i<wanted.size(); i++)
+    {
+        if(inflight.contains(wanted[i]) || cache.contains(wanted[i]))
+            continue;
+
+        QHash<qint64, qint64>::const_iterator it = missing.constFind(wanted[i]);
+        if(it != missing.constEnd() && now - it.value() < RETRYMS)
+            continue;
+
+        queue.append(wanted[i]);
+    }
+
+    startLoads();
+}
+
+//----------------------------------------------
+void TilePreview::startLoads()
+{
+    while(!queue.isEmpty() && inflight.size() < LOADERS)
+    {
+        qint64 tilekey = queue.takeFirst();
+
+        QFutureWatcher<QImage>* watcher = new QFutureWatcher<QImage>(this);
+        connect(watcher, SIGNAL(finished()), this, SLOT(tileLoaded()));
+        loading.insert(watcher, tilekey);
+        inflight.insert(tilekey);
+        watcher->setProperty("generation", generation);
+        watcher->setFuture(QtConcurrent::run(&pool, loadTile, tilePath(tilekey)));
+    }
+}
+
+//----------------------------------------------
+void TilePreview::tileLoaded()
+{
+    QFutureWatcher<QImage>* watcher = static_cast<QFutureWatcher<QImage>*>(sender());
+    qint64 tilekey = loading.take(watcher);
+    bool bcurrent = watcher->property("generation").toInt() == generation;
+    QImage image = watcher->result();
+    watcher->deleteLater();
+
+    if(!bcurrent)
+    {
+        startLoads();
+        return;
+    }
+
+    inflight.remove(tilekey);
+
+    if(image.isNull())
+        missing.insert(tilekey, clock.elapsed());
+    else
+    {
+        missing.remove(tilekey);
+        cache.insert(tilekey, new QImage(image), qMax(1, image.byteCount() / 1024));
+        update();
+    }
+
+    startLoads();
+}
+
+//----------------------------------------------
+void TilePreview::resizeEvent(QResizeEvent*)
+{
+    update();
+}
+
+//----------------------------------------------
+void TilePreview::mousePressEvent(QMouseEvent* event)
+{
+    if(event->button() == Qt::LeftButton)
+    {
+        bdragging = true;
+        dragpos = event->pos();
+        setCursor(Qt::ClosedHandCursor);
+    }
+}
+
+//----------------------------------------------
+void TilePreview::mouseMoveEvent(QMouseEvent* event)
+{
+    if(bdragging)
+    {
+        QPoint delta = event->pos() - dragpos;
+        dragpos = event->pos();
+        cx -= delta.x() * viewres;
+        cy += delta.y() * viewres;
+        update();
+    }
+
+    showStatus(event->pos());
+}
+
+//----------------------------------------------
+void TilePreview::mouseReleaseEvent(QMouseEvent* event)
+{
+    if(event->button() == Qt::LeftButton && bdragging)
+    {
+        bdragging = false;
+        unsetCursor();
+        update();
+    }
+}
+
+//----------------------------------------------
+void TilePreview::mouseDoubleClickEvent(QMouseEvent*)
+{
+    zoomToExtent();
+}
+
+//----------------------------------------------
+// about the point under the cursor, 2x per wheel step
+void TilePreview::wheelEvent(QWheelEvent* event)
+{
+    if(!hasPyramid())
+        return;
+
+    double factor = std::pow(2.0, -event->angleDelta().y() / 120.0);
+    double newres = qBound(grid.highResolution() / 8, viewres * factor, grid.span(grid.levels() - 1) / 16);
+
+    // the map point under the cursor stays
+    double mx = cx + (event->pos().x() - width() / 2.0) * viewres;
+    double my = cy - (event->pos().y() - height() / 2.0) * viewres;
+    cx = mx - (event->pos().x() - width() / 2.0) * newres;
+    cy = my + (event->pos().y() - height() / 2.0) * newres;
+    viewres = newres;
+
+    update();
+    showStatus(event->pos());
+}
+
+//----------------------------------------------
+void TilePreview::showStatus(const QPoint& pos)
+{
+    if(!hasPyramid())
+        return;
+
+    double x = cx + (pos.x() - width() / 2.0) * viewres;
+    double y = cy - (pos.y() - height() / 2.0) * viewres;
+
+    int k = viewLevel();
+    TileRange tile = grid.range(BBox(x, y, x, y), k);
+
+    QString sstatus = "z " + QString::number(grid.zoom(k)) + "  (" +
+                      QString::number(x, 'f', 6) + ", " + QString::number(y, 'f', 6) + ")";
+    if(!tile.isEmpty())
+        sstatus += "  tile " + QString::number(tile.c0) + "/" + QString::number(tile.r0);
+    sstatus += "  " + QString::number(cache.totalCost() / 1024) + " MB decoded";
+
+    emit status(sstatus);
+}
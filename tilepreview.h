@@ -0,0 +1,108 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by Саша Миленковић                                 *
+ *   sasa.milenkovic.xyz@gmail.com                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *   ( http://www.gnu.org/licenses/gpl-3.0.en.html )                       *
+ *									   *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef TILEPREVIEW_H
+#define TILEPREVIEW_H
+
+#include <QWidget>
+#include <QCache>
+#include <QHash>
+#include <QSet>
+#include <QImage>
+#include <QThreadPool>
+#include <QElapsedTimer>
+#include <QFutureWatcher>
+
+#include "tilegrid.h"
+
+//----------------------------------------------
+// Pans (drag) and zooms (wheel) through a tile pyramid on the disk
+// (<root>/<z>/<x>/<y>.<ext>, TMS). The paint event draws only tiles which
+// are decoded already; the others are queued, the visible ones first
+// (from the centre out), then their neighbours and the next coarser level.
+// A few pool threads read and decode them (settled files memory-mapped)
+// into an LRU cache bounded in bytes. Until a tile arrives, the nearest
+// decoded ancestor is drawn scaled up in its place.
+//
+// A tile which is missing or cannot be decoded (a tilemaker may be writing
+// it right now) is tried again a few seconds later; reload() drops all
+// decoded tiles, e.g. after a run.
+class TilePreview : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit TilePreview(QWidget *parent = 0);
+    ~TilePreview();
+
+    void setPyramid(const QString& root, const TileGrid& grid);
+    void setCacheSize(int megabytes);
+
+    bool hasPyramid() const { return grid.levels() > 0; }
+
+public slots:
+    void reload();
+    void zoomToExtent();
+
+signals:
+    void status(const QString&);    // the level and the tile under the cursor
+
+protected:
+    void paintEvent(QPaintEvent*);
+    void resizeEvent(QResizeEvent*);
+    void mousePressEvent(QMouseEvent*);
+    void mouseMoveEvent(QMouseEvent*);
+    void mouseReleaseEvent(QMouseEvent*);
+    void mouseDoubleClickEvent(QMouseEvent*);
+    void wheelEvent(QWheelEvent*);
+
+private slots:
+    void tileLoaded();
+
+private:
+    QString root;
+    TileGrid grid;
+    double cx, cy;      // the map point in the widget centre
+    double viewres;     // map units per pixel
+    QPoint dragpos;
+    bool bdragging;
+
+    QCache<qint64, QImage> cache;       // the cost in kB
+    QHash<qint64, qint64> missing;      // -> when (clock) it was not found
+    QList<qint64> queue;                // the most wanted first
+    QHash<QFutureWatcher<QImage>*, qint64> loading;
+    QSet<qint64> inflight;
+    int generation;                     // of the pyramid; older loads are dropped
+    QThreadPool pool;
+    QElapsedTimer clock;
+
+    static qint64 key(int k, qint64 c, qint64 r);
+    int viewLevel() const;
+    BBox viewBox() const;
+    QRectF mapRect(const BBox& box) const;
+    QString tilePath(qint64 key) const;
+
+    bool drawAncestor(QPainter& painter, int k, qint64 c, qint64 r, const QRectF& target);
+    void request(const QList<qint64>& wanted);
+    void startLoads();
+    void showStatus(const QPoint& pos);
+};
+
+#endif // TILEPREVIEW_H
@@ -0,0 +1,528 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by Саша Миленковић                                 *
+ *   sasa.milenkovic.xyz@gmail.com                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *   ( http://www.gnu.org/licenses/gpl-3.0.en.html )                       *
+ *									   *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QDataStream>
+#include <QCryptographicHash>
+#include <QImage>
+#include <QStringList>
+#include <QThreadPool>
+#include <QtConcurrentRun>
+#include <QtConcurrentMap>
+
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+
+#include "tilestager.h"
+#include "changemanifest.h"
+#include "uboxindex.h"
+#include "tracer.h"
+#include "bufferarena.h"
+
+static const char* const extensions[] = { "jpg", "jpeg", "png", "gif" };
+static const int EXTENSIONS = 4;
+
+static const quint16 VERSION = 1;
+static const int MAXREPORTED = 20;      // regions listed in the report
+
+//----------------------------------------------
+// 'from' over 'to' at once: a reader of the cache sees the old file or the
+// new one, never none. From another file system through a copy next to
+// the target, which is renamed over it.
+static bool replaceFile(const QString& from, const QString& to)
+{
+#ifdef Q_OS_UNIX
+    if(::rename(QFile::encodeName(from).constData(), QFile::encodeName(to).constData()) == 0)
+        return true;
+
+    QString temp = to + ".part";
+    QFile::remove(temp);
+    if(!QFile::copy(from, temp))
+        return false;
+
+    if(::rename(QFile::encodeName(temp).constData(), QFile::encodeName(to).constData()) != 0)
+    {
+        QFile::remove(temp);
+        return false;
+    }
+#else
+    // QFile doesn't rename over an existing file
+    QFile::remove(to);
+    if(!QFile::rename(from, to))
+        return QFile::copy(from, to) && QFile::remove(from);
+#endif
+
+    QFile::remove(from);
+    return true;
+}
+
+//----------------------------------------------
+StagedTile::StagedTile() :
+    z(0), x(0), y(0), ext(0), state(New), bindexed(false), size(0), mtime(0)
+{
+    memset(md5, 0, sizeof(md5));
+}
+
+//----------------------------------------------
+qint64 StagedTile::key() const
+{
+    return TileChange::key(z, x, y);
+}
+
+//----------------------------------------------
+static bool byKey(const StagedTile& a, const StagedTile& b)
+{
+    return a.key() < b.key();
+}
+
+//==============================================
+// the sidecar index
+
+//----------------------------------------------
+static QString indexName(const QString& cache)
+{
+    return cache + "/tilehashes.idx";
+}
+
+//----------------------------------------------
+// positioned at the first record if the index is of the same kind of hashes
+static bool readIndexHeader(QDataStream& in, bool bpixels)
+{
+    char magic[4];
+    quint16 version = 0;
+    quint8 pixels = 0;
+    if(in.readRawData(magic, 4) != 4 || memcmp(magic, "TCHI", 4) != 0)
+        return false;
+
+    in >> version >> pixels;
+    return in.status() == QDataStream::Ok && version == VERSION && (pixels != 0) == bpixels;
+}
+
+//----------------------------------------------
+static bool readEntry(QDataStream& in, StagedTile& entry)
+{
+    quint8 z;
+    in >> z >> entry.x >> entry.y >> entry.size >> entry.mtime;
+    in.readRawData(entry.md5, 16);
+    entry.z = z;
+
+    return in.status() == QDataStream::Ok;
+}
+
+//----------------------------------------------
+static void writeEntry(QDataStream& out, const StagedTile& entry)
+{
+    out << quint8(entry.z) << entry.x << entry.y << entry.size << entry.mtime;
+    out.writeRawData(entry.md5, 16);
+}
+
+//----------------------------------------------
+// MD5 of the file or of its pixels (the undecodable ones by their bytes)
+static bool tileHash(const QString& path, bool bpixels, char* md5)
+{
+    QFile file(path);
+    if(!file.open(QIODevice::ReadOnly))
+        return false;
+
+    ArenaBuffer raw(file.size());
+    qint64 length = qMax(qint64(0), file.read((char*)raw.data(), raw.size()));
+
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    QImage image;
+    if(bpixels && image.loadFromData((const uchar*)raw.data(), int(length)))
+    {
+        image = image.convertToFormat(QImage::Format_ARGB32);
+        qint32 size[2] = { image.width(), image.height() };
+        hash.addData((const char*)size, sizeof(size));
+        for(int y=0; y<image.height(); y++)
+            hash.addData((const char*)image.constScanLine(y), image.width() * 4);
+    }
+    else
+        hash.addData((const char*)raw.data(), int(length));
+
+    memcpy(md5, hash.result().constData(), 16);
+    return true;
+}
+
+//----------------------------------------------
+// runs in the pool threads: moves the staged tile into the cache unless it is there already
+struct MergeTile
+{
+    MergeTile(const QString& s, const QString& c, bool b) : staging(s), cache(c), bpixels(b) {}
+
+    void operator()(StagedTile& tile) const
+    {
+        TraceSpan span("merge", "stage", tile.x);
+
+        QString dir = "/" + QString::number(tile.z) + "/" + QString::number(tile.x);
+        QString name = dir + "/" + QString::number(tile.y) + "." + extensions[tile.ext];
+
+        char md5[16];
+        if(!tileHash(staging + name, bpixels, md5))
+        {
+            tile.state = StagedTile::Failed;
+            return;
+        }
+
+        QFileInfo info(cache + name);
+        if(info.exists())
+        {
+            // the sidecar entry only while the file is the one it describes
+            char cached[16];
+            bool bknown = tile.bindexed && tile.size == quint32(info.size()) &&
+                          tile.mtime == info.lastModified().toMSecsSinceEpoch();
+            if(bknown)
+                memcpy(cached, tile.md5, 16);
+            else if(!tileHash(info.filePath(), bpixels, cached))
+                memset(cached, 0, 16);
+
+            if(memcmp(cached, md5, 16) == 0)
+            {
+                QFile::remove(staging + name);
+                tile.state = StagedTile::Unchanged;
+                tile.bindexed = true;
+                tile.size = quint32(info.size());
+                tile.mtime = info.lastModified().toMSecsSinceEpoch();
+                memcpy(tile.md5, cached, 16);
+                return;
+            }
+
+            tile.state = StagedTile::Changed;
+        }
+        else
+        {
+            tile.state = StagedTile::New;
+            QDir().mkpath(cache + dir);
+        }
+
+        if(!replaceFile(staging + name, cache + name))
+        {
+            tile.state = StagedTile::Failed;
+            return;
+        }
+
+        info.refresh();
+        tile.bindexed = true;
+        tile.size = quint32(info.size());
+        tile.mtime = info.lastModified().toMSecsSinceEpoch();
+        memcpy(tile.md5, md5, 16);
+    }
+
+    QString staging, cache;
+    bool bpixels;
+};
+
+//----------------------------------------------
+TileStager::TileStager(QObject *parent) :
+    QObject(parent),
+    bpixels(false),
+    unexpected(0),
+    bcancelled(false)
+{
+    connect(&scanwatcher, SIGNAL(finished()), this, SLOT(scanned()));
+    connect(&mergewatcher, SIGNAL(progressValueChanged(int)), this, SLOT(mergeProgress(int)));
+    connect(&mergewatcher, SIGNAL(finished()), this, SLOT(merged()));
+    connect(&indexwatcher, SIGNAL(finished()), this, SLOT(indexed()));
+}
+
+//----------------------------------------------
+TileStager::~TileStager()
+{
+    cancel();
+    scanwatcher.waitForFinished();
+    mergewatcher.waitForFinished();
+    indexwatcher.waitForFinished();
+}
+
+//----------------------------------------------
+QString TileStager::stagingDir(const QString& cache)
+{
+    return cache + "/staging";
+}
+
+//----------------------------------------------
+void TileStager::start(const QString& dir, const QString& root, const TileGrid& g,
+                       const QList<UBox>& regions, bool bpix)
+{
+    staging = dir;
+    cache = root;
+    grid = g;
+    uboxes = regions;
+    bpixels = bpix;
+    BufferArena::configure(QThreadPool::globalInstance()->maxThreadCount(), grid.tileSize());
+
+    tiles.clear();
+    unexpected = 0;
+    error.clear();
+    bcancel.store(0);
+    bcancelled = false;
+    timer.start();
+
+    scanwatcher.setFuture(QtConcurrent::run(this, &TileStager::scan));
+}
+
+//----------------------------------------------
+void TileStager::cancel()
+{
+    bcancel.store(1);
+    bcancelled = true;
+    mergewatcher.cancel();
+}
+
+//----------------------------------------------
+bool TileStager::isRunning() const
+{
+    return scanwatcher.isRunning() || mergewatcher.isRunning() || indexwatcher.isRunning();
+}
+
+//----------------------------------------------
+// collects the staged tiles and their sidecar entries (in a pool thread)
+void TileStager::scan()
+{
+    TraceSpan span("scan", "stage");
+
+    QStringList filters;
+    for(int i=0; i<EXTENSIONS; i++)
+        filters << QString("*.") + extensions[i];
+
+    QDirIterator it(staging, filters, QDir::Files, QDirIterator::Subdirectories);
+    while(it.hasNext() && !bcancel.load())
+    {
+        QStringList parts = it.next().mid(staging.length()).split('/', QString::SkipEmptyParts);
+
+        bool bOK = parts.size() == 3;
+
+        StagedTile tile;
+        if(bOK)
+        {
+            QString name = parts[2];
+            int dot = name.lastIndexOf('.');
+            QString suffix = name.mid(dot + 1);
+
+            bool bz, bx, by;
+            tile.z = parts[0].toInt(&bz);
+            tile.x = parts[1].toUInt(&bx);
+            tile.y = name.left(dot).toUInt(&by);
+            bOK = bz && bx && by && tile.z >= 0 && tile.z < grid.levels();
+
+            for(int i=0; i<EXTENSIONS; i++)
+                if(suffix == extensions[i])
+                    tile.ext = i;
+        }
+
+        if(bOK)
+            tiles.append(tile);
+        else
+            unexpected++;
+    }
+
+    std::sort(tiles.begin(), tiles.end(), byKey);
+
+    // one pass over the index, both are sorted by tile
+    QFile file(indexName(cache));
+    if(!file.open(QIODevice::ReadOnly))
+        return;
+
+    QDataStream in(&file);
+    in.setByteOrder(QDataStream::LittleEndian);
+    if(!readIndexHeader(in, bpixels))
+        return;
+
+    StagedTile entry;
+    int i = 0;
+    while(i < tiles.size() && !bcancel.load() && readEntry(in, entry))
+    {
+        while(i < tiles.size() && tiles[i].key() < entry.key())
+            i++;
+
+        if(i < tiles.size() && tiles[i].key() == entry.key())
+        {
+            tiles[i].bindexed = true;
+            tiles[i].size = entry.size;
+            tiles[i].mtime = entry.mtime;
+            memcpy(tiles[i].md5, entry.md5, 16);
+        }
+    }
+}
+
+//----------------------------------------------
+void TileStager::scanned()
+{
+    if(bcancelled || tiles.isEmpty())
+    {
+        emit finished();
+        return;
+    }
+
+    emit progress(0, tiles.size());
+    mergewatcher.setFuture(QtConcurrent::map(tiles, MergeTile(staging, cache, bpixels)));
+}
+
+//----------------------------------------------
+void TileStager::mergeProgress(int done)
+{
+    emit progress(done, tiles.size());
+}
+
+//----------------------------------------------
+// the tiles merged before a cancel are in the index as well
+void TileStager::merged()
+{
+    indexwatcher.setFuture(QtConcurrent::run(this, &TileStager::writeIndex));
+}
+
+//----------------------------------------------
+// the old index and the new entries into a fresh copy (in a pool thread)
+void TileStager::writeIndex()
+{
+    TraceSpan span("index", "stage");
+
+    QString path = indexName(cache);
+    QFile old(path);
+    QDataStream in(&old);
+    in.setByteOrder(QDataStream::LittleEndian);
+    bool bold = old.open(QIODevice::ReadOnly) && readIndexHeader(in, bpixels);
+
+    QFile file(path + ".tmp");
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        error = "Can't write " + file.fileName() + ": " + file.errorString();
+        return;
+    }
+
+    QDataStream out(&file);
+    out.setByteOrder(QDataStream::LittleEndian);
+    out.writeRawData("TCHI", 4);
+    out << VERSION << quint8(bpixels ? 1 : 0);
+
+    StagedTile entry;
+    bool bentry = bold && readEntry(in, entry);
+    for(int i=0; i<tiles.size() || bentry; )
+    {
+        qint64 key = i < tiles.size() ? tiles[i].key() : -1;
+        if(bentry && (key < 0 || entry.key() <= key))
+        {
+            // the staged tile replaces the entry unless it has failed
+            if(entry.key() != key || !tiles[i].bindexed)
+                writeEntry(out, entry);
+            bentry = readEntry(in, entry);
+            continue;
+        }
+
+        if(tiles[i].bindexed)
+            writeEntry(out, tiles[i]);
+        i++;
+    }
+
+    if(out.status() != QDataStream::Ok || !file.flush())
+    {
+        error = "Can't write " + file.fileName() + ": " + file.errorString();
+        file.remove();
+        return;
+    }
+
+    file.close();
+    old.close();
+    if(!replaceFile(file.fileName(), path))
+        error = "Can't replace " + path + ".";
+}
+
+//----------------------------------------------
+void TileStager::indexed()
+{
+    // the staging directory goes unless a tile is left in it
+    bool bclean = !bcancelled && unexpected == 0;
+    for(int i=0; i<tiles.size() && bclean; i++)
+        bclean = tiles[i].state != StagedTile::Failed;
+
+    if(bclean)
+        QDir(staging).removeRecursively();
+
+    emit finished();
+}
+
+//----------------------------------------------
+QString TileStager::report() const
+{
+    int counts[StagedTile::Failed + 1] = { 0, 0, 0, 0 };
+    for(int i=0; i<tiles.size(); i++)
+        counts[tiles[i].state]++;
+
+    int written = counts[StagedTile::New] + counts[StagedTile::Changed];
+    QString sretval = "Staged " + QString::number(tiles.size()) + " tiles in " +
+                      QString::number(timer.elapsed() / 1000.0, 'f', 1) + " s" +
+                      (bcancelled ? " (cancelled)" : "") + ": " +
+                      QString::number(written) + " written (" + QString::number(counts[StagedTile::New]) +
+                      " new, " + QString::number(counts[StagedTile::Changed]) + " changed), " +
+                      QString::number(counts[StagedTile::Unchanged]) + " unchanged" +
+                      (bpixels ? " pixel for pixel" : "");
+
+    if(counts[StagedTile::Failed] > 0)
+        sretval += ", " + QString::number(counts[StagedTile::Failed]) + " failed (left in " + staging + ")";
+
+    // the changed-tile ratio of every region
+    QVector<int> total(uboxes.size(), 0), changed(uboxes.size(), 0);
+    UBoxIndex index(grid.extent(), qMax(grid.extent().right - grid.extent().left,
+                                        grid.extent().top - grid.extent().bottom) / 64);
+    for(int i=0; i<uboxes.size(); i++)
+        index.insert(i, uboxes[i].box);
+
+    QVector<int> ids;
+    for(int i=0; i<tiles.size() && !uboxes.isEmpty(); i++)
+    {
+        const StagedTile& tile = tiles[i];
+        int k = grid.level(tile.z);
+        index.query(grid.tileBox(k, tile.x, tile.y), ids);
+        for(int j=0; j<ids.size(); j++)
+        {
+            int kmin, kmax;
+            grid.levelRange(uboxes[ids[j]], kmin, kmax);
+            TileRange range = grid.range(uboxes[ids[j]], k);
+            if(k < kmin || k > kmax || qint64(tile.x) < range.c0 || qint64(tile.x) > range.c1 ||
+               qint64(tile.y) < range.r0 || qint64(tile.y) > range.r1)
+                continue;
+
+            total[ids[j]]++;
+            if(tile.state == StagedTile::New || tile.state == StagedTile::Changed)
+                changed[ids[j]]++;
+        }
+    }
+
+    for(int i=0; i<uboxes.size() && i<MAXREPORTED; i++)
+        sretval += "\n  UBOX " + JobIO::formatUBox(uboxes[i]) + ": " + QString::number(changed[i]) + " of " +
+                   QString::number(total[i]) + " changed (" +
+                   QString::number(total[i] > 0 ? 100.0 * changed[i] / total[i] : 0.0, 'f', 1) + " %)";
+
+    if(uboxes.size() > MAXREPORTED)
+        sretval += "\n  ... and " + QString::number(uboxes.size() - MAXREPORTED) + " regions more";
+
+    if(unexpected > 0)
+        sretval += "\n" + QString::number(unexpected) + " staged files are not tiles of this job (left in " + staging + ").";
+
+    if(!error.isEmpty())
+        sretval += "\n" + error;
+
+    return sretval;
+}
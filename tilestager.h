@@ -0,0 +1,115 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by Саша Миленковић                                 *
+ *   sasa.milenkovic.xyz@gmail.com                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *   ( http://www.gnu.org/licenses/gpl-3.0.en.html )                       *
+ *									   *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef TILESTAGER_H
+#define TILESTAGER_H
+
+#include <QObject>
+#include <QVector>
+#include <QFutureWatcher>
+#include <QElapsedTimer>
+#include <QAtomicInt>
+
+#include "tilegrid.h"
+
+//----------------------------------------------
+// a tile of the staging directory; size, mtime and md5 are the sidecar
+// entry of the cached tile (if 'bindexed'), then of what the cache holds
+struct StagedTile
+{
+    enum State { New, Changed, Unchanged, Failed };
+
+    StagedTile();
+
+    qint64 key() const;
+
+    int z;
+    quint32 x, y;
+    quint8 ext;         // index into the tile extensions
+    quint8 state;
+    bool bindexed;
+    quint32 size;
+    qint64 mtime;       // ms since the epoch
+    char md5[16];
+};
+
+//----------------------------------------------
+// Compare-before-write of an update run. The tilemaker renders into a
+// staging directory; every staged tile is hashed in the pool and moved
+// into the cache only if it differs from the cached one, the identical
+// ones are dropped, so the cache, its backups and the CDN in front of it
+// see only the real changes.
+//
+// The hashes of the cached tiles come from a sidecar index,
+// <cache>/tilehashes.idx, while the size and the modification time of
+// a tile match its entry; otherwise the cached file is hashed again.
+// The hash is of the file or, to ignore the encoder, of the decoded
+// pixels. The index holds 37 byte records sorted by tile, it is merged
+// with the new entries into a fresh copy after every run.
+class TileStager : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit TileStager(QObject *parent = 0);
+    ~TileStager();
+
+    static QString stagingDir(const QString& cache);
+
+    // 'uboxes' - the regions of the run, for the changed-tile ratio of each
+    void start(const QString& staging, const QString& cache, const TileGrid& grid,
+               const QList<UBox>& uboxes, bool bpixels);
+    void cancel();
+    bool isRunning() const;
+
+    QString report() const;
+
+signals:
+    void progress(int done, int total);
+    void finished();
+
+private slots:
+    void scanned();
+    void mergeProgress(int);
+    void merged();
+    void indexed();
+
+private:
+    QString staging, cache;
+    TileGrid grid;
+    QList<UBox> uboxes;
+    bool bpixels;
+
+    QVector<StagedTile> tiles;
+    int unexpected;         // staged files which are not tiles of this job
+    QString error;
+    QAtomicInt bcancel;
+    bool bcancelled;
+    QElapsedTimer timer;
+
+    QFutureWatcher<void> scanwatcher;
+    QFutureWatcher<void> mergewatcher;
+    QFutureWatcher<void> indexwatcher;
+
+    void scan();
+    void writeIndex();
+};
+
+#endif // TILESTAGER_H
@@ -0,0 +1,442 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by Саша Миленковић                                 *
+ *   sasa.milenkovic.xyz@gmail.com                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *   ( http://www.gnu.org/licenses/gpl-3.0.en.html )                       *
+ *									   *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <QDirIterator>
+#include <QFile>
+#include <QImage>
+#include <QStringList>
+#include <QThreadPool>
+#include <QtConcurrentRun>
+#include <QtConcurrentMap>
+
+#include <algorithm>
+
+#include "tileverifier.h"
+#include "tracer.h"
+#include "bufferarena.h"
+
+static const char* const extensions[] = { "jpg", "jpeg", "png", "gif" };
+static const int EXTENSIONS = 4;
+
+static const char* const problemnames[TileCheck::Problems] =
+    { "OK", "XML/HTML body", "not the expected image type", "truncated", "undecodable",
+      "wrong size", "error color", "size outliers (kept, only reported)" };
+
+const int OUTLIERRATIO = 8;     // a tile this many times smaller than the median of its level is reported
+const int OUTLIERSAMPLES = 16;  // fewer tiles in a level - no median
+
+//----------------------------------------------
+// the body of the file is markup (a ServiceException or an HTML error page)
+static bool isMarkup(const QByteArray& data)
+{
+    for(int i=0; i<data.size() && i<256; i++)
+    {
+        char c = data[i];
+        if(c == ' ' || c == '\t' || c == '\r' || c == '\n')
+            continue;
+
+        // UTF-8 BOM
+        if((uchar)c == 0xEF && i+2 < data.size() && (uchar)data[i+1] == 0xBB && (uchar)data[i+2] == 0xBF)
+        {
+            i += 2;
+            continue;
+        }
+
+        return c == '<';
+    }
+
+    return false;
+}
+
+//----------------------------------------------
+// 0 - jpeg, 2 - png, 3 - gif (indices of the extensions), -1 - unknown
+static int imageType(const QByteArray& data)
+{
+    const uchar* p = (const uchar*)data.constData();
+
+    if(data.size() >= 3 && p[0] == 0xFF && p[1] == 0xD8 && p[2] == 0xFF)
+        return 0;
+    if(data.size() >= 8 && data.startsWith("\x89PNG\r\n\x1a\n"))
+        return 2;
+    if(data.size() >= 6 && (data.startsWith("GIF87a") || data.startsWith("GIF89a")))
+        return 3;
+
+    return -1;
+}
+
+//----------------------------------------------
+// the stream ends as its format requires
+static bool isComplete(const QByteArray& data, int type)
+{
+    int end = data.size();
+
+    if(type == 0)
+    {
+        // some encoders pad after EOI
+        while(end > 2 && data[end-1] == 0)
+            end--;
+        return end >= 4 && (uchar)data[end-2] == 0xFF && (uchar)data[end-1] == 0xD9;
+    }
+
+    if(type == 2)
+        return end >= 12 && data.mid(end-8, 4) == "IEND";
+
+    if(type == 3)
+        return end >= 1 && data[end-1] == 0x3B;
+
+    return false;
+}
+
+//----------------------------------------------
+// the image has one color only; 'color' gets it
+static bool isUniform(const QImage& image, QRgb& color)
+{
+    QImage argb = image.convertToFormat(QImage::Format_ARGB32);
+
+    color = argb.pixel(0, 0);
+    for(int y=0; y<argb.height(); y++)
+    {
+        const QRgb* line = (const QRgb*)argb.constScanLine(y);
+        for(int x=0; x<argb.width(); x++)
+            if(line[x] != color)
+                return false;
+    }
+
+    return true;
+}
+
+//----------------------------------------------
+// runs in the pool threads
+struct CheckTile
+{
+    CheckTile(const QString& r, int size, QRgb b, const QVector<QRgb>& e) :
+        root(r), tilesize(size), background(b), errorcolors(e) {}
+
+    void operator()(TileCheck& tile) const
+    {
+        TraceSpan span(TraceName::Decode, "verify", tile.x);
+
+        QString path = root + "/" + QString::number(tile.z) + "/" + QString::number(tile.x) + "/" +
+                       QString::number(tile.y) + "." + extensions[tile.ext];
+
+        QFile file(path);
+        if(!file.open(QIODevice::ReadOnly))
+        {
+            tile.problem = TileCheck::Truncated;
+            return;
+        }
+
+        ArenaBuffer raw(file.size());
+        qint64 length = file.read((char*)raw.data(), raw.size());
+        QByteArray data = QByteArray::fromRawData((const char*)raw.data(), length > 0 ? int(length) : 0);
+        tile.size = data.size();
+
+        if(data.isEmpty())
+        {
+            tile.problem = TileCheck::Truncated;
+            return;
+        }
+
+        if(isMarkup(data))
+        {
+            tile.problem = TileCheck::Markup;
+            return;
+        }
+
+        int type = imageType(data);
+        int expected = tile.ext == 1 ? 0 : tile.ext; // jpeg is jpg
+        if(type < 0 || type != expected)
+        {
+            tile.problem = TileCheck::WrongType;
+            return;
+        }
+
+        if(!isComplete(data, type))
+        {
+            tile.problem = TileCheck::Truncated;
+            return;
+        }
+
+        QImage image;
+        if(!image.loadFromData(data, type == 0 ? "JPEG" : type == 2 ? "PNG" : "GIF"))
+        {
+            tile.problem = TileCheck::Undecodable;
+            return;
+        }
+
+        if(image.width() != tilesize || image.height() != tilesize)
+        {
+            tile.problem = TileCheck::WrongSize;
+            return;
+        }
+
+        QRgb color;
+        if(isUniform(image, color))
+        {
+            if(color == background || (qAlpha(background) == 0 && qAlpha(color) == 0))
+                tile.blank = true;
+            else if(errorcolors.contains(color))
+                tile.problem = TileCheck::ErrorColor;
+            else
+                tile.uniform = true;
+        }
+    }
+
+    QString root;
+    int tilesize;
+    QRgb background;
+    QVector<QRgb> errorcolors;
+};
+
+//----------------------------------------------
+TileVerifier::TileVerifier(QObject *parent) :
+    QObject(parent),
+    background(0),
+    unexpected(0),
+    bcancelled(false)
+{
+    connect(&scanwatcher, SIGNAL(finished()), this, SLOT(scanned()));
+    connect(&checkwatcher, SIGNAL(progressValueChanged(int)), this, SLOT(checkProgress(int)));
+    connect(&checkwatcher, SIGNAL(finished()), this, SLOT(checked()));
+}
+
+//----------------------------------------------
+TileVerifier::~TileVerifier()
+{
+    cancel();
+    scanwatcher.waitForFinished();
+    checkwatcher.waitForFinished();
+}
+
+//----------------------------------------------
+void TileVerifier::start(const QString& dir, const TileGrid& g, QRgb color, const QVector<QRgb>& errors)
+{
+    root = dir;
+    grid = g;
+    background = color;
+    errorcolors = errors;
+    BufferArena::configure(QThreadPool::globalInstance()->maxThreadCount(), grid.tileSize());
+
+    tiles.clear();
+    unexpected = 0;
+    bcancel.store(0);
+    bcancelled = false;
+    timer.start();
+
+    scanwatcher.setFuture(QtConcurrent::run(this, &TileVerifier::scan));
+}
+
+//----------------------------------------------
+void TileVerifier::cancel()
+{
+    bcancel.store(1);
+    bcancelled = true;
+    checkwatcher.cancel();
+}
+
+//----------------------------------------------
+bool TileVerifier::isRunning() const
+{
+    return scanwatcher.isRunning() || checkwatcher.isRunning();
+}
+
+//----------------------------------------------
+// collects the tiles of the tree (in a pool thread)
+void TileVerifier::scan()
+{
+    TraceSpan span("scan", "verify");
+
+    QStringList filters;
+    for(int i=0; i<EXTENSIONS; i++)
+        filters << QString("*.") + extensions[i];
+
+    QDirIterator it(root, filters, QDir::Files, QDirIterator::Subdirectories);
+    while(it.hasNext() && !bcancel.load())
+    {
+        QStringList parts = it.next().mid(root.length()).split('/', QString::SkipEmptyParts);
+
+        bool bOK = parts.size() == 3;
+
+        TileCheck tile;
+        if(bOK)
+        {
+            QString name = parts[2];
+            int dot = name.lastIndexOf('.');
+            QString suffix = name.mid(dot + 1).toLower();
+
+            bool bz, bx, by;
+            tile.z = parts[0].toInt(&bz);
+            tile.x = parts[1].toInt(&bx);
+            tile.y = name.left(dot).toInt(&by);
+            bOK = bz && bx && by && tile.z >= 0 && tile.z < grid.levels() && tile.x >= 0 && tile.y >= 0;
+
+            for(int i=0; i<EXTENSIONS; i++)
+                if(suffix == extensions[i])
+                    tile.ext = i;
+        }
+
+        if(bOK)
+            tiles.append(tile);
+        else
+            unexpected++;
+    }
+}
+
+//----------------------------------------------
+void TileVerifier::scanned()
+{
+    if(bcancelled || tiles.isEmpty())
+    {
+        emit finished();
+        return;
+    }
+
+    emit progress(0, tiles.size());
+    checkwatcher.setFuture(QtConcurrent::map(tiles, CheckTile(root, grid.tileSize(), background, errorcolors)));
+}
+
+//----------------------------------------------
+void TileVerifier::checkProgress(int done)
+{
+    emit progress(done, tiles.size());
+}
+
+//----------------------------------------------
+void TileVerifier::checked()
+{
+    if(!bcancelled)
+        findSizeOutliers();
+
+    emit finished();
+}
+
+//----------------------------------------------
+// tiles which decode, but are far smaller than the other tiles of their
+// level; the blank and uniform ones are legitimately small
+void TileVerifier::findSizeOutliers()
+{
+    const int levels = grid.levels();
+    QVector<QVector<qint64> > sizes(levels);
+    for(int i=0; i<tiles.size(); i++)
+        if(tiles[i].problem == TileCheck::OK && !tiles[i].blank && !tiles[i].uniform)
+            sizes[tiles[i].z].append(tiles[i].size);
+
+    QVector<qint64> medians(levels, 0);
+    for(int z=0; z<levels; z++)
+    {
+        QVector<qint64>& s = sizes[z];
+        if(s.size() < OUTLIERSAMPLES)
+            continue;
+
+        std::nth_element(s.begin(), s.begin() + s.size()/2, s.end());
+        medians[z] = s[s.size()/2];
+    }
+
+    for(int i=0; i<tiles.size(); i++)
+    {
+        TileCheck& tile = tiles[i];
+        if(tile.problem == TileCheck::OK && !tile.blank && !tile.uniform && tile.size * OUTLIERRATIO < medians[tile.z])
+            tile.problem = TileCheck::SizeOutlier;
+    }
+}
+
+//----------------------------------------------
+static bool lessTiles(const TileCheck& a, const TileCheck& b)
+{
+    if(a.z != b.z)
+        return a.z < b.z;
+    if(a.y != b.y)
+        return a.y < b.y;
+    return a.x < b.x;
+}
+
+//----------------------------------------------
+QList<UBox> TileVerifier::badRegions() const
+{
+    QVector<TileCheck> bad;
+    for(int i=0; i<tiles.size(); i++)
+        if(tiles[i].isBad())
+            bad.append(tiles[i]);
+
+    std::sort(bad.begin(), bad.end(), lessTiles);
+
+    QList<UBox> regions;
+    for(int i=0; i<bad.size(); )
+    {
+        // a run of neighbouring bad tiles in a row
+        int j = i + 1;
+        while(j < bad.size() && bad[j].z == bad[i].z && bad[j].y == bad[i].y && bad[j].x == bad[j-1].x + 1)
+            j++;
+
+        int k = grid.level(bad[i].z);
+        double inset = grid.span(k) / 4.0; // the region touches only these tiles
+
+        UBox ubox;
+        ubox.box = grid.rangeBox(k, TileRange(bad[i].x, bad[j-1].x, bad[i].y, bad[i].y));
+        ubox.box.left += inset;
+        ubox.box.right -= inset;
+        ubox.box.bottom += inset;
+        ubox.box.top -= inset;
+        ubox.hres = ubox.lres = grid.resolution(k);
+        regions.append(ubox);
+
+        i = j;
+    }
+
+    return regions;
+}
+
+//----------------------------------------------
+QString TileVerifier::report() const
+{
+    QVector<int> counts(TileCheck::Problems, 0);
+    const int levels = grid.levels();
+    QVector<int> badperlevel(levels, 0);
+    int blank = 0, uniform = 0;
+    for(int i=0; i<tiles.size(); i++)
+    {
+        counts[tiles[i].problem]++;
+        if(tiles[i].isBad())
+            badperlevel[tiles[i].z]++;
+        if(tiles[i].blank)
+            blank++;
+        if(tiles[i].uniform)
+            uniform++;
+    }
+
+    QString sretval = "Verified " + QString::number(tiles.size()) + " tiles in " +
+                      QString::number(timer.elapsed() / 1000.0, 'f', 1) + " s" +
+                      (bcancelled ? " (cancelled)" : "") + ": " +
+                      QString::number(counts[TileCheck::OK]) + " OK (" + QString::number(blank) + " blank, " +
+                      QString::number(uniform) + " of another single color)";
+
+    for(int p=TileCheck::OK+1; p<TileCheck::Problems; p++)
+        if(counts[p] > 0)
+            sretval += ", " + QString::number(counts[p]) + " " + problemnames[p];
+
+    for(int z=0; z<levels; z++)
+        if(badperlevel[z] > 0)
+            sretval += "\n  level " + QString::number(z) + ": " + QString::number(badperlevel[z]) + " bad tiles";
+
+    if(unexpected > 0)
+        sretval += "\n" + QString::number(unexpected) + " files are not tiles of this job (ignored).";
+
+    return sretval;
+}
@@ -0,0 +1,111 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by Саша Миленковић                                 *
+ *   sasa.milenkovic.xyz@gmail.com                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *   ( http://www.gnu.org/licenses/gpl-3.0.en.html )                       *
+ *									   *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef TILEVERIFIER_H
+#define TILEVERIFIER_H
+
+#include <QObject>
+#include <QVector>
+#include <QFutureWatcher>
+#include <QElapsedTimer>
+#include <QAtomicInt>
+#include <QRgb>
+
+#include "tilegrid.h"
+
+//----------------------------------------------
+// the verdict on one tile of the output tree (<root>/<z>/<x>/<y>.<ext>)
+struct TileCheck
+{
+    enum Problem { OK, Markup, WrongType, Truncated, Undecodable, WrongSize, ErrorColor, SizeOutlier, Problems };
+
+    TileCheck() : z(0), x(0), y(0), ext(0), problem(OK), blank(false), uniform(false), size(0) {}
+
+    // a size outlier is only a warning, the others are re-fetched
+    bool isBad() const { return problem != OK && problem != SizeOutlier; }
+
+    int z, x, y;
+    quint8 ext;         // index into the known extensions
+    quint8 problem;
+    bool blank;         // of the background color only (legitimately empty)
+    bool uniform;       // of another single color (water, snow) - not an error
+    qint64 size;
+};
+
+//----------------------------------------------
+// Verifies a tile tree in parallel (QtConcurrent, all cores). A WMS in
+// the tolerant exception mode leaves its errors in the cache as tiles:
+// XML/HTML bodies, truncated or undecodable images and images of a
+// single configured error color. The bad tiles are turned into update
+// regions for re-fetching. Tiles far smaller than the others of their
+// level are only reported: open water, snow or desert compress that well,
+// and a re-fetch would return the same tile.
+//
+// Levels are numbered as in TMS: 0 is the coarsest one and the last one
+// has the high resolution; y counts from the BBOX bottom.
+class TileVerifier : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit TileVerifier(QObject *parent = 0);
+    ~TileVerifier();
+
+    // 'background' - the color of the tiles without data (0 - transparent);
+    // 'errorcolors' - the colors the WMS paints its error tiles with
+    void start(const QString& root, const TileGrid& grid, QRgb background,
+               const QVector<QRgb>& errorcolors = QVector<QRgb>());
+    void cancel();
+    bool isRunning() const;
+
+    // one region per run of bad tiles in a tile row, rendering only their level
+    QList<UBox> badRegions() const;
+
+    QString report() const;
+
+signals:
+    void progress(int done, int total);
+    void finished();
+
+private slots:
+    void scanned();
+    void checkProgress(int);
+    void checked();
+
+private:
+    QString root;
+    TileGrid grid;
+    QRgb background;
+    QVector<QRgb> errorcolors;
+
+    QVector<TileCheck> tiles;
+    int unexpected;         // files which are not tiles of this job
+    QAtomicInt bcancel;
+    bool bcancelled;
+    QElapsedTimer timer;
+
+    QFutureWatcher<void> scanwatcher;
+    QFutureWatcher<void> checkwatcher;
+
+    void scan();
+    void findSizeOutliers();
+};
+
+#endif // TILEVERIFIER_H
@@ -0,0 +1,706 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by Саша Миленковић                                 *
+ *   sasa.milenkovic.xyz@gmail.com                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *   ( http://www.gnu.org/licenses/gpl-3.0.en.html )                       *
+ *									   *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <QDir>
+#include <QFile>
+#include <QVector>
+#include <QImage>
+#include <QImageWriter>
+#include <QSaveFile>
+#include <QBuffer>
+#include <QThreadPool>
+#include <QtConcurrentMap>
+
+#include <cmath>
+#include <cstring>
+
+#include "tilewarper.h"
+#include "tracer.h"
+#include "bufferarena.h"
+
+const int SUBGRID = 16;             // pixels between the exactly transformed points
+const int SOURCECACHE = 16;         // decoded source tiles kept per column job (a few rows of them)
+const double EARTHRADIUS = 6378137.0;
+const double MAXLATITUDE = 85.0511287798066;
+const double EPS = 1e-9;
+
+//----------------------------------------------
+Projection::Kind Projection::fromSrs(const QString& srs)
+{
+    QString s = srs.simplified().toUpper();
+
+    if(s == "EPSG:4326" || s == "CRS:84" || s == "EPSG:4258")
+        return Geographic;
+
+    if(s == "EPSG:3857" || s == "EPSG:900913" || s == "EPSG:3785" || s == "EPSG:102100" || s == "EPSG:102113")
+        return WebMercator;
+
+    return Unknown;
+}
+
+//----------------------------------------------
+bool Projection::transform(Kind from, Kind to, double& x, double& y)
+{
+    if(from == Unknown || to == Unknown)
+        return false;
+
+    if(from == to)
+        return true;
+
+    if(from == Geographic)
+    {
+        if(y < -MAXLATITUDE || y > MAXLATITUDE)
+            return false;
+
+        x = EARTHRADIUS * x * M_PI / 180.0;
+        y = EARTHRADIUS * std::log(std::tan(M_PI / 4.0 + y * M_PI / 360.0));
+        return true;
+    }
+
+    x = x / EARTHRADIUS * 180.0 / M_PI;
+    y = (2.0 * std::atan(std::exp(y / EARTHRADIUS)) - M_PI / 2.0) * 180.0 / M_PI;
+    return true;
+}
+
+//----------------------------------------------
+BBox Projection::transformBox(Kind from, Kind to, const BBox& box)
+{
+    const int SAMPLES = 64;
+
+    BBox b = box;
+    if(from == Geographic && to == WebMercator)
+    {
+        b.bottom = qMax(b.bottom, -MAXLATITUDE);
+        b.top = qMin(b.top, MAXLATITUDE);
+    }
+
+    BBox result(0.0, 0.0, 0.0, 0.0);
+    bool bfirst = true;
+
+    for(int i=0; i<=SAMPLES; i++)
+    {
+        double t = double(i) / SAMPLES;
+        double xs[4] = { b.left + t * (b.right - b.left), b.left + t * (b.right - b.left), b.left, b.right };
+        double ys[4] = { b.bottom, b.top, b.bottom + t * (b.top - b.bottom), b.bottom + t * (b.top - b.bottom) };
+
+        for(int e=0; e<4; e++)
+        {
+            double x = xs[e], y = ys[e];
+            if(!transform(from, to, x, y))
+                continue;
+
+            if(bfirst)
+            {
+                result = BBox(x, y, x, y);
+                bfirst = false;
+            }
+
+            result.left = qMin(result.left, x);
+            result.right = qMax(result.right, x);
+            result.bottom = qMin(result.bottom, y);
+            result.top = qMax(result.top, y);
+        }
+    }
+
+    return result;
+}
+
+//==============================================
+// the source pixels
+
+//----------------------------------------------
+// a decoded source tile in an arena buffer; a null image - no tile
+struct SourceTile
+{
+    SourceTile() : key(-1), buffer(0), used(0) {}
+
+    qint64 key;
+    ArenaBuffer* buffer;
+    QImage image;
+    quint64 used;
+};
+
+//----------------------------------------------
+// decoded tiles of one source level, premultiplied ARGB, the last used
+// ones kept; the pixels are addressed globally: gx from the grid left,
+// gy from the grid bottom
+class SourceSampler
+{
+public:
+    SourceSampler(const QString& r, const TileGrid& g, const QStringList& e) :
+        missing(0), root(r), grid(g), exts(e), level(0), clock(0), last(-1) {}
+
+    ~SourceSampler()
+    {
+        clear();
+    }
+
+    void setLevel(int k)
+    {
+        if(k == level && !cache.isEmpty())
+            return;
+
+        level = k;
+        tiles = grid.levelTiles(k);
+        clear();
+    }
+
+    QRgb pixel(qint64 gx, qint64 gy)
+    {
+        const int ts = grid.tileSize();
+        if(gx < 0 || gy < 0)
+            return 0;
+
+        qint64 c = gx / ts, r = gy / ts;
+        const QImage* image = tile(c, r);
+        if(!image)
+            return 0;
+
+        int px = int(gx - c * ts);
+        int py = ts - 1 - int(gy - r * ts);
+        if(px >= image->width() || py >= image->height())
+            return 0;
+
+        return ((const QRgb*)image->constScanLine(py))[px];
+    }
+
+    int missing;
+
+private:
+    QString root;
+    TileGrid grid;
+    QStringList exts;
+    int level;
+    TileRange tiles;
+    QVector<SourceTile> cache;      // at most SOURCECACHE
+    quint64 clock;
+    int last;                       // the index of the last used tile
+
+    // not copyable (owns the buffers)
+    SourceSampler(const SourceSampler&);
+    SourceSampler& operator=(const SourceSampler&);
+
+    void clear()
+    {
+        for(int i=0; i<cache.size(); i++)
+            delete cache[i].buffer;
+        cache.clear();
+        last = -1;
+    }
+
+    const QImage* tile(qint64 c, qint64 r)
+    {
+        if(c < tiles.c0 || c > tiles.c1 || r < tiles.r0 || r > tiles.r1)
+            return 0;
+
+        qint64 key = (r << 32) | c;
+        if(last < 0 || cache[last].key != key)
+        {
+            last = -1;
+            for(int i=0; i<cache.size() && last < 0; i++)
+                if(cache[i].key == key)
+                    last = i;
+
+            if(last < 0)
+                last = load(key, c, r);
+
+            cache[last].used = ++clock;
+        }
+
+        return cache[last].image.isNull() ? 0 : &cache[last].image;
+    }
+
+    // into the slot of the least recently used tile once the cache is full
+    int load(qint64 key, qint64 c, qint64 r)
+    {
+        int slot = cache.size();
+        if(slot < SOURCECACHE)
+            cache.append(SourceTile());
+        else
+        {
+            slot = 0;
+            for(int i=1; i<cache.size(); i++)
+                if(cache[i].used < cache[slot].used)
+                    slot = i;
+        }
+
+        SourceTile& entry = cache[slot];
+        entry.image = QImage();
+        delete entry.buffer;
+        entry.buffer = 0;
+        entry.key = key;
+
+        TraceSpan span(TraceName::Decode, "warp", r);
+
+        QImage image;
+        QString path = root + "/" + QString::number(grid.zoom(level)) + "/" + QString::number(c) + "/" + QString::number(r) + ".";
+        for(int i=0; i<exts.size() && image.isNull(); i++)
+            if(QFile::exists(path + exts[i]))
+                image.load(path + exts[i]);
+
+        if(image.isNull())
+        {
+            missing++;
+            return slot;
+        }
+
+        // the decoded copy goes with this scope, the arena one is kept
+        image = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+        entry.buffer = new ArenaBuffer(qint64(image.width()) * image.height() * 4);
+        entry.image = entry.buffer->image(image.width(), image.height(), QImage::Format_ARGB32_Premultiplied);
+        for(int y=0; y<image.height(); y++)
+            memcpy(entry.image.scanLine(y), image.constScanLine(y), image.width() * 4);
+
+        return slot;
+    }
+};
+
+//----------------------------------------------
+static inline int clampByte(double v)
+{
+    return v <= 0.0 ? 0 : v >= 255.0 ? 255 : int(v + 0.5);
+}
+
+//----------------------------------------------
+// u, v - continuous global pixel coordinates (v from the bottom)
+static QRgb bilinear(SourceSampler& sampler, double u, double v)
+{
+    double fx = u - 0.5, fy = v - 0.5;
+    qint64 x0 = qint64(std::floor(fx)), y0 = qint64(std::floor(fy));
+    double ax = fx - x0, ay = fy - y0;
+
+    QRgb p[4] = { sampler.pixel(x0, y0), sampler.pixel(x0 + 1, y0),
+                  sampler.pixel(x0, y0 + 1), sampler.pixel(x0 + 1, y0 + 1) };
+    double w[4] = { (1 - ax) * (1 - ay), ax * (1 - ay), (1 - ax) * ay, ax * ay };
+
+    double a = 0, r = 0, g = 0, b = 0;
+    for(int i=0; i<4; i++)
+    {
+        a += w[i] * qAlpha(p[i]);
+        r += w[i] * qRed(p[i]);
+        g += w[i] * qGreen(p[i]);
+        b += w[i] * qBlue(p[i]);
+    }
+
+    return qRgba(clampByte(r), clampByte(g), clampByte(b), clampByte(a));
+}
+
+//----------------------------------------------
+// Catmull-Rom
+static inline void cubicWeights(double t, double w[4])
+{
+    w[0] = ((-t + 2.0) * t - 1.0) * t / 2.0;
+    w[1] = ((3.0 * t - 5.0) * t * t + 2.0) / 2.0;
+    w[2] = ((-3.0 * t + 4.0) * t + 1.0) * t / 2.0;
+    w[3] = (t - 1.0) * t * t / 2.0;
+}
+
+//----------------------------------------------
+static QRgb bicubic(SourceSampler& sampler, double u, double v)
+{
+    double fx = u - 0.5, fy = v - 0.5;
+    qint64 x0 = qint64(std::floor(fx)), y0 = qint64(std::floor(fy));
+
+    double wx[4], wy[4];
+    cubicWeights(fx - x0, wx);
+    cubicWeights(fy - y0, wy);
+
+    double a = 0, r = 0, g = 0, b = 0;
+    for(int j=0; j<4; j++)
+    {
+        for(int i=0; i<4; i++)
+        {
+            QRgb p = sampler.pixel(x0 - 1 + i, y0 - 1 + j);
+            double w = wx[i] * wy[j];
+            a += w * qAlpha(p);
+            r += w * qRed(p);
+            g += w * qGreen(p);
+            b += w * qBlue(p);
+        }
+    }
+
+    // premultiplied - no color above the alpha
+    int alpha = clampByte(a);
+    return qRgba(qMin(clampByte(r), alpha), qMin(clampByte(g), alpha), qMin(clampByte(b), alpha), alpha);
+}
+
+//==============================================
+// the warper
+
+//----------------------------------------------
+// runs in the pool threads
+struct WarpJob
+{
+    WarpJob(const TileWarper* p) : warper(p) {}
+
+    void operator()(WarpColumn& column) const
+    {
+        warper->warpColumn(column);
+    }
+
+    const TileWarper* warper;
+};
+
+//----------------------------------------------
+TileWarper::TileWarper(QObject *parent) :
+    QObject(parent),
+    sourcekind(Projection::Unknown),
+    bbicubic(false),
+    quality(90),
+    background(0),
+    bjpeg(true),
+    current(0),
+    bcancelled(false)
+{
+    connect(&watcher, SIGNAL(progressValueChanged(int)), this, SLOT(columnProgress(int)));
+    connect(&watcher, SIGNAL(finished()), this, SLOT(targetFinished()));
+}
+
+//----------------------------------------------
+TileWarper::~TileWarper()
+{
+    cancel();
+    watcher.waitForFinished();
+}
+
+//----------------------------------------------
+bool TileWarper::targetGrid(const TileGrid& src, Projection::Kind from, Projection::Kind to, TileGrid& target)
+{
+    BBox extent = Projection::transformBox(from, to, src.extent());
+    if(extent.right <= extent.left || extent.top <= extent.bottom)
+        return false;
+
+    // the source pixel at the centre of the source extent
+    const BBox& s = src.extent();
+    double cx = (s.left + s.right) / 2.0, cy = (s.bottom + s.top) / 2.0;
+    double x0 = cx, y0 = cy, x1 = cx + src.highResolution(), y1 = cy, x2 = cx, y2 = cy + src.highResolution();
+    if(!Projection::transform(from, to, x0, y0) || !Projection::transform(from, to, x1, y1) ||
+       !Projection::transform(from, to, x2, y2))
+        return false;
+
+    double hres = qMin(std::sqrt((x1-x0)*(x1-x0) + (y1-y0)*(y1-y0)), std::sqrt((x2-x0)*(x2-x0) + (y2-y0)*(y2-y0)));
+    if(hres <= 0.0)
+        return false;
+
+    // as JobIO::validateResolution - two tiles along the shorter side
+    double minspan = qMin(extent.right - extent.left, extent.top - extent.bottom);
+    target = TileGrid(extent, hres, minspan * 2.0 / src.tileSize(), src.tileSize());
+    return true;
+}
+
+//----------------------------------------------
+bool TileWarper::start(const QString& root, const TileGrid& grid, const QString& srs,
+                       const QString& format, const QStringList& targetsrs, const QString& targetroot,
+                       bool bcubic, int q, QRgb color, QString* error)
+{
+    QString err;
+    if(!error)
+        error = &err;
+
+    sourceroot = root;
+    source = grid;
+    sourcekind = Projection::fromSrs(srs);
+    bbicubic = bcubic;
+    quality = q;
+    background = color;
+
+    sourceexts.clear();
+    if(format == "png")
+        sourceexts << "png";
+    else if(format == "gif")
+        sourceexts << "gif";
+    else
+        sourceexts << "jpg" << "jpeg";
+    bjpeg = format == "jpeg" && qAlpha(background) == 255;
+
+    if(sourcekind == Projection::Unknown)
+    {
+        *error = "The SRS '" + srs + "' of the cache can't be warped locally (only EPSG:4326 and EPSG:3857).";
+        return false;
+    }
+
+    targets.clear();
+    for(int i=0; i<targetsrs.size(); i++)
+    {
+        WarpTarget target;
+        target.srs = targetsrs[i].simplified().toUpper();
+        target.kind = Projection::fromSrs(target.srs);
+        target.root = targetroot + "/" + QString(target.srs).replace(':', '_');
+
+        if(target.kind == Projection::Unknown || target.kind == sourcekind)
+        {
+            *error = "The target SRS '" + targetsrs[i] + "' is not supported or it is the SRS of the cache.";
+            return false;
+        }
+
+        if(!targetGrid(source, sourcekind, target.kind, target.grid))
+        {
+            *error = "The BBOX of the cache has no extent in " + target.srs + ".";
+            return false;
+        }
+
+        targets.append(target);
+    }
+
+    if(targets.isEmpty())
+    {
+        *error = "There is no target SRS.";
+        return false;
+    }
+
+    reports.clear();
+    BufferArena::configure(QThreadPool::globalInstance()->maxThreadCount(), grid.tileSize(), 2 + SOURCECACHE);
+    bcancel.store(0);
+    bcancelled = false;
+    current = 0;
+    timer.start();
+
+    startTarget();
+    return true;
+}
+
+//----------------------------------------------
+void TileWarper::startTarget()
+{
+    const WarpTarget& target = targets[current];
+    const TileGrid& grid = target.grid;
+
+    columns.clear();
+    for(int k=grid.levels()-1; k>=0; k--)
+    {
+        TileRange all = grid.levelTiles(k);
+        for(qint64 c=all.c0; c<=all.c1; c++)
+        {
+            WarpColumn column;
+            column.k = k;
+            column.c = c;
+            columns.append(column);
+        }
+    }
+
+    const BBox& e = grid.extent();
+    emit message("Warping to " + target.srs + " (" + target.root + "): BBOX " +
+                 QString::number(e.left, 'f', 6) + "," + QString::number(e.bottom, 'f', 6) + "," +
+                 QString::number(e.right, 'f', 6) + "," + QString::number(e.top, 'f', 6) +
+                 ", resolution " + QString::number(grid.highResolution(), 'g', 8) + ", " +
+                 QString::number(grid.levels()) + " levels ...");
+
+    emit progress(0, columns.size());
+    watcher.setFuture(QtConcurrent::map(columns, WarpJob(this)));
+}
+
+//----------------------------------------------
+void TileWarper::cancel()
+{
+    bcancel.store(1);
+    bcancelled = true;
+    watcher.cancel();
+}
+
+//----------------------------------------------
+bool TileWarper::isRunning() const
+{
+    return watcher.isRunning();
+}
+
+//----------------------------------------------
+void TileWarper::columnProgress(int done)
+{
+    emit progress(done, columns.size());
+}
+
+//----------------------------------------------
+void TileWarper::targetFinished()
+{
+    int written = 0, empty = 0, missing = 0;
+    for(int i=0; i<columns.size(); i++)
+    {
+        written += columns[i].written;
+        empty += columns[i].empty;
+        missing += columns[i].missing;
+    }
+
+    reports << targets[current].srs + ": " + QString::number(written) + " tiles written, " +
+               QString::number(empty) + " without source data" + (bcancelled ? " (cancelled)" : "") +
+               (missing > 0 ? ", " + QString::number(missing) + " source tiles not found" : QString());
+
+    if(!bcancelled && ++current < targets.size())
+    {
+        startTarget();
+        return;
+    }
+
+    emit finished();
+}
+
+//----------------------------------------------
+QString TileWarper::report() const
+{
+    return "Warped in " + QString::number(timer.elapsed() / 1000.0, 'f', 1) + " s\n" + reports.join("\n");
+}
+
+//----------------------------------------------
+void TileWarper::warpColumn(WarpColumn& column) const
+{
+    TraceSpan span("column", "warp", column.c);
+
+    const WarpTarget& target = targets[current];
+    const TileGrid& grid = target.grid;
+    const int ts = grid.tileSize();
+    const int nodes = ts / SUBGRID + 1;
+    const double res = grid.resolution(column.k);
+    const BBox& sextent = source.extent();
+
+    SourceSampler sampler(sourceroot, source, sourceexts);
+
+    // source coordinates of the sub-grid, interpolated along the current pixel row
+    QVector<double> nx(nodes * nodes), ny(nodes * nodes);
+    QVector<char> nok(nodes * nodes);
+    QVector<double> rx(nodes), ry(nodes);
+    QVector<char> rok(nodes);
+
+    QString dir = target.root + "/" + QString::number(grid.zoom(column.k)) + "/" + QString::number(column.c);
+    bool bdir = false;
+
+    TileRange all = grid.levelTiles(column.k);
+    for(qint64 r=all.r0; r<=all.r1 && !bcancel.load(); r++)
+    {
+        BBox tb = grid.tileBox(column.k, column.c, r);
+
+        bool bany = false;
+        for(int j=0; j<nodes; j++)
+        {
+            for(int i=0; i<nodes; i++)
+            {
+                double x = tb.left + i * SUBGRID * res;
+                double y = tb.top - j * SUBGRID * res;
+                nok[j*nodes + i] = Projection::transform(target.kind, sourcekind, x, y);
+                nx[j*nodes + i] = x;
+                ny[j*nodes + i] = y;
+                bany = bany || nok[j*nodes + i];
+            }
+        }
+
+        if(!bany)
+        {
+            column.empty++;
+            continue;
+        }
+
+        // the source level with the resolution of the target pixels (near the tile centre)
+        int m = (nodes / 2) * nodes + nodes / 2;
+        double pixel = res;
+        if(nok[m] && nok[m+1] && nok[m+nodes])
+            pixel = qMin(std::sqrt((nx[m+1]-nx[m])*(nx[m+1]-nx[m]) + (ny[m+1]-ny[m])*(ny[m+1]-ny[m])),
+                         std::sqrt((nx[m+nodes]-nx[m])*(nx[m+nodes]-nx[m]) + (ny[m+nodes]-ny[m])*(ny[m+nodes]-ny[m]))) / SUBGRID;
+
+        int ks = qBound(0, int(std::floor(std::log(pixel / source.highResolution()) / std::log(2.0) + EPS)), source.levels() - 1);
+        sampler.setLevel(ks);
+        const double sres = source.resolution(ks);
+
+        ArenaBuffer raster(qint64(ts) * ts * 4);
+        QImage image = raster.image(ts, ts, QImage::Format_ARGB32_Premultiplied);
+        bool bdata = false;
+
+        for(int py=0; py<ts; py++)
+        {
+            int a = py / SUBGRID;
+            double tv = (py + 0.5 - a * SUBGRID) / SUBGRID;
+
+            const double* x0 = nx.constData() + a * nodes;
+            const double* y0 = ny.constData() + a * nodes;
+            for(int i=0; i<nodes; i++)
+            {
+                rx[i] = x0[i] + (x0[i + nodes] - x0[i]) * tv;
+                ry[i] = y0[i] + (y0[i + nodes] - y0[i]) * tv;
+                rok[i] = nok[a*nodes + i] && nok[(a+1)*nodes + i];
+            }
+
+            QRgb* line = (QRgb*)image.scanLine(py);
+            for(int px=0; px<ts; px++)
+            {
+                int b = px / SUBGRID;
+                if(!rok[b] || !rok[b+1])
+                {
+                    line[px] = 0;
+                    continue;
+                }
+
+                double tu = (px + 0.5 - b * SUBGRID) / SUBGRID;
+                double u = (rx[b] + (rx[b+1] - rx[b]) * tu - sextent.left) / sres;
+                double v = (ry[b] + (ry[b+1] - ry[b]) * tu - sextent.bottom) / sres;
+
+                line[px] = bbicubic ? bicubic(sampler, u, v) : bilinear(sampler, u, v);
+                if(line[px])
+                    bdata = true;
+            }
+        }
+
+        if(!bdata)
+        {
+            column.empty++;
+            continue;
+        }
+
+        if(!bdir)
+            bdir = QDir().mkpath(dir);
+
+        // no alpha in JPEG - over the background
+        ArenaBuffer encoded(qint64(ts) * ts * 4);
+        QImage output = encoded.image(ts, ts, bjpeg ? QImage::Format_RGB32 : QImage::Format_ARGB32);
+        for(int py=0; py<ts; py++)
+        {
+            const QRgb* in = (const QRgb*)image.constScanLine(py);
+            QRgb* out = (QRgb*)output.scanLine(py);
+            for(int px=0; px<ts; px++)
+            {
+                if(!bjpeg)
+                {
+                    out[px] = qUnpremultiply(in[px]);
+                    continue;
+                }
+
+                int alpha = 255 - qAlpha(in[px]);
+                out[px] = qRgb(qRed(in[px]) + (qRed(background) * alpha + 127) / 255,
+                               qGreen(in[px]) + (qGreen(background) * alpha + 127) / 255,
+                               qBlue(in[px]) + (qBlue(background) * alpha + 127) / 255);
+            }
+        }
+
+        QByteArray data;
+        {
+            TraceSpan encode(TraceName::Encode, "warp", r);
+            QBuffer buffer(&data);
+            buffer.open(QIODevice::WriteOnly);
+            QImageWriter writer(&buffer, bjpeg ? "jpg" : "png");
+            if(bjpeg)
+                writer.setQuality(quality);
+            if(!writer.write(output))
+                continue;
+        }
+
+        TraceSpan write(TraceName::Write, "warp", r);
+        QSaveFile file(dir + "/" + QString::number(r) + (bjpeg ? ".jpg" : ".png"));
+        if(file.open(QIODevice::WriteOnly) && file.write(data) == data.size() && file.commit())
+            column.written++;
+    }
+
+    column.missing = sampler.missing;
+}
@@ -0,0 +1,138 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by Саша Миленковић                                 *
+ *   sasa.milenkovic.xyz@gmail.com                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *   ( http://www.gnu.org/licenses/gpl-3.0.en.html )                       *
+ *									   *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef TILEWARPER_H
+#define TILEWARPER_H
+
+#include <QObject>
+#include <QVector>
+#include <QStringList>
+#include <QFutureWatcher>
+#include <QElapsedTimer>
+#include <QAtomicInt>
+#include <QRgb>
+
+#include "tilegrid.h"
+
+// The reference systems which can be warped between locally (analytic
+// transforms, no projection library): geographic lon/lat and the spherical
+// (web) Mercator.
+namespace Projection
+{
+    enum Kind { Unknown, Geographic, WebMercator };
+
+    // EPSG:4326, CRS:84 - Geographic; EPSG:3857, EPSG:900913, ... - WebMercator
+    Kind fromSrs(const QString& srs);
+
+    // in place; false - the point has no image in the target system
+    bool transform(Kind from, Kind to, double& x, double& y);
+
+    // the extent of the transformed box (the edges are sampled)
+    BBox transformBox(Kind from, Kind to, const BBox& box);
+}
+
+//----------------------------------------------
+struct WarpTarget
+{
+    QString srs;
+    Projection::Kind kind;
+    QString root;
+    TileGrid grid;
+};
+
+//----------------------------------------------
+// one column of the target pyramid (the unit of the parallel work)
+struct WarpColumn
+{
+    WarpColumn() : k(0), c(0), written(0), empty(0), missing(0) {}
+
+    int k;
+    qint64 c;
+    int written;        // tiles with some source data
+    int empty;          // no source data - not written
+    int missing;        // source tiles which were expected, but not found
+};
+
+//----------------------------------------------
+// Produces the pyramids of other reference systems from an existing tile
+// cache, so the WMS is asked once and the server doesn't reproject. Every
+// target tile is mapped back to the source: the exact transform is computed
+// on a sub-grid of the tile only (every SUBGRID pixels) and interpolated in
+// between, then the source pixels are resampled (bilinear or bicubic) from
+// the level with the matching resolution. Columns of target tiles run in
+// parallel (QtConcurrent); the targets one after the other.
+class TileWarper : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit TileWarper(QObject *parent = 0);
+    ~TileWarper();
+
+    // the pyramid which covers the source extent in another system, with
+    // a high resolution which keeps the detail of the source centre
+    static bool targetGrid(const TileGrid& source, Projection::Kind from, Projection::Kind to, TileGrid& target);
+
+    // 'format' of the source tiles: jpeg, png, gif; the targets get
+    // <targetroot>/<srs>/<z>/<x>/<y>.<jpg|png>
+    bool start(const QString& sourceroot, const TileGrid& sourcegrid, const QString& sourcesrs,
+               const QString& format, const QStringList& targetsrs, const QString& targetroot,
+               bool bbicubic, int quality, QRgb background, QString* error = 0);
+    void cancel();
+    bool isRunning() const;
+
+    QString report() const;
+
+    // runs in the pool threads
+    void warpColumn(WarpColumn& column) const;
+
+signals:
+    void progress(int done, int total);
+    void message(const QString&);
+    void finished();
+
+private slots:
+    void columnProgress(int);
+    void targetFinished();
+
+private:
+    QString sourceroot;
+    TileGrid source;
+    Projection::Kind sourcekind;
+    QStringList sourceexts;     // tried in this order
+    bool bbicubic;
+    int quality;
+    QRgb background;
+    bool bjpeg;                 // output
+
+    QList<WarpTarget> targets;
+    int current;
+    QVector<WarpColumn> columns;
+    QStringList reports;
+
+    QAtomicInt bcancel;
+    bool bcancelled;
+    QElapsedTimer timer;
+    QFutureWatcher<void> watcher;
+
+    void startTarget();
+};
+
+#endif // TILEWARPER_H
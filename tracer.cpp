@@ -0,0 +1,329 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by Саша Миленковић                                 *
+ *   sasa.milenkovic.xyz@gmail.com                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *   ( http://www.gnu.org/licenses/gpl-3.0.en.html )                       *
+ *									   *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <QFile>
+#include <QTextStream>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QVector>
+#include <QList>
+#include <QCoreApplication>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QMap>
+
+#include "tracer.h"
+
+//----------------------------------------------
+struct TraceEvent
+{
+    const char* name;
+    const char* category;
+    qint64 ts;
+    qint64 dur;     // -1 for an instant event
+    qint64 arg;
+};
+
+//----------------------------------------------
+// ring buffer of one thread; the lock is contended only while dumping
+struct ThreadBuffer
+{
+    QMutex mutex;
+    QVector<TraceEvent> events;
+    qint64 written;
+    int tid;
+    QString name;
+    bool retired;   // the thread has finished, the buffer is freed on the next start
+};
+
+static QMutex registrymutex;
+static QList<ThreadBuffer*> registry;
+static QAtomicInt enabled(0);
+static QAtomicInt nexttid(1);
+static QElapsedTimer epoch;
+static int capacity = 65536;
+
+//----------------------------------------------
+struct ThreadSlot
+{
+    ThreadSlot() : buffer(0) {}
+    ~ThreadSlot()
+    {
+        if(buffer)
+        {
+            QMutexLocker locker(&registrymutex);
+            buffer->retired = true;
+        }
+    }
+
+    ThreadBuffer* buffer;
+};
+
+static thread_local ThreadSlot threadslot;
+
+//----------------------------------------------
+static ThreadBuffer* threadBuffer()
+{
+    if(!threadslot.buffer)
+    {
+        ThreadBuffer* buffer = new ThreadBuffer;
+        buffer->written = 0;
+        buffer->tid = nexttid.fetchAndAddRelaxed(1);
+        buffer->name = "thread " + QString::number(buffer->tid);
+        buffer->retired = false;
+
+        QMutexLocker locker(&registrymutex);
+        buffer->events.resize(capacity);
+        registry.append(buffer);
+        threadslot.buffer = buffer;
+    }
+
+    return threadslot.buffer;
+}
+
+//----------------------------------------------
+static void record(const TraceEvent& ev)
+{
+    ThreadBuffer* buffer = threadBuffer();
+
+    QMutexLocker locker(&buffer->mutex);
+    buffer->events[int(buffer->written % buffer->events.size())] = ev;
+    ++buffer->written;
+}
+
+//----------------------------------------------
+// json-escaped string
+static QString jsonString(const QString& str)
+{
+    QString escaped = str;
+    escaped.replace("\\", "\\\\").replace("\"", "\\\"");
+    return "\"" + escaped + "\"";
+}
+
+//----------------------------------------------
+void Tracer::start(int eventsperthread)
+{
+    QMutexLocker locker(&registrymutex);
+
+    capacity = eventsperthread < 1024 ? 1024 : eventsperthread;
+
+    for(int i=registry.size()-1; i>=0; i--)
+    {
+        ThreadBuffer* buffer = registry[i];
+        if(buffer->retired)
+        {
+            registry.removeAt(i);
+            delete buffer;
+            continue;
+        }
+
+        QMutexLocker bufferlocker(&buffer->mutex);
+        buffer->events.resize(capacity);
+        buffer->written = 0;
+    }
+
+    epoch.start();
+    enabled.fetchAndStoreOrdered(1);
+}
+
+//----------------------------------------------
+void Tracer::stop()
+{
+    enabled.fetchAndStoreOrdered(0);
+}
+
+//----------------------------------------------
+bool Tracer::isEnabled()
+{
+    return enabled.loadAcquire() != 0;
+}
+
+//----------------------------------------------
+qint64 Tracer::now()
+{
+    return epoch.nsecsElapsed() / 1000;
+}
+
+//----------------------------------------------
+void Tracer::complete(const char* name, const char* category, qint64 startus, qint64 durus, qint64 arg)
+{
+    if(!isEnabled())
+        return;
+
+    TraceEvent ev = { name, category, startus, durus, arg };
+    record(ev);
+}
+
+//----------------------------------------------
+void Tracer::instant(const char* name, const char* category, qint64 arg)
+{
+    if(!isEnabled())
+        return;
+
+    TraceEvent ev = { name, category, now(), -1, arg };
+    record(ev);
+}
+
+//----------------------------------------------
+void Tracer::setThreadName(const QString& name)
+{
+    ThreadBuffer* buffer = threadBuffer();
+
+    QMutexLocker locker(&buffer->mutex);
+    buffer->name = name;
+}
+
+//----------------------------------------------
+// Chrome trace (JSON object format); the events of each thread are already
+// in time order, so they are written as they are in the ring
+bool Tracer::dump(const QString& path, QString* error)
+{
+    QFile outfile(path);
+    if(!outfile.open(QIODevice::WriteOnly))
+    {
+        if(error)
+            *error = outfile.errorString();
+        return false;
+    }
+
+    QTextStream out(&outfile);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+    const qint64 pid = QCoreApplication::applicationPid();
+    bool bfirst = true;
+
+    QMutexLocker locker(&registrymutex);
+    for(int i=0; i<registry.size(); i++)
+    {
+        ThreadBuffer* buffer = registry[i];
+        QMutexLocker bufferlocker(&buffer->mutex);
+
+        if(buffer->written == 0)
+            continue;
+
+        if(!bfirst)
+            out << ",\n";
+        bfirst = false;
+
+        out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << buffer->tid
+            << ",\"args\":{\"name\":" << jsonString(buffer->name) << "}}";
+
+        const qint64 size = buffer->events.size();
+        const qint64 first = buffer->written > size ? buffer->written - size : 0;
+        for(qint64 n=first; n<buffer->written; n++)
+        {
+            const TraceEvent& ev = buffer->events[int(n % size)];
+
+            out << ",\n{\"name\":\"" << ev.name << "\",\"cat\":\"" << ev.category << "\""
+                << ",\"pid\":" << pid << ",\"tid\":" << buffer->tid << ",\"ts\":" << ev.ts;
+
+            if(ev.dur >= 0)
+                out << ",\"ph\":\"X\",\"dur\":" << ev.dur;
+            else
+                out << ",\"ph\":\"i\",\"s\":\"t\"";
+
+            if(ev.arg >= 0)
+                out << ",\"args\":{\"arg\":" << ev.arg << "}";
+
+            out << "}";
+        }
+    }
+
+    out << "\n]}\n";
+    out.flush();
+
+    if(outfile.error() != QFile::NoError)
+    {
+        if(error)
+            *error = outfile.errorString();
+        return false;
+    }
+
+    return true;
+}
+
+//----------------------------------------------
+QString Tracer::summary(const QString& path, QString* error)
+{
+    QFile infile(path);
+    if(!infile.open(QIODevice::ReadOnly))
+    {
+        if(error)
+            *error = infile.errorString();
+        return QString();
+    }
+
+    QJsonParseError parseerror;
+    QJsonDocument doc = QJsonDocument::fromJson(infile.readAll(), &parseerror);
+    if(doc.isNull())
+    {
+        if(error)
+            *error = parseerror.errorString();
+        return QString();
+    }
+
+    // both the object format and the bare array format are accepted
+    QJsonArray events = doc.isArray() ? doc.array() : doc.object().value("traceEvents").toArray();
+
+    struct Totals { qint64 count; double total; double max; };
+    QMap<QString, Totals> totals;
+    double tbegin = -1.0, tend = 0.0;
+
+    for(int i=0; i<events.size(); i++)
+    {
+        QJsonObject ev = events[i].toObject();
+        if(ev.value("ph").toString() != "X")
+            continue;
+
+        double ts = ev.value("ts").toDouble();
+        double dur = ev.value("dur").toDouble();
+        if(tbegin < 0.0 || ts < tbegin)
+            tbegin = ts;
+        if(ts + dur > tend)
+            tend = ts + dur;
+
+        QString key = ev.value("cat").toString() + "/" + ev.value("name").toString();
+        Totals& t = totals[key]; // value-initialized i.e. zeroed at first
+        t.count++;
+        t.total += dur;
+        if(dur > t.max)
+            t.max = dur;
+    }
+
+    if(totals.isEmpty())
+        return "The trace contains no spans.";
+
+    QString text = QString("Trace %1: %2 s wall time\n").arg(path).arg((tend - tbegin) / 1e6, 0, 'f', 3);
+    text += "span                      count     total ms       avg ms       max ms\n";
+    for(QMap<QString, Totals>::const_iterator it=totals.constBegin(); it!=totals.constEnd(); ++it)
+    {
+        text += QString("%1 %2 %3 %4 %5\n")
+                .arg(it.key(), -24)
+                .arg(it.value().count, 8)
+                .arg(it.value().total / 1000.0, 12, 'f', 1)
+                .arg(it.value().total / 1000.0 / it.value().count, 12, 'f', 3)
+                .arg(it.value().max / 1000.0, 12, 'f', 3);
+    }
+
+    return text;
+}
@@ -0,0 +1,91 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by Саша Миленковић                                 *
+ *   sasa.milenkovic.xyz@gmail.com                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *   ( http://www.gnu.org/licenses/gpl-3.0.en.html )                       *
+ *									   *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <QString>
+#include <QtGlobal>
+
+//----------------------------------------------
+// Opt-in timeline tracing. Every thread records complete spans into its
+// own fixed-size ring buffer (the oldest events are overwritten), so a
+// running capture costs a clock read and an uncontended lock per span and
+// a stopped one costs a single atomic load. The capture is dumped as
+// Chrome trace JSON, which chrome://tracing and ui.perfetto.dev open.
+//
+// Span names and categories must be string literals (only the pointers are
+// stored). The pipeline stages use the names below, one span per tile
+// (slicing the metatiles happens in the tilemaker, out of the capture).
+namespace TraceName
+{
+    const char* const Request = "request";
+    const char* const Decode  = "decode";
+    const char* const Encode  = "encode";
+    const char* const Write   = "write";
+}
+
+class Tracer
+{
+public:
+    static void start(int eventsperthread = 65536);
+    static void stop();
+    static bool isEnabled();
+
+    // microseconds since the capture has started
+    static qint64 now();
+
+    static void complete(const char* name, const char* category, qint64 startus, qint64 durus, qint64 arg = -1);
+    static void instant(const char* name, const char* category, qint64 arg = -1);
+
+    // names the calling thread in the dumped trace
+    static void setThreadName(const QString&);
+
+    static bool dump(const QString& path, QString* error = 0);
+
+    // per span name totals of a dumped trace file, as text
+    static QString summary(const QString& path, QString* error = 0);
+};
+
+//----------------------------------------------
+// RAII span; 'arg' is usually a tile key or a byte count
+class TraceSpan
+{
+public:
+    TraceSpan(const char* name, const char* category = "gui", qint64 arg = -1) :
+        spanname(name), spancategory(category), spanarg(arg),
+        startus(Tracer::isEnabled() ? Tracer::now() : -1) {}
+
+    ~TraceSpan()
+    {
+        if(startus >= 0)
+            Tracer::complete(spanname, spancategory, startus, Tracer::now() - startus, spanarg);
+    }
+
+    void setArg(qint64 arg) { spanarg = arg; }
+
+private:
+    const char* spanname;
+    const char* spancategory;
+    qint64 spanarg;
+    qint64 startus;
+};
+
+#endif // TRACER_H
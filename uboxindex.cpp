@@ -0,0 +1,658 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by Саша Миленковић                                 *
+ *   sasa.milenkovic.xyz@gmail.com                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *   ( http://www.gnu.org/licenses/gpl-3.0.en.html )                       *
+ *									   *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <QElapsedTimer>
+#include <QStringList>
+
+#include <algorithm>
+#include <cmath>
+
+#include "uboxindex.h"
+
+const int MAXCELLSPAN = 1024;   // a box spanning more cells than this is 'oversize'
+const int MAXFRAGMENTS = 64;    // a box cut into more pieces than this is kept whole
+const qint64 MAXLEVELBITS = qint64(1) << 26;    // 8 MB - a level with more tiles keeps ranges
+
+//----------------------------------------------
+UBoxIndex::UBoxIndex(const BBox& ext, double size) :
+    extent(ext),
+    cellsize(size)
+{
+    double w = extent.right - extent.left;
+    double h = extent.top - extent.bottom;
+
+    // not more than 2^20 x 2^20 (sparse) cells
+    if(cellsize < w / (1 << 20))
+        cellsize = w / (1 << 20);
+    if(cellsize < h / (1 << 20))
+        cellsize = h / (1 << 20);
+    if(cellsize <= 0.0)
+        cellsize = 1.0;
+
+    columns = int(std::ceil(w / cellsize)) + 1;
+    rows = int(std::ceil(h / cellsize)) + 1;
+}
+
+//----------------------------------------------
+bool UBoxIndex::cellRange(const BBox& b, int& c0, int& r0, int& c1, int& r1) const
+{
+    c0 = qBound(0, int(std::floor((b.left - extent.left) / cellsize)), columns - 1);
+    c1 = qBound(0, int(std::floor((b.right - extent.left) / cellsize)), columns - 1);
+    r0 = qBound(0, int(std::floor((b.bottom - extent.bottom) / cellsize)), rows - 1);
+    r1 = qBound(0, int(std::floor((b.top - extent.bottom) / cellsize)), rows - 1);
+
+    return qint64(c1 - c0 + 1) * (r1 - r0 + 1) <= MAXCELLSPAN;
+}
+
+//----------------------------------------------
+void UBoxIndex::insert(int id, const BBox& b)
+{
+    int c0, r0, c1, r1;
+    if(!cellRange(b, c0, r0, c1, r1))
+    {
+        oversize.append(id);
+        return;
+    }
+
+    for(int r=r0; r<=r1; r++)
+        for(int c=c0; c<=c1; c++)
+            cells[qint64(r) * columns + c].append(id);
+}
+
+//----------------------------------------------
+void UBoxIndex::query(const BBox& b, QVector<int>& ids) const
+{
+    ids = oversize;
+
+    int c0, r0, c1, r1;
+    cellRange(b, c0, r0, c1, r1);
+
+    // a big query box - walking the occupied cells is cheaper
+    if(qint64(c1 - c0 + 1) * (r1 - r0 + 1) > cells.size())
+    {
+        for(QHash<qint64, QVector<int> >::const_iterator it=cells.constBegin(); it!=cells.constEnd(); ++it)
+        {
+            int r = int(it.key() / columns);
+            int c = int(it.key() % columns);
+            if(r >= r0 && r <= r1 && c >= c0 && c <= c1)
+                ids += it.value();
+        }
+        return;
+    }
+
+    for(int r=r0; r<=r1; r++)
+    {
+        for(int c=c0; c<=c1; c++)
+        {
+            QHash<qint64, QVector<int> >::const_iterator it = cells.constFind(qint64(r) * columns + c);
+            if(it != cells.constEnd())
+                ids += it.value();
+        }
+    }
+}
+
+//==============================================
+// the optimizer
+
+//----------------------------------------------
+static bool sameResolutions(const UBox& a, const UBox& b)
+{
+    return a.hres == b.hres && a.lres == b.lres && a.fitres == b.fitres;
+}
+
+//----------------------------------------------
+static bool lessResolutions(const UBox& a, const UBox& b)
+{
+    if(a.hres != b.hres)
+        return a.hres < b.hres;
+    if(a.lres != b.lres)
+        return a.lres < b.lres;
+    return a.fitres < b.fitres;
+}
+
+//----------------------------------------------
+static bool contains(const BBox& a, const BBox& b)
+{
+    return a.left <= b.left && a.bottom <= b.bottom && a.right >= b.right && a.top >= b.top;
+}
+
+//----------------------------------------------
+static bool intersects(const TileRange& a, const TileRange& b)
+{
+    return a.c0 <= b.c1 && b.c0 <= a.c1 && a.r0 <= b.r1 && b.r0 <= a.r1;
+}
+
+//----------------------------------------------
+static bool equal(const TileRange& a, const TileRange& b)
+{
+    return a.c0 == b.c0 && a.c1 == b.c1 && a.r0 == b.r0 && a.r1 == b.r1;
+}
+
+//----------------------------------------------
+// the tiles of the next coarser level
+static TileRange parents(const TileRange& r)
+{
+    return TileRange(r.c0 >> 1, r.c1 >> 1, r.r0 >> 1, r.r1 >> 1);
+}
+
+//----------------------------------------------
+// a tile range as a box in tile units, for the index; the far edges stay
+// inside the last tile, so the range is not filed under the next cells
+static BBox tileExtent(const TileRange& r)
+{
+    return BBox(double(r.c0), double(r.r0), r.c1 + 0.5, r.r1 + 0.5);
+}
+
+//----------------------------------------------
+// r minus c, as up to four ranges: left and right full-height strips,
+// bottom and top strips in between
+static void subtract(const TileRange& r, const TileRange& c, QVector<TileRange>& pieces)
+{
+    if(!intersects(r, c))
+    {
+        pieces.append(r);
+        return;
+    }
+
+    qint64 c0 = qMax(r.c0, c.c0);
+    qint64 c1 = qMin(r.c1, c.c1);
+
+    if(r.c0 < c.c0)
+        pieces.append(TileRange(r.c0, c.c0 - 1, r.r0, r.r1));
+    if(c.c1 < r.c1)
+        pieces.append(TileRange(c.c1 + 1, r.c1, r.r0, r.r1));
+    if(r.r0 < c.r0)
+        pieces.append(TileRange(c0, c1, r.r0, c.r0 - 1));
+    if(c.r1 < r.r1)
+        pieces.append(TileRange(c0, c1, c.r1 + 1, r.r1));
+}
+
+//----------------------------------------------
+// The tiles which the placed pieces render at one level: a bit per tile
+// while the level is small enough (the coarse levels and jobs of a city),
+// otherwise the placed ranges in an index.
+struct LevelTiles
+{
+    LevelTiles() : columns(0), index(BBox(), 1.0) {}
+
+    qint64 columns;             // of the bitmap, 0 - the ranges
+    QVector<quint64> bits;      // row by row
+
+    UBoxIndex index;            // in tile units
+    QVector<TileRange> ranges;
+    QVector<int> seen;          // query stamp per range, the buckets return duplicates
+
+    bool isSet(qint64 c, qint64 r) const
+    {
+        qint64 i = r * columns + c;
+        return (bits[int(i >> 6)] >> (i & 63)) & 1;
+    }
+
+    void insert(const TileRange& t)
+    {
+        if(columns == 0)
+        {
+            index.insert(ranges.size(), tileExtent(t));
+            ranges.append(t);
+            seen.append(-1);
+            return;
+        }
+
+        for(qint64 r=t.r0; r<=t.r1; r++)
+        {
+            for(qint64 c=t.c0; c<=t.c1; c++)
+            {
+                qint64 i = r * columns + c;
+                bits[int(i >> 6)] |= quint64(1) << (i & 63);
+            }
+        }
+    }
+
+    // 'all' minus the placed ranges which the index returns; 'stamp' - once per query
+    void subtracted(const TileRange& all, int stamp, QVector<TileRange>& fragments,
+                    QVector<TileRange>& next, QVector<int>& candidates)
+    {
+        fragments.clear();
+        fragments.append(all);
+
+        index.query(tileExtent(all), candidates);
+        for(int ci=0; ci<candidates.size() && !fragments.isEmpty(); ci++)
+        {
+            int c = candidates[ci];
+            if(seen[c] == stamp)
+                continue;
+            seen[c] = stamp;
+
+            if(!intersects(ranges[c], all))
+                continue;
+
+            next.clear();
+            for(int f=0; f<fragments.size(); f++)
+                subtract(fragments[f], ranges[c], next);
+            fragments = next;
+
+            if(fragments.size() > MAXFRAGMENTS)
+                break;
+        }
+    }
+
+    // the tiles of 'all' not rendered yet: the runs of a row, stacked into
+    // one range while the next rows repeat them
+    void uncovered(const TileRange& all, QVector<TileRange>& fragments,
+                   QVector<TileRange>& open, QVector<TileRange>& row) const
+    {
+        fragments.clear();
+        open.clear();
+
+        for(qint64 r=all.r0; r<=all.r1; r++)
+        {
+            row.clear();
+            int o = 0;
+            qint64 c = all.c0;
+            for(;;)
+            {
+                while(c <= all.c1 && isSet(c, r))
+                    c++;
+                if(c > all.c1)
+                    break;
+
+                qint64 c0 = c;
+                while(c <= all.c1 && !isSet(c, r))
+                    c++;
+
+                // the open ranges are in column order, as the runs are
+                while(o < open.size() && open[o].c0 < c0)
+                    fragments.append(open[o++]);
+
+                if(o < open.size() && open[o].c0 == c0 && open[o].c1 == c - 1)
+                {
+                    row.append(open[o++]);
+                    row.last().r1 = r;
+                }
+                else
+                    row.append(TileRange(c0, c - 1, r, r));
+            }
+
+            while(o < open.size())
+                fragments.append(open[o++]);
+            open.swap(row);
+        }
+
+        fragments += open;
+    }
+};
+
+//----------------------------------------------
+struct Piece
+{
+    UBox ubox;
+    double inset;   // the box is shrunk by it at the end (0 - a box as given)
+    int origin;     // the smallest input position it comes from - keeps the given order
+};
+
+//----------------------------------------------
+// the tiles r of the level ka and their parents up to kb: the box a quarter
+// of a tile inside the tile edges (the rounding of the --file list cannot
+// reach the neighbours then) and resolutions between the levels
+static Piece levelPiece(const TileGrid& grid, int ka, int kb, const TileRange& r, int origin)
+{
+    Piece p;
+    p.ubox.box = grid.rangeBox(ka, r);
+    p.ubox.hres = ka == 0 ? grid.highResolution() : grid.resolution(ka) * 0.75;
+    p.ubox.lres = kb == grid.levels() - 1 ? grid.lowResolution() : grid.resolution(kb) * 1.5;
+    p.inset = grid.span(ka) / 4;
+    p.origin = origin;
+
+    return p;
+}
+
+//----------------------------------------------
+// A cut box as regions. A run of levels which lost nothing is one region;
+// a piece of a cut level goes on to the coarser levels while its parents
+// are a piece there as well.
+static void levelPieces(const TileGrid& grid, const UBox& ubox, int kmin, int kmax,
+                        const QVector<QVector<TileRange> >& remainders, const QVector<bool>& cut,
+                        int origin, QVector<Piece>& pieces)
+{
+    struct Run
+    {
+        int ka, kb;
+        TileRange first, last;
+    };
+
+    QVector<Run> runs;
+    int whole = -1;     // the run of the uncut levels which is open
+
+    for(int k=kmin; k<=kmax; k++)
+    {
+        if(!cut[k])
+        {
+            TileRange all = grid.range(ubox, k);
+            if(all.isEmpty())
+                continue;
+
+            if(whole >= 0 && runs[whole].kb == k - 1)
+            {
+                runs[whole].kb = k;
+                continue;
+            }
+
+            Run run;
+            run.ka = run.kb = k;
+            run.first = run.last = all;
+            whole = runs.size();
+            runs.append(run);
+            continue;
+        }
+
+        const QVector<TileRange>& fragments = remainders[k];
+        for(int f=0; f<fragments.size(); f++)
+        {
+            bool bextended = false;
+            for(int r=0; r<runs.size() && !bextended; r++)
+            {
+                if(r == whole || runs[r].kb != k - 1 || !equal(parents(runs[r].last), fragments[f]))
+                    continue;
+
+                runs[r].kb = k;
+                runs[r].last = fragments[f];
+                bextended = true;
+            }
+
+            if(bextended)
+                continue;
+
+            Run run;
+            run.ka = run.kb = k;
+            run.first = run.last = fragments[f];
+            runs.append(run);
+        }
+    }
+
+    for(int r=0; r<runs.size(); r++)
+        pieces.append(levelPiece(grid, runs[r].ka, runs[r].kb, runs[r].first, origin));
+}
+
+static bool lessRows(const Piece& a, const Piece& b)
+{
+    if(!sameResolutions(a.ubox, b.ubox))
+        return lessResolutions(a.ubox, b.ubox);
+    if(a.ubox.box.bottom != b.ubox.box.bottom)
+        return a.ubox.box.bottom < b.ubox.box.bottom;
+    if(a.ubox.box.top != b.ubox.box.top)
+        return a.ubox.box.top < b.ubox.box.top;
+    return a.ubox.box.left < b.ubox.box.left;
+}
+
+static bool lessColumns(const Piece& a, const Piece& b)
+{
+    if(!sameResolutions(a.ubox, b.ubox))
+        return lessResolutions(a.ubox, b.ubox);
+    if(a.ubox.box.left != b.ubox.box.left)
+        return a.ubox.box.left < b.ubox.box.left;
+    if(a.ubox.box.right != b.ubox.box.right)
+        return a.ubox.box.right < b.ubox.box.right;
+    return a.ubox.box.bottom < b.ubox.box.bottom;
+}
+
+static bool lessOrigin(const Piece& a, const Piece& b)
+{
+    return a.origin < b.origin;
+}
+
+//----------------------------------------------
+// joins the neighbours which share a whole edge: rows==true - along x
+static int mergeAdjacent(QVector<Piece>& pieces, bool rows)
+{
+    std::sort(pieces.begin(), pieces.end(), rows ? lessRows : lessColumns);
+
+    int merged = 0;
+    int out = 0;
+    for(int i=0; i<pieces.size(); i++)
+    {
+        if(out > 0)
+        {
+            Piece& last = pieces[out-1];
+            const Piece& p = pieces[i];
+
+            bool badjacent = rows ? (last.ubox.box.bottom == p.ubox.box.bottom && last.ubox.box.top == p.ubox.box.top &&
+                                     last.ubox.box.right == p.ubox.box.left)
+                                  : (last.ubox.box.left == p.ubox.box.left && last.ubox.box.right == p.ubox.box.right &&
+                                     last.ubox.box.top == p.ubox.box.bottom);
+
+            if(badjacent && sameResolutions(last.ubox, p.ubox) && last.inset == p.inset)
+            {
+                if(rows)
+                    last.ubox.box.right = p.ubox.box.right;
+                else
+                    last.ubox.box.top = p.ubox.box.top;
+                last.origin = qMin(last.origin, p.origin);
+                merged++;
+                continue;
+            }
+        }
+
+        pieces[out++] = pieces[i];
+    }
+
+    pieces.resize(out);
+    return merged;
+}
+
+//----------------------------------------------
+UBoxStats UBoxOptimizer::optimize(QList<UBox>& uboxes, const TileGrid& grid)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    UBoxStats stats;
+    stats.input = uboxes.size();
+    stats.tilesbefore = grid.countTiles(uboxes);
+
+    const int n = uboxes.size();
+    if(n < 2)
+    {
+        stats.output = n;
+        stats.tilesafter = stats.tilesbefore;
+        stats.msecs = timer.elapsed();
+        return stats;
+    }
+
+    QVector<UBox> boxes = uboxes.toVector();
+    QVector<int> kmin(n), kmax(n);
+    QVector<double> sizes(n);
+    QVector<int> order(n);
+    for(int i=0; i<n; i++)
+    {
+        grid.levelRange(boxes[i], kmin[i], kmax[i]);
+        sizes[i] = qMax(boxes[i].box.right - boxes[i].box.left, boxes[i].box.top - boxes[i].box.bottom);
+        order[i] = i;
+    }
+
+    // the biggest boxes first - they are the ones which may contain the others
+    struct ByArea
+    {
+        const QVector<UBox>& b;
+        ByArea(const QVector<UBox>& boxes) : b(boxes) {}
+        double area(int i) const { return (b[i].box.right - b[i].box.left) * (b[i].box.top - b[i].box.bottom); }
+        bool operator()(int i, int j) const { return area(i) > area(j) || (area(i) == area(j) && i < j); }
+    };
+    std::sort(order.begin(), order.end(), ByArea(boxes));
+
+    // the typical box spans about one cell
+    QVector<double> sorted = sizes;
+    std::nth_element(sorted.begin(), sorted.begin() + n/2, sorted.end());
+    double cellsize = sorted[n/2];
+
+    //------ 1. nested boxes ------------
+    UBoxIndex accepted(grid.extent(), cellsize);
+    QVector<bool> alive(n, false);
+    QVector<int> candidates;
+
+    for(int oi=0; oi<n; oi++)
+    {
+        int i = order[oi];
+
+        bool bnested = false;
+        accepted.query(boxes[i].box, candidates);
+        for(int ci=0; ci<candidates.size() && !bnested; ci++)
+        {
+            int c = candidates[ci];
+            bnested = contains(boxes[c].box, boxes[i].box) &&
+                      kmin[c] <= kmin[i] && kmax[c] >= kmax[i] &&
+                      boxes[c].fitres == boxes[i].fitres;
+        }
+
+        if(bnested)
+        {
+            stats.nested++;
+            continue;
+        }
+
+        alive[i] = true;
+        accepted.insert(i, boxes[i].box);
+    }
+
+    //------ 2. the tiles which are rendered already are cut away, level by level ------------
+    QVector<LevelTiles> placed(grid.levels());
+    for(int k=0; k<grid.levels(); k++)
+    {
+        TileRange level = grid.levelTiles(k);
+        if(level.count() <= MAXLEVELBITS)
+        {
+            placed[k].columns = level.columns();
+            placed[k].bits.fill(0, int((level.count() + 63) / 64));
+        }
+        else
+            placed[k].index = UBoxIndex(tileExtent(level), qMax(1.0, cellsize / grid.span(k)));
+    }
+
+    QVector<Piece> pieces;
+    QVector<QVector<TileRange> > remainders(grid.levels());
+    QVector<bool> cut(grid.levels());
+    QVector<TileRange> fragments, next, open;
+
+    for(int oi=0; oi<n; oi++)
+    {
+        int i = order[oi];
+        if(!alive[i])
+            continue;
+
+        bool bcut = false, bfragmented = false, bempty = true;
+        for(int k=kmin[i]; k<=kmax[i]; k++)
+        {
+            TileRange all = grid.range(boxes[i], k);
+            remainders[k].clear();
+            cut[k] = false;
+            if(all.isEmpty())
+                continue;
+
+            LevelTiles& level = placed[k];
+            if(level.columns > 0)
+                level.uncovered(all, fragments, open, next);
+            else
+                level.subtracted(all, oi, fragments, next, candidates);
+
+            if(fragments.size() > MAXFRAGMENTS)
+            {
+                fragments.clear();
+                fragments.append(all);
+                bfragmented = true;
+            }
+
+            cut[k] = fragments.size() != 1 || !equal(fragments[0], all);
+            bcut = bcut || cut[k];
+            bempty = bempty && fragments.isEmpty();
+            remainders[k] = fragments;
+        }
+
+        for(int k=kmin[i]; k<=kmax[i]; k++)
+            for(int f=0; f<remainders[k].size(); f++)
+                placed[k].insert(remainders[k][f]);
+
+        if(bfragmented)
+            stats.fragmented++;
+
+        if(bempty)
+        {
+            stats.nested++;
+            continue;
+        }
+
+        if(!bcut)
+        {
+            Piece p;
+            p.ubox = boxes[i];
+            p.inset = 0.0;
+            p.origin = i;
+            pieces.append(p);
+            continue;
+        }
+
+        stats.clipped++;
+        levelPieces(grid, boxes[i], kmin[i], kmax[i], remainders, cut, i, pieces);
+    }
+
+    //------ 3. neighbours with the same resolutions are joined ------------
+    stats.merged += mergeAdjacent(pieces, true);
+    stats.merged += mergeAdjacent(pieces, false);
+
+    std::stable_sort(pieces.begin(), pieces.end(), lessOrigin);
+
+    uboxes.clear();
+    for(int i=0; i<pieces.size(); i++)
+    {
+        UBox ubox = pieces[i].ubox;
+        ubox.box.left += pieces[i].inset;
+        ubox.box.bottom += pieces[i].inset;
+        ubox.box.right -= pieces[i].inset;
+        ubox.box.top -= pieces[i].inset;
+        uboxes.append(ubox);
+    }
+
+    stats.output = uboxes.size();
+    stats.tilesafter = grid.countTiles(uboxes);
+    stats.msecs = timer.elapsed();
+
+    return stats;
+}
+
+//----------------------------------------------
+QString UBoxOptimizer::report(const UBoxStats& stats)
+{
+    QStringList parts;
+    parts << QString("Update regions: %1 given, %2 used").arg(stats.input).arg(stats.output);
+
+    if(stats.nested)
+        parts << QString("%1 nested dropped").arg(stats.nested);
+    if(stats.clipped)
+        parts << QString("%1 clipped").arg(stats.clipped);
+    if(stats.merged)
+        parts << QString("%1 merged").arg(stats.merged);
+    if(stats.fragmented)
+        parts << QString("%1 too fragmented to cut at some levels").arg(stats.fragmented);
+
+    QString text = parts.join(", ") + ".";
+    text += QString("\nTile renders: %1 -> %2 (%3 duplicates avoided) in %4 ms.")
+            .arg(stats.tilesbefore).arg(stats.tilesafter)
+            .arg(stats.tilesbefore - stats.tilesafter).arg(stats.msecs);
+
+    return text;
+}
@@ -0,0 +1,78 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by Саша Миленковић                                 *
+ *   sasa.milenkovic.xyz@gmail.com                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *   ( http://www.gnu.org/licenses/gpl-3.0.en.html )                       *
+ *									   *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef UBOXINDEX_H
+#define UBOXINDEX_H
+
+#include <QVector>
+#include <QHash>
+
+#include "tilegrid.h"
+
+//----------------------------------------------
+// Uniform grid (bucket) index of rectangles; boxes which would span too
+// many cells are kept aside and checked on every query.
+class UBoxIndex
+{
+public:
+    UBoxIndex(const BBox& extent, double cellsize);
+
+    void insert(int id, const BBox&);
+
+    // ids of the boxes whose bucket the given box touches (candidates only)
+    void query(const BBox&, QVector<int>& ids) const;
+
+private:
+    BBox extent;
+    double cellsize;
+    int columns, rows;
+    QHash<qint64, QVector<int> > cells;
+    QVector<int> oversize;
+
+    bool cellRange(const BBox&, int& c0, int& r0, int& c1, int& r1) const;
+};
+
+//----------------------------------------------
+struct UBoxStats
+{
+    UBoxStats() : input(0), nested(0), clipped(0), merged(0), output(0),
+                  tilesbefore(0), tilesafter(0), fragmented(0), msecs(0) {}
+
+    int input;
+    int nested;         // dropped, every tile of it is rendered by the other boxes
+    int clipped;        // cut, per level, to the tiles the other boxes do not render
+    int merged;         // adjacent boxes with the same resolutions, joined into one
+    int output;
+    qint64 tilesbefore; // tile renders as the boxes have been given
+    qint64 tilesafter;  // the boxes render disjoint tiles now, so these are distinct
+    int fragmented;     // kept whole at a level where cutting would give too many pieces
+    qint64 msecs;
+};
+
+namespace UBoxOptimizer
+{
+    // dedupes, clips and merges the update regions in place; the overlaps
+    // are cut on the tile edges of every level, so no tile is rendered twice
+    UBoxStats optimize(QList<UBox>& uboxes, const TileGrid& grid);
+
+    QString report(const UBoxStats&);
+}
+
+#endif // UBOXINDEX_H